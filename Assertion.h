@@ -65,7 +65,7 @@ public:
 		}
 		return false;
 	}
-	void reg( AssertionHandler& h );
+	void reg( AssertionHandler& h ) { mHandlers.push_back( &h ); }
 	static AssertBase& instance() { static AssertBase b; return b; }
 };
 
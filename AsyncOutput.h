@@ -0,0 +1,313 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_ASYNC_OUTPUT
+#define SPEW_ASYNC_OUTPUT
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// what a producer does when the async ring is full
+enum OverflowPolicy
+{
+   OVERFLOW_BLOCK,      //< wait for the writer thread to make room (nothing is lost)
+   OVERFLOW_DROP,       //< throw the new message away
+   OVERFLOW_DROP_COUNT, //< throw the new message away, writer reports how many were lost
+};
+
+
+/// bounded lock-free multi-producer/single-consumer ring of finished messages.
+/// each slot has a sequence number that says whose turn it is (producer or consumer),
+/// producers claim a slot with one CAS, the consumer needs no atomic RMW at all.
+/// slot strings keep their capacity, so after warm up pushes don't allocate.
+class MpscRing
+{
+public:
+   /// capacity is rounded up to a power of 2
+   MpscRing( size_t capacity ) : mEnqueuePos( 0 ), mDequeuePos( 0 )
+   {
+      size_t size = 2;
+      while (size < capacity)
+         size <<= 1;
+      mMask = size - 1;
+      mSlots = std::vector<Slot>( size );
+      for (size_t x = 0; x < size; ++x)
+      {
+         mSlots[x].mSequence.store( x, std::memory_order_relaxed );
+         mSlots[x].mText.reserve( 256 );
+      }
+   }
+
+   /// producer side, any thread.  false if the ring is full.
+   /// filter and level ride along for the consumer (flush policies)
+   bool push( const char* text, size_t length, unsigned int filter, unsigned int level )
+   {
+      size_t pos = mEnqueuePos.load( std::memory_order_relaxed );
+      Slot* slot;
+      for (;;)
+      {
+         slot = &mSlots[pos & mMask];
+         size_t seq = slot->mSequence.load( std::memory_order_acquire );
+         intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+         if (diff == 0)
+         {
+            if (mEnqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ))
+               break;
+         }
+         else if (diff < 0)
+            return false; // full
+         else
+            pos = mEnqueuePos.load( std::memory_order_relaxed );
+      }
+      slot->mText.assign( text, length );
+      slot->mFilter = filter;
+      slot->mLevel = level;
+      slot->mSequence.store( pos + 1, std::memory_order_release );
+      return true;
+   }
+
+   /// consumer side, writer thread only.  calls out.write( data, length, filter, level ) for the next
+   /// message and returns true, or returns false if the ring is empty.
+   template <typename Output>
+   bool pop( Output& out )
+   {
+      Slot& slot = mSlots[mDequeuePos & mMask];
+      size_t seq = slot.mSequence.load( std::memory_order_acquire );
+      if ((intptr_t)seq - (intptr_t)(mDequeuePos + 1) < 0)
+         return false; // empty (or the producer hasn't finished its copy yet)
+      out.write( slot.mText.data(), slot.mText.size(), slot.mFilter, slot.mLevel );
+      slot.mSequence.store( mDequeuePos + mMask + 1, std::memory_order_release );
+      ++mDequeuePos;
+      return true;
+   }
+
+   inline bool empty() const
+   {
+      const Slot& slot = mSlots[mDequeuePos & mMask];
+      return (intptr_t)slot.mSequence.load( std::memory_order_acquire ) - (intptr_t)(mDequeuePos + 1) < 0;
+   }
+
+private:
+   struct Slot
+   {
+      Slot() : mSequence( 0 ) {}
+      Slot( const Slot& ) : mSequence( 0 ) {} //< for vector, only used before the ring is live
+      std::atomic<size_t> mSequence;
+      std::string mText;
+      unsigned int mFilter, mLevel;
+   };
+   std::vector<Slot> mSlots;
+   size_t mMask;
+   alignas(64) std::atomic<size_t> mEnqueuePos;
+   alignas(64) size_t mDequeuePos;
+};
+
+
+/// background writer: producers push finished text into an MpscRing,
+/// a thread drains it to the Output policy.
+/// Output needs:
+///    void write( const char* data, size_t length, unsigned int filter, unsigned int level ) //< a queued message
+///    void printf( const char* text )                //< the writer's own notices (same idea as OstreamTemplate)
+///    void flush()                                   //< end of a batch
+template <typename Output>
+class AsyncWriter
+{
+public:
+   AsyncWriter( Output out, size_t capacity, OverflowPolicy policy ) :
+      mOut( out ), mRing( capacity ), mPolicy( policy ), mDropped( 0 ), mReported( 0 ),
+      mSleeping( false ), mStop( false ), mPushers( 0 ), mDeadline( 0 )
+   {
+      mThread = std::thread( &AsyncWriter::run, this );
+   }
+
+   ~AsyncWriter() { stop( 1000 ); }
+
+   /// producer side, any thread.  false if the message was dropped.
+   /// a writer that's been stopped drops (and counts) everything, there's no thread
+   /// left to make room, so blocking would never end.
+   /// counted in mPushers while it runs: stop waits for it, so what it pushed gets written.
+   inline bool push( const char* text, size_t length, unsigned int filter, unsigned int level )
+   {
+      mPushers.fetch_add( 1 );
+      bool pushed = enqueue( text, length, filter, level );
+      mPushers.fetch_sub( 1, std::memory_order_release );
+      return pushed;
+   }
+
+   /// number of messages lost to a full ring (OVERFLOW_DROP_COUNT), or pushed after stop
+   inline size_t dropped() const { return mDropped.load( std::memory_order_relaxed ); }
+
+   /// ask the writer to drain and exit, waits at most 'milliseconds' for the drain.
+   /// returns true if everything pushed so far was written.
+   bool stop( unsigned int milliseconds )
+   {
+      if (!mThread.joinable())
+         return mRing.empty();
+      mDeadline = (std::chrono::steady_clock::now() + std::chrono::milliseconds( milliseconds )).time_since_epoch().count();
+      // pushes from here on drop.  the ones under way finish first (their slots are filled
+      // in by the time mPushers is 0), the thread may have seen an empty ring before they
+      // did, so whatever it left behind is written here.
+      mStop.store( true );
+      while (0 != mPushers.load())
+         std::this_thread::yield();
+      wake();
+      mThread.join();
+      while (!mRing.empty() && drain( true ))
+         ;
+      return mRing.empty();
+   }
+
+private:
+   /// push, or drop as the policy says (see push)
+   bool enqueue( const char* text, size_t length, unsigned int filter, unsigned int level )
+   {
+      bool pushed = !mStop.load() && mRing.push( text, length, filter, level );
+      while (!pushed)
+      {
+         if (mStop.load())
+         {
+            mDropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+         }
+         if (OVERFLOW_BLOCK != mPolicy)
+         {
+            if (OVERFLOW_DROP_COUNT == mPolicy)
+               mDropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+         }
+         wake();
+         std::this_thread::yield();
+         pushed = mRing.push( text, length, filter, level );
+      }
+      // only touch the mutex when the writer has gone to sleep (not under load)
+      if (mSleeping.load( std::memory_order_seq_cst ))
+         wake();
+      return true;
+   }
+
+   inline void wake()
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      mWake.notify_one();
+   }
+
+   void run()
+   {
+      for (;;)
+      {
+         bool stopping = mStop.load();
+         if (drain( stopping ))
+            continue;
+         if (stopping)
+            break;
+
+         // nothing to do.  poll a little while first: waking a sleeping writer
+         // costs the producer a syscall, so avoid going to sleep between bursts.
+         if (idle())
+            continue;
+
+         // sleep.  publish mSleeping first, then re-check the ring,
+         // so a producer either sees us sleeping (and wakes us) or we see its message.
+         std::unique_lock<std::mutex> lock( mMutex );
+         mSleeping.store( true, std::memory_order_seq_cst );
+         if (mRing.empty() && !mStop.load())
+            mWake.wait_for( lock, std::chrono::milliseconds( 50 ) );
+         mSleeping.store( false, std::memory_order_relaxed );
+      }
+   }
+
+   /// yield for up to ~1ms waiting for work, true if some arrived
+   bool idle()
+   {
+      std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds( 1 );
+      while (mRing.empty() && !mStop.load( std::memory_order_relaxed ))
+      {
+         if (std::chrono::steady_clock::now() > until)
+            return false;
+         std::this_thread::yield();
+      }
+      return true;
+   }
+
+   /// write out everything queued, then flush once for the whole batch.
+   /// returns false if there was nothing to write (or the stop deadline passed)
+   bool drain( bool stopping )
+   {
+      size_t count = 0;
+      while (mRing.pop( mOut ))
+      {
+         // bound the time spent draining at shutdown
+         ++count;
+         if (stopping && 0 == (count & 63) &&
+             std::chrono::steady_clock::now().time_since_epoch().count() > mDeadline)
+            break;
+      }
+
+      size_t dropped = mDropped.load( std::memory_order_relaxed );
+      if (dropped != mReported)
+      {
+         char buf[64];
+         snprintf( buf, sizeof( buf ), "spew: async queue full, dropped %lu messages\n", (unsigned long)(dropped - mReported) );
+         mOut.printf( buf );
+         mReported = dropped;
+         ++count;
+      }
+
+      if (0 == count)
+         return false;
+      mOut.flush();
+      if (stopping && std::chrono::steady_clock::now().time_since_epoch().count() > mDeadline)
+         return false;
+      return true;
+   }
+
+   Output mOut;
+   MpscRing mRing;
+   OverflowPolicy mPolicy;
+   std::atomic<size_t> mDropped;
+   size_t mReported;
+   std::atomic<bool> mSleeping, mStop;
+   alignas(64) std::atomic<unsigned int> mPushers; //< producers in push() right now
+   long long mDeadline;
+   std::mutex mMutex;
+   std::condition_variable mWake;
+   std::thread mThread;
+};
+
+
+} // spew namespace
+
+#endif
@@ -0,0 +1,149 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_BACKTRACE
+#define SPEW_BACKTRACE
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// one thread's held back messages for one output (OutputBase::SetBacktrace):
+/// the last N, oldest written over first.  only its thread touches it.
+/// the slots keep their strings' capacity, once warm holding a message is a copy.
+class BacktraceRing
+{
+public:
+   BacktraceRing() : mNext( 0 ), mCount( 0 ), mGeneration( 0 ) {}
+
+   /// hold a message.  a different capacity or generation (the settings changed) starts over.
+   inline void push( const char* data, size_t length, unsigned int filter, unsigned int level, size_t capacity, unsigned int generation )
+   {
+      if (capacity != mSlots.size() || generation != mGeneration)
+      {
+         mSlots.resize( capacity );
+         mGeneration = generation;
+         clear();
+      }
+      if (0 == capacity)
+         return;
+      Slot& slot = mSlots[mNext];
+      slot.mText.assign( data, length );
+      slot.mFilter = filter;
+      slot.mLevel = level;
+      mNext = mNext + 1 == capacity ? 0 : mNext + 1;
+      if (mCount < capacity)
+         ++mCount;
+   }
+
+   /// hand every held message to 'out( data, length, filter, level )', oldest first, and forget them.
+   /// (messages of an older generation are forgotten without being handed out)
+   template <typename Out>
+   inline void drain( unsigned int generation, Out out )
+   {
+      if (generation != mGeneration)
+         return clear();
+      size_t at = mNext + mSlots.size() - mCount;
+      for (size_t x = 0; x < mCount; ++x, ++at)
+      {
+         const Slot& slot = mSlots[at % mSlots.size()];
+         out( slot.mText.data(), slot.mText.size(), slot.mFilter, slot.mLevel );
+      }
+      clear();
+   }
+
+   inline size_t size() const { return mCount; }
+   inline void clear() { mNext = 0; mCount = 0; }
+
+private:
+   struct Slot
+   {
+      std::string mText;
+      unsigned int mFilter, mLevel;
+   };
+   std::vector<Slot> mSlots;
+   size_t mNext, mCount;
+   unsigned int mGeneration;
+};
+
+/// this thread's ring for the output in 'slot' (see nextOutputSlot), made on first use.
+/// the thread owns them, they go when it exits.
+inline BacktraceRing& threadBacktrace( unsigned int slot )
+{
+   static thread_local std::vector<std::unique_ptr<BacktraceRing> > rings;
+   if (rings.size() <= slot)
+      rings.resize( slot + 1 );
+   if (!rings[slot])
+      rings[slot].reset( new BacktraceRing );
+   return *rings[slot];
+}
+
+
+/// holds, wraps, and drains in order
+struct BacktraceUnitTest
+{
+   static void test()
+   {
+      printf( "running backtrace tests... [" );
+      BacktraceRing ring;
+      std::string got;
+      auto collect = [&got]( const char* data, size_t length, unsigned int filter, unsigned int level )
+      {
+         got.append( data, length );
+         got += (char)('0' + level);
+      };
+      ring.push( "a", 1, 0, 1, 3, 0 );
+      ring.push( "b", 1, 0, 2, 3, 0 );
+      ring.drain( 0, collect );
+      printf( "%s", "a1b2" == got && 0 == ring.size() ? "." : "F" );
+
+      got.clear();
+      const char* letters = "cdefg";
+      for (int x = 0; x < 5; ++x)
+         ring.push( letters + x, 1, 0, 4, 3, 0 );
+      ring.drain( 0, collect );
+      printf( "%s", "e4f4g4" == got ? "." : "F" );
+
+      // new settings: what was held under the old ones is dropped
+      got.clear();
+      ring.push( "h", 1, 0, 5, 3, 0 );
+      ring.drain( 1, collect );
+      ring.push( "i", 1, 0, 5, 2, 1 );
+      ring.drain( 1, collect );
+      printf( "%s", "i5" == got && &threadBacktrace( 7 ) == &threadBacktrace( 7 ) ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
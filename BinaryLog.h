@@ -0,0 +1,723 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_BINARY_LOG
+#define SPEW_BINARY_LOG
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <locale.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "FormatBuffer.h"
+#include "Utf8.h" //< appendUtf8
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// binary (deferred formatting) log format.
+/// instead of running vsprintf, a printf style call records the id of its format
+/// string plus the raw bytes of its arguments.  spew-decode does the formatting later.
+///
+/// stream layout (v = unsigned LEB128 varint, native byte order otherwise):
+///    "SPEWBIN1"                                     file header
+///    'F' v:id, v:length, format string              format definition, before its first use
+///    'M' u8:flags, [v:filter], v:id, args           printf style message
+///    'T' u8:flags, [v:filter], v:length, text       already formatted text (ostream style)
+///    'K' u8:flags, [v:filter], fields                key/value record (see Structured.h)
+/// flags is the level number (1-5) in the low bits, plus 0x80 when a filter other than
+/// FILTERALL follows.  args are in format string order, their types come from the format:
+///    integers (and '*' widths) zigzag varint, double 8 bytes, long double sizeof( long double ),
+///    pointers varint, strings v:(length + 1) then chars (0 means NULL), %n nothing.
+const char gBinaryHeader[] = "SPEWBIN1";
+
+
+/// one printf conversion, e.g. "%-08.3lld"
+struct FormatSpec
+{
+   const char* mBegin;   //< the '%'
+   size_t mLength;       //< through the conversion char
+   char mLengthMod[3];   //< "", "h", "hh", "l", "ll", "L", "j", "z", "t", "q"
+   char mConversion;     //< 'd', 's', 'f', ... or '%'
+   int mStars;           //< number of '*' (width/precision taken from args)
+};
+
+/// the precision of 'spec', -1 if it has none ('stars' are the '*' values, a negative one is none)
+inline int formatPrecision( const FormatSpec& spec, const int* stars )
+{
+   const char* dot = (const char*)memchr( spec.mBegin, '.', spec.mLength );
+   if (NULL == dot)
+      return -1;
+   if ('*' == dot[1])
+      return 0 < spec.mStars ? stars[spec.mStars - 1] : -1;
+   return atoi( dot + 1 );
+}
+
+/// find the next conversion at or after p.  returns false when there are no more.
+inline bool nextFormatSpec( const char*& p, FormatSpec& spec )
+{
+   while ('\0' != *p && '%' != *p)
+      ++p;
+   if ('\0' == *p)
+      return false;
+   spec.mBegin = p++;
+   spec.mStars = 0;
+   while (NULL != strchr( "-+ #0'I", *p ) && '\0' != *p) // flags
+      ++p;
+   for (int part = 0; part < 2; ++part) // width, then precision
+   {
+      if (1 == part)
+      {
+         if ('.' != *p)
+            break;
+         ++p;
+      }
+      if ('*' == *p)
+      {
+         ++spec.mStars;
+         ++p;
+      }
+      while ('0' <= *p && *p <= '9')
+         ++p;
+   }
+   size_t mod = 0;
+   while (NULL != strchr( "hlLjztq", *p ) && '\0' != *p && mod < 2)
+      spec.mLengthMod[mod++] = *p++;
+   spec.mLengthMod[mod] = '\0';
+   spec.mConversion = *p;
+   if ('\0' != *p)
+      ++p;
+   spec.mLength = p - spec.mBegin;
+   return true;
+}
+
+/// how to pull a conversion's argument off a va_list:
+/// 'i' int, 'l' long, 'q' long long, 'j' intmax_t, 'z' size_t, 't' ptrdiff_t,
+/// 'd' double, 'L' long double, 'p' void*, 's' char*, 'w' wchar_t*, 'x' %n, 0 for %%
+inline char binaryArgFetch( const FormatSpec& spec )
+{
+   const char* mod = spec.mLengthMod;
+   switch (spec.mConversion)
+   {
+   case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+      if (('l' == mod[0] && 'l' == mod[1]) || 'L' == mod[0] || 'q' == mod[0]) return 'q';
+      if ('l' == mod[0]) return 'l';
+      if ('j' == mod[0]) return 'j';
+      if ('z' == mod[0]) return 'z';
+      if ('t' == mod[0]) return 't';
+      return 'i'; // int, and short/char which promote to int
+   case 'c': case 'C':
+      return 'i'; // int or wint_t
+   case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      return ('L' == mod[0]) ? 'L' : 'd';
+   case 's':
+      return ('l' == mod[0]) ? 'w' : 's';
+   case 'S':
+      return 'w';
+   case 'p':
+      return 'p';
+   case 'n':
+      return 'x';
+   }
+   return 0;
+}
+
+/// every argument a format string consumes, in order (see binaryArgFetch)
+inline std::string binaryArgFetches( const char* fmtstr )
+{
+   std::string fetches;
+   FormatSpec spec;
+   while (nextFormatSpec( fmtstr, spec ))
+   {
+      char fetch = binaryArgFetch( spec );
+      if (0 == fetch)
+         continue;
+      fetches.append( spec.mStars, 'i' );
+      fetches += fetch;
+   }
+   return fetches;
+}
+
+
+/// a format string interned by the FormatTable
+struct BinaryFormat
+{
+   uint32_t mId;
+   std::string mFormat;
+   std::string mFetches; //< see binaryArgFetches
+};
+
+/// process wide table of interned format strings, keyed by the string's address
+/// (so each call site is interned once).  lookups from the hot path go through
+/// a small per thread cache and don't take the lock.
+class FormatTable
+{
+public:
+   static FormatTable& instance() { static FormatTable table; return table; }
+
+   /// a string literal (the type checked calls): its address alone says which
+   /// format it is, a cache hit is one compare
+   inline const BinaryFormat& intern( const char* fmtstr )
+   {
+      CacheEntry& entry = cacheEntry( fmtstr );
+      if (entry.mKey != fmtstr)
+         fill( entry, fmtstr );
+      return *entry.mFormat;
+   }
+   /// a format string that may not be a literal (va_list calls): the text is compared
+   /// too, so a reused char buffer still comes out right
+   inline const BinaryFormat& internText( const char* fmtstr )
+   {
+      CacheEntry& entry = cacheEntry( fmtstr );
+      if (entry.mKey != fmtstr || 0 != strcmp( entry.mFormat->mFormat.c_str(), fmtstr ))
+         fill( entry, fmtstr );
+      return *entry.mFormat;
+   }
+
+   /// NULL if the id is unknown
+   const BinaryFormat* find( uint32_t id )
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      return id < mById.size() ? mById[id] : NULL;
+   }
+
+private:
+   struct CacheEntry { const char* mKey; const BinaryFormat* mFormat; };
+   static inline CacheEntry& cacheEntry( const char* fmtstr )
+   {
+      static thread_local CacheEntry cache[64];
+      return cache[((uintptr_t)fmtstr >> 3) & 63];
+   }
+   void fill( CacheEntry& entry, const char* fmtstr )
+   {
+      entry.mFormat = &internSlow( fmtstr );
+      entry.mKey = fmtstr;
+   }
+
+   const BinaryFormat& internSlow( const char* fmtstr )
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      std::unordered_map<const char*, BinaryFormat*>::iterator it = mByAddress.find( fmtstr );
+      if (it != mByAddress.end() && it->second->mFormat == fmtstr)
+         return *it->second;
+      mFormats.push_back( BinaryFormat() );
+      BinaryFormat& format = mFormats.back();
+      format.mId = (uint32_t)mById.size();
+      format.mFormat = fmtstr;
+      format.mFetches = binaryArgFetches( fmtstr );
+      mById.push_back( &format );
+      mByAddress[fmtstr] = &format;
+      return format;
+   }
+
+   std::mutex mMutex;
+   std::deque<BinaryFormat> mFormats; //< deque: addresses stay put as it grows
+   std::vector<BinaryFormat*> mById;
+   std::unordered_map<const char*, BinaryFormat*> mByAddress;
+};
+
+
+inline void appendVarint( FormatBuffer& buf, uint64_t value )
+{
+   char bytes[10];
+   size_t length = 0;
+   while (value >= 0x80)
+   {
+      bytes[length++] = (char)(value | 0x80);
+      value >>= 7;
+   }
+   bytes[length++] = (char)value;
+   buf.append( bytes, length );
+}
+inline void appendZigzag( FormatBuffer& buf, int64_t value )
+{
+   appendVarint( buf, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63) );
+}
+
+/// record type, level, and (if not FILTERALL) the filter, appended to what's in 'buf'.
+/// 'extra' are record specific flag bits (0x40 and 0x20 are free).
+inline void appendBinaryTag( FormatBuffer& buf, char type, uint32_t filter, uint32_t level, unsigned char extra = 0 )
+{
+   unsigned char flags = 1 | extra;
+   while ((flags & 0x1f) < 8 && 0 == (level & 1))
+   {
+      level >>= 1;
+      ++flags;
+   }
+   if (0xffffffff != filter)
+      flags |= 0x80;
+   buf.append( &type, 1 );
+   buf.append( (const char*)&flags, 1 );
+   if (0xffffffff != filter)
+      appendVarint( buf, filter );
+}
+/// same, starting a new record
+inline void appendBinaryHeader( FormatBuffer& buf, char type, uint32_t filter, uint32_t level )
+{
+   buf.clear();
+   appendBinaryTag( buf, type, filter, level );
+}
+
+/// the text of a 'K' record's fields (defined in Structured.h).
+/// false if they run past end.
+inline bool decodeStructured( unsigned char flags, const char*& p, const char* end, FormatBuffer& out );
+
+/// a %ls argument, stored as UTF-8 (what vsprintf prints in a UTF-8 locale),
+/// the decoder prints it with %s
+inline void appendBinaryWide( FormatBuffer& buf, const wchar_t* wide )
+{
+   if (NULL == wide)
+      return appendVarint( buf, 0 );
+   size_t at = buf.size();
+   appendUtf8( buf, wide );
+   size_t bytes = buf.size() - at;
+   // the length only comes out after the text: append it, then turn it round to the front
+   appendVarint( buf, bytes + 1 );
+   std::rotate( buf.data() + at, buf.data() + at + bytes, buf.data() + buf.size() );
+}
+
+/// record a printf style call as an 'M' record, no formatting is done.
+inline void captureBinary( FormatBuffer& buf, uint32_t filter, uint32_t level, const char* fmtstr, va_list arg_ptr )
+{
+   const BinaryFormat& format = FormatTable::instance().internText( fmtstr );
+   appendBinaryHeader( buf, 'M', filter, level );
+   appendVarint( buf, format.mId );
+
+   // walk the pre-parsed argument list, just copying bytes
+   for (size_t x = 0; x < format.mFetches.size(); ++x)
+   {
+      switch (format.mFetches[x])
+      {
+      case 'i': appendZigzag( buf, va_arg( arg_ptr, int ) ); break;
+      case 'l': appendZigzag( buf, va_arg( arg_ptr, long ) ); break;
+      case 'q': appendZigzag( buf, va_arg( arg_ptr, long long ) ); break;
+      case 'j': appendZigzag( buf, va_arg( arg_ptr, intmax_t ) ); break;
+      case 'z': appendZigzag( buf, (int64_t)va_arg( arg_ptr, size_t ) ); break;
+      case 't': appendZigzag( buf, va_arg( arg_ptr, ptrdiff_t ) ); break;
+      case 'x': va_arg( arg_ptr, void* ); break;
+      case 'p': appendVarint( buf, (uintptr_t)va_arg( arg_ptr, void* ) ); break;
+      case 'd':
+         {
+            double value = va_arg( arg_ptr, double );
+            buf.append( (const char*)&value, sizeof( value ) );
+         }
+         break;
+      case 'L':
+         {
+            long double value = va_arg( arg_ptr, long double );
+            buf.append( (const char*)&value, sizeof( value ) );
+         }
+         break;
+      case 's':
+         {
+            const char* str = va_arg( arg_ptr, const char* );
+            appendVarint( buf, (NULL == str) ? 0 : strlen( str ) + 1 );
+            if (NULL != str)
+               buf.append( str, strlen( str ) );
+         }
+         break;
+      case 'w': appendBinaryWide( buf, va_arg( arg_ptr, const wchar_t* ) ); break;
+      }
+   }
+}
+
+/// typed arguments (the variadic api): the format string was already checked
+/// against these types at compile time, so each one is written the way the
+/// decoder's fetch for its conversion reads it.  no va_list walk needed.
+template <typename T>
+inline void appendBinaryArg( FormatBuffer& buf, const T& value )
+{
+   typedef std::remove_cv_t<T> U;
+   if constexpr (std::is_enum_v<U> || std::is_integral_v<U>)
+      appendZigzag( buf, (int64_t)value );
+   else if constexpr (std::is_same_v<U, float> || std::is_same_v<U, double>)
+   {
+      double d = value;
+      buf.append( (const char*)&d, sizeof( d ) );
+   }
+   else if constexpr (std::is_same_v<U, long double>)
+      buf.append( (const char*)&value, sizeof( value ) );
+   else if constexpr (std::is_convertible_v<const U&, const char*>)
+   {
+      const char* str = value;
+      appendVarint( buf, (NULL == str) ? 0 : strlen( str ) + 1 );
+      if (NULL != str)
+         buf.append( str, strlen( str ) );
+   }
+   else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>)
+   {
+      appendVarint( buf, value.size() + 1 );
+      buf.append( value.data(), value.size() );
+   }
+   else if constexpr (std::is_convertible_v<const U&, const wchar_t*>)
+      appendBinaryWide( buf, value );
+   else
+      appendVarint( buf, (uintptr_t)(const void*)value );
+}
+
+/// record a typed call as an 'M' record, same bytes as captureBinary( va_list ).
+template <typename... Args>
+inline void captureBinaryArgs( FormatBuffer& buf, uint32_t filter, uint32_t level, const char* fmtstr, const Args&... args )
+{
+   const BinaryFormat& format = FormatTable::instance().intern( fmtstr );
+   appendBinaryHeader( buf, 'M', filter, level );
+   appendVarint( buf, format.mId );
+   (appendBinaryArg( buf, args ), ...);
+}
+
+/// a second per thread buffer, for wrapping text into records
+inline FormatBuffer& threadBinaryBuffer()
+{
+   static thread_local FormatBuffer buf;
+   return buf;
+}
+
+/// wrap already formatted text as a 'T' record
+inline void textBinary( FormatBuffer& buf, uint32_t filter, uint32_t level, const char* text, size_t length )
+{
+   appendBinaryHeader( buf, 'T', filter, level );
+   appendVarint( buf, length );
+   buf.append( text, length );
+}
+
+/// the 'F' record that defines a format id
+inline void defineBinary( FormatBuffer& buf, const BinaryFormat& format )
+{
+   buf.clear();
+   buf.append( "F", 1 );
+   appendVarint( buf, format.mId );
+   appendVarint( buf, format.mFormat.size() );
+   buf.append( format.mFormat.c_str(), format.mFormat.size() );
+}
+
+/// the format id of an 'M' record
+inline uint32_t binaryRecordId( const char* data, size_t length )
+{
+   const char* p = data + 2;
+   const char* end = data + length;
+   uint64_t value = 0;
+   if (0 != (data[1] & 0x80))
+      while (p < end && (*p++ & 0x80)) {} // skip the filter
+   for (int shift = 0; p < end; shift += 7)
+   {
+      value |= (uint64_t)(*p & 0x7f) << shift;
+      if (0 == (*p++ & 0x80))
+         break;
+   }
+   return (uint32_t)value;
+}
+
+
+/// turns binary records back into text, exactly as vsprintf would have.
+/// keeps the format definitions it has seen, so several files (log segments)
+/// can be fed through one decoder in order.
+class BinaryDecoder
+{
+public:
+   /// decode one record from [data, end), appending its text to 'out'.
+   /// returns the number of bytes consumed, 0 if the record is incomplete, -1 if corrupt.
+   long decode( const char* data, const char* end, FormatBuffer& out )
+   {
+      const char* p = data;
+      size_t headerLength = sizeof( gBinaryHeader ) - 1;
+      if ((size_t)(end - p) >= headerLength && 0 == memcmp( p, gBinaryHeader, headerLength ))
+         return (long)headerLength;
+      if (p >= end)
+         return 0;
+      uint64_t id, length, filter;
+      unsigned char flags = 0;
+      char type = *p++;
+      if ('T' == type || 'M' == type || 'K' == type)
+      {
+         if (p >= end) return 0;
+         flags = (unsigned char)*p++;
+         if ((flags & 0x80) && !varint( p, end, filter )) return 0;
+      }
+      switch (type)
+      {
+      case 'F':
+         if (!varint( p, end, id ) || !varint( p, end, length ) || (uint64_t)(end - p) < length) return 0;
+         if (mFormats.size() <= id)
+            mFormats.resize( id + 1 );
+         mFormats[id].assign( p, length );
+         return (long)(p + length - data);
+      case 'T':
+         if (!varint( p, end, length ) || (uint64_t)(end - p) < length) return 0;
+         out.append( p, length );
+         return (long)(p + length - data);
+      case 'M':
+         {
+            if (!varint( p, end, id )) return 0;
+            if (mFormats.size() <= id)
+               return -1; // message before its definition
+            size_t before = out.size();
+            if (!format( mFormats[id].c_str(), p, end, out ))
+            {
+               out.truncate( before ); // incomplete, undo
+               return 0;
+            }
+            return (long)(p - data);
+         }
+      case 'K':
+         {
+            size_t before = out.size();
+            if (!decodeStructured( flags, p, end, out ))
+            {
+               out.truncate( before );
+               return 0;
+            }
+            return (long)(p - data);
+         }
+      default:
+         return -1;
+      }
+   }
+
+   /// format one 'M' record's args with fmtstr, advancing args past them.
+   /// false if the args run past end.
+   static bool format( const char* fmtstr, const char*& args, const char* end, FormatBuffer& out )
+   {
+      const char* p = fmtstr;
+      FormatSpec spec;
+      while (nextFormatSpec( p, spec ))
+      {
+         out.append( fmtstr, spec.mBegin - fmtstr );
+         fmtstr = p;
+         char fetch = binaryArgFetch( spec );
+         if (0 == fetch)
+         {
+            // "%%", or a conversion we don't know (copied as is)
+            if ('%' == spec.mConversion)
+               out.append( "%", 1 );
+            else
+               out.append( spec.mBegin, spec.mLength );
+            continue;
+         }
+         int stars[2] = { 0, 0 };
+         for (int s = 0; s < spec.mStars && s < 2; ++s)
+         {
+            int64_t star;
+            if (!zigzag( args, end, star )) return false;
+            stars[s] = (int)star;
+         }
+         std::string one( spec.mBegin, spec.mLength );
+         int64_t integer = 0;
+         if (strchr( "ilqjzt", fetch ) && !zigzag( args, end, integer ))
+            return false;
+         switch (fetch)
+         {
+         case 'i':
+            if ('c' == spec.mConversion && 'l' == spec.mLengthMod[0]) printOne( out, one, spec.mStars, stars, (wint_t)integer );
+            else printOne( out, one, spec.mStars, stars, (int)integer );
+            break;
+         case 'l': printOne( out, one, spec.mStars, stars, (long)integer ); break;
+         case 'q': printOne( out, one, spec.mStars, stars, (long long)integer ); break;
+         case 'j': printOne( out, one, spec.mStars, stars, (intmax_t)integer ); break;
+         case 'z': printOne( out, one, spec.mStars, stars, (size_t)integer ); break;
+         case 't': printOne( out, one, spec.mStars, stars, (ptrdiff_t)integer ); break;
+         case 'x': break;
+         case 'd':
+            {
+               double value;
+               if (!read( args, end, value )) return false;
+               printOne( out, one, spec.mStars, stars, value );
+            }
+            break;
+         case 'L':
+            {
+               long double value;
+               if (!read( args, end, value )) return false;
+               printOne( out, one, spec.mStars, stars, value );
+            }
+            break;
+         case 'p':
+            {
+               uint64_t value;
+               if (!varint( args, end, value )) return false;
+               printOne( out, one, spec.mStars, stars, (void*)(uintptr_t)value );
+            }
+            break;
+         case 's': case 'w':
+            {
+               uint64_t length;
+               if (!varint( args, end, length ) || (uint64_t)(end - args) + 1 < length) return false;
+               if ('w' == fetch) // recorded as UTF-8, print as %s
+                  one = std::string( spec.mBegin, spec.mLength - 1 - strlen( spec.mLengthMod ) ) + "s";
+               if (0 == length)
+               {
+                  printOne( out, one, spec.mStars, stars, (const char*)NULL );
+                  break;
+               }
+               std::string str( args, length - 1 );
+               args += length - 1;
+               // a %ls precision counts bytes too, but never ends in the middle of a character
+               int precision = formatPrecision( spec, stars );
+               if ('w' == fetch && 0 <= precision && (size_t)precision < str.size())
+               {
+                  size_t cut = precision;
+                  while (0 < cut && 0x80 == (str[cut] & 0xc0))
+                     --cut;
+                  str.resize( cut );
+               }
+               printOne( out, one, spec.mStars, stars, str.c_str() );
+            }
+            break;
+         }
+      }
+      out.append( fmtstr, strlen( fmtstr ) );
+      return true;
+   }
+
+   /// read one value, false if it runs past end (also used for 'K' records)
+   template <typename T>
+   static inline bool read( const char*& p, const char* end, T& value )
+   {
+      if ((size_t)(end - p) < sizeof( T ))
+         return false;
+      memcpy( &value, p, sizeof( T ) );
+      p += sizeof( T );
+      return true;
+   }
+   static inline bool varint( const char*& p, const char* end, uint64_t& value )
+   {
+      value = 0;
+      for (int shift = 0; p < end && shift < 64; shift += 7)
+      {
+         value |= (uint64_t)(*p & 0x7f) << shift;
+         if (0 == (*p++ & 0x80))
+            return true;
+      }
+      return false;
+   }
+   static inline bool zigzag( const char*& p, const char* end, int64_t& value )
+   {
+      uint64_t raw;
+      if (!varint( p, end, raw ))
+         return false;
+      value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+      return true;
+   }
+
+private:
+   template <typename T>
+   static void printOne( FormatBuffer& out, const std::string& one, int starCount, const int* stars, T v )
+   {
+      if (0 == starCount) out.appendf( one.c_str(), v );
+      else if (1 == starCount) out.appendf( one.c_str(), stars[0], v );
+      else out.appendf( one.c_str(), stars[0], stars[1], v );
+   }
+
+   std::vector<std::string> mFormats;
+};
+
+
+/// check that capture + decode gives exactly what vsprintf gives
+struct BinaryLogUnitTest
+{
+   static bool check( const char* fmtstr, ... )
+   {
+      va_list arg_ptr, copy;
+      va_start( arg_ptr, fmtstr );
+      va_copy( copy, arg_ptr );
+      FormatBuffer expected, record;
+      expected.vappendf( fmtstr, copy );
+      captureBinary( record, 1, 1, fmtstr, arg_ptr );
+      va_end( copy );
+      va_end( arg_ptr );
+      return decodes( record, expected.c_str() );
+   }
+   static void captureWide( FormatBuffer& record, const char* fmtstr, ... )
+   {
+      va_list arg_ptr;
+      va_start( arg_ptr, fmtstr );
+      captureBinary( record, 1, 1, fmtstr, arg_ptr );
+      va_end( arg_ptr );
+   }
+   static bool decodes( const FormatBuffer& record, const char* expected )
+   {
+      FormatBuffer def, decoded;
+      BinaryDecoder decoder;
+      defineBinary( def, *FormatTable::instance().find( binaryRecordId( record.c_str(), record.size() ) ) );
+      decoder.decode( def.c_str(), def.c_str() + def.size(), decoded );
+      decoder.decode( record.c_str(), record.c_str() + record.size(), decoded );
+      return decoded.size() == strlen( expected ) && 0 == memcmp( decoded.c_str(), expected, decoded.size() );
+   }
+   static void test()
+   {
+      printf( "running binary log tests... [" );
+      int n = 0;
+      printf( "%s", check( "plain text\n" ) ? "." : "F" );
+      printf( "%s", check( "%d %i %u %x %X %o %c %%\n", -42, 7, 3000000000u, 255, 255, 8, 'z' ) ? "." : "F" );
+      printf( "%s", check( "%hhd %hd %ld %lld %zu %jd %td\n", 300, 70000, -5L, -123456789012LL, (size_t)99, (intmax_t)-1, (ptrdiff_t)12 ) ? "." : "F" );
+      printf( "%s", check( "%f %.3e %g %-10.2f| %a %Lf\n", 3.14159, 1e-7, 2.5, -1.25, 1.0, (long double)0.1 ) ? "." : "F" );
+      printf( "%s", check( "[%s] [%10s] [%-6.2s] [%s]\n", "hello", "right", "trunc", (const char*)NULL ) ? "." : "F" );
+      printf( "%s", check( "%*d|%-*.*f|%.*s\n", 6, 42, 9, 2, 3.14159, 3, "abcdef" ) ? "." : "F" );
+      printf( "%s", check( "%p %n%d\n", (void*)&n, &n, 5 ) ? "." : "F" );
+      // a format that isn't a literal: same address, new text
+      char reused[32];
+      strcpy( reused, "first %d\n" );
+      bool first = check( reused, 1 );
+      strcpy( reused, "second %s\n" );
+      printf( "%s", first && check( reused, "two" ) ? "." : "F" );
+
+      // typed arguments (the variadic api) make the same records
+      FormatBuffer typed;
+      std::string name( "typed" );
+      captureBinaryArgs( typed, 1, 1, "%s %zu %ld %c %.2f %s\n", name, (size_t)7, -3L, 'q', 2.5f, "end" );
+      printf( "%s", decodes( typed, "typed 7 -3 q 2.50 end\n" ) ? "." : "F" );
+
+      // %ls beyond ASCII comes back as UTF-8, a precision doesn't split a character
+      const char* wideExpected = "caf\xc3\xa9 [\xe2\x82\xac] [\xc3\xa9] [(null)]\n";
+      FormatBuffer wide, typedWide;
+      captureWide( wide, "%ls [%ls] [%.3ls] [%ls]\n", L"caf\u00e9", L"\u20ac", L"\u00e9\u00e9", (const wchar_t*)NULL );
+      captureBinaryArgs( typedWide, 1, 1, "%ls [%ls] [%.3ls] [%ls]\n", L"caf\u00e9", L"\u20ac", L"\u00e9\u00e9", (const wchar_t*)NULL );
+      printf( "%s", decodes( wide, wideExpected ) && decodes( typedWide, wideExpected ) ? "." : "F" );
+      // and matches vsprintf's own, in a UTF-8 locale
+      std::string previous = setlocale( LC_CTYPE, NULL );
+      if (NULL != setlocale( LC_CTYPE, "C.UTF-8" ))
+         printf( "%s", check( "%ls [%-6ls] [%.3ls]\n", L"caf\u00e9", L"\u20ac", L"\u00e9\u00e9" ) ? "." : "F" );
+      setlocale( LC_CTYPE, previous.c_str() );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#include "Structured.h" //< decodeStructured
+
+#endif
@@ -0,0 +1,162 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_CATEGORY
+#define SPEW_CATEGORY
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <ctype.h>
+#include <string.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// most categories there can be, each output keeps a byte per category
+#ifndef SPEW_MAX_CATEGORIES
+#  define SPEW_MAX_CATEGORIES 1024
+#endif
+
+/// true if category 'name' is 'prefix' or under it ("net.http" covers "net.http.client"
+/// but not "net.https").  case insensitive, like the command line.
+inline bool categoryUnder( const char* name, const char* prefix )
+{
+   size_t length = strlen( prefix );
+   for (size_t x = 0; x < length; ++x)
+      if (tolower( (unsigned char)name[x] ) != tolower( (unsigned char)prefix[x] ))
+         return false;
+   return '\0' == name[length] || '.' == name[length];
+}
+
+/// every category name there is, each with a dense id.
+/// ids 0..31 are the Filter bits (GFX is 0, SCRIPT 1, ...), so the old constants
+/// are predefined categories; names registered at runtime get 32 and up.
+/// names are hierarchical, dot separated: "net.http.client".
+class CategoryRegistry
+{
+public:
+   enum
+   {
+      FILTER_IDS = 32,                            //< ids taken by the Filter bits
+      OVERFLOW_ID = SPEW_MAX_CATEGORIES - 1        //< what names get once the registry is full
+   };
+
+   /// 'tags' is a name/tag table (gTagDescriptions), the single bit tags name the Filter ids
+   template <typename Tag>
+   explicit CategoryRegistry( const Tag* tags ) : mNames( FILTER_IDS ), mNamePointers()
+   {
+      for (int x = 0; '\0' != tags[x].mName[0]; ++x)
+      {
+         unsigned int tag = tags[x].mTag;
+         if (0 == tag || 0 != (tag & (tag - 1)))
+            continue;
+         unsigned int id = 0;
+         while (tag != (1u << id))
+            ++id;
+         if (mNames[id].empty()) // filters come first in the table, levels reuse the same bits
+         {
+            mNames[id] = tags[x].mName;
+            mIds[mNames[id]] = id;
+            mNamePointers[id].store( mNames[id].c_str(), std::memory_order_release );
+         }
+      }
+   }
+
+   /// the id for 'name', registered if it's new
+   unsigned int id( const char* name )
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      std::map<std::string, unsigned int>::const_iterator it = mIds.find( name );
+      if (it != mIds.end())
+         return it->second;
+      if (mNames.size() >= OVERFLOW_ID)
+         return OVERFLOW_ID;
+      unsigned int id = (unsigned int)mNames.size();
+      mNames.push_back( name );
+      mIds[name] = id;
+      mNamePointers[id].store( mNames.back().c_str(), std::memory_order_release );
+      return id;
+   }
+
+   /// name of category 'id' ("" for unused Filter bits)
+   std::string name( unsigned int id )
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      return id < mNames.size() ? mNames[id] : std::string();
+   }
+
+   /// same, without the lock or a copy: the registry's own string ("" for unused ids)
+   inline const char* c_str( unsigned int id ) const
+   {
+      const char* name = id < SPEW_MAX_CATEGORIES ? mNamePointers[id].load( std::memory_order_acquire ) : NULL;
+      return NULL == name ? "" : name;
+   }
+
+   /// number of ids handed out so far (Filter ids included)
+   unsigned int size()
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      return (unsigned int)mNames.size();
+   }
+
+private:
+   std::mutex mMutex;
+   std::deque<std::string> mNames; //< deque: names stay put as it grows (see c_str)
+   std::map<std::string, unsigned int> mIds;
+   std::atomic<const char*> mNamePointers[SPEW_MAX_CATEGORIES];
+};
+
+/// the registry (defined in Output.h, with the Filter names as its first entries)
+inline CategoryRegistry& categoryRegistry();
+
+/// a log category: a dense id for a hierarchical name.
+/// registering takes a lock, so make these once (statics, members) and log with them.
+/// usage:
+/// @code
+///    static const spew::Category HTTP( "net.http.client" );
+///    spew::Log( HTTP, 2, "GET %s\n", url );
+///    spew::Log.EnableCategory( "net", true ); // net.* on, and anything under it registered later
+/// @endcode
+struct Category
+{
+   explicit Category( const char* name ) : mId( categoryRegistry().id( name ) ) {}
+   explicit Category( unsigned int id ) : mId( id ) {}
+
+   /// the Filter bit for a predefined category, 0 for the rest
+   inline unsigned int filter() const { return mId < CategoryRegistry::FILTER_IDS ? 1u << mId : 0; }
+   inline std::string name() const { return categoryRegistry().name( mId ); }
+
+   unsigned int mId;
+};
+
+
+} // spew namespace
+
+#endif
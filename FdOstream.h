@@ -0,0 +1,240 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_FD_OSTREAM
+#define SPEW_FD_OSTREAM
+
+#ifndef WIN32
+
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// writev until everything is out (short writes, EINTR), counting the syscalls in 'writes'.
+/// 'iov' is used up in the process.
+inline bool writeAllFd( int fd, struct iovec* iov, int count, size_t& writes )
+{
+   if (fd < 0)
+      return false;
+   while (count > 0)
+   {
+      ssize_t written = ::writev( fd, iov, count );
+      ++writes;
+      if (written < 0)
+      {
+         if (EINTR == errno)
+            continue;
+         return false;
+      }
+      while (count > 0 && (size_t)written >= iov->iov_len)
+      {
+         written -= iov->iov_len;
+         ++iov;
+         --count;
+      }
+      if (count > 0)
+      {
+         iov->iov_base = (char*)iov->iov_base + written;
+         iov->iov_len -= written;
+      }
+   }
+   return true;
+}
+
+/// streambuf on a file descriptor that coalesces messages.
+/// text collects in one buffer until a flush (see FlushPolicy), which is then a single
+/// write(2).  a message that doesn't fit goes out together with what's pending in
+/// one writev(2), without being copied.
+class FdStreambuf : public std::streambuf
+{
+public:
+   FdStreambuf( int fd = -1, size_t bufferSize = 65536 ) : mFd( fd ), mOwned( false ), mWrites( 0 ), mBuffer( bufferSize )
+   {
+      setp( mBuffer.data(), mBuffer.data() + mBuffer.size() );
+   }
+   ~FdStreambuf() { close(); }
+
+   /// append to 'path' (created if needed)
+   bool open( const char* path )
+   {
+      close();
+      mFd = ::open( path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+      mOwned = true;
+      return mFd >= 0;
+   }
+   void close()
+   {
+      sync();
+      if (mOwned && mFd >= 0)
+         ::close( mFd );
+      mFd = -1;
+      mOwned = false;
+   }
+
+   /// number of write/writev syscalls so far
+   inline size_t writes() const { return mWrites; }
+
+protected:
+   std::streamsize xsputn( const char* data, std::streamsize length )
+   {
+      if (length <= epptr() - pptr())
+      {
+         memcpy( pptr(), data, length );
+         pbump( (int)length );
+         return length;
+      }
+      // doesn't fit: pending text and this message in one go
+      struct iovec iov[2];
+      iov[0].iov_base = pbase();
+      iov[0].iov_len = pptr() - pbase();
+      iov[1].iov_base = (void*)data;
+      iov[1].iov_len = length;
+      setp( mBuffer.data(), mBuffer.data() + mBuffer.size() );
+      return writeAll( iov, 2 ) ? length : 0;
+   }
+
+   int_type overflow( int_type c )
+   {
+      if (0 != sync())
+         return traits_type::eof();
+      if (!traits_type::eq_int_type( c, traits_type::eof() ))
+      {
+         *pptr() = traits_type::to_char_type( c );
+         pbump( 1 );
+      }
+      return traits_type::not_eof( c );
+   }
+
+   int sync()
+   {
+      if (pptr() == pbase())
+         return 0;
+      struct iovec iov;
+      iov.iov_base = pbase();
+      iov.iov_len = pptr() - pbase();
+      setp( mBuffer.data(), mBuffer.data() + mBuffer.size() );
+      return writeAll( &iov, 1 ) ? 0 : -1;
+   }
+
+private:
+   FdStreambuf( const FdStreambuf& );
+   FdStreambuf& operator=( const FdStreambuf& );
+
+   inline bool writeAll( struct iovec* iov, int count ) { return writeAllFd( mFd, iov, count, mWrites ); }
+
+   int mFd;
+   bool mOwned;
+   size_t mWrites;
+   std::vector<char> mBuffer;
+};
+
+/// ostream on an FdStreambuf.
+/// usage:
+/// @code
+///    FdOstream out;
+///    out.open( "server.log" );     // or FdOstream out( 2 ) for stderr
+///    Log.mOutStreams.push_back( &out );
+///    Log.SetFlushPolicy( &out, FlushPolicy::EveryBytes( 65536 ).Every( 100 ).Urgent( ERROR ) );
+/// @endcode
+class FdOstream : public std::ostream
+{
+public:
+   FdOstream( int fd = -1, size_t bufferSize = 65536 ) : std::ostream( NULL ), mBuf( fd, bufferSize ) { this->init( &mBuf ); }
+   ~FdOstream() { mBuf.close(); }
+
+   inline void open( const char* path )
+   {
+      if (mBuf.open( path ))
+         clear();
+      else
+         setstate( std::ios_base::failbit );
+   }
+   inline void close() { mBuf.close(); }
+   inline size_t writes() const { return mBuf.writes(); }
+
+private:
+   FdStreambuf mBuf;
+};
+
+
+/// text arrives whole and in order, and is coalesced
+struct FdOstreamUnitTest
+{
+   static void test()
+   {
+      printf( "running fd stream tests... [" );
+      int fds[2];
+      if (0 != ::pipe( fds ))
+      {
+         printf( "F]\n" );
+         return;
+      }
+      std::string expected;
+      {
+         FdOstream out( fds[1], 64 );
+         for (int x = 0; x < 10; ++x)
+         {
+            out << "msg" << x << '\n';
+            expected += "msg" + std::to_string( x ) + "\n";
+         }
+         printf( "%s", 0 == out.writes() ? "." : "F" ); // 50 bytes, still buffered
+         std::string big( 100, 'b' );
+         out.write( big.data(), big.size() ); // doesn't fit: one writev with the pending text
+         expected += big;
+         printf( "%s", 1 == out.writes() ? "." : "F" );
+         out << "tail\n" << std::flush;
+         expected += "tail\n";
+         printf( "%s", 2 == out.writes() ? "." : "F" );
+      }
+      ::close( fds[1] );
+      std::string got;
+      char buf[256];
+      ssize_t n;
+      while (0 < (n = ::read( fds[0], buf, sizeof( buf ) )))
+         got.append( buf, n );
+      ::close( fds[0] );
+      printf( "%s", got == expected ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
+
+#endif
@@ -0,0 +1,566 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_FLIGHT_RECORDER
+#define SPEW_FLIGHT_RECORDER
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <signal.h>
+#  include <sys/mman.h>
+#  include <sys/resource.h>
+#  include <sys/stat.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+#include "Sink.h"
+#include "Assertion.h" //< AssertBase::AssertionHandler
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+#ifndef WIN32
+
+/// the start of a flight recorder file, the ring follows it
+struct FlightRecorderHeader
+{
+   enum { SIZE = 64 };
+   char mMagic[8];               //< "SPEWFR1\n"
+   uint64_t mCapacity;           //< bytes in the ring, a power of two
+   std::atomic<uint64_t> mHead;  //< bytes ever written, the next one goes at mHead % mCapacity
+   uint64_t mPid;                //< who wrote it
+};
+static_assert( sizeof( FlightRecorderHeader ) <= FlightRecorderHeader::SIZE, "header outgrew its space" );
+const char gFlightRecorderMagic[8] = { 'S', 'P', 'E', 'W', 'F', 'R', '1', '\n' };
+
+/// a sink that keeps the last 'capacity' bytes of messages in a ring, in a file backed
+/// shared mapping: a message costs a memcpy, nothing is written to disk until something
+/// goes wrong, and since the pages belong to the file, a hard kill doesn't lose them
+/// (spew-recover reads them back out of the file).
+/// give it its own level with OutputBase::SetRecorder, so it sees LEVEL5 detail while the
+/// other streams and sinks only get what the output's level lets through.
+/// dumped as text, oldest message first: on demand (Dump), when the process crashes
+/// (DumpOnCrash), or on a failed ASSERT (FlightRecorderAssert).
+/// opening keeps the previous run's ring as <path>.1.  text only (not binary mode records).
+/// usage:
+/// @code
+///    FlightRecorder recorder;
+///    recorder.open( "/var/tmp/myapp.flight", 4 * 1024 * 1024 );
+///    recorder.DumpOnCrash( "/var/tmp/myapp.crash.txt" );
+///    Log.SetRecorder( &recorder, LEVEL5ANDLOWER );
+///
+///    > spew-recover /var/tmp/myapp.flight     (after a kill -9)
+/// @endcode
+class FlightRecorder : public Sink
+{
+public:
+   enum { MAX_CRASH_DUMPS = 8 }; //< recorders DumpOnCrash can have at once
+
+   FlightRecorder() : mFd( -1 ), mHeader( NULL ), mRing( NULL ), mMask( 0 ) { mCrashPath[0] = '\0'; }
+   ~FlightRecorder() { close(); }
+
+   /// map a ring of 'capacity' bytes (rounded up to a power of two) at 'path'
+   bool open( const char* path, size_t capacity )
+   {
+      close();
+      size_t size = 4096;
+      while (size < capacity)
+         size <<= 1;
+      struct stat info;
+      if (0 == ::stat( path, &info ) && 0 < info.st_size)
+         ::rename( path, (std::string( path ) + ".1").c_str() );
+      mFd = ::open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+      if (mFd < 0)
+         return false;
+      size_t total = FlightRecorderHeader::SIZE + size;
+      // the blocks are allocated now, so a full disk fails here and not as a SIGBUS later
+#ifdef __linux__
+      bool allocated = 0 == ::posix_fallocate( mFd, 0, total );
+#else
+      bool allocated = false;
+#endif
+      void* base = MAP_FAILED;
+      if (allocated || 0 == ::ftruncate( mFd, total ))
+         base = ::mmap( NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0 );
+      if (MAP_FAILED == base)
+      {
+         ::close( mFd );
+         mFd = -1;
+         return false;
+      }
+      mHeader = new (base) FlightRecorderHeader;
+      mHeader->mCapacity = size;
+      mHeader->mHead.store( 0, std::memory_order_relaxed );
+      mHeader->mPid = (uint64_t)::getpid();
+      memcpy( mHeader->mMagic, gFlightRecorderMagic, sizeof( mHeader->mMagic ) );
+      mRing = (char*)base + FlightRecorderHeader::SIZE;
+      mMask = size - 1;
+      return true;
+   }
+
+   /// unmap (the file keeps the ring)
+   void close()
+   {
+      if (NULL == mHeader)
+         return;
+      crashSlot( this, false );
+      ::munmap( mHeader, FlightRecorderHeader::SIZE + mMask + 1 );
+      ::close( mFd );
+      mFd = -1;
+      mHeader = NULL;
+      mRing = NULL;
+   }
+   inline bool is_open() const { return NULL != mHeader; }
+   inline size_t capacity() const { return NULL == mHeader ? 0 : mMask + 1; }
+
+   /// (one writer at a time, the output serializes them)
+   void write( const char* data, size_t length )
+   {
+      if (NULL == mRing)
+         return;
+      if (length > mMask + 1) // only the end of it fits
+      {
+         data += length - (mMask + 1);
+         length = mMask + 1;
+      }
+      uint64_t head = mHeader->mHead.load( std::memory_order_relaxed );
+      size_t at = (size_t)(head & mMask);
+      size_t first = length < mMask + 1 - at ? length : mMask + 1 - at;
+      memcpy( mRing + at, data, first );
+      memcpy( mRing, data + first, length - first );
+      mHeader->mHead.store( head + length, std::memory_order_release );
+   }
+
+   /// what's in the ring now, oldest message first
+   void contents( std::string& out ) const
+   {
+      out.clear();
+      if (NULL == mHeader)
+         return;
+      Span parts[2];
+      size_t count = pieces( mRing, mMask + 1, mHeader->mHead.load( std::memory_order_acquire ), parts );
+      for (size_t x = 0; x < count; ++x)
+         out.append( parts[x].mData, parts[x].mLength );
+   }
+
+   /// write the ring out to 'path' as text, followed by 'note' (if any).
+   /// only open/write/close, so it's safe in a signal handler.  messages written while
+   /// it runs may tear the oldest ones, dump from a thread that logs to this recorder's
+   /// output (or while it's quiet) for an exact copy.
+   bool Dump( const char* path, const char* note = NULL ) const
+   {
+      if (NULL == mHeader)
+         return false;
+      int fd = ::open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+      if (fd < 0)
+         return false;
+      Span parts[2];
+      size_t count = pieces( mRing, mMask + 1, mHeader->mHead.load( std::memory_order_acquire ), parts );
+      struct iovec iov[3];
+      for (size_t x = 0; x < count; ++x)
+      {
+         iov[x].iov_base = (void*)parts[x].mData;
+         iov[x].iov_len = parts[x].mLength;
+      }
+      if (NULL != note)
+      {
+         iov[count].iov_base = (void*)note;
+         iov[count++].iov_len = strlen( note );
+      }
+      size_t writes = 0;
+      bool ok = writeAllFd( fd, iov, (int)count, writes );
+      return 0 == ::close( fd ) && ok;
+   }
+
+   /// Dump to 'path' if the process dies of SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT
+   /// (then the signal does what it did before).  NULL stops it.
+   /// false if MAX_CRASH_DUMPS recorders have one already.
+   /// a stack overflow is only caught on a thread with an alternate signal stack: the
+   /// calling thread gets one here, other threads call ProtectThread (below) themselves.
+   bool DumpOnCrash( const char* path )
+   {
+      if (NULL == path)
+      {
+         crashSlot( this, false );
+         mCrashPath[0] = '\0';
+         return true;
+      }
+      snprintf( mCrashPath, sizeof( mCrashPath ), "%s", path );
+      if (!crashSlot( this, true ))
+         return false;
+      installCrashHandler();
+      ProtectThread();
+      return true;
+   }
+
+   /// give the calling thread an alternate signal stack (freed when the thread exits),
+   /// so the crash handler runs and dumps when this thread overflows its stack.
+   /// sigaltstack is per thread: call it at the top of each thread that might overflow.
+   static void ProtectThread()
+   {
+      thread_local AlternateStack stack;
+      stack.install();
+   }
+
+   /// the text in a flight recorder file's bytes (see spew-recover), false if it isn't one
+   static bool recover( const char* data, size_t size, std::string& out )
+   {
+      out.clear();
+      if (size < FlightRecorderHeader::SIZE || 0 != memcmp( data, gFlightRecorderMagic, sizeof( gFlightRecorderMagic ) ))
+         return false;
+      uint64_t capacity, head;
+      memcpy( &capacity, data + offsetof( FlightRecorderHeader, mCapacity ), sizeof( capacity ) );
+      memcpy( &head, data + offsetof( FlightRecorderHeader, mHead ), sizeof( head ) );
+      if (0 == capacity || 0 != (capacity & (capacity - 1)) || size - FlightRecorderHeader::SIZE < capacity)
+         return false;
+      Span parts[2];
+      size_t count = pieces( data + FlightRecorderHeader::SIZE, capacity, head, parts );
+      for (size_t x = 0; x < count; ++x)
+         out.append( parts[x].mData, parts[x].mLength );
+      return true;
+   }
+
+   /// same, reading the file at 'path'
+   static bool recoverFile( const char* path, std::string& out )
+   {
+      std::string bytes;
+      FILE* file = fopen( path, "rb" );
+      if (NULL == file)
+         return false;
+      char chunk[65536];
+      size_t got;
+      while (0 < (got = fread( chunk, 1, sizeof( chunk ), file )))
+         bytes.append( chunk, got );
+      fclose( file );
+      return recover( bytes.data(), bytes.size(), out );
+   }
+
+private:
+   FlightRecorder( const FlightRecorder& );
+   FlightRecorder& operator=( const FlightRecorder& );
+
+   /// the ring's bytes oldest first, in up to two pieces.  once it has wrapped, the
+   /// oldest message was partly written over, it starts after the first newline.
+   static size_t pieces( const char* ring, uint64_t capacity, uint64_t head, Span* parts )
+   {
+      uint64_t start = head > capacity ? head - capacity : 0;
+      if (0 != start)
+      {
+         while (start < head && '\n' != ring[start & (capacity - 1)])
+            ++start;
+         ++start; // past the newline
+      }
+      size_t count = 0;
+      while (start < head)
+      {
+         size_t at = (size_t)(start & (capacity - 1));
+         size_t length = (size_t)(head - start < capacity - at ? head - start : capacity - at);
+         parts[count].mData = ring + at;
+         parts[count++].mLength = length;
+         start += length;
+      }
+      return count;
+   }
+
+   /// the recorders to dump on a crash
+   static std::atomic<FlightRecorder*>* crashSlots()
+   {
+      static std::atomic<FlightRecorder*> slots[MAX_CRASH_DUMPS];
+      return slots;
+   }
+   static bool crashSlot( FlightRecorder* recorder, bool add )
+   {
+      std::atomic<FlightRecorder*>* slots = crashSlots();
+      for (int x = 0; x < MAX_CRASH_DUMPS; ++x)
+         if (recorder == slots[x].load())
+         {
+            if (!add)
+               slots[x].store( NULL );
+            return true;
+         }
+      for (int x = 0; add && x < MAX_CRASH_DUMPS; ++x)
+      {
+         FlightRecorder* empty = NULL;
+         if (slots[x].compare_exchange_strong( empty, recorder ))
+            return true;
+      }
+      return !add;
+   }
+
+   enum { CRASH_SIGNALS = 5 };
+   static const int* crashSignals()
+   {
+      static const int signals[CRASH_SIGNALS] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+      return signals;
+   }
+   static struct sigaction* previousActions()
+   {
+      static struct sigaction previous[CRASH_SIGNALS];
+      return previous;
+   }
+   /// a thread's alternate signal stack (ProtectThread), taken down before it's freed
+   struct AlternateStack
+   {
+      enum { SIZE = 65536 };
+      AlternateStack() : mStack( NULL ) {}
+      ~AlternateStack()
+      {
+         if (NULL == mStack)
+            return;
+         stack_t off;
+         memset( &off, 0, sizeof( off ) );
+         off.ss_flags = SS_DISABLE;
+         ::sigaltstack( &off, NULL );
+         free( mStack );
+      }
+      void install()
+      {
+         if (NULL != mStack)
+            return;
+         mStack = (char*)malloc( SIZE );
+         if (NULL == mStack)
+            return;
+         stack_t alternate;
+         alternate.ss_sp = mStack;
+         alternate.ss_size = SIZE;
+         alternate.ss_flags = 0;
+         ::sigaltstack( &alternate, NULL );
+      }
+      char* mStack;
+   };
+
+   /// once per process.  (handled on the alternate stack, if the thread has one: ProtectThread)
+   static void installCrashHandler()
+   {
+      static std::atomic<bool> installed( false );
+      if (installed.exchange( true ))
+         return;
+      struct sigaction action;
+      memset( &action, 0, sizeof( action ) );
+      action.sa_handler = crashHandler;
+      action.sa_flags = SA_ONSTACK;
+      sigemptyset( &action.sa_mask );
+      for (int x = 0; x < CRASH_SIGNALS; ++x)
+         ::sigaction( crashSignals()[x], &action, &previousActions()[x] );
+   }
+   static void crashHandler( int signal )
+   {
+      char note[48] = "--- crashed, signal ";
+      size_t length = strlen( note );
+      if (signal >= 10)
+         note[length++] = (char)('0' + signal / 10);
+      note[length++] = (char)('0' + signal % 10);
+      note[length++] = '\n';
+      note[length] = '\0';
+      std::atomic<FlightRecorder*>* slots = crashSlots();
+      for (int x = 0; x < MAX_CRASH_DUMPS; ++x)
+      {
+         FlightRecorder* recorder = slots[x].load();
+         if (NULL != recorder && '\0' != recorder->mCrashPath[0])
+            recorder->Dump( recorder->mCrashPath, note );
+      }
+      // on to whatever handled it before (the default: die)
+      for (int x = 0; x < CRASH_SIGNALS; ++x)
+         if (signal == crashSignals()[x])
+            ::sigaction( signal, &previousActions()[x], NULL );
+      ::raise( signal );
+   }
+
+   int mFd;
+   FlightRecorderHeader* mHeader;
+   char* mRing;
+   size_t mMask;
+   char mCrashPath[256]; //< a fixed buffer, the crash handler can't allocate
+};
+
+/// dumps a flight recorder when an ASSERT fails, after recording the assertion
+/// (then carries on, as the other handlers say).
+/// a recorder that an output writes to (SetRecorder) takes the assertion through that
+/// output's RecorderNotes, so it goes in between messages instead of racing the writer.
+/// usage:
+/// @code
+///    FlightRecorderAssert dumpOnAssert( recorder, "/var/tmp/myapp.assert.txt", &Log.RecorderNotes() );
+///    AssertBase::instance().reg( dumpOnAssert );
+/// @endcode
+class FlightRecorderAssert : public AssertBase::AssertionHandler
+{
+public:
+   /// 'notes' NULL writes to the recorder directly (for one no output writes to)
+   FlightRecorderAssert( FlightRecorder& recorder, const char* path, Sink* notes = NULL ) : mRecorder( recorder ), mNotes( notes ), mPath( path ) {}
+   bool call( const char* str, int line, const char* file )
+   {
+      char text[512];
+      int length = snprintf( text, sizeof( text ), "--- assertion '%s' in '%s' line %d\n", str, file, line );
+      size_t size = length < (int)sizeof( text ) ? length : sizeof( text ) - 1;
+      if (NULL != mNotes)
+         mNotes->write( text, size );
+      else
+         mRecorder.write( text, size );
+      mRecorder.Dump( mPath.c_str() );
+      return false;
+   }
+
+private:
+   FlightRecorder& mRecorder;
+   Sink* mNotes; //< the output's RecorderNotes, or NULL
+   std::string mPath;
+};
+
+#endif
+
+
+/// wraps a small ring, dumps it, recovers it from the file, and dumps it from a crashing child
+struct FlightRecorderUnitTest
+{
+   static void test()
+   {
+#ifndef WIN32
+      printf( "running flight recorder tests... [" );
+      const char* name = "spew-flight-test.bin";
+      const char* dump = "spew-flight-test.txt";
+      FlightRecorder recorder;
+      printf( "%s", recorder.open( name, 3000 ) && 4096 == recorder.capacity() ? "." : "F" );
+
+      // 200 lines of 29 bytes wrap a 4k ring: it keeps the newest whole lines
+      char line[64];
+      size_t length = 0;
+      for (int x = 0; x < 200; ++x)
+      {
+         length = snprintf( line, sizeof( line ), "message %05d ..............\n", x );
+         recorder.write( line, length );
+      }
+      std::string text;
+      recorder.contents( text );
+      printf( "%s", 4096 - length < text.size() && text.size() <= 4096 && 0 == text.find( "message 00" ) &&
+                    text.size() - length == text.find( "message 00199" ) && 0 == text.size() % length ? "." : "F" );
+
+      // on demand, and from the file (as after a kill -9, it's still mapped here)
+      bool dumped = recorder.Dump( dump );
+      std::string fromDump, fromFile, recovered;
+      readFile( dump, fromDump );
+      readFile( name, fromFile );
+      printf( "%s", dumped && fromDump == text && FlightRecorder::recover( fromFile.data(), fromFile.size(), recovered ) &&
+                    recovered == text && !FlightRecorder::recover( text.data(), text.size(), recovered ) ? "." : "F" );
+
+      // a failed ASSERT writes itself in, then dumps
+      FlightRecorderAssert onAssert( recorder, dump );
+      onAssert.call( "x != 0", 42, "thing.cpp" );
+      readFile( dump, fromDump );
+      printf( "%s", fromDump.size() - strlen( "--- assertion 'x != 0' in 'thing.cpp' line 42\n" ) ==
+                    fromDump.find( "--- assertion 'x != 0' in 'thing.cpp' line 42\n" ) ? "." : "F" );
+
+      // or through the notes sink of the output that writes to the recorder
+      MemorySink notes;
+      FlightRecorderAssert throughNotes( recorder, dump, &notes );
+      throughNotes.call( "y != 0", 43, "thing.cpp" );
+      readFile( dump, fromDump );
+      printf( "%s", notes.str() == "--- assertion 'y != 0' in 'thing.cpp' line 43\n" &&
+                    std::string::npos == fromDump.find( "'y != 0'" ) ? "." : "F" );
+
+      // a crash: the child dies of SIGABRT, its ring is dumped on the way out
+      ::remove( dump );
+      pid_t child = ::fork();
+      if (0 == child)
+      {
+         struct rlimit noCore = { 0, 0 };
+         ::setrlimit( RLIMIT_CORE, &noCore );
+         recorder.DumpOnCrash( dump );
+         recorder.write( "last words\n", 11 );
+         ::raise( SIGABRT );
+         ::_exit( 0 );
+      }
+      int status = 0;
+      bool aborted = 0 < child && child == ::waitpid( child, &status, 0 ) && WIFSIGNALED( status ) && SIGABRT == WTERMSIG( status );
+      readFile( dump, fromDump );
+      printf( "%s", aborted && std::string::npos != fromDump.find( "last words\n--- crashed, signal 6\n" ) ? "." : "F" );
+
+      // a stack overflow on another thread, one that has its own alternate stack
+      ::remove( dump );
+      child = ::fork();
+      if (0 == child)
+      {
+         struct rlimit noCore = { 0, 0 };
+         ::setrlimit( RLIMIT_CORE, &noCore );
+         recorder.DumpOnCrash( dump );
+         recorder.write( "deep\n", 5 );
+         volatile size_t depth = (size_t)-1;
+         std::thread( [&depth]() { FlightRecorder::ProtectThread(); recurse( depth, NULL ); } ).join();
+         ::_exit( 0 );
+      }
+      bool overflowed = 0 < child && child == ::waitpid( child, &status, 0 ) && WIFSIGNALED( status ) && SIGSEGV == WTERMSIG( status );
+      readFile( dump, fromDump );
+      printf( "%s", overflowed && std::string::npos != fromDump.find( "deep\n--- crashed, signal 11\n" ) ? "." : "F" );
+
+      // a new run keeps the last one as .1
+      recorder.open( name, 4096 );
+      recorder.write( "second run\n", 11 );
+      std::string current;
+      recorder.contents( current );
+      printf( "%s", FlightRecorder::recoverFile( (std::string( name ) + ".1").c_str(), recovered ) &&
+                    std::string::npos != recovered.find( "last words\n" ) && "second run\n" == current ? "." : "F" );
+      recorder.close();
+      ::remove( name );
+      ::remove( (std::string( name ) + ".1").c_str() );
+      ::remove( dump );
+      printf( "]\n" );
+#endif
+   }
+
+   /// uses up the stack, a frame at a time
+   static size_t recurse( size_t depth, volatile char* above )
+   {
+      volatile char frame[1024];
+      frame[0] = NULL != above ? above[0] : 0;
+      return 0 == depth ? 0 : recurse( depth - 1, frame ) + frame[0];
+   }
+   static void readFile( const char* path, std::string& out )
+   {
+      out.clear();
+      FILE* file = fopen( path, "rb" );
+      if (NULL == file)
+         return;
+      char chunk[4096];
+      size_t got;
+      while (0 < (got = fread( chunk, 1, sizeof( chunk ), file )))
+         out.append( chunk, got );
+      fclose( file );
+   }
+};
+
+
+} // spew namespace
+
+#endif
@@ -0,0 +1,114 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_FLUSH_POLICY
+#define SPEW_FLUSH_POLICY
+
+#include <chrono>
+#include <ostream>
+#include <stddef.h>
+#include "Sink.h"
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// when an output stream gets flushed (see OutputBase::SetFlushPolicy).
+/// streams without a policy are flushed after every message.
+/// usage:
+/// @code
+///    // flush every 64k, or after 100ms, or right away for ERROR and level 1 messages
+///    Log.SetFlushPolicy( &myfile, FlushPolicy::EveryBytes( 65536 ).Every( 100 ).Urgent( ERROR, LEVEL1 ) );
+/// @endcode
+struct FlushPolicy
+{
+   FlushPolicy() : mBytes( 0 ), mMilliseconds( 0 ), mUrgentFilter( 0 ), mUrgentLevel( 0 ) {}
+
+   static FlushPolicy EveryMessage() { return FlushPolicy(); }
+   static FlushPolicy EveryBytes( size_t bytes ) { FlushPolicy p; p.mBytes = bytes; return p; }
+   static FlushPolicy EveryMilliseconds( unsigned int ms ) { FlushPolicy p; p.mMilliseconds = ms; return p; }
+
+   /// also flush when this much is pending
+   inline FlushPolicy& Bytes( size_t bytes ) { mBytes = bytes; return *this; }
+   /// also flush text that has been pending this long
+   inline FlushPolicy& Every( unsigned int ms ) { mMilliseconds = ms; return *this; }
+   /// also flush right away for messages with any of these filters, or any of these levels
+   /// (FILTERALL/FILTERDEFAULT messages only count through their level)
+   inline FlushPolicy& Urgent( unsigned int filter, unsigned int level = 0 )
+   {
+      mUrgentFilter = filter;
+      mUrgentLevel = level;
+      return *this;
+   }
+
+   inline bool everyMessage() const { return 0 == mBytes && 0 == mMilliseconds; }
+   inline bool urgent( unsigned int filter, unsigned int level ) const
+   {
+      return (0xffffffff != filter && 0 != (filter & mUrgentFilter)) || 0 != (level & mUrgentLevel);
+   }
+
+   size_t mBytes;              //< 0: no byte limit
+   unsigned int mMilliseconds; //< 0: no timer
+   unsigned int mUrgentFilter, mUrgentLevel;
+};
+
+/// a stream's (or sink's) policy, plus what it has pending
+struct StreamFlush
+{
+   std::ostream* mStream;                          //< one of these two is set
+   Sink* mSink;
+   FlushPolicy mPolicy;
+   size_t mPending;                                //< bytes written since the last flush
+   std::chrono::steady_clock::time_point mOldest;  //< when the oldest of them was written
+
+   /// account for one message, true if the stream should be flushed now
+   inline bool wrote( size_t length, unsigned int filter, unsigned int level )
+   {
+      if (0 == mPending && 0 != mPolicy.mMilliseconds)
+         mOldest = std::chrono::steady_clock::now();
+      mPending += length;
+      return mPolicy.urgent( filter, level ) || (0 != mPolicy.mBytes && mPending >= mPolicy.mBytes);
+   }
+   /// true if the timer says the stream should be flushed
+   inline bool due( std::chrono::steady_clock::time_point now ) const
+   {
+      return 0 != mPending && 0 != mPolicy.mMilliseconds &&
+             now - mOldest >= std::chrono::milliseconds( mPolicy.mMilliseconds );
+   }
+   inline void flush()
+   {
+      if (NULL != mSink)
+         mSink->flush();
+      else
+         mStream->flush();
+      mPending = 0;
+   }
+};
+
+
+} // spew namespace
+
+#endif
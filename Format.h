@@ -0,0 +1,631 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_FORMAT
+#define SPEW_FORMAT
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "FormatBuffer.h"
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// printf style formatting, checked at compile time.
+/// the format string is parsed by the compiler, each conversion is checked against
+/// the type of its argument, and mistakes are compile errors:
+/// @code
+///    formatTo( buf, "%d items, %s\n", 3, std::string( "ok" ) ); // fine, std::string works with %s
+///    formatTo( buf, "%s\n", 3 );                                 // error: formatErrorArgumentType
+///    formatTo( buf, "%d %d\n", 3 );                              // error: formatErrorTooFewArguments
+/// @endcode
+/// numbers are written with std::to_chars, output matches what snprintf would write.
+/// integer length modifiers must fit the argument (%d int, %ld long, %zu size_t, ...).
+/// the format has to be a constant, for run time format strings use the va_list interface.
+
+// these are never defined as constexpr: calling one from the parser is how a
+// bad format string becomes a compile error, the name says what went wrong.
+inline void formatErrorTooFewArguments() {}
+inline void formatErrorTooManyArguments() {}
+inline void formatErrorArgumentType() {}
+inline void formatErrorUnknownConversion() {}
+inline void formatErrorPercentNNotSupported() {}
+inline void formatErrorFormatTooLong() {}
+
+/// what kind of value an argument is
+enum FormatArgKind
+{
+   FORMAT_NONE, FORMAT_SIGNED, FORMAT_UNSIGNED, FORMAT_DOUBLE, FORMAT_LONGDOUBLE,
+   FORMAT_CSTRING, FORMAT_STRING, FORMAT_POINTER,
+};
+
+template <typename T>
+constexpr FormatArgKind formatArgKind()
+{
+   typedef std::remove_cv_t<std::remove_reference_t<T> > U;
+   if constexpr (std::is_enum_v<U>)
+      return std::is_signed_v<std::underlying_type_t<U> > ? FORMAT_SIGNED : FORMAT_UNSIGNED;
+   else if constexpr (std::is_same_v<U, bool>)
+      return FORMAT_SIGNED;
+   else if constexpr (std::is_integral_v<U>)
+      return std::is_signed_v<U> ? FORMAT_SIGNED : FORMAT_UNSIGNED;
+   else if constexpr (std::is_same_v<U, float> || std::is_same_v<U, double>)
+      return FORMAT_DOUBLE;
+   else if constexpr (std::is_same_v<U, long double>)
+      return FORMAT_LONGDOUBLE;
+   else if constexpr (std::is_array_v<U> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<U> >, char>)
+      return FORMAT_CSTRING;
+   else if constexpr (std::is_pointer_v<U> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<U> >, char>)
+      return FORMAT_CSTRING;
+   else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>)
+      return FORMAT_STRING;
+   else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>)
+      return FORMAT_POINTER;
+   else
+      return FORMAT_NONE;
+}
+
+/// static info about one argument, so the parser can check it
+struct FormatArgInfo
+{
+   FormatArgKind mKind;
+   unsigned char mSize;
+};
+
+/// one conversion, as parsed by the compiler
+struct FormatConversion
+{
+   enum
+   {
+      LEFT = 1, PLUS = 2, SPACE = 4, ALT = 8, ZERO = 16,
+      STAR = -2, NONE = -1,
+   };
+   unsigned short mBegin = 0;      //< offset of the '%'
+   unsigned short mEnd = 0;        //< offset just past the conversion char
+   short mWidth = NONE;            //< NONE, STAR, or the width
+   short mPrecision = NONE;        //< NONE, STAR, or the precision
+   unsigned char mFlags = 0;
+   unsigned char mSize = 0;        //< hh/h: the size printf converts the value to (0 == the argument's size)
+   char mConversion = 0;
+   bool mLiteralHasPercent = false; //< the text before this conversion contains "%%"
+};
+
+/// constant format string, parsed and checked against Args at compile time.
+/// (Args are the argument types, use std::type_identity_t<Args>... to keep them from being deduced)
+template <typename... Args>
+struct FormatString
+{
+   template <typename S, typename = std::enable_if_t<std::is_convertible_v<const S&, std::string_view> > >
+   consteval FormatString( const S& str ) : mStr( std::string_view( str ).data() ), mConversions(), mCount( 0 ), mLength( 0 ), mTailHasPercent( false )
+   {
+      const FormatArgInfo infos[] = { { formatArgKind<Args>(), (unsigned char)sizeof( Args ) }..., { FORMAT_NONE, 0 } };
+      std::string_view s( str );
+      if (s.size() > 0xffff)
+         formatErrorFormatTooLong();
+      mLength = (unsigned short)s.size();
+      size_t arg = 0, pos = 0;
+      bool literalHasPercent = false;
+      while (pos < s.size())
+      {
+         if ('%' != s[pos])
+         {
+            ++pos;
+            continue;
+         }
+         if (pos + 1 < s.size() && '%' == s[pos + 1])
+         {
+            literalHasPercent = true;
+            pos += 2;
+            continue;
+         }
+         FormatConversion c = { (unsigned short)pos++, 0, 0, 0, 0, 0, 0, false };
+         c.mLiteralHasPercent = literalHasPercent;
+         literalHasPercent = false;
+         for (;; ++pos)
+         {
+            if (pos >= s.size()) break;
+            else if ('-' == s[pos]) c.mFlags |= FormatConversion::LEFT;
+            else if ('+' == s[pos]) c.mFlags |= FormatConversion::PLUS;
+            else if (' ' == s[pos]) c.mFlags |= FormatConversion::SPACE;
+            else if ('#' == s[pos]) c.mFlags |= FormatConversion::ALT;
+            else if ('0' == s[pos]) c.mFlags |= FormatConversion::ZERO;
+            else break;
+         }
+         c.mWidth = number( s, pos, arg, infos );
+         c.mPrecision = FormatConversion::NONE;
+         if (pos < s.size() && '.' == s[pos])
+         {
+            ++pos;
+            c.mPrecision = number( s, pos, arg, infos );
+            if (FormatConversion::NONE == c.mPrecision)
+               c.mPrecision = 0; // "%.f" means precision 0
+         }
+         char mod[2] = { 0, 0 };
+         for (int m = 0; m < 2 && pos < s.size() && std::string_view( "hlLjztq" ).find( s[pos] ) != std::string_view::npos; ++m)
+            mod[m] = s[pos++];
+         if (pos >= s.size())
+            formatErrorUnknownConversion();
+         c.mConversion = s[pos++];
+         c.mEnd = (unsigned short)pos;
+         check( c, mod, arg, infos );
+         ++arg;
+         mConversions[mCount++] = c;
+      }
+      mTailHasPercent = literalHasPercent;
+      if (arg < sizeof...(Args))
+         formatErrorTooManyArguments();
+   }
+
+   const char* mStr;
+   FormatConversion mConversions[sizeof...(Args) + 1];
+   unsigned short mCount, mLength;
+   bool mTailHasPercent;
+
+private:
+   /// a width or precision: a number, '*' (takes an int argument), or nothing
+   static consteval short number( std::string_view s, size_t& pos, size_t& arg, const FormatArgInfo* infos )
+   {
+      if (pos < s.size() && '*' == s[pos])
+      {
+         ++pos;
+         if (arg >= sizeof...(Args))
+            formatErrorTooFewArguments();
+         if ((FORMAT_SIGNED != infos[arg].mKind && FORMAT_UNSIGNED != infos[arg].mKind) || infos[arg].mSize > sizeof( int ))
+            formatErrorArgumentType();
+         ++arg;
+         return FormatConversion::STAR;
+      }
+      if (pos >= s.size() || s[pos] < '0' || '9' < s[pos])
+         return FormatConversion::NONE;
+      int n = 0;
+      while (pos < s.size() && '0' <= s[pos] && s[pos] <= '9' && n < 10000)
+         n = n * 10 + (s[pos++] - '0');
+      return (short)n;
+   }
+
+   /// is the argument the right kind (and size) for the conversion?
+   static consteval void check( FormatConversion& c, const char* mod, size_t arg, const FormatArgInfo* infos )
+   {
+      if (arg >= sizeof...(Args))
+         formatErrorTooFewArguments();
+      const FormatArgInfo& info = infos[arg];
+      switch (c.mConversion)
+      {
+      case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+         {
+            if (FORMAT_SIGNED != info.mKind && FORMAT_UNSIGNED != info.mKind)
+               formatErrorArgumentType();
+            // the length modifier has to describe the argument, like printf needs
+            size_t expected = sizeof( int );
+            if ('h' == mod[0]) c.mSize = ('h' == mod[1]) ? 1 : 2;
+            else if ('l' == mod[0] && 'l' == mod[1]) expected = sizeof( long long );
+            else if ('l' == mod[0]) expected = sizeof( long );
+            else if ('L' == mod[0] || 'q' == mod[0]) expected = sizeof( long long );
+            else if ('j' == mod[0]) expected = sizeof( intmax_t );
+            else if ('z' == mod[0]) expected = sizeof( size_t );
+            else if ('t' == mod[0]) expected = sizeof( ptrdiff_t );
+            if ('c' == c.mConversion && 0 != mod[0])
+               formatErrorArgumentType(); // no wide chars
+            if (sizeof( int ) == expected ? info.mSize > sizeof( int ) : info.mSize != expected)
+               formatErrorArgumentType();
+         }
+         break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+         if (('L' == mod[0]) ? FORMAT_LONGDOUBLE != info.mKind : FORMAT_DOUBLE != info.mKind)
+            formatErrorArgumentType();
+         break;
+      case 's':
+         if ((FORMAT_CSTRING != info.mKind && FORMAT_STRING != info.mKind) || 0 != mod[0])
+            formatErrorArgumentType();
+         break;
+      case 'p':
+         if (FORMAT_POINTER != info.mKind || 0 != mod[0])
+            formatErrorArgumentType();
+         break;
+      case 'n':
+         formatErrorPercentNNotSupported();
+         break;
+      default:
+         formatErrorUnknownConversion();
+      }
+   }
+};
+
+
+/// an argument, type erased for the formatter (like va_list, but it knows its type)
+struct FormatArg
+{
+   FormatArgKind mKind;
+   unsigned char mSize;
+   union
+   {
+      unsigned long long mBits; //< integers: raw bits, mSize bytes of them matter
+      double mDouble;
+      long double mLongDouble;
+      const void* mPointer;
+      struct { const char* mStr; size_t mLength; } mString; //< mLength == npos: nul terminated
+   };
+
+   template <typename T>
+   inline FormatArg( const T& value ) : mKind( formatArgKind<T>() ), mSize( (unsigned char)sizeof( T ) )
+   {
+      constexpr FormatArgKind kind = formatArgKind<T>();
+      if constexpr (FORMAT_SIGNED == kind || FORMAT_UNSIGNED == kind)
+         mBits = (unsigned long long)(long long)value;
+      else if constexpr (FORMAT_DOUBLE == kind)
+         mDouble = value;
+      else if constexpr (FORMAT_LONGDOUBLE == kind)
+         mLongDouble = value;
+      else if constexpr (FORMAT_CSTRING == kind)
+      {
+         mString.mStr = value;
+         mString.mLength = std::string::npos;
+      }
+      else if constexpr (FORMAT_STRING == kind)
+      {
+         mString.mStr = value.data();
+         mString.mLength = value.size();
+      }
+      else if constexpr (FORMAT_POINTER == kind)
+         mPointer = (const void*)value;
+      else
+         mBits = 0;
+   }
+   inline FormatArg() : mKind( FORMAT_NONE ), mSize( 0 ), mBits( 0 ) {}
+
+   /// the value as printf would see it after converting to 'size' bytes
+   inline unsigned long long unsignedValue( unsigned char size ) const
+   {
+      if (0 == size || size > mSize) size = mSize;
+      return (size >= 8) ? mBits : (mBits & ((1ULL << (size * 8)) - 1));
+   }
+   inline long long signedValue( unsigned char size ) const
+   {
+      if (0 == size || size > mSize) size = mSize;
+      if (size >= 8) return (long long)mBits;
+      unsigned long long sign = 1ULL << (size * 8 - 1);
+      unsigned long long bits = mBits & ((sign << 1) - 1);
+      return (long long)((bits ^ sign) - sign);
+   }
+};
+
+
+/// copy literal text, turning "%%" into "%"
+inline void formatLiteral( FormatBuffer& buf, const char* text, size_t length, bool hasPercent )
+{
+   if (!hasPercent)
+      return buf.append( text, length );
+   for (size_t x = 0; x < length; ++x)
+   {
+      buf.append( text + x, 1 );
+      if ('%' == text[x])
+         ++x;
+   }
+}
+
+/// write [prefix][zeros][body] padded to width, the way printf lays a number out
+inline void formatPadded( FormatBuffer& buf, const char* prefix, size_t prefixLength, size_t zeros,
+                          const char* body, size_t bodyLength, int width, unsigned flags )
+{
+   size_t total = prefixLength + zeros + bodyLength;
+   size_t pad = (width > 0 && (size_t)width > total) ? width - total : 0;
+   if (0 == (flags & FormatConversion::LEFT) && 0 != (flags & FormatConversion::ZERO))
+   {
+      zeros += pad;
+      pad = 0;
+   }
+   static const char spaces[] = "                                ";
+   static const char zeroes[] = "00000000000000000000000000000000";
+   if (0 == (flags & FormatConversion::LEFT))
+      for (; pad > 0; pad -= (pad < 32 ? pad : 32))
+         buf.append( spaces, pad < 32 ? pad : 32 );
+   buf.append( prefix, prefixLength );
+   for (; zeros > 0; zeros -= (zeros < 32 ? zeros : 32))
+      buf.append( zeroes, zeros < 32 ? zeros : 32 );
+   buf.append( body, bodyLength );
+   for (; pad > 0; pad -= (pad < 32 ? pad : 32))
+      buf.append( spaces, pad < 32 ? pad : 32 );
+}
+
+/// the slow path: hand one conversion to snprintf (%a, %p, '#' on floats)
+template <typename T>
+inline void formatFallback( FormatBuffer& buf, const char* begin, const char* end, int width, int precision, T value )
+{
+   // rebuild the conversion with '*' width/precision already resolved
+   char spec[64];
+   size_t length = 0;
+   spec[length++] = '%';
+   const char* p = begin + 1;
+   while (p < end && strchr( "-+ #0", *p ))
+      spec[length++] = *p++;
+   length += snprintf( spec + length, sizeof( spec ) - length, "%d", width < 0 ? 0 : width );
+   if (precision >= 0)
+      length += snprintf( spec + length, sizeof( spec ) - length, ".%d", precision );
+   if (std::is_same_v<T, long double>)
+      spec[length++] = 'L';
+   spec[length++] = end[-1];
+   spec[length] = '\0';
+   buf.appendf( spec, value );
+}
+
+/// format one conversion.  width and precision are already resolved ('*'), NONE if not given.
+inline void formatOne( FormatBuffer& buf, const char* str, const FormatConversion& c, unsigned flags, const FormatArg& arg, int width, int precision )
+{
+   if (0 == flags && width < 0 && precision < 0 && 0 == c.mSize)
+   {
+      // the common case, plain "%d" "%u" "%x" "%s": straight into the buffer
+      switch (c.mConversion)
+      {
+      case 'd': case 'i':
+         {
+            long long value = arg.signedValue( 0 );
+            char* out = buf.prepare( 24 );
+            if (NULL != out)
+               buf.commit( std::to_chars( out, out + 24, value ).ptr - out );
+         }
+         return;
+      case 'u':
+         {
+            char* out = buf.prepare( 24 );
+            if (NULL != out)
+               buf.commit( std::to_chars( out, out + 24, arg.unsignedValue( 0 ) ).ptr - out );
+         }
+         return;
+      case 'x':
+         {
+            char* out = buf.prepare( 24 );
+            if (NULL != out)
+               buf.commit( std::to_chars( out, out + 24, arg.unsignedValue( 0 ), 16 ).ptr - out );
+         }
+         return;
+      case 's':
+         if (NULL != arg.mString.mStr)
+         {
+            size_t length = arg.mString.mLength;
+            buf.append( arg.mString.mStr, (std::string::npos == length) ? strlen( arg.mString.mStr ) : length );
+            return;
+         }
+         break;
+      }
+   }
+   char digits[128];
+   switch (c.mConversion)
+   {
+   case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+      {
+         const bool isSigned = ('d' == c.mConversion || 'i' == c.mConversion);
+         unsigned long long magnitude;
+         char sign = 0;
+         if (isSigned)
+         {
+            long long value = arg.signedValue( c.mSize );
+            magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+            if (value < 0) sign = '-';
+            else if (flags & FormatConversion::PLUS) sign = '+';
+            else if (flags & FormatConversion::SPACE) sign = ' ';
+         }
+         else
+            magnitude = arg.unsignedValue( c.mSize );
+
+         int base = ('o' == c.mConversion) ? 8 : ('x' == c.mConversion || 'X' == c.mConversion) ? 16 : 10;
+         size_t length = 0;
+         if (0 != magnitude || 0 != precision)
+            length = std::to_chars( digits, digits + sizeof( digits ), magnitude, base ).ptr - digits;
+         if ('X' == c.mConversion)
+            for (size_t x = 0; x < length; ++x)
+               if ('a' <= digits[x]) digits[x] -= 'a' - 'A';
+
+         char prefix[3];
+         size_t prefixLength = 0;
+         if (sign) prefix[prefixLength++] = sign;
+         size_t zeros = (precision >= 0 && (size_t)precision > length) ? precision - length : 0;
+         if (flags & FormatConversion::ALT)
+         {
+            if ('o' == c.mConversion && 0 == zeros && (0 == length || '0' != digits[0]))
+               zeros = 1;
+            else if (16 == base && 0 != magnitude)
+            {
+               prefix[prefixLength++] = '0';
+               prefix[prefixLength++] = c.mConversion;
+            }
+         }
+         if (precision >= 0)
+            flags &= ~FormatConversion::ZERO; // a precision turns off '0' for integers
+         formatPadded( buf, prefix, prefixLength, zeros, digits, length, width, flags );
+      }
+      break;
+
+   case 'c':
+      digits[0] = (char)arg.unsignedValue( 1 );
+      formatPadded( buf, "", 0, 0, digits, 1, width, flags & ~FormatConversion::ZERO );
+      break;
+
+   case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+      {
+         if (flags & FormatConversion::ALT)
+         {
+            if (FORMAT_LONGDOUBLE == arg.mKind) formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mLongDouble );
+            else formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mDouble );
+            break;
+         }
+         char lower = c.mConversion | 0x20;
+         std::chars_format format = ('f' == lower) ? std::chars_format::fixed :
+                                    ('e' == lower) ? std::chars_format::scientific : std::chars_format::general;
+         int p = (precision < 0) ? 6 : precision;
+         if ('g' == lower && 0 == p)
+            p = 1;
+         std::to_chars_result result = (FORMAT_LONGDOUBLE == arg.mKind) ?
+            std::to_chars( digits, digits + sizeof( digits ), arg.mLongDouble, format, p ) :
+            std::to_chars( digits, digits + sizeof( digits ), arg.mDouble, format, p );
+         if (std::errc() != result.ec)
+         {
+            // huge fixed numbers, rare
+            if (FORMAT_LONGDOUBLE == arg.mKind) formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mLongDouble );
+            else formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mDouble );
+            break;
+         }
+         const char* body = digits;
+         size_t length = result.ptr - digits;
+         char sign[1];
+         size_t signLength = 0;
+         if ('-' == body[0]) { sign[0] = '-'; ++body; --length; signLength = 1; }
+         else if (flags & FormatConversion::PLUS) { sign[0] = '+'; signLength = 1; }
+         else if (flags & FormatConversion::SPACE) { sign[0] = ' '; signLength = 1; }
+         const bool finite = ('0' <= body[0] && body[0] <= '9');
+         if (c.mConversion != lower)
+            for (size_t x = 0; x < length; ++x)
+               if ('a' <= body[x] && body[x] <= 'z') ((char*)body)[x] -= 'a' - 'A';
+         formatPadded( buf, sign, signLength, 0, body, length, width, finite ? flags : (flags & ~FormatConversion::ZERO) );
+      }
+      break;
+
+   case 'a': case 'A':
+      if (FORMAT_LONGDOUBLE == arg.mKind) formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mLongDouble );
+      else formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mDouble );
+      break;
+
+   case 's':
+      {
+         const char* text = arg.mString.mStr;
+         size_t length = arg.mString.mLength;
+         if (NULL == text)
+         {
+            // glibc prints "(null)", unless the precision is too short for it
+            text = (precision < 0 || precision >= 6) ? "(null)" : "";
+            length = strlen( text );
+         }
+         else if (std::string::npos == length)
+            length = (precision < 0) ? strlen( text ) : strnlen( text, precision );
+         if (precision >= 0 && (size_t)precision < length)
+            length = precision;
+         formatPadded( buf, "", 0, 0, text, length, width, flags & ~FormatConversion::ZERO );
+      }
+      break;
+
+   case 'p':
+      formatFallback( buf, str + c.mBegin, str + c.mEnd, width, precision, arg.mPointer );
+      break;
+   }
+}
+
+/// append formatted text to buf.  usage:
+/// @code
+///    FormatBuffer buf;
+///    formatTo( buf, "%d items\n", count );
+/// @endcode
+template <typename... Args>
+inline void formatTo( FormatBuffer& buf, const FormatString<std::type_identity_t<Args>...>& fmtstr, const Args&... args )
+{
+   const FormatArg argv[] = { FormatArg( args )..., FormatArg() };
+   size_t arg = 0, pos = 0;
+   for (unsigned short x = 0; x < fmtstr.mCount; ++x)
+   {
+      const FormatConversion& c = fmtstr.mConversions[x];
+      formatLiteral( buf, fmtstr.mStr + pos, c.mBegin - pos, c.mLiteralHasPercent );
+      int width = c.mWidth, precision = c.mPrecision;
+      unsigned flags = c.mFlags;
+      if (FormatConversion::STAR == width)
+      {
+         width = (int)argv[arg++].signedValue( sizeof( int ) );
+         if (width < 0)
+         {
+            // negative '*' width means left justify
+            flags |= FormatConversion::LEFT;
+            width = -width;
+         }
+      }
+      if (FormatConversion::STAR == precision)
+      {
+         precision = (int)argv[arg++].signedValue( sizeof( int ) );
+         if (precision < 0)
+            precision = FormatConversion::NONE; // negative '*' precision is ignored
+      }
+      formatOne( buf, fmtstr.mStr, c, flags, argv[arg++], width, precision );
+      pos = c.mEnd;
+   }
+   formatLiteral( buf, fmtstr.mStr + pos, fmtstr.mLength - pos, fmtstr.mTailHasPercent );
+}
+
+
+/// check the formatter against snprintf
+struct FormatUnitTest
+{
+   template <typename... Args>
+   static const char* check( FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
+   {
+      FormatBuffer ours;
+      formatTo( ours, fmtstr, args... );
+      char theirs[512];
+      snprintf( theirs, sizeof( theirs ), fmtstr.mStr, printfArg( args )... );
+      if (0 == strcmp( ours.c_str(), theirs ))
+         return ".";
+      printf( "\n   [%s] != [%s]\n", ours.c_str(), theirs );
+      return "F";
+   }
+   template <typename T> static const T& printfArg( const T& value ) { return value; }
+   static const char* printfArg( const std::string& value ) { return value.c_str(); }
+
+   static void test()
+   {
+      printf( "running format tests... [" );
+      printf( "%s", check( "plain %% text\n" ) );
+      printf( "%s", check( "%d %i %u %o %x %X %c|", -42, 7, 3000000000u, 8, 255, 255, 'z' ) );
+      printf( "%s", check( "%5d|%-5d|%05d|%+d|% d|%.3d|%8.3d|%-+6d|%.0d|", 42, 42, -42, 42, 42, 7, -7, 3, 0 ) );
+      printf( "%s", check( "%#x %#X %#o %#o %x|", 255, 255, 8, 0, 0 ) );
+      printf( "%s", check( "%hhd %hd %hhu %ld %lld %zu %lu %llx|", 300, 70000, -1, -5L, -123456789012LL, (size_t)99, 4000000000UL, -1LL ) );
+      printf( "%s", check( "%d %d %u|", -2147483647 - 1, 2147483647, 0u ) );
+      printf( "%s", check( "%f %.3e %g %-10.2f| %G %E %.0f %.10g|", 3.14159, 1e-7, 2.5, -1.25, 1e20, 12345.678, 2.5, 1.0 / 3 ) );
+      printf( "%s", check( "%+.2f|% f|%010.3f|%-8.1e|%g %g %g|", 1.5, 2.0, -3.25, 1e5, 100000.0, 1000000.0, 1e-5 ) );
+      printf( "%s", check( "%f %f %F %5.1f %g|", 1.0 / 0.0, -1.0 / 0.0, 1.0 / 0.0, 0.0 / 0.0 * 0, 0.0 ) );
+      printf( "%s", check( "%Lf %.3Le %a %#g %#.0f|", (long double)0.1, (long double)12345.6789, 1.0, 1.5, 2.0 ) );
+      printf( "%s", check( "[%s] [%10s] [%-6.2s] [%.3s]|", "hello", "right", "trunc", std::string( "string" ) ) );
+      printf( "%s", check( "%*d|%-*.*f|%.*s|%*d|%*s|%.*s|", 6, 42, 9, 2, 3.14159, 3, "abcdef", -4, 1, -1, "", -1, "all" ) );
+      printf( "%s", check( "%p %p|", (void*)&test, (void*)NULL ) );
+      const char* nothing = NULL;
+      printf( "%s", check( "%s|%.3s|", nothing, nothing ) );
+      // out of heap: the buffer keeps what it had instead of writing through NULL
+      FormatBuffer full;
+      full.append( "kept", 4 );
+      size_t capacity = full.capacity();
+      bool refused = !full.reserve( (size_t)-1 / 4 ) && NULL == full.prepare( (size_t)-1 / 4 ) &&
+                     !full.reserve( (size_t)-1 ) && !full.reserve( (size_t)-1 / 2 + 2 ) &&
+                     NULL == full.prepare( (size_t)-1 ) && NULL == full.prepare( (size_t)-1 - 2 );
+      printf( "%s", refused && capacity == full.capacity() && 0 == strcmp( full.c_str(), "kept" ) ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
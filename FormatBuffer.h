@@ -0,0 +1,181 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_FORMAT_BUFFER
+#define SPEW_FORMAT_BUFFER
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// text buffer for building one message.
+/// starts out using inline storage, only goes to the heap for big messages,
+/// and keeps whatever it grew to.  nothing is truncated unless the heap runs out.
+/// OutputBase keeps one of these per thread.
+///
+/// usage:
+/// @code
+///    FormatBuffer buf;
+///    buf.appendf( "hi %s", steve );
+///    fwrite( buf.c_str(), 1, buf.size(), stdout );
+/// @endcode
+class FormatBuffer
+{
+public:
+   enum { INLINE_SIZE = 256 };
+
+   FormatBuffer() : mData( mInline ), mCapacity( INLINE_SIZE ), mLength( 0 ) { mInline[0] = '\0'; }
+   ~FormatBuffer() { if (mData != mInline) free( mData ); }
+
+   inline void clear() { mLength = 0; mData[0] = '\0'; }
+   inline const char* c_str() const { return mData; }
+   inline char* data() { return mData; } //< to patch what's been written
+   inline size_t size() const { return mLength; }
+   inline size_t capacity() const { return mCapacity; }
+
+   /// drop everything after the first 'length' chars
+   inline void truncate( size_t length )
+   {
+      if (length < mLength)
+      {
+         mLength = length;
+         mData[mLength] = '\0';
+      }
+   }
+
+   /// make room for at least 'capacity' chars (including the nul).
+   /// false if the heap is out (or no heap has that much), the buffer is left as it was.
+   bool reserve( size_t capacity )
+   {
+      if (capacity <= mCapacity)
+         return true;
+      if (capacity > (size_t)PTRDIFF_MAX)
+         return false; // a wrapped length, most likely
+      size_t size = mCapacity * 2;
+      while (size < capacity)
+      {
+         if (size > SIZE_MAX / 2)
+         {
+            size = capacity;
+            break;
+         }
+         size *= 2;
+      }
+      char* data = (char*)malloc( size );
+      if (NULL == data)
+         return false;
+      memcpy( data, mData, mLength + 1 );
+      if (mData != mInline)
+         free( mData );
+      mData = data;
+      mCapacity = size;
+      return true;
+   }
+
+   /// (what fits, if the heap is out)
+   inline void append( const char* text, size_t length )
+   {
+      if (!reserveMore( length ))
+         length = mCapacity - mLength - 1;
+      memcpy( mData + mLength, text, length );
+      mLength += length;
+      mData[mLength] = '\0';
+   }
+
+   /// room to write up to 'length' chars in place, follow with commit().
+   /// NULL if the heap is out (the message ends here)
+   inline char* prepare( size_t length )
+   {
+      if (!reserveMore( length ))
+         return NULL;
+      return mData + mLength;
+   }
+   /// reserve room for 'length' more chars, false for a length the buffer can't add up to
+   inline bool reserveMore( size_t length )
+   {
+      return length < SIZE_MAX - mLength && reserve( mLength + length + 1 );
+   }
+   /// keep 'length' chars written after prepare()
+   inline void commit( size_t length )
+   {
+      mLength += length;
+      mData[mLength] = '\0';
+   }
+
+   /// append printf style formatted text
+   void vappendf( const char* fmtstr, va_list arg_ptr )
+   {
+      va_list copy;
+      va_copy( copy, arg_ptr );
+      int length = vsnprintf( mData + mLength, mCapacity - mLength, fmtstr, copy );
+      va_end( copy );
+      if (length < 0)
+         return; // bad format string, leave the buffer as it was
+      if (mLength + length + 1 > mCapacity)
+      {
+         // didn't fit, grow to the exact size and format again.
+         // out of heap: keep the part that did fit
+         if (!reserve( mLength + length + 1 ))
+            length = (int)(mCapacity - mLength - 1);
+         else
+            vsnprintf( mData + mLength, mCapacity - mLength, fmtstr, arg_ptr );
+      }
+      mLength += length;
+   }
+   inline void appendf( const char* fmtstr, ... )
+   {
+      va_list arg_ptr;
+      va_start( arg_ptr, fmtstr );
+      vappendf( fmtstr, arg_ptr );
+      va_end( arg_ptr );
+   }
+
+private:
+   FormatBuffer( const FormatBuffer& );
+   FormatBuffer& operator=( const FormatBuffer& );
+
+   char* mData;
+   size_t mCapacity, mLength;
+   char mInline[INLINE_SIZE];
+};
+
+/// the calling thread's message buffer, no locking needed to format into it.
+inline FormatBuffer& threadFormatBuffer()
+{
+   static thread_local FormatBuffer buf;
+   return buf;
+}
+
+
+} // spew namespace
+
+#endif
@@ -0,0 +1,416 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_HEADER
+#define SPEW_HEADER
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "FormatBuffer.h"
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#  include <cpuid.h>
+#  include <x86intrin.h>
+#  define SPEW_CLOCK_TSC
+#endif
+#ifdef __linux__
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// what goes in front of each message (OutputBase::SetHeader), in this order:
+/// @code
+///   2026-10-17 13:45:07.123456 [4242] L2 IO: message
+/// @endcode
+enum HeaderField
+{
+   HEADER_NONE     = 0x00,
+   HEADER_DATE     = 0x01, //< 2026-10-17
+   HEADER_TIME     = 0x02, //< 13:45:07
+   HEADER_MILLIS   = 0x04, //< .123 after the time
+   HEADER_MICROS   = 0x08, //< .123456 after the time
+   HEADER_UTC      = 0x10, //< date and time in UTC, not local time
+   HEADER_THREAD   = 0x20, //< [4242] the thread id (what top and gdb show on linux)
+   HEADER_LEVEL    = 0x40, //< L2
+   HEADER_CATEGORY = 0x80, //< IO, net.http.client (nothing for FILTERALL or several filters)
+
+   HEADER_DEFAULT  = HEADER_DATE | HEADER_TIME | HEADER_MICROS | HEADER_THREAD | HEADER_LEVEL | HEADER_CATEGORY,
+   HEADER_CLOCK    = HEADER_DATE | HEADER_TIME | HEADER_MILLIS | HEADER_MICROS, //< the ones that read the clock
+};
+
+
+/// wall clock time, nanoseconds since the epoch, cheap enough to read for every message.
+/// x86-64: the TSC scaled by a rate calibrated against the system clock when the Clock is
+/// made (~2ms), refined later over longer spans, and re-anchored to the system clock once
+/// a second per thread so it doesn't drift.  only when the TSC is invariant (and on linux,
+/// when the kernel's own clocksource is the TSC, it checks the cores agree).
+/// elsewhere: clock_gettime( CLOCK_REALTIME ), which linux answers in the vDSO.
+/// each thread's readings never go backwards.
+class Clock
+{
+public:
+   static Clock& instance() { static Clock clock; return clock; }
+
+   inline int64_t now()
+   {
+#ifdef SPEW_CLOCK_TSC
+      if (mTsc)
+      {
+         Anchor& anchor = threadAnchor();
+         uint64_t ticks = __rdtsc();
+         uint64_t elapsed = ticks - anchor.mTicks;
+         if (elapsed >= mTicksPerSecond) // (also the thread's first reading)
+            return reanchor( anchor, ticks );
+         // elapsed is under a second, so this fits in 64 bits for any TSC rate
+         int64_t nanos = anchor.mNanos + (int64_t)((elapsed * mScale.load( std::memory_order_relaxed )) >> 32);
+         if (nanos < anchor.mLast)
+            nanos = anchor.mLast;
+         anchor.mLast = nanos;
+         return nanos;
+      }
+#endif
+      return systemNow();
+   }
+
+   /// true if now() reads the TSC
+   inline bool tsc() const { return mTsc; }
+
+   /// a raw reading for timing spans (the TSC, or steady ns): nanos( b - a ) is the span in ns
+   inline uint64_t ticks() const
+   {
+#ifdef SPEW_CLOCK_TSC
+      if (mTsc)
+         return __rdtsc();
+#endif
+      return (uint64_t)steadyNow();
+   }
+   inline uint64_t nanos( uint64_t ticks ) const
+   {
+      if (!mTsc)
+         return ticks;
+      if (ticks < mTicksPerSecond) // fits in 64 bits
+         return (ticks * mScale.load( std::memory_order_relaxed )) >> 32;
+      return (uint64_t)(ticks * (mScale.load( std::memory_order_relaxed ) / 4294967296.0));
+   }
+
+   /// the system's wall clock
+   static inline int64_t systemNow()
+   {
+#ifndef WIN32
+      struct timespec now;
+      clock_gettime( CLOCK_REALTIME, &now );
+      return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+#endif
+   }
+
+private:
+   Clock() : mTsc( false ), mScale( 0 ), mTicksPerSecond( 0 ), mStartTicks( 0 ), mStartNanos( 0 ), mRefinedNanos( 0 )
+   {
+#ifdef SPEW_CLOCK_TSC
+      unsigned int eax, ebx, ecx, edx;
+      if (!__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) || 0 == (edx & (1u << 8)))
+         return; // the TSC rate changes with the cpu's
+#  ifdef __linux__
+      FILE* file = fopen( "/sys/devices/system/clocksource/clocksource0/current_clocksource", "r" );
+      char source[32] = "";
+      if (NULL != file)
+      {
+         if (NULL == fgets( source, sizeof( source ), file ))
+            source[0] = '\0';
+         fclose( file );
+      }
+      if (0 != strncmp( source, "tsc", 3 ))
+         return;
+#  endif
+      mStartNanos = steadyNow();
+      mStartTicks = __rdtsc();
+      int64_t nanos;
+      while ((nanos = steadyNow()) - mStartNanos < 2000000)
+         ;
+      uint64_t ticks = __rdtsc();
+      mRefinedNanos = nanos - mStartNanos;
+      mTicksPerSecond = (ticks - mStartTicks) * 1000000000 / mRefinedNanos;
+      mScale = (uint64_t)(mRefinedNanos * 4294967296.0 / (ticks - mStartTicks));
+      mTsc = 0 != mTicksPerSecond;
+#endif
+   }
+
+   static inline int64_t steadyNow()
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+   }
+
+#ifdef SPEW_CLOCK_TSC
+   /// each thread's tie between the TSC and the wall clock
+   struct Anchor
+   {
+      uint64_t mTicks;
+      int64_t mNanos, mLast;
+   };
+   static Anchor& threadAnchor()
+   {
+      static thread_local Anchor anchor = { 0, 0, 0 };
+      return anchor;
+   }
+   /// once a second: the wall clock again, and a better rate if it's been a while
+   int64_t reanchor( Anchor& anchor, uint64_t ticks )
+   {
+      int64_t nanos = systemNow();
+      int64_t span = steadyNow() - mStartNanos;
+      int64_t refined = mRefinedNanos.load( std::memory_order_relaxed );
+      if (span > 2 * refined && mRefinedNanos.compare_exchange_strong( refined, span, std::memory_order_relaxed ))
+         mScale.store( (uint64_t)(span * 4294967296.0 / (ticks - mStartTicks)), std::memory_order_relaxed );
+      anchor.mTicks = ticks;
+      anchor.mNanos = nanos;
+      if (nanos < anchor.mLast)
+         nanos = anchor.mLast;
+      anchor.mLast = nanos;
+      return nanos;
+   }
+#endif
+
+   bool mTsc;
+   std::atomic<uint64_t> mScale; //< nanoseconds per tick, 32.32 fixed point
+   uint64_t mTicksPerSecond;
+   uint64_t mStartTicks;
+   int64_t mStartNanos; //< (steady clock) where calibration started
+   std::atomic<int64_t> mRefinedNanos; //< the span mScale was measured over
+};
+
+
+/// the calling thread's id, looked up once
+inline unsigned int threadId()
+{
+#ifdef __linux__
+   static thread_local unsigned int id = (unsigned int)syscall( SYS_gettid );
+#else
+   static thread_local unsigned int id = (unsigned int)std::hash<std::thread::id>()( std::this_thread::get_id() );
+#endif
+   return id;
+}
+
+/// "[4242] " for the calling thread, rendered once (the first char is the length)
+inline const char* threadTag()
+{
+   struct Tag
+   {
+      Tag() { mText[0] = (char)snprintf( mText + 1, sizeof( mText ) - 1, "[%u] ", threadId() ); }
+      char mText[16];
+   };
+   static thread_local Tag tag;
+   return tag.mText;
+}
+
+/// 'count' decimal digits of 'value', zero padded
+inline void writeDigits( char* out, unsigned int value, int count )
+{
+   for (int x = count - 1; x >= 0; --x)
+   {
+      out[x] = (char)('0' + value % 10);
+      value /= 10;
+   }
+}
+
+/// "2026-10-17 13:45:07" for a second, rendered once per second per thread.
+/// localtime_r takes a lock and walks the timezone rules, this is a compare and a copy.
+inline const char* dateTime( int64_t second, bool utc )
+{
+   struct Cache
+   {
+      int64_t mSecond;
+      bool mUtc;
+      char mText[20];
+   };
+   static thread_local Cache cache = { -1, false, "" };
+   if (cache.mSecond != second || cache.mUtc != utc)
+   {
+      time_t t = (time_t)second;
+      struct tm parts;
+#ifdef WIN32
+      if (utc)
+         gmtime_s( &parts, &t );
+      else
+         localtime_s( &parts, &t );
+#else
+      if (utc)
+         gmtime_r( &t, &parts );
+      else
+         localtime_r( &t, &parts );
+#endif
+      char* out = cache.mText;
+      writeDigits( out, parts.tm_year + 1900, 4 );
+      out[4] = '-';
+      writeDigits( out + 5, parts.tm_mon + 1, 2 );
+      out[7] = '-';
+      writeDigits( out + 8, parts.tm_mday, 2 );
+      out[10] = ' ';
+      writeDigits( out + 11, parts.tm_hour, 2 );
+      out[13] = ':';
+      writeDigits( out + 14, parts.tm_min, 2 );
+      out[16] = ':';
+      writeDigits( out + 17, parts.tm_sec, 2 );
+      out[19] = '\0';
+      cache.mSecond = second;
+      cache.mUtc = utc;
+   }
+   return cache.mText;
+}
+
+/// append the header 'fields' ask for, for a message at 'nanos' (Clock::now).
+/// 'category' may be NULL.  returns how many chars it appended.
+inline size_t appendHeader( FormatBuffer& buf, unsigned int fields, int64_t nanos, unsigned int level, const char* category )
+{
+   size_t categoryLength = (0 != (fields & HEADER_CATEGORY) && NULL != category) ? strlen( category ) : 0;
+   char* start = buf.prepare( 64 + categoryLength );
+   if (NULL == start)
+      return 0;
+   char* out = start;
+   if (0 != (fields & HEADER_CLOCK))
+   {
+      int64_t second = nanos / 1000000000;
+      unsigned int fraction = (unsigned int)(nanos - second * 1000000000);
+      const char* text = dateTime( second, 0 != (fields & HEADER_UTC) );
+      if (0 != (fields & HEADER_DATE))
+      {
+         memcpy( out, text, 10 );
+         out += 10;
+         if (0 != (fields & HEADER_TIME))
+            *out++ = ' ';
+      }
+      if (0 != (fields & HEADER_TIME))
+      {
+         memcpy( out, text + 11, 8 );
+         out += 8;
+      }
+      // the rest of the line is the same all second, only these digits change
+      if (0 != (fields & HEADER_MICROS))
+      {
+         *out++ = '.';
+         writeDigits( out, fraction / 1000, 6 );
+         out += 6;
+      }
+      else if (0 != (fields & HEADER_MILLIS))
+      {
+         *out++ = '.';
+         writeDigits( out, fraction / 1000000, 3 );
+         out += 3;
+      }
+      *out++ = ' ';
+   }
+   if (0 != (fields & HEADER_THREAD))
+   {
+      const char* tag = threadTag();
+      memcpy( out, tag + 1, 15 ); // (room for it all, only the tag is kept)
+      out += (unsigned char)tag[0];
+   }
+   bool tagged = false;
+   unsigned int number = level & 0x1f;
+   if (0 != (fields & HEADER_LEVEL) && 0 != number && 0 == (number & (number - 1)))
+   {
+      *out++ = 'L';
+      *out++ = (char)('1' + __builtin_ctz( number ));
+      tagged = true;
+   }
+   if (0 != categoryLength)
+   {
+      if (tagged)
+         *out++ = ' ';
+      memcpy( out, category, categoryLength );
+      out += categoryLength;
+      tagged = true;
+   }
+   if (tagged)
+   {
+      *out++ = ':';
+      *out++ = ' ';
+   }
+   buf.commit( out - start );
+   return out - start;
+}
+
+
+/// the clock, the cached date and the header layout
+struct HeaderUnitTest
+{
+   static void test()
+   {
+      printf( "running header tests... [" );
+      Clock& clock = Clock::instance();
+      int64_t system = Clock::systemNow(), now = clock.now();
+      printf( "%s", now - system < 2000000 && system - now < 2000000 ? "." : "F" );
+
+      // never backwards, and still close to the system clock a while later
+      bool forward = true;
+      int64_t last = clock.now();
+      for (int x = 0; x < 100000; ++x)
+      {
+         int64_t next = clock.now();
+         forward = forward && last <= next;
+         last = next;
+      }
+      std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+      system = Clock::systemNow();
+      now = clock.now();
+      printf( "%s", forward && now - system < 2000000 && system - now < 2000000 ? "." : "F" );
+
+      // 2026-10-17 13:45:07.123456789 UTC
+      const int64_t when = 1792244707123456789ll;
+      FormatBuffer buf;
+      size_t length = appendHeader( buf, HEADER_DEFAULT | HEADER_UTC, when, 0x02 /*LEVEL2*/, "net.http" );
+      char expect[64];
+      snprintf( expect, sizeof( expect ), "2026-10-17 13:45:07.123456 [%u] L2 net.http: ", threadId() );
+      printf( "%s", length == buf.size() && 0 == strcmp( buf.c_str(), expect ) ? "." : "F" );
+
+      // the cached second isn't reused for the next one, or across midnight
+      buf.clear();
+      appendHeader( buf, HEADER_TIME | HEADER_MILLIS | HEADER_UTC, when + 1000000000, 0x01, NULL );
+      appendHeader( buf, HEADER_DATE | HEADER_TIME | HEADER_UTC, when + 37000ll * 1000000000, 0x01, NULL );
+      printf( "%s", 0 == strcmp( buf.c_str(), "13:45:08.123 2026-10-18 00:01:47 " ) ? "." : "F" );
+
+      buf.clear();
+      appendHeader( buf, HEADER_LEVEL | HEADER_CATEGORY, when, 0x10 /*LEVEL5*/, NULL );
+      appendHeader( buf, HEADER_CATEGORY, when, 0x01, "IO" );
+      appendHeader( buf, HEADER_LEVEL, when, 0xffffffff, "IO" );
+      printf( "%s", 0 == strcmp( buf.c_str(), "L5: IO: " ) ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
@@ -0,0 +1,375 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_MAPPED_FILE
+#define SPEW_MAPPED_FILE
+
+#include <fstream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// told each time a mapped file moves on to a new segment, to write what every
+/// segment has to begin with (binary mode: the header and format definitions).
+/// called from inside the write that filled the last segment.
+class SegmentStart
+{
+public:
+   virtual ~SegmentStart() {}
+   virtual void started( std::streambuf& segment ) = 0;
+};
+
+
+#ifndef WIN32
+
+/// file output through a memory mapping, in preallocated fixed size segments.
+/// writing a message is a memcpy into the mapping (no syscall, no iostream buffering),
+/// the kernel writes the pages back.  when a segment fills up it is trimmed to its
+/// used length and the files rotate like logrotate does:
+///    log.txt (newest)  log.txt.1  log.txt.2 ... log.txt.<segments - 1> (oldest)
+/// so disk use is bounded by segmentSize * segments.  opening rotates too, the
+/// previous run ends up in log.txt.1 instead of being truncated.
+/// messages are kept whole, a message only spans segments if it's bigger than one.
+/// (a segment that was never closed, e.g. after a crash, ends in zero bytes)
+class MappedFileBuf : public std::streambuf
+{
+public:
+   MappedFileBuf() : mFd( -1 ), mBase( NULL ), mSize( 0 ), mSegments( 1 ), mLater( false ), mSegmentStart( NULL ), mStarting( false ) {}
+   ~MappedFileBuf() { close(); }
+
+   /// start logging to 'name', false if the first segment couldn't be mapped
+   bool open( const char* name, size_t segmentSize, unsigned int segments )
+   {
+      openLater( name, segmentSize, segments );
+      return openNow();
+   }
+
+   /// open( ... ) on the first write (or the next openNow), until then no file is touched
+   void openLater( const char* name, size_t segmentSize, unsigned int segments )
+   {
+      close();
+      mName = name;
+      mSize = segmentSize < 4096 ? 4096 : segmentSize;
+      mSegments = segments < 1 ? 1 : segments;
+      mLater = true;
+   }
+
+   /// open what openLater named, if it isn't already.  false if it can't be.
+   bool openNow()
+   {
+      if (NULL != mBase)
+         return true;
+      if (!mLater)
+         return false;
+      mLater = false;
+      struct stat info;
+      if (0 == ::stat( mName.c_str(), &info ) && 0 < info.st_size)
+         shift();
+      return map();
+   }
+
+   /// unmap, and trim the file to what was written
+   void close()
+   {
+      mLater = false;
+      if (NULL == mBase)
+         return;
+      size_t used = pptr() - mBase;
+      ::munmap( mBase, mSize );
+      if (0 != ::ftruncate( mFd, used )) {} // nothing to do about it
+      ::close( mFd );
+      mBase = NULL;
+      mFd = -1;
+      setp( NULL, NULL );
+   }
+
+   inline bool is_open() const { return NULL != mBase; }
+
+   /// bytes written to the current segment
+   inline size_t used() const { return NULL == mBase ? 0 : pptr() - mBase; }
+
+   /// 'start' writes the beginning of every segment after the first, NULL for none
+   inline void setSegmentStart( SegmentStart* start ) { mSegmentStart = start; }
+
+protected:
+   std::streamsize xsputn( const char* data, std::streamsize length )
+   {
+      if (NULL == mBase && !openNow())
+         return 0;
+      // keep messages whole: start a new segment rather than split one
+      if (length > epptr() - pptr() && pptr() != mBase && (size_t)length <= mSize)
+         rotate();
+      std::streamsize written = 0;
+      while (written < length && NULL != mBase)
+      {
+         if (pptr() == epptr())
+            rotate();
+         if (NULL == mBase)
+            break;
+         std::streamsize chunk = epptr() - pptr();
+         if (chunk > length - written)
+            chunk = length - written;
+         memcpy( pptr(), data + written, chunk );
+         pbump( (int)chunk ); // segments are < 2GB
+         written += chunk;
+      }
+      return written;
+   }
+
+   int_type overflow( int_type c )
+   {
+      if (NULL == mBase && !openNow())
+         return traits_type::eof();
+      if (pptr() == epptr())
+         rotate();
+      if (NULL == mBase)
+         return traits_type::eof();
+      if (!traits_type::eq_int_type( c, traits_type::eof() ))
+      {
+         *pptr() = traits_type::to_char_type( c );
+         pbump( 1 );
+      }
+      return traits_type::not_eof( c );
+   }
+
+   /// nothing to flush, the text is already in the page cache
+   int sync() { return 0; }
+
+private:
+   MappedFileBuf( const MappedFileBuf& );
+   MappedFileBuf& operator=( const MappedFileBuf& );
+
+   /// name of the n'th newest segment
+   std::string segmentName( unsigned int n ) const
+   {
+      if (0 == n)
+         return mName;
+      char suffix[16];
+      snprintf( suffix, sizeof( suffix ), ".%u", n );
+      return mName + suffix;
+   }
+
+   /// age every segment by one, the oldest falls off the end
+   void shift()
+   {
+      if (1 == mSegments)
+         return; // the new segment just replaces the old one
+      for (unsigned int n = mSegments - 1; n > 0; --n)
+         ::rename( segmentName( n - 1 ).c_str(), segmentName( n ).c_str() );
+   }
+
+   /// create, preallocate and map a fresh segment at mName
+   bool map()
+   {
+      mFd = ::open( mName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+      if (mFd < 0)
+         return false;
+      // really allocate the blocks, so a full disk fails here instead of
+      // as a SIGBUS when a page of the mapping gets touched
+#ifdef __linux__
+      bool allocated = 0 == ::posix_fallocate( mFd, 0, mSize );
+#else
+      bool allocated = false;
+#endif
+      if (!allocated && 0 != ::ftruncate( mFd, mSize ))
+      {
+         ::close( mFd );
+         mFd = -1;
+         return false;
+      }
+      void* base = ::mmap( NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0 );
+      if (MAP_FAILED == base)
+      {
+         ::close( mFd );
+         mFd = -1;
+         return false;
+      }
+      mBase = (char*)base;
+      setp( mBase, mBase + mSize );
+      return true;
+   }
+
+   void rotate()
+   {
+      close();
+      shift();
+      if (!map() || NULL == mSegmentStart || mStarting)
+         return; // (a start bigger than a segment isn't started again)
+      mStarting = true;
+      mSegmentStart->started( *this );
+      mStarting = false;
+   }
+
+   int mFd;
+   char* mBase;
+   size_t mSize;
+   unsigned int mSegments;
+   std::string mName;
+   bool mLater; //< openLater named a file that isn't open yet
+   SegmentStart* mSegmentStart;
+   bool mStarting; //< inside mSegmentStart
+};
+
+/// ostream on a MappedFileBuf.
+/// usage:
+/// @code
+///    MappedFileOstream out;
+///    out.open( "log.txt", 16 * 1024 * 1024, 4 ); // at most 4 segments of 16MB
+///    Log.mOutStreams.push_back( &out );
+/// @endcode
+class MappedFileOstream : public std::ostream
+{
+public:
+   MappedFileOstream() : std::ostream( NULL ) { this->init( &mBuf ); }
+   ~MappedFileOstream() { mBuf.close(); }
+
+   inline void open( const char* name, size_t segmentSize, unsigned int segments )
+   {
+      if (mBuf.open( name, segmentSize, segments ))
+         clear();
+      else
+         setstate( std::ios_base::failbit );
+   }
+   /// name the file now, create it on the first write (see MappedFileBuf::openLater)
+   inline void openLater( const char* name, size_t segmentSize, unsigned int segments )
+   {
+      mBuf.openLater( name, segmentSize, segments );
+      clear();
+   }
+   inline bool openNow()
+   {
+      if (mBuf.openNow())
+         clear();
+      else
+         setstate( std::ios_base::failbit );
+      return good();
+   }
+   inline void close() { mBuf.close(); }
+   inline bool is_open() const { return mBuf.is_open(); }
+   /// see MappedFileBuf::setSegmentStart
+   inline void setSegmentStart( SegmentStart* start ) { mBuf.setSegmentStart( start ); }
+
+private:
+   MappedFileBuf mBuf;
+};
+
+#else
+
+/// no mapping (or rotation) on windows yet, a plain file with the same interface
+class MappedFileOstream : public std::ofstream
+{
+public:
+   inline void open( const char* name, size_t, unsigned int ) { std::ofstream::open( name ); }
+   inline void openLater( const char* name, size_t, unsigned int ) { std::ofstream::open( name ); }
+   inline bool openNow() { return is_open(); }
+   inline void setSegmentStart( SegmentStart* ) {} // one segment
+};
+
+#endif
+
+
+/// writes enough through tiny segments to rotate a few times
+struct MappedFileUnitTest
+{
+   static void test()
+   {
+#ifndef WIN32
+      printf( "running mapped file tests... [" );
+      const char* name = "spew-mapped-test.txt";
+      std::string line( 99, 'x' );
+      line += '\n';
+      {
+         MappedFileOstream out;
+         out.open( name, 4096, 3 );
+         printf( "%s", out.good() && out.is_open() ? "." : "F" );
+         for (int x = 0; x < 100; ++x)
+         {
+            out.write( line.data(), line.size() );
+            out.flush();
+         }
+         out << "last\n" << std::flush;
+      }
+
+      // 40 whole lines fit a segment (4000 bytes), 100 lines + "last" make 3
+      // segments: 2 full (trimmed to 4000) and the newest with 20 lines + "last"
+      struct stat info;
+      bool sizes = 0 == ::stat( name, &info ) && 20 * 100 + 5 == info.st_size &&
+                   0 == ::stat( (std::string( name ) + ".1").c_str(), &info ) && 4000 == info.st_size &&
+                   0 == ::stat( (std::string( name ) + ".2").c_str(), &info ) && 4000 == info.st_size &&
+                   0 != ::stat( (std::string( name ) + ".3").c_str(), &info );
+      printf( "%s", sizes ? "." : "F" );
+
+      // reopening keeps the last run as .1 (the oldest falls off)
+      {
+         MappedFileOstream out;
+         out.open( name, 4096, 3 );
+         out << "second run\n" << std::flush;
+      }
+      std::ifstream newest( name ), previous( (std::string( name ) + ".1").c_str() );
+      std::string first, last;
+      std::getline( newest, first );
+      while (std::getline( previous, line ))
+         last = line;
+      printf( "%s", "second run" == first && "last" == last ? "." : "F" );
+
+      // opening later touches nothing (no rotation) until the first write
+      {
+         MappedFileOstream out;
+         out.openLater( name, 4096, 3 );
+         std::ifstream before( name );
+         std::getline( before, line );
+         bool untouched = !out.is_open() && "second run" == line;
+         out << "third run\n" << std::flush;
+         printf( "%s", untouched && out.good() && out.is_open() ? "." : "F" );
+      }
+      std::ifstream third( name ), second( (std::string( name ) + ".1").c_str() );
+      std::getline( third, first );
+      std::getline( second, last );
+      printf( "%s", "third run" == first && "second run" == last ? "." : "F" );
+
+      for (int n = 0; n < 4; ++n)
+         ::remove( (0 == n) ? name : (std::string( name ) + "." + (char)('0' + n)).c_str() );
+      printf( "]\n" );
+#endif
+   }
+};
+
+
+} // spew namespace
+
+#endif
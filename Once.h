@@ -20,7 +20,155 @@
 
 #ifndef SPEW_ONCE_INCLUDED
 #define SPEW_ONCE_INCLUDED
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// slots in each SPEW_ONCE call site's table (runtime keys only)
+#ifndef SPEW_ONCE_SLOTS
+#  define SPEW_ONCE_SLOTS 1024
+#endif
+
+/// true when 'key' is a compile time constant (like __LINE__), decided by the
+/// compiler front end, so inlining and unrolling can't change the answer.
+#if defined(__GNUC__) || defined(__clang__)
+#  define SPEW_IS_CONSTANT( key ) __builtin_constant_p( key )
+#else
+#  define SPEW_IS_CONSTANT( key ) false
+#endif
+
+/// hash for OnceSet: std::hash when there is one, otherwise the key's bytes
+template <typename Key>
+inline size_t onceHash( const Key& key )
+{
+   uint64_t h;
+   if constexpr (requires { std::hash<Key>()( key ); })
+      h = std::hash<Key>()( key );
+   else
+   {
+      static_assert( std::is_trivially_copyable<Key>::value, "SPEW_ONCE: key needs a std::hash, or has to be plain bytes" );
+      h = 14695981039346656037ull; // fnv-1a
+      const unsigned char* bytes = (const unsigned char*)&key;
+      for (size_t x = 0; x < sizeof( Key ); ++x)
+         h = (h ^ bytes[x]) * 1099511628211ull;
+   }
+   // std::hash of an int is the int, spread it over the table
+   return (size_t)((h * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/// the set of keys a SPEW_ONCE call site has seen.
+/// open addressing, lock-free while the keys fit: a key is claimed with one
+/// compare-and-swap, and lookups of a known key are a few loads.  slots are never
+/// freed, and keys are never destroyed (the set lives as long as the program, like
+/// the call site).  a key that finds its probe window full goes to a mutex protected
+/// overflow set, and every later lookup of it takes that mutex.  a call site that
+/// sees many more than SLOTS keys wants a bigger SPEW_ONCE_SLOTS.
+/// constexpr constructible, so a function local static of this has no init guard.
+/// keys compare with operator< (equal is "neither is less").
+template <typename Key, size_t SLOTS = SPEW_ONCE_SLOTS>
+class OnceSet
+{
+public:
+   constexpr OnceSet() : mSlots(), mOverflow( NULL ) {}
+
+   /// true the first time 'key' is seen (by any thread)
+   bool insert( const Key& key )
+   {
+      const size_t probes = SLOTS < 64 ? SLOTS : 64;
+      size_t at = onceHash( key ) % SLOTS;
+      for (size_t x = 0; x < probes; ++x, at = (at + 1) % SLOTS)
+      {
+         Slot& slot = mSlots[at];
+         unsigned char state = slot.mState.load( std::memory_order_acquire );
+         if (EMPTY == state && slot.mState.compare_exchange_strong( state, WRITING, std::memory_order_acquire ))
+         {
+            new (slot.mKey) Key( key );
+            slot.mState.store( FULL, std::memory_order_release );
+            return true;
+         }
+         while (WRITING == state) // another thread is filling this slot in
+         {
+            std::this_thread::yield();
+            state = slot.mState.load( std::memory_order_acquire );
+         }
+         if (equal( *(const Key*)slot.mKey, key ))
+            return false;
+      }
+      std::lock_guard<std::mutex> lock( mOverflowMutex );
+      if (NULL == mOverflow)
+         mOverflow = new std::set<Key>; // never freed, see above
+      return mOverflow->insert( key ).second;
+   }
+
+private:
+   enum { EMPTY = 0, WRITING = 1, FULL = 2 };
+   struct Slot
+   {
+      std::atomic<unsigned char> mState;
+      alignas( Key ) unsigned char mKey[sizeof( Key )];
+   };
+   static inline bool equal( const Key& a, const Key& b ) { return !(a < b) && !(b < a); }
+
+   Slot mSlots[SLOTS];
+   std::mutex mOverflowMutex;
+   std::set<Key>* mOverflow;
+};
+
+/// true on the first call and every n'th one after, never when 'n' is 0
+inline bool everyN( std::atomic<unsigned int>& count, unsigned int n )
+{
+   return 0 != n && 0 == count.fetch_add( 1, std::memory_order_relaxed ) % n;
+}
+
+/// true the first 'n' times, then false (without touching the counter again)
+inline bool firstN( std::atomic<unsigned int>& count, unsigned int n )
+{
+   return count.load( std::memory_order_relaxed ) < n &&
+          count.fetch_add( 1, std::memory_order_relaxed ) < n;
+}
+
+/// monotonic nanoseconds, cheap rather than precise (a few ms of jitter on linux)
+inline int64_t coarseNanoseconds()
+{
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC_COARSE, &now );
+   return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+inline int64_t coarseMilliseconds() { return coarseNanoseconds() / 1000000; }
+
+/// true at most once every 'ms' milliseconds (the first time included).
+/// 'next' is when it may be true again, in coarseMilliseconds() + 1.
+inline bool everyMs( std::atomic<int64_t>& next, int64_t ms )
+{
+   int64_t now = coarseMilliseconds() + 1;
+   int64_t due = next.load( std::memory_order_relaxed );
+   return now >= due && next.compare_exchange_strong( due, now + ms, std::memory_order_relaxed );
+}
+
 
 /// Execute code once...
 ///    this calls 'call' only once from the line of code where called.
@@ -28,14 +176,17 @@
 ///     - such as line number (__LINE__)
 ///     - or custom error message details (see code example)
 /// key needs to have a compare method defined:
-///    bool operator<( MyKeyType )
+///    bool operator<( const MyKeyType& ) const
+/// and a std::hash, or be plain bytes (no pointers to compare through, no padding).
+/// thread safe.  a constant key (like __LINE__) costs one atomic flag, runtime keys
+/// go in a per call site OnceSet (lock-free up to about SPEW_ONCE_SLOTS keys).
 ///
 /// Example Usage:
 /// @code:
 ///    struct errorinfo
 ///    {
-///       inline errorinfo( int id ) : x( id ) {}
-///       inline bool operator<( const errorinfo& i ) { return mId < i.mId; }
+///       inline errorinfo( int id ) : mId( id ) {}
+///       inline bool operator<( const errorinfo& i ) const { return mId < i.mId; }
 ///       int mId;
 ///    };
 ///    SPEW_ONCE( spew::Log( "the %dth item is having a problem\n", x ), errorinfo( x ), errorinfo );
@@ -43,13 +194,132 @@
 /// @endcode
 #define SPEW_ONCE( call, key, keytype ) \
 {\
-    static std::map<keytype, bool> mOnceOnly;\
-    if (0 == mOnceOnly.count( key ))\
+    if constexpr (SPEW_IS_CONSTANT( key ))\
     {\
-        mOnceOnly[key] = true;\
-        call;\
+        static std::atomic<bool> onceDone_;\
+        if (!onceDone_.load( std::memory_order_relaxed ) && !onceDone_.exchange( true ))\
+            call;\
     }\
+    else\
+    {\
+        static SPEWNAMESPACE::OnceSet<keytype> onceSeen_;\
+        if (onceSeen_.insert( key ))\
+            call;\
+    }\
+}
+
+/// Execute code on the first hit, and every n'th hit after that (1, n+1, 2n+1...),
+/// never when n is 0
+/// @code:
+///    SPEW_EVERY_N( spew::Log( "frame %d\n", frame ), 100 );
+/// @endcode
+#define SPEW_EVERY_N( call, n ) \
+{\
+    static std::atomic<unsigned int> everyCount_;\
+    if (SPEWNAMESPACE::everyN( everyCount_, (n) ))\
+        call;\
+}
+
+/// Execute code for the first n hits only
+/// @code:
+///    SPEW_FIRST_N( spew::Log( "bad packet from %s\n", addr ), 10 );
+/// @endcode
+#define SPEW_FIRST_N( call, n ) \
+{\
+    static std::atomic<unsigned int> firstCount_;\
+    if (SPEWNAMESPACE::firstN( firstCount_, (n) ))\
+        call;\
+}
+
+/// Execute code at most once per 'ms' milliseconds
+/// @code:
+///    SPEW_EVERY_MS( spew::Log( "queue depth %d\n", depth ), 1000 );
+/// @endcode
+#define SPEW_EVERY_MS( call, ms ) \
+{\
+    static std::atomic<int64_t> everyNext_;\
+    if (SPEWNAMESPACE::everyMs( everyNext_, (ms) ))\
+        call;\
 }
 
 
+/// counts how often each macro lets its call through
+struct OnceUnitTest
+{
+   struct Key
+   {
+      int mA, mB;
+      inline bool operator<( const Key& k ) const { return mA < k.mA || (mA == k.mA && mB < k.mB); }
+   };
+
+   static void test()
+   {
+      printf( "running once tests... [" );
+      int calls = 0;
+      for (int x = 0; x < 10; ++x)
+         SPEW_ONCE( ++calls, __LINE__, int );
+      printf( "%s", 1 == calls ? "." : "F" );
+
+      calls = 0;
+      for (int x = 0; x < 100; ++x)
+         SPEW_ONCE( ++calls, x % 10, int );
+      printf( "%s", 10 == calls ? "." : "F" );
+
+      calls = 0;
+      for (int x = 0; x < 100; ++x)
+      {
+         Key key = { x % 3, x % 5 };
+         SPEW_ONCE( ++calls, key, Key );
+      }
+      printf( "%s", 15 == calls ? "." : "F" );
+
+      // more keys than slots: the rest go to the overflow set
+      OnceSet<int, 16> small;
+      calls = 0;
+      for (int pass = 0; pass < 2; ++pass)
+         for (int x = 0; x < 100; ++x)
+            calls += small.insert( x ) ? 1 : 0;
+      printf( "%s", 100 == calls ? "." : "F" );
+
+      // threads racing on the same keys: each key still gets one call
+      std::atomic<int> raced( 0 );
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 8; ++t)
+         threads.push_back( std::thread( [&raced]()
+         {
+            for (int x = 0; x < 2000; ++x)
+               SPEW_ONCE( ++raced, x, int );
+         } ) );
+      for (size_t t = 0; t < threads.size(); ++t)
+         threads[t].join();
+      printf( "%s", 2000 == raced ? "." : "F" );
+
+      calls = 0;
+      for (int x = 0; x < 100; ++x)
+         SPEW_EVERY_N( ++calls, 10 );
+      printf( "%s", 10 == calls ? "." : "F" );
+
+      calls = 0;
+      unsigned int never = 0;
+      for (int x = 0; x < 100; ++x)
+         SPEW_EVERY_N( ++calls, never );
+      printf( "%s", 0 == calls ? "." : "F" );
+
+      calls = 0;
+      for (int x = 0; x < 100; ++x)
+         SPEW_FIRST_N( ++calls, 7 );
+      printf( "%s", 7 == calls ? "." : "F" );
+
+      calls = 0;
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds( 55 );
+      while (std::chrono::steady_clock::now() < end)
+         SPEW_EVERY_MS( ++calls, 20 );
+      printf( "%s", 2 <= calls && calls <= 3 ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
 #endif // SPEW_ONCE_INCLUDED
@@ -48,9 +48,8 @@ template<class CharT, typename Output, class TraitsT = std::char_traits<CharT> >
 class OstreamTemplate : public std::basic_ostream<CharT, TraitsT>
 {
 public:
-    OstreamTemplate() : std::basic_ostream<CharT, TraitsT>( mStringBuf = new StringbufTemplate<CharT, Output, TraitsT>() ), out( mStringBuf->out ) {}
+    OstreamTemplate() : std::basic_ostream<CharT, TraitsT>( NULL ), mStringBuf( new StringbufTemplate<CharT, Output, TraitsT>() ), out( mStringBuf->out ) { this->init( mStringBuf ); }
     ~OstreamTemplate() { delete std::basic_ostream<CharT, TraitsT>::rdbuf(); }
-    Output& out; //< outputter is accessable...
 private:
     template <class CharT_, typename Output_, class TraitsT_ = std::char_traits<CharT> >
     class StringbufTemplate : public std::basic_stringbuf<CharT_, TraitsT_>
@@ -62,12 +61,14 @@ private:
         int sync()
         {
             output_debug_string( std::basic_stringbuf<CharT_, TraitsT_>::str().c_str() );
-            str( std::basic_string<CharT_>() );    // Clear the string buffer
+            this->str( std::basic_string<CharT_>() );    // Clear the string buffer
             return 0;
         }
         void output_debug_string(const CharT_ *text) { out.printf( text ); }
     };
     StringbufTemplate<CharT, Output, TraitsT>* mStringBuf;
+public:
+    Output& out; //< outputter is accessable...
 };
 
 
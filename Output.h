@@ -22,15 +22,40 @@
 #define OUTPUT_SYSTEM
 
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <new> // placement new, std::launder
+#include <mutex>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
 #include <stdarg.h> // varargs
 #include <assert.h>
 #include <cstdio> // vsnprinf
+#include <cstring> // strlen
+#ifndef WIN32
+#  include <strings.h> // strncasecmp
+#endif
 #include "OstreamTemplate.h"
 #  include "OutputDebugStringOstream.h" //< compiler trace window output
 #include "the.h" //< singleton generator
+#include "AsyncOutput.h" //< background writer
+#include "FormatBuffer.h" //< per thread message buffer
+#include "BinaryLog.h" //< deferred formatting
+#include "Format.h" //< compile time checked printf
+#include "MappedFile.h" //< Log's file
+#include "FlushPolicy.h" //< when streams get flushed
+#include "FdOstream.h" //< coalescing file descriptor stream
+#include "Sink.h" //< lightweight outputs
+#include "RateLimit.h" //< flood suppression
+#include "Category.h" //< runtime categories
+#include "Structured.h" //< key/value messages
+#include "Header.h" //< timestamp, thread, level prefixes
+#include "Stats.h" //< counters and latency histograms
+#include "Backtrace.h" //< messages held back until an error
+#include "Utf8.h" //< wide text
+#include "SharedRing.h" //< multi process collection
+#include <bit> // countr_zero
 
 #ifdef ERROR // wingdi.h has this :(
 #undef ERROR
@@ -101,7 +126,7 @@ enum Level
 struct TagDescription
 {
    const char* mName;
-   int mTag;
+   unsigned int mTag;
 };
 const TagDescription gTagDescriptions[] = 
 {
@@ -130,38 +155,189 @@ const TagDescription gTagDescriptions[] =
    { "", 0 } // keep this last...
 };
 
+/// name of a single bit filter ("IO"), NULL for anything else
+inline const char* filterName( unsigned int filter )
+{
+   for (int x = 0; '\0' != gTagDescriptions[x].mName[0]; ++x)
+      if (gTagDescriptions[x].mTag == filter && 0 != filter && 0 == (filter & (filter - 1)))
+         return gTagDescriptions[x].mName;
+   return NULL;
+}
+
+/// marks a structured record (encodeStructured) on its way through the write path,
+/// in the level word above the Level bits
+const unsigned int STRUCTURED_RECORD = 0x80000000;
+/// the length of a message's header (SetHeader) rides along in the level word too,
+/// so the write stage can tell the header from the message (repeats, json and tlv streams)
+const unsigned int HEADER_LENGTH_SHIFT = 8;
+const unsigned int HEADER_LENGTH_BITS = 0x7fffff00;
+/// a message the tap (SetTap) wants, and one nothing but the tap wants: set by the filter
+/// test, just above the Level bits, and gone from the level word after emitRecord
+const unsigned int TAP_MESSAGE = 0x00000020;
+const unsigned int TAP_ONLY = 0x00000040;
+
 /// converter between integers and LevelType
 struct Level_
 {
-   inline Level_( const int number )
+   constexpr Level_( const int number ) : mType( LEVEL1 )
    {
-      assert( 1 <= number && number <= _LEVELHIGHEST && "error: level exceeded" );
+      assert( 1 <= number && number <= (int)_LEVELHIGHEST && "error: level exceeded" );
       const Level lt[] = { LEVEL1, LEVEL2, LEVEL3, LEVEL4, LEVEL5 };
       mType = lt[number-1];
    }
-   inline Level_( const Level level ) { mType = level; }
-   inline operator const Level() const { return mType; }
+   constexpr Level_( const Level level ) : mType( level ) {}
+   constexpr operator const Level() const { return mType; }
    Level mType;
 };
 /// converter between integers and LevelType
 struct LevelSelect_
 {
-   inline LevelSelect_( const int number )
+   constexpr LevelSelect_( const int number ) : mType( LEVEL1 )
    {
-      assert( 1 <= number && number <= _LEVELHIGHEST && "error: level exceeded" );
+      assert( 1 <= number && number <= (int)_LEVELHIGHEST && "error: level exceeded" );
       const Level lt[] = { LEVEL1ANDLOWER, LEVEL2ANDLOWER, LEVEL3ANDLOWER, LEVEL4ANDLOWER, LEVEL5ANDLOWER };
       mType = lt[number-1];
    }
-   inline LevelSelect_( const Level level ) { mType = level; }
-   inline operator const Level() const { return mType; }
+   constexpr LevelSelect_( const Level level ) : mType( level ) {}
+   constexpr operator const Level() const { return mType; }
    Level mType;
 };
 
+/// build time stripping, for every output (Log, StdOut, StdErr, and your own OutputBase types).
+/// a call more verbose than SPEW_COMPILE_MIN_LEVEL, or whose Filter isn't in SPEW_COMPILE_FILTER,
+/// is compiled out: no runtime setting turns it back on, and with constant arguments the
+/// compiler drops it.  SPEW_IF, SPEW_PRINTF and friends don't evaluate its arguments either.
+/// #define these before including spew to change them, e.g. -DSPEW_COMPILE_MIN_LEVEL=2
+#ifndef SPEW_COMPILE_MIN_LEVEL
+#  define SPEW_COMPILE_MIN_LEVEL 5 //< the most verbose level kept, 5 keeps everything
+#endif
+#ifndef SPEW_COMPILE_FILTER
+#  define SPEW_COMPILE_FILTER 0xffffffff //< the Filter bits kept, e.g. (0xffffffff & ~spew::GFX)
+#endif
+static_assert( 0 <= SPEW_COMPILE_MIN_LEVEL && SPEW_COMPILE_MIN_LEVEL <= _LEVELHIGHEST, "SPEW_COMPILE_MIN_LEVEL is 0 (nothing) to 5" );
+
+/// is a message with this filter and level compiled in?  (see SPEW_COMPILE_MIN_LEVEL)
+constexpr bool compiledIn( unsigned int filter, Level_ level )
+{
+   return 0 != (level.mType & ((1u << SPEW_COMPILE_MIN_LEVEL) - 1)) &&
+          0 != (filter & (unsigned int)(SPEW_COMPILE_FILTER));
+}
+/// categories past the Filter bits have no bit in SPEW_COMPILE_FILTER, only their level counts
+constexpr bool compiledIn( const Category& category, Level_ level )
+{
+   return compiledIn( category.mId < CategoryRegistry::FILTER_IDS ? 1u << category.mId : FILTERALL, level );
+}
+
+
+/// the category registry, the single bit Filter names above are its first entries
+/// (see Category.h)
+inline CategoryRegistry& categoryRegistry()
+{
+   static CategoryRegistry registry( gTagDescriptions );
+   return registry;
+}
+
+/// bumped whenever any output's filter or level changes.
+/// call sites compare against this to know when their cached enable bit is stale.
+/// (see CallSite, SPEW_IF, SPEW_PRINTF below)
+/// (bumped after the new settings are published, see CallSite::current)
+inline std::atomic<unsigned int> gFilterGeneration( 1 );
+inline void bumpFilterGeneration()
+{
+   // keep generation 0 reserved for "never checked" (a zeroed CallSite)
+   if (0 == ((gFilterGeneration.fetch_add( 1, std::memory_order_release ) + 1) & 0x7fffffff))
+      gFilterGeneration.fetch_add( 1, std::memory_order_release );
+}
+
+/// an EnableCategory call: the categories under mPrefix go on or off
+struct CategoryRule
+{
+   std::string mPrefix;
+   bool mOn;
+};
+
+/// everything that decides what an output lets through, as a plain value.
+/// changes are made to a copy and published all at once (OutputBase::SetSettings),
+/// so a reader sees the old settings or the new ones, never half of each.
+/// usage:
+/// @code
+///   OutputSettings settings;
+///   Log.GetSettings( settings, true ); // start from the defaults
+///   settings.SetFilter( IO | ERROR );
+///   settings.SetLevel( LEVEL3ANDLOWER );
+///   Log.SetSettings( settings );
+/// @endcode
+struct OutputSettings
+{
+   OutputSettings() : mFilter( FILTERDEFAULT ), mLevel( _LEVELDEFAULT ), mCategoryDefault( true ) {}
+
+   /// same as the OutputBase calls of the same names
+   inline void SetFilter( unsigned int filter ) { mFilter = filter; allCategories( FILTERALL == filter ); }
+   inline void AddFilter( unsigned int filter )
+   {
+      mFilter |= filter;
+      if (FILTERALL == filter)
+         allCategories( true );
+   }
+   inline void RemoveFilter( unsigned int filter )
+   {
+      mFilter &= ~filter;
+      if (FILTERALL == filter)
+         allCategories( false );
+   }
+   inline void SetLevel( unsigned int level ) { mLevel = level; }
+   void EnableCategory( const char* prefix, bool on )
+   {
+      CategoryRule rule = { prefix, on };
+      mCategoryRules.push_back( rule );
+      for (unsigned int id = 0; id < CategoryRegistry::FILTER_IDS; ++id)
+      {
+         std::string name = categoryRegistry().name( id );
+         if (!name.empty() && categoryUnder( name.c_str(), prefix ))
+            mFilter = on ? (mFilter | (1u << id)) : (mFilter & ~(1u << id));
+      }
+   }
+
+   unsigned int mFilter, mLevel;
+   bool mCategoryDefault;                    //< runtime categories no rule covers
+   std::vector<CategoryRule> mCategoryRules; //< EnableCategory calls since the last SetFilter
+
+private:
+   inline void allCategories( bool on )
+   {
+      mCategoryRules.clear();
+      mCategoryDefault = on;
+   }
+};
+
+/// Log, Trace, StdOut and StdErr live in StaticStorage, built and shut down by the
+/// library's Lifetime (below), not on first use.  any other output type is built on first use.
+struct InitLog;
+struct InitTrace;
+struct InitStdOut;
+struct InitStdErr;
+template <typename OUTPUTBASE_INIT> struct BuiltinOutput { enum { value = 0 }; };
+template <> struct BuiltinOutput<InitLog> { enum { value = 1 }; };
+#ifdef _DEBUG
+template <> struct BuiltinOutput<InitTrace> { enum { value = 1 }; }; // (Trace is compiled out in release)
+#endif
+template <> struct BuiltinOutput<InitStdOut> { enum { value = 1 }; };
+template <> struct BuiltinOutput<InitStdErr> { enum { value = 1 }; };
+
+/// room for one T at a constant address, zeroed before any code runs (constant initialized),
+/// so reaching it needs no static-init guard.  whoever owns it constructs T in place.
+template <typename T>
+struct StaticStorage
+{
+   static inline T& get() { return *std::launder( reinterpret_cast<T*>( mBytes ) ); }
+   alignas( T ) static inline unsigned char mBytes[sizeof( T )];
+};
 
 /// output base type
 /// all text output goes through this for logging, trace messages, command line output, etc...
 /// see output types (under '@see' below) for examples of how to extend.
 /// catagory filters are available.
+/// thread safe: each thread formats into its own buffer and has its own stream state.
 ///
 /// for usage:
 ///  - ignore this class
@@ -181,7 +357,6 @@ class OutputBase
    /// some compile-time constants to query if we're in debug mode...
    enum
    {
-      MAX_BUF_SIZE = 256,
 #ifdef _DEBUG
       IN_DEBUG_MODE = 1
 #else
@@ -191,12 +366,321 @@ class OutputBase
 
 public:
    /// constructor
-   OutputBase()
+   OutputBase() : mFilterLevel( 0 ), mOutLevel( 0 ), mRecordLevel( 0 ), mRecorder( NULL ), mOwnFilterLevel( 0 ), mTapFilterLevel( 0 ), mTap( NULL ), mTapWriters(), mTapEpoch( 0 ), mTapOn( false ), mBacktraceLevel( 0 ), mHeldLevel( 0 ), mBacktraceTrigger( ERROR ), mBacktraceSize( 0 ), mBacktraceGeneration( 0 ), mLimitedFilters( 0 ), mLimitSites( NULL ), mFlushTimerStop( false ), mRepeatMilliseconds( 0 ), mRepeats( 0 ), mLastLength( 0 ), mLastHash( 0 ), mEncodingMask( 1u << ENCODE_TEXT ), mHeader( HEADER_NONE ), mBinary( false ), mWritingFormat( NO_FORMAT ), mAsync( NULL ), mAsyncCallers( 0 ), mAsyncDropped( 0 ), mSlot( nextOutputSlot() ), mStatsOn( false ), mStatsHome( std::make_shared<StatsHome>() ), mCoalesced( 0 )
    {
-      mStreamOut.out.mParent = this;
-      mGlobalFilter = FILTERDEFAULT;
-      mGlobalLevel = _LEVELDEFAULT;
+      mSegmentStart.mParent = this;
+      mRecorderNotes.mParent = this;
+      SetSettings( OutputSettings() );
       mOutputBaseInit.init( *this );
+      GetSettings( mDefaults );
+   }
+
+   /// destructor, drains the async writer (if any)
+   ~OutputBase()
+   {
+      Shutdown();
+      // this thread's streams may still point at us
+      if (ThreadStream::alive() && threadStream().out.mParent == this)
+         threadStream().out.mParent = NULL;
+      if (WideThreadStream::alive() && threadWideStream().out.mParent == this)
+         threadWideStream().out.mParent = NULL;
+   }
+
+   /// open what the output writes to now, rather than on the first message
+   /// (Log's file, see InitLog).  spew::init() does this for the built in outputs.
+   void Open()
+   {
+      if (!(INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE))
+         return; // (Log in release writes nothing, so makes no file)
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      if constexpr (requires { mOutputBaseInit.open( *this ); })
+         mOutputBaseInit.open( *this );
+   }
+
+   /// stop the background work (async writer, flush timer, stats file), write out
+   /// what's pending and flush, and close what Open opened.  the output stays usable,
+   /// later messages are written synchronously (to what's still open).
+   /// spew::shutdown() does this for the built in outputs.
+   void Shutdown()
+   {
+      // this thread's streams may hold a partial message
+      if (ThreadStream::alive() && threadStream().out.mParent == this)
+         threadStream().flush();
+      if (WideThreadStream::alive() && threadWideStream().out.mParent == this)
+         threadWideStream().flush();
+      reportSuppressed( true );
+      mStatsFile.Stop();
+      StopFlushTimer();
+      StopAsync();
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      endRepeats( false );
+      for (size_t x = 0; x < mFlush.size(); ++x)
+         if (0 != mFlush[x].mPending)
+            mFlush[x].flush();
+      for (size_t x = 0; x < mOutStreams.size(); ++x)
+         mOutStreams[x]->flush();
+      for (size_t x = 0; x < mSinks.size(); ++x)
+         mSinks[x]->flush();
+      if constexpr (requires { mOutputBaseInit.close( *this ); })
+         mOutputBaseInit.close( *this );
+   }
+
+   /// write to the output streams from a background thread.
+   /// callers only copy the finished text into a lock-free ring and return,
+   /// a writer thread drains the ring to mOutStreams and flushes once per batch.
+   /// don't change mOutStreams while async is running.
+   /// usage:
+   /// @code
+   ///   Log.StartAsync( 8192, OVERFLOW_DROP_COUNT );
+   ///   ...
+   ///   Log.StopAsync( 500 ); // drain for at most 500ms
+   /// @endcode
+   void StartAsync( size_t capacity = 8192, OverflowPolicy policy = OVERFLOW_BLOCK )
+   {
+      StopAsync();
+      AsyncAdaptor adaptor;
+      adaptor.mParent = this;
+      adaptor.mLocked = false;
+      mAsyncWriter.reset( new AsyncWriter<AsyncAdaptor>( adaptor, capacity, policy ) );
+      mAsync.store( mAsyncWriter.get(), std::memory_order_release );
+   }
+
+   /// back to synchronous writes.  drains what's queued, waiting at most 'milliseconds'.
+   /// returns false if the drain timed out and messages were lost.
+   bool StopAsync( unsigned int milliseconds = 1000 )
+   {
+      AsyncWriter<AsyncAdaptor>* async = mAsync.exchange( NULL );
+      if (NULL == async)
+         return true;
+      // a caller that loaded the writer just before the exchange is still pushing to it
+      // (see emitNow), once they're done nothing else can reach it, and it goes
+      while (0 != mAsyncCallers.load())
+         std::this_thread::yield();
+      bool drained = async->stop( milliseconds );
+      mAsyncDropped = async->dropped();
+      mAsyncWriter.reset();
+      return drained;
+   }
+
+   /// number of messages lost because the async ring was full (OVERFLOW_DROP_COUNT only),
+   /// by the running writer, or the last one after StopAsync
+   inline size_t GetDropped() const { return mAsyncWriter.get() ? mAsyncWriter->dropped() : mAsyncDropped; }
+
+   /// binary mode: printf style calls record a format string id plus their raw
+   /// argument bytes instead of formatting (see BinaryLog.h), run spew-decode on
+   /// the output to get the text back.  set this before logging, it writes a header.
+   /// set it after mOutStreams: each segment of a MappedFileOstream there starts with
+   /// the header again and its own definitions, so every segment decodes on its own.
+   /// usage:
+   /// @code
+   ///   Log.SetBinary( true );
+   ///   Log( GFX, 2, "frame %d took %f ms\n", frame, ms ); // ~a memcpy
+   ///   ...
+   ///   > spew-decode log.txt
+   /// @endcode
+   void SetBinary( bool binary )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mWriteMutex );
+         endRepeats( false );
+         mDefined.clear();
+         mLastLength = 0;
+         for (size_t x = 0; x < mOutStreams.size(); ++x)
+         {
+            MappedFileOstream* mapped = dynamic_cast<MappedFileOstream*>( mOutStreams[x] );
+            if (NULL != mapped)
+               mapped->setSegmentStart( binary ? &mSegmentStart : NULL );
+         }
+      }
+      mBinary.store( binary, std::memory_order_relaxed );
+      if (binary)
+         emitRecord( FILTERALL, LEVEL1, gBinaryHeader, sizeof( gBinaryHeader ) - 1 );
+   }
+
+   /// how often a stream in mOutStreams is flushed.  the default is after every
+   /// message, a policy can batch text up (by size and/or age) and still flush
+   /// important messages right away.  with a buffering stream (FdOstream, ofstream)
+   /// that turns one write(2) per message into one per batch.
+   /// usage:
+   /// @code
+   ///   FdOstream file;
+   ///   file.open( "server.log" );
+   ///   Log.mOutStreams.push_back( &file );
+   ///   Log.SetFlushPolicy( &file, FlushPolicy::EveryBytes( 65536 ).Every( 100 ).Urgent( ERROR ) );
+   /// @endcode
+   void SetFlushPolicy( std::ostream* stream, const FlushPolicy& policy ) { setFlushPolicy( stream, NULL, policy ); }
+   /// same for a sink in mSinks
+   void SetFlushPolicy( Sink* sink, const FlushPolicy& policy ) { setFlushPolicy( NULL, sink, policy ); }
+
+   /// how a stream in mOutStreams gets its messages: ENCODE_TEXT (the default),
+   /// ENCODE_JSON lines or ENCODE_TLV binary records.  structured messages are encoded
+   /// once for each encoding in use, plain ones are wrapped ({"level":1,"msg":"text"}).
+   /// set this after adding the stream (a structured message or two may come out in
+   /// another encoding until the output notices a new stream).
+   /// binary mode (SetBinary) overrides this, everything is binary then.
+   /// usage:
+   /// @code
+   ///   Log.SetEncoding( &jsonFile, ENCODE_JSON );
+   /// @endcode
+   void SetEncoding( std::ostream* stream, Encoding encoding ) { setEncoding( stream, NULL, encoding ); }
+   /// same for a sink in mSinks
+   void SetEncoding( Sink* sink, Encoding encoding ) { setEncoding( NULL, sink, encoding ); }
+
+   /// start every message with a header: any of HEADER_DATE, HEADER_TIME, HEADER_MICROS,
+   /// HEADER_THREAD, HEADER_LEVEL, HEADER_CATEGORY, ... (see Header.h).  it's written into
+   /// the message buffer just before the message, the clock is the TSC where it can be, and
+   /// the date and time are rendered once a second per thread.  HEADER_NONE (the default)
+   /// turns it off.  json and tlv streams get the message without it, they have their own
+   /// fields, and so do binary mode and structured messages.
+   /// usage:
+   /// @code
+   ///   Log.SetHeader( HEADER_DEFAULT );
+   ///   Log( IO, 2, "opened %s\n", path ); // 2026-10-17 13:45:07.123456 [4242] L2 IO: opened /tmp/x
+   /// @endcode
+   void SetHeader( unsigned int fields )
+   {
+      if (0 != (fields & HEADER_CLOCK))
+         Clock::instance(); // calibrate now, not in the first message
+      mHeader.store( fields, std::memory_order_relaxed );
+   }
+   inline unsigned int GetHeader() const { return mHeader.load( std::memory_order_relaxed ); }
+
+   /// count what this output does (see Stats.h): messages emitted, filtered out, suppressed
+   /// by rate limits, dropped by a full async ring, coalesced repeats, bytes and writes per
+   /// stream and sink, and histograms of the ns spent in a log call and in each stream's
+   /// write.  each thread counts into a block of its own, with plain stores, so nothing is
+   /// shared between loggers (the write stage counts under the lock it already holds).
+   /// off by default, when off it's one relaxed load per call.
+   /// the log call time is from the filter test through the write (or the push to the
+   /// async ring), for ostream style calls it's from the flush of the text.
+   /// calls filtered out at SPEW_IF/SPEW_PRINTF call sites don't get this far, so aren't counted.
+   /// usage:
+   /// @code
+   ///   Log.SetStats( true );
+   ///   OutputStats stats;
+   ///   Log.GetStats( stats );
+   ///   printf( "p99 %llu ns\n", (unsigned long long)stats.mCall.percentile( 0.99 ) );
+   /// @endcode
+   void SetStats( bool on )
+   {
+      if (on)
+         Clock::instance(); // calibrate now, not in the first message
+      mStatsOn.store( on, std::memory_order_relaxed );
+   }
+
+   /// the counts so far, over all threads (counts stay when SetStats( false ))
+   void GetStats( OutputStats& stats )
+   {
+      stats = OutputStats();
+      {
+         std::lock_guard<std::mutex> lock( mStatsHome->mMutex );
+         stats.add( mStatsHome->mRetired );
+         for (size_t x = 0; x < mStatsHome->mLive.size(); ++x)
+            stats.add( *mStatsHome->mLive[x] );
+      }
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      stats.mCoalesced = mCoalesced;
+      stats.mSinks = mSinkStats;
+   }
+
+   /// write the counts (as OutputStats::print does) to a file every 'milliseconds',
+   /// from a thread of its own.  turns the counting on.  0 milliseconds stops it.
+   /// usage:
+   /// @code
+   ///   Log.DumpStats( "/tmp/myapp.stats", 10000 );
+   /// @endcode
+   void DumpStats( const char* path, unsigned int milliseconds )
+   {
+      if (NULL == path || 0 == milliseconds)
+         return mStatsFile.Stop();
+      SetStats( true );
+      mStatsFile.Start( path, milliseconds, [this]( std::string& text )
+      {
+         OutputStats stats;
+         GetStats( stats );
+         stats.print( text );
+      } );
+   }
+
+   /// coalesce repeats: a message that is the same as the one before it is held back
+   /// and counted, the run ends with one "last message repeated N times" line (when a
+   /// different message comes, or 'milliseconds' after the run started).  0 turns it off.
+   /// every message gets hashed, about a nanosecond per 8 bytes.
+   /// usage:
+   /// @code
+   ///   Log.SetRepeatCoalescing( 1000 );
+   /// @endcode
+   void SetRepeatCoalescing( unsigned int milliseconds )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mWriteMutex );
+         endRepeats( false );
+         mRepeatMilliseconds = milliseconds;
+         mLastLength = 0;
+      }
+      if (0 != milliseconds)
+         StartFlushTimer();
+   }
+
+   /// flood suppression per filter category.  messages with any of these filters get
+   /// 'perSecond' a second through (in bursts of up to 'burst'), the rest are dropped
+   /// for about what a filtered out message costs.  the next message let through is
+   /// preceded by "suppressed N <filter> messages", or if the flood just stops, the flush
+   /// timer writes that once the bucket has filled up again.  perSecond 0 removes the limit.
+   /// FILTERALL/FILTERDEFAULT messages aren't limited, use SPEW_IF_LIMITED for those.
+   /// usage:
+   /// @code
+   ///   Log.SetRateLimit( ERROR | IO, 100, 20 );
+   /// @endcode
+   void SetRateLimit( unsigned int filter, unsigned int perSecond, unsigned int burst = 1 )
+   {
+      for (unsigned int bit = 0; bit < 32; ++bit)
+      {
+         if (0 == (filter & (1u << bit)))
+            continue;
+         mLimitInterval[bit].store( RateLimit::interval( perSecond ), std::memory_order_relaxed );
+         mLimitTolerance[bit].store( RateLimit::tolerance( perSecond, burst ), std::memory_order_relaxed );
+      }
+      // the mask last: a caller that sees the bit sees its interval and tolerance
+      if (0 == perSecond)
+         mLimitedFilters.fetch_and( ~filter, std::memory_order_release );
+      else
+      {
+         mLimitedFilters.fetch_or( filter, std::memory_order_release );
+         StartFlushTimer();
+      }
+   }
+
+   /// (SPEW_LIMIT_OK) a call site's first suppression: it's listed, so the flush timer
+   /// (and Shutdown) write its summary when its flood is over
+   void Flooded( LimitedSite& site, Filter filter, Level_ level )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mLimitSitesMutex );
+         if (site.mListed.load( std::memory_order_relaxed ))
+            return;
+         site.mFilter = filter;
+         site.mLevel = level.mType;
+         site.mNext = mLimitSites.load( std::memory_order_relaxed );
+         mLimitSites.store( &site, std::memory_order_relaxed );
+         site.mListed.store( true, std::memory_order_relaxed );
+      }
+      StartFlushTimer();
+   }
+
+   /// the summary after a flood at a SPEW_IF_LIMITED or SPEW_PRINTF_LIMITED call site
+   void Suppressed( Filter filter, Level_ level, unsigned int count, const char* file, int line )
+   {
+      char text[256];
+      int length = snprintf( text, sizeof( text ), "suppressed %u messages from %s:%d\n", count, file, line );
+      ThreadStats* stats = threadStats();
+      if (NULL != stats)
+      {
+         stats->mSuppressed.add( count );
+         if (length >= (int)sizeof( text ))
+            stats->mTruncated.add();
+      }
+      emit( filter, level, text, length < (int)sizeof( text ) ? length : sizeof( text ) - 1 );
    }
 
    /// set the logging filter.
@@ -207,9 +691,23 @@ public:
    ///   #define StdOut OutputBase<StdOutInit>::instance()
    ///   StdOut.SetFilter( GFX );
    /// @endcode
-   inline void SetFilter( int filter ) { mGlobalFilter = filter; }
-   inline void AddFilter( int filter ) { mGlobalFilter |= filter; }
-   inline void RemoveFilter( int filter ) { mGlobalFilter &= ~filter; }
+   /// FILTERALL/FILTERNONE here also turn every runtime category on/off,
+   /// other filters leave them off (see EnableCategory).
+   inline void SetFilter( int filter ) { update( [=]( OutputSettings& s ) { s.SetFilter( filter ); } ); }
+   inline void AddFilter( int filter ) { update( [=]( OutputSettings& s ) { s.AddFilter( filter ); } ); }
+   inline void RemoveFilter( int filter ) { update( [=]( OutputSettings& s ) { s.RemoveFilter( filter ); } ); }
+
+   /// turn a category and everything under it on or off: "net.http" covers
+   /// "net.http" and "net.http.client" (registered now or later), not "net.https".
+   /// the predefined ones work too ("GFX" is the GFX filter).
+   /// later calls win over earlier ones, SetFilter starts over.
+   /// usage:
+   /// @code
+   ///   Log.SetFilter( FILTERNONE );
+   ///   Log.EnableCategory( "net", true );
+   ///   Log.EnableCategory( "net.http.client", false ); // all of net but that
+   /// @endcode
+   void EnableCategory( const char* prefix, bool on ) { update( [=]( OutputSettings& s ) { s.EnableCategory( prefix, on ); } ); }
 
    /// reset to default filter and default level...
    inline void SetDefaults() { mOutputBaseInit.reset( *this ); }
@@ -221,24 +719,163 @@ public:
    ///   #define StdOut OutputBase<StdOutInit>::instance()
    ///   StdOut.SetLevel( LEVEL4ANDLOWER );
    /// @endcode
-   inline void SetLevel( LevelSelect_ level ) { mGlobalLevel = level; }
+   inline void SetLevel( LevelSelect_ level ) { update( [=]( OutputSettings& s ) { s.SetLevel( level ); } ); }
+
+   inline unsigned int GetFilter() const { return (unsigned int)mOwnFilterLevel.load( std::memory_order_acquire ); }
+   inline unsigned int GetLevel() const { return mOutLevel.load( std::memory_order_acquire ); }
+
+   /// a sink that gets more than the streams and sinks do (a FlightRecorder, see FlightRecorder.h):
+   /// messages at any of 'levels' (in the filters and categories that are on) go to it, only
+   /// the ones at the output's own level (SetLevel) go on to mOutStreams and mSinks too.
+   /// it gets text (structured messages in ENCODE_TEXT).  NULL removes it.
+   /// usage:
+   /// @code
+   ///   Log.SetLevel( LEVEL2ANDLOWER );
+   ///   Log.SetRecorder( &recorder, LEVEL5ANDLOWER ); // LEVEL3-5 only to the recorder
+   /// @endcode
+   void SetRecorder( Sink* recorder, LevelSelect_ levels = LEVELALL )
+   {
+      // the wider levels are published after the recorder is there, and before it goes
+      if (NULL != recorder)
+         setRecorder( recorder );
+      {
+         std::lock_guard<std::mutex> lock( mSettingsMutex );
+         mRecordLevel = NULL != recorder ? (unsigned int)levels.mType : 0;
+         OutputSettings settings;
+         getSettingsLocked( settings );
+         publish( settings );
+      }
+      if (NULL == recorder)
+         setRecorder( NULL );
+   }
+
+   /// a sink that writes straight to the recorder (SetRecorder), in turn with the messages
+   /// the output writes to it: for notes of your own (FlightRecorderAssert's assertion text).
+   /// dropped while there's no recorder.  not for use from inside a stream's or sink's write.
+   inline Sink& RecorderNotes() { return mRecorderNotes; }
+
+   /// a tap: a sink that gets what 'subscription' (its filter, level and EnableCategory
+   /// rules) lets through, on top of the output's own settings, for as long as it's set.
+   /// mOutStreams, mSinks and the recorder still get only what the output's own settings
+   /// let through.  with no tap the subscription costs nothing, verbose calls fail the
+   /// filter test as before.  the tap gets finished text on the logging thread (before the
+   /// async writer), so its write has to be thread safe and quick, TailServer's queues it.
+   /// text mode only.  NULL removes it: when SetTap returns, no thread is writing to the
+   /// old tap any more, so it can be destroyed.
+   /// usage:
+   /// @code
+   ///   OutputSettings subscription;
+   ///   subscription.SetFilter( FILTERNONE );
+   ///   subscription.EnableCategory( "net", true );
+   ///   subscription.SetLevel( LEVEL5ANDLOWER );
+   ///   Log.SetTap( &tap, subscription ); // all of net.* to the tap, log.txt unchanged
+   /// @endcode
+   /// @see TailServer
+   void SetTap( Sink* tap, const OutputSettings& subscription = OutputSettings() )
+   {
+      // like SetRecorder: the wider settings are published after the tap is there, and before it goes
+      if (NULL != tap)
+         setTap( tap );
+      {
+         std::lock_guard<std::mutex> lock( mSettingsMutex );
+         mTapOn = NULL != tap;
+         mTapSettings = subscription;
+         OutputSettings settings;
+         getSettingsLocked( settings );
+         publish( settings );
+      }
+      if (NULL == tap)
+         setTap( NULL );
+   }
+
+   /// backtrace buffering: messages at 'levels' that the output's own level (SetLevel)
+   /// doesn't let through aren't written, each thread keeps its last 'messages' of them in
+   /// a ring.  when a 'trigger' message (a filter, ERROR by default) comes on that thread,
+   /// they're written out first, oldest first.  otherwise they're just written over.
+   /// holding one costs its formatting and a copy, no lock and no I/O.
+   /// 0 messages turns it off (what's held is dropped).
+   /// usage:
+   /// @code
+   ///   Log.SetLevel( LEVEL2ANDLOWER );
+   ///   Log.SetBacktrace( LEVEL5ANDLOWER, 64 );   // LEVEL3-5 held, the last 64 come out before an error
+   ///   Log( IO, 4, "parsed header %s\n", name );  // held
+   ///   Log( ERROR, 1, "bad request\n" );         // the held ones, then this
+   /// @endcode
+   void SetBacktrace( unsigned int levels, unsigned int messages, unsigned int trigger = ERROR )
+   {
+      std::lock_guard<std::mutex> lock( mSettingsMutex );
+      mBacktraceSize.store( messages, std::memory_order_relaxed );
+      mBacktraceTrigger.store( trigger, std::memory_order_relaxed );
+      mBacktraceGeneration.fetch_add( 1, std::memory_order_relaxed );
+      mBacktraceLevel = 0 == messages ? 0 : levels & ~(STRUCTURED_RECORD | HEADER_LENGTH_BITS);
+      OutputSettings settings;
+      getSettingsLocked( settings );
+      publish( settings );
+   }
+
+   /// a copy of the current settings, or of the ones init() set up ('defaults')
+   void GetSettings( OutputSettings& settings, bool defaults = false )
+   {
+      std::lock_guard<std::mutex> lock( mSettingsMutex );
+      if (defaults)
+         settings = mDefaults;
+      else
+         getSettingsLocked( settings );
+   }
+
+   /// publish new settings, all at once.  the filter and level share one atomic word,
+   /// so loggers read both with one load, and never half old and half new.
+   void SetSettings( const OutputSettings& settings )
+   {
+      std::lock_guard<std::mutex> lock( mSettingsMutex );
+      publish( settings );
+   }
+
+   /// is a message with this filter and level built into this output at all?
+   /// (Trace in release, SPEW_COMPILE_MIN_LEVEL, SPEW_COMPILE_FILTER)
+   /// a constant expression for constant arguments, so stripped calls fold away.
+   template <typename FilterType>
+   static constexpr bool included( const FilterType& filter, Level_ level )
+   {
+      return (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE) && compiledIn( filter, level );
+   }
+
+   /// would a message with this filter and level be output?
+   /// test this before doing expensive work to build a message.
+   inline bool IsEnabled( Filter filter, Level_ level ) const
+   {
+      if (!included( filter, level ))
+         return false;
+      uint64_t filterLevel = mFilterLevel.load( std::memory_order_acquire );
+      return 0 != (filter & (unsigned int)filterLevel) && 0 != (level.mType & (unsigned int)(filterLevel >> 32));
+   }
+   /// would a message in this category be output?  one byte load
+   /// (the first check of a category registered since the last settings change takes a lock)
+   inline bool IsEnabled( Category category, Level_ level ) const
+   {
+      if (!included( category, level ))
+         return false;
+      // the filter word first: its bytes were published before it
+      uint64_t filterLevel = mFilterLevel.load( std::memory_order_acquire );
+      unsigned char on = mCategoryOn[category.mId].load( std::memory_order_relaxed );
+      if (CATEGORY_UNRESOLVED == on)
+         on = resolveCategory( category.mId );
+      return 0 != on && 0 != (level.mType & (unsigned int)(filterLevel >> 32));
+   }
 
    /// send formatted text to the output, similar to printf in the C stdlib
-   /// uses default filter and level
+   /// uses default filter and level.
+   /// the format string is checked against the arguments at compile time (see Format.h),
+   /// so it has to be a constant.  std::string works with %s.
    /// usage:  
    /// @code
    ///   #define StdOut OutputBase<StdOutInit>::instance()
    ///   StdOut( "hi %s", steve );
    /// @endcode
-   inline void operator()( const char fmtstr[], ... )
+   template <typename... Args>
+   inline void operator()( FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
    {
-      if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
-      {
-         va_list arg_ptr;
-         va_start( arg_ptr, fmtstr );
-         operator()( FILTERDEFAULT, fmtstr, arg_ptr );
-         va_end( arg_ptr );
-      }
+      print( FILTERDEFAULT, _LEVELDEFAULT, fmtstr, args... );
    }
 
    /// send formatted text to the output, similar to printf in the C stdlib
@@ -248,15 +885,10 @@ public:
    ///   #define StdOut OutputBase<StdOutInit>::instance()
    ///   StdOut( GFX, "hi %s", steve );
    /// @endcode
-   inline void operator()( Filter filter, const char fmtstr[], ... )
+   template <typename... Args>
+   inline void operator()( Filter filter, FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
    {
-      if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
-      {
-         va_list arg_ptr;
-         va_start( arg_ptr, fmtstr );
-         operator()( filter, fmtstr, arg_ptr );
-         va_end( arg_ptr );
-      }
+      print( filter, _LEVELDEFAULT, fmtstr, args... );
    }
 
    /// send formatted text to the output, similar to printf in the C stdlib
@@ -266,18 +898,57 @@ public:
    ///   #define StdOut OutputBase<StdOutInit>::instance()
    ///   StdOut( GFX, 1, "hi %s", steve );
    /// @endcode
-   inline void operator()( Filter filter, Level_ level, const char fmtstr[], ... )
+   template <typename... Args>
+   inline void operator()( Filter filter, Level_ level, FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
    {
-      if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
-      {
-         va_list arg_ptr;
-         va_start( arg_ptr, fmtstr );
-         operator()( filter, level, fmtstr, arg_ptr );
-         va_end( arg_ptr );
-      }
+      print( filter, level, fmtstr, args... );
+   }
+
+   /// send formatted text to the output, similar to printf in the C stdlib
+   /// in a runtime category (see Category.h), with or without a level.
+   /// usage:
+   /// @code
+   ///   static const Category HTTP( "net.http.client" );
+   ///   Log( HTTP, 2, "GET %s\n", url );
+   /// @endcode
+   template <typename... Args>
+   inline void operator()( Category category, Level_ level, FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
+   {
+      if (passes( category, level ))
+         format( (Filter)category.filter(), level, categoryName( category ), fmtstr, args... );
+   }
+   template <typename... Args>
+   inline void operator()( Category category, FormatString<std::type_identity_t<Args>...> fmtstr, const Args&... args )
+   {
+      Level_ level = _LEVELDEFAULT;
+      if (passes( category, level ))
+         format( (Filter)category.filter(), level, categoryName( category ), fmtstr, args... );
+   }
+
+   /// structured message: a message plus typed key/value fields (see Structured.h).
+   /// each stream and sink gets it in its own encoding (SetEncoding): text by default,
+   /// or a json line, or a binary record.  the fields are encoded straight from the
+   /// arguments, nothing is formatted into a string first.
+   /// usage:
+   /// @code
+   ///   Log( IO, 2, "request done", { { "path", path }, { "status", 200 }, { "ms", ms } } );
+   ///   // text:  request done path="/index.html" status=200 ms=3.5
+   ///   // json:  {"level":2,"filter":"IO","msg":"request done","path":"/index.html","status":200,"ms":3.5}
+   /// @endcode
+   inline void operator()( Filter filter, Level_ level, const char* message, std::initializer_list<Field> fields )
+   {
+      if (passes( filter, level ))
+         structured( filter, level, NULL, message, fields );
+   }
+   /// same, in a runtime category (json and binary records name the category)
+   inline void operator()( Category category, Level_ level, const char* message, std::initializer_list<Field> fields )
+   {
+      if (passes( category, level ))
+         structured( (Filter)category.filter(), level, categoryName( category ), message, fields );
    }
 
    /// vararg compatible implementation of print, most users wont need this.
+   /// also the way to print with a format string that isn't a constant (it isn't type checked).
    /// usage:  
    /// @code
    ///   #define StdOut OutputBase<StdOutInit>::instance()
@@ -291,23 +962,20 @@ public:
    /// @endcode
    void operator()( Filter filter, Level_ level, const char fmtstr[], va_list& arg_ptr )
    {
-      if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
+      // test the filter first, don't pay for formatting text nobody will see.
+      if (passes( filter, level ))
       {
-         static char buf[MAX_BUF_SIZE] = "\0";
-#ifdef WIN32
-         _vsnprintf( buf, MAX_BUF_SIZE, fmtstr, arg_ptr );
-#else
-         vsprintf( buf, fmtstr, arg_ptr );
-         assert( strlen( buf ) <= MAX_BUF_SIZE && "overflow" );
-#endif
-
-         // ensure nul termination
-         buf[MAX_BUF_SIZE-1] = '\0';
-
-         // output to every output stream if the filter matches.
-         if (0 != (filter & mGlobalFilter) && 0 != (level.mType & mGlobalLevel))
-            for (size_t x = 0; x < mOutStreams.size(); ++x)
-               (*mOutStreams[x]) << buf << std::flush;
+         CallTimer timer( threadStats() );
+         FormatBuffer& buf = threadFormatBuffer();
+         if (mBinary.load( std::memory_order_relaxed ))
+         {
+            captureBinary( buf, filter, level.mType, fmtstr, arg_ptr );
+            emitRecord( filter, level.mType, buf.c_str(), buf.size() );
+            return;
+         }
+         size_t header = startMessage( buf, filter, level, NULL );
+         buf.vappendf( fmtstr, arg_ptr );
+         emitRecord( filter, level.mType | (unsigned int)(header << HEADER_LENGTH_SHIFT), buf.c_str(), buf.size() );
       }
    }
 
@@ -317,7 +985,73 @@ public:
       operator()( filter, _LEVELDEFAULT, fmtstr, arg_ptr );
    }
 
+   /// wide text: printf with a wchar_t format string, by swprintf's rules (%ls is a wchar_t*,
+   /// %s a char* in the C locale).  transcoded to UTF-8 in this thread's buffer (see Utf8.h),
+   /// then written like any other message.  not type checked, so plain printf arguments only.
+   /// usage:
+   /// @code
+   ///   Log( IO, 2, L"opened %ls, %d bytes\n", path.c_str(), size );
+   /// @endcode
+   template <typename... Args>
+   inline void operator()( Filter filter, Level_ level, const wchar_t* fmtstr, const Args&... args )
+   {
+      if (passes( filter, level ))
+         wide( filter, level, NULL, fmtstr, args... );
+   }
+   template <typename... Args>
+   inline void operator()( Filter filter, const wchar_t* fmtstr, const Args&... args )
+   {
+      Level_ level = _LEVELDEFAULT;
+      if (passes( filter, level ))
+         wide( filter, level, NULL, fmtstr, args... );
+   }
+   template <typename... Args>
+   inline void operator()( const wchar_t* fmtstr, const Args&... args )
+   {
+      Level_ level = _LEVELDEFAULT;
+      if (passes( FILTERDEFAULT, level ))
+         wide( FILTERDEFAULT, level, NULL, fmtstr, args... );
+   }
+   template <typename... Args>
+   inline void operator()( Category category, Level_ level, const wchar_t* fmtstr, const Args&... args )
+   {
+      if (passes( category, level ))
+         wide( (Filter)category.filter(), level, categoryName( category ), fmtstr, args... );
+   }
+   /// vararg compatible wide print, most users wont need this.
+   void operator()( Filter filter, Level_ level, const wchar_t fmtstr[], va_list& arg_ptr )
+   {
+      if (passes( filter, level ))
+      {
+         CallTimer timer( threadStats() );
+         WideFormatBuffer& text = threadWideFormatBuffer();
+         if (text.vformat( fmtstr, arg_ptr ))
+            emitWide( filter, level, NULL, text.c_str(), text.size() );
+      }
+   }
+
+   /// wide ostream, for wide strings and wide manipulators.  like the narrow stream, what's
+   /// streamed is written (as UTF-8) when the stream is flushed, std::endl for one.
+   /// usage:
+   /// @code
+   ///   StdOut.Wide( GFX, 2 ) << L"r\u00e9sum\u00e9 " << count << std::endl;
+   /// @endcode
+   inline std::wostream& Wide( Filter filter = FILTERDEFAULT, Level_ level = _LEVELDEFAULT )
+   {
+      if (!passes( filter, level ))
+         return threadNullWideStream();
+      return wideStream( filter, level, NULL );
+   }
+   inline std::wostream& Wide( Category category, Level_ level = _LEVELDEFAULT )
+   {
+      if (!passes( category, level ))
+         return threadNullWideStream();
+      return wideStream( (Filter)category.filter(), level, categoryName( category ) );
+   }
+
    /// ostream with filter and level specified
+   /// when filtered out, a null stream is returned so that nothing gets formatted.
+   /// each thread gets its own stream (and filter/level), so threads don't mix their text.
    /// usage:  
    /// @code
    ///   #define StdOut OutputBase<StdOutInit>::instance()
@@ -325,10 +1059,22 @@ public:
    /// @endcode
    inline std::ostream& operator()( Filter filter, Level_ level = _LEVELDEFAULT ) 
 	{ 
-		mStreamOut.out.mFilter = filter;
-		mStreamOut.out.mLevel = level;
-		return mStreamOut;
+      if (!passes( filter, level ))
+         return threadNullStream();
+		return stream( filter, level, NULL );
 	}	
+
+   /// ostream in a runtime category (see Category.h)
+   /// usage:
+   /// @code
+   ///   Log( HTTP, 2 ) << "GET " << url << std::endl;
+   /// @endcode
+   inline std::ostream& operator()( Category category, Level_ level = _LEVELDEFAULT )
+   {
+      if (!passes( category, level ))
+         return threadNullStream();
+      return stream( (Filter)category.filter(), level, categoryName( category ) );
+   }
 	
    /// ostream with no args (default filter and level)
    /// usage:  
@@ -339,45 +1085,1174 @@ public:
    template <typename T>
    inline std::ostream& operator<<( T& blah )
    { 
-      if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
+      return operator()( FILTERDEFAULT, _LEVELDEFAULT ) << blah;
+   }
+
+   /// get output object as an o-stream
+   inline operator std::ostream&() { return operator()( FILTERDEFAULT, _LEVELDEFAULT ); }
+
+   /// holds the singleton object for each output type.
+   /// Log/Trace/StdOut/StdErr are a constant address (see Lifetime), the rest are made on first use.
+	static OutputBase& instance()
+   {
+      if constexpr (BuiltinOutput<OUTPUTBASE_INIT>::value)
+         return StaticStorage<OutputBase>::get();
+      else
+      {
+         static OutputBase blah;
+         return blah;
+      }
+   }
+
+   /// list of output streams available.
+   std::vector<std::ostream*> mOutStreams;
+   /// sinks (see Sink.h), get the same bytes as mOutStreams, minus the ostream overhead.
+   /// like mOutStreams, don't change this while async is running.
+   std::vector<Sink*> mSinks;
+   OUTPUTBASE_INIT mOutputBaseInit; //< used to initialize this outputter.
+
+private:
+   /// the typed printf: filter, then format (or capture) into this thread's buffer.
+   template <typename... Args>
+   inline void print( Filter filter, Level_ level, const FormatString<Args...>& fmtstr, const Args&... args )
+   {
+      if (passes( filter, level ))
+         format( filter, level, NULL, fmtstr, args... );
+   }
+   template <typename... Args>
+   inline void format( Filter filter, Level_ level, const char* category, const FormatString<Args...>& fmtstr, const Args&... args )
+   {
+      CallTimer timer( threadStats() );
+      FormatBuffer& buf = threadFormatBuffer();
+      if (mBinary.load( std::memory_order_relaxed ))
+      {
+         captureBinaryArgs( buf, filter, level.mType, fmtstr.mStr, args... );
+         emitRecord( filter, level.mType, buf.c_str(), buf.size() );
+         return;
+      }
+      size_t header = startMessage( buf, filter, level, category );
+      formatTo<Args...>( buf, fmtstr, args... );
+      emitRecord( filter, level.mType | (unsigned int)(header << HEADER_LENGTH_SHIFT), buf.c_str(), buf.size() );
+   }
+
+   /// the wide printf: format into this thread's wide buffer, then on as UTF-8
+   template <typename... Args>
+   inline void wide( Filter filter, Level_ level, const char* category, const wchar_t* fmtstr, const Args&... args )
+   {
+      static_assert( (std::is_scalar_v<std::decay_t<Args> > && ...), "wide printf takes plain printf arguments (a wstring's c_str(), say)" );
+      CallTimer timer( threadStats() );
+      WideFormatBuffer& text = threadWideFormatBuffer();
+      if (text.format( fmtstr, args... ))
+         emitWide( filter, level, category, text.c_str(), text.size() );
+   }
+   /// finished (and filtered) wide text: transcoded into this thread's buffer behind the
+   /// header, or into a text record in binary mode
+   inline void emitWide( Filter filter, Level level, const char* category, const wchar_t* text, size_t length )
+   {
+      FormatBuffer& buf = threadFormatBuffer();
+      if (mBinary.load( std::memory_order_relaxed ))
+      {
+         buf.clear();
+         appendUtf8( buf, text, length );
+         FormatBuffer& record = threadBinaryBuffer();
+         textBinary( record, filter, level, buf.c_str(), buf.size() );
+         emitRecord( filter, level, record.c_str(), record.size() );
+         return;
+      }
+      size_t header = startMessage( buf, filter, level, category );
+      appendUtf8( buf, text, length );
+      emitRecord( filter, level | (unsigned int)(header << HEADER_LENGTH_SHIFT), buf.c_str(), buf.size() );
+   }
+
+   /// empty this thread's buffer, and start it with the header (SetHeader) if there is one.
+   /// returns the header's length.  (never in binary mode)
+   inline size_t startMessage( FormatBuffer& buf, Filter filter, Level level, const char* category )
+   {
+      buf.clear();
+      unsigned int fields = mHeader.load( std::memory_order_relaxed );
+      if (HEADER_NONE == fields)
+         return 0;
+      return appendHeader( buf, fields, 0 != (fields & HEADER_CLOCK) ? Clock::instance().now() : 0, level,
+                           NULL != category ? category : filterName( filter ) );
+   }
+   /// a runtime category's name (for headers and structured records), NULL for a Filter
+   static inline const char* categoryName( Category category )
+   {
+      return 0 == category.filter() ? categoryRegistry().c_str( category.mId ) : NULL;
+   }
+
+   /// a structured message, in every encoding a stream or sink wants (one record)
+   void structured( Filter filter, Level level, const char* category, const char* message, std::initializer_list<Field> fields )
+   {
+      CallTimer timer( threadStats() );
+      StructuredRecord record = { filter, filterName( filter ), (Level)(level & ~(TAP_MESSAGE | TAP_ONLY)), category, message, strlen( message ), fields.begin(), fields.size() };
+      FormatBuffer& buf = threadFormatBuffer();
+      if (mBinary.load( std::memory_order_relaxed ))
+      {
+         buf.clear();
+         appendTlv( buf, record );
+         emitRecord( filter, level, buf.c_str(), buf.size() );
+         return;
+      }
+      encodeStructured( buf, mEncodingMask.load( std::memory_order_relaxed ), record );
+      emitRecord( filter, level | STRUCTURED_RECORD, buf.c_str(), buf.size() );
+   }
+
+   /// this thread's stream, set up for a message that passed the filter
+   inline std::ostream& stream( Filter filter, Level level, const char* category )
+   {
+      OstreamTemplate<char, OutputAdaptor>& stream = threadStream();
+      if (stream.out.mParent != this)
+      {
+         stream.flush(); // text left unflushed for another output goes there, not here
+         stream.out.mParent = this;
+      }
+      stream.out.mFilter = filter;
+      stream.out.mLevel = level;
+      stream.out.mCategory = category;
+      return stream;
+   }
+
+   /// this thread's wide stream, set up for a message that passed the filter
+   inline std::wostream& wideStream( Filter filter, Level level, const char* category )
+   {
+      OstreamTemplate<wchar_t, WideOutputAdaptor>& stream = threadWideStream();
+      if (stream.out.mParent != this)
+      {
+         stream.flush();
+         stream.out.mParent = this;
+      }
+      stream.out.mFilter = filter;
+      stream.out.mLevel = level;
+      stream.out.mCategory = category;
+      return stream;
+   }
+
+   /// change the settings: copy, modify, publish (one writer at a time)
+   template <typename F>
+   inline void update( F change )
+   {
+      std::lock_guard<std::mutex> lock( mSettingsMutex );
+      OutputSettings settings;
+      getSettingsLocked( settings );
+      change( settings );
+      publish( settings );
+   }
+   void getSettingsLocked( OutputSettings& settings )
+   {
+      settings.mFilter = GetFilter();
+      settings.mLevel = GetLevel();
+      std::lock_guard<std::mutex> lock( mCategoryMutex );
+      settings.mCategoryDefault = mCategoryDefault;
+      settings.mCategoryRules = mCategoryRules;
+   }
+   /// (under mSettingsMutex) the categories, then filter and level in one store (a caller
+   /// that sees the new filter word sees the categories that go with it).  Filter ids follow
+   /// the filter bits, runtime ones are worked out here, off the logging threads; only ids
+   /// registered after this get worked out on their first check.
+   /// a tap's subscription (SetTap) is published along with them.
+   void publish( const OutputSettings& settings )
+   {
+      const OutputSettings none;
+      const OutputSettings& tap = mTapOn ? mTapSettings : none;
+      unsigned int tapFilter = mTapOn ? tap.mFilter : 0, tapLevel = mTapOn ? tap.mLevel : 0;
+      {
+         std::lock_guard<std::mutex> lock( mCategoryMutex );
+         mCategoryDefault = settings.mCategoryDefault;
+         mCategoryRules = settings.mCategoryRules;
+         mTapCategoryDefault = mTapOn && tap.mCategoryDefault;
+         mTapCategoryRules = tap.mCategoryRules;
+         unsigned int registered = categoryRegistry().size();
+         for (unsigned int id = 0; id < CategoryRegistry::FILTER_IDS; ++id)
+            mCategoryOn[id].store( (0 != (settings.mFilter & (1u << id)) ? CATEGORY_ON : 0) | (0 != (tapFilter & (1u << id)) ? CATEGORY_TAP : 0), std::memory_order_relaxed );
+         for (unsigned int id = CategoryRegistry::FILTER_IDS; id < SPEW_MAX_CATEGORIES; ++id)
+            mCategoryOn[id].store( id < registered ? categoryState( id ) : (unsigned char)CATEGORY_UNRESOLVED, std::memory_order_relaxed );
+      }
+      uint64_t own = ((uint64_t)(settings.mLevel | mRecordLevel | mBacktraceLevel) << 32) | settings.mFilter;
+      mOutLevel.store( settings.mLevel, std::memory_order_release );
+      mHeldLevel.store( mBacktraceLevel & ~settings.mLevel, std::memory_order_relaxed );
+      mOwnFilterLevel.store( own, std::memory_order_release );
+      mTapFilterLevel.store( ((uint64_t)tapLevel << 32) | tapFilter, std::memory_order_relaxed );
+      mFilterLevel.store( own | ((uint64_t)tapLevel << 32) | tapFilter, std::memory_order_release );
+      bumpFilterGeneration();
+   }
+   /// a runtime category registered since the last publish: work it out now
+   unsigned char resolveCategory( unsigned int id ) const
+   {
+      std::lock_guard<std::mutex> lock( mCategoryMutex );
+      unsigned char on = categoryState( id );
+      mCategoryOn[id].store( on, std::memory_order_relaxed );
+      return on;
+   }
+   /// (under mCategoryMutex) a runtime category's state: the last rule that covers it, or the default
+   unsigned char categoryState( unsigned int id ) const
+   {
+      const char* name = categoryRegistry().c_str( id );
+      unsigned char on = mCategoryDefault ? CATEGORY_ON : 0;
+      for (size_t x = 0; x < mCategoryRules.size(); ++x)
+         if (categoryUnder( name, mCategoryRules[x].mPrefix.c_str() ))
+            on = mCategoryRules[x].mOn ? CATEGORY_ON : 0;
+      unsigned char tap = mTapCategoryDefault ? CATEGORY_TAP : 0;
+      for (size_t x = 0; x < mTapCategoryRules.size(); ++x)
+         if (categoryUnder( name, mTapCategoryRules[x].mPrefix.c_str() ))
+            tap = mTapCategoryRules[x].mOn ? CATEGORY_TAP : 0;
+      return on | tap;
+   }
+
+   /// the filter test, then the rate limit (counting the calls that don't get through).
+   /// with a tap (SetTap) the test let through what either wants, 'level' gets the
+   /// TAP_ bits that say which.
+   inline bool passes( Filter filter, Level_& level )
+   {
+      if (!included( filter, level )) // compiled out, nothing to count
+         return false;
+      if (!IsEnabled( filter, level ))
+         return filtered();
+      if (NULL != mTap.load( std::memory_order_relaxed ))
+         return tapped( filter, level, wants( mOwnFilterLevel, filter, level ), wants( mTapFilterLevel, filter, level ) );
+      return allowed( filter, level );
+   }
+   inline bool passes( Category category, Level_& level )
+   {
+      if (!included( category, level ))
+         return false;
+      if (!IsEnabled( category, level ))
+         return filtered();
+      if (NULL != mTap.load( std::memory_order_relaxed ))
+      {
+         // (IsEnabled resolved the category's byte)
+         unsigned char on = mCategoryOn[category.mId].load( std::memory_order_relaxed );
+         return tapped( (Filter)category.filter(), level, 0 != (on & CATEGORY_ON) && wants( mOwnFilterLevel, FILTERALL, level ),
+                        0 != (on & CATEGORY_TAP) && wants( mTapFilterLevel, FILTERALL, level ) );
+      }
+      return allowed( (Filter)category.filter(), level );
+   }
+   static inline bool wants( const std::atomic<uint64_t>& filterLevel, unsigned int filter, Level_ level )
+   {
+      uint64_t word = filterLevel.load( std::memory_order_relaxed );
+      return 0 != (filter & (unsigned int)word) && 0 != (level.mType & (unsigned int)(word >> 32));
+   }
+   /// mark a message for the tap.  rate limits are the output's, the tap's own messages skip them.
+   inline bool tapped( Filter filter, Level_& level, bool own, bool tap )
+   {
+      if (!own)
+      {
+         level.mType = (Level)(level.mType | TAP_MESSAGE | TAP_ONLY);
+         return tap; // (false if the settings changed since IsEnabled)
+      }
+      if (!allowed( filter, level ))
+         return false;
+      if (tap)
+         level.mType = (Level)(level.mType | TAP_MESSAGE);
+      return true;
+   }
+   inline bool filtered()
+   {
+      ThreadStats* stats = threadStats();
+      if (NULL != stats)
+         stats->mFiltered.add();
+      return false;
+   }
+
+   /// rate limit by filter category (SetRateLimit), one AND when there's none
+   inline bool allowed( Filter filter, Level level )
+   {
+      unsigned int limited = mLimitedFilters.load( std::memory_order_acquire );
+      if (0 == (filter & limited) || FILTERALL == filter)
+         return true;
+      unsigned int bit = std::countr_zero( (unsigned int)filter & limited );
+      if (!mLimits[bit].take( mLimitInterval[bit].load( std::memory_order_relaxed ), mLimitTolerance[bit].load( std::memory_order_relaxed ) ))
+      {
+         ThreadStats* stats = threadStats();
+         if (NULL != stats)
+            stats->mSuppressed.add();
+         return false;
+      }
+      unsigned int count = mLimits[bit].takeSuppressed();
+      if (0 != count)
+         suppressed( filter, level, bit, count );
+      return true;
+   }
+   /// the summaries of floods that are over (their bucket is full again) that no message
+   /// since has reported, from filters (SetRateLimit) and listed call sites (Flooded).
+   /// 'all': every one still unreported, over or not (Shutdown).  not under mWriteMutex.
+   void reportSuppressed( bool all )
+   {
+      unsigned int limited = all ? 0xffffffff : mLimitedFilters.load( std::memory_order_acquire );
+      for (; 0 != limited; limited &= limited - 1)
+      {
+         unsigned int bit = std::countr_zero( limited );
+         if (!all && !mLimits[bit].refilled())
+            continue;
+         unsigned int count = mLimits[bit].takeSuppressed();
+         if (0 != count)
+            suppressed( (Filter)(1u << bit), LEVEL1, bit, count );
+      }
+      if (NULL == mLimitSites.load( std::memory_order_relaxed ))
+         return;
+      std::lock_guard<std::mutex> lock( mLimitSitesMutex );
+      for (LimitedSite* site = mLimitSites.load( std::memory_order_relaxed ); NULL != site; site = site->mNext)
+      {
+         if (!all && !site->mLimit.refilled())
+            continue;
+         unsigned int count = site->mLimit.takeSuppressed();
+         if (0 != count)
+            Suppressed( (Filter)site->mFilter, (Level)site->mLevel, count, site->mFile, site->mLine );
+      }
+   }
+   /// the summary after a flood in a filter category
+   void suppressed( Filter filter, Level level, unsigned int bit, unsigned int count )
+   {
+      const char* name = filterName( 1u << bit );
+      char text[128];
+      int length = snprintf( text, sizeof( text ), "suppressed %u %s messages\n", count, NULL == name ? "" : name );
+      emit( filter, level, text, length );
+   }
+
+   /// send already formatted (and already filtered) text to every output stream.
+   /// (not text in this thread's format buffer, a header would go there)
+   inline void emit( Filter filter, Level level, const char* text, size_t length, const char* category = NULL )
+   {
+      CallTimer timer( threadStats() );
+      if (mBinary.load( std::memory_order_relaxed ))
+      {
+         FormatBuffer& buf = threadBinaryBuffer();
+         textBinary( buf, filter, level, text, length );
+         emitRecord( filter, level, buf.c_str(), buf.size() );
+         return;
+      }
+      if (HEADER_NONE != mHeader.load( std::memory_order_relaxed ))
+      {
+         FormatBuffer& buf = threadFormatBuffer();
+         size_t header = startMessage( buf, filter, level, category );
+         buf.append( text, length );
+         emitRecord( filter, level | (unsigned int)(header << HEADER_LENGTH_SHIFT), buf.c_str(), buf.size() );
+         return;
+      }
+      emitRecord( filter, level, text, length );
+   }
+
+   /// send a finished message (text, or a binary record) to every output stream.
+   /// (or hand it to the async writer, which will do that later)
+   /// formatting happens outside of any lock, only the writes are serialized.
+   inline void emitRecord( unsigned int filter, unsigned int level, const char* data, size_t length )
+   {
+      if (0 != (level & (TAP_MESSAGE | TAP_ONLY)))
+      {
+         if (tap( data, length, level ))
+            return;
+         level &= ~TAP_MESSAGE;
+      }
+      unsigned int held = mHeldLevel.load( std::memory_order_relaxed );
+      if (0 != held && backtrace( filter, level, data, length, held ))
+         return;
+      emitNow( filter, level, data, length );
+   }
+   /// the tap (SetTap) gets its messages as they're made, held back or queued or not.
+   /// true if nothing else wants it.
+   /// (counted in mTapWriters while it writes, so setTap can wait for it to be done)
+   inline bool tap( const char* data, size_t length, unsigned int level )
+   {
+      if (NULL == mTap.load( std::memory_order_relaxed ) || 0 == (level & TAP_MESSAGE) || mBinary.load( std::memory_order_relaxed ))
+         return 0 != (level & TAP_ONLY);
+      std::atomic<unsigned int>& writers = mTapWriters[mTapEpoch.load()];
+      writers.fetch_add( 1 );
+      Sink* tap = mTap.load(); // after the count: setTap either sees us, or we see its change
+      if (NULL != tap)
       {
-         mStreamOut << blah;
+         if (0 == (level & STRUCTURED_RECORD))
+            tap->write( data, length );
+         else
+         {
+            bool missing;
+            Span part = structuredPart( data, ENCODE_TEXT, missing );
+            tap->write( part.mData, part.mLength );
+         }
+      }
+      writers.fetch_sub( 1, std::memory_order_release );
+      return 0 != (level & TAP_ONLY);
+   }
+   /// SetBacktrace: hold the message in this thread's ring (true), or if it's a trigger,
+   /// write out what the ring holds before it
+   bool backtrace( unsigned int filter, unsigned int level, const char* data, size_t length, unsigned int held )
+   {
+      BacktraceRing& ring = threadBacktrace( mSlot );
+      unsigned int generation = mBacktraceGeneration.load( std::memory_order_relaxed );
+      if (0 != (level & held))
+      {
+         ring.push( data, length, filter, level, mBacktraceSize.load( std::memory_order_relaxed ), generation );
+         return true;
+      }
+      if (0 != (filter & mBacktraceTrigger.load( std::memory_order_relaxed )) && FILTERALL != filter && 0 != ring.size())
+         ring.drain( generation, [this]( const char* data, size_t length, unsigned int filter, unsigned int level )
+            { emitNow( filter, level, data, length ); } );
+      return false;
+   }
+   /// (counted in mAsyncCallers while it uses the async writer, so StopAsync can free it)
+   inline void emitNow( unsigned int filter, unsigned int level, const char* data, size_t length )
+   {
+      ThreadStats* stats = threadStats();
+      if (NULL != mAsync.load( std::memory_order_relaxed ))
+      {
+         mAsyncCallers.fetch_add( 1 );
+         AsyncWriter<AsyncAdaptor>* async = mAsync.load(); // after the count: StopAsync either sees us, or we see NULL
+         bool queued = NULL != async && async->push( data, length, filter, level );
+         mAsyncCallers.fetch_sub( 1, std::memory_order_release );
+         if (NULL != async)
+         {
+            if (NULL != stats)
+               (queued ? stats->mEmitted : stats->mDropped).add();
+            return;
+         }
+      }
+      if (NULL != stats)
+         stats->mEmitted.add();
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      write( data, length, filter, level, false );
+   }
+
+   /// this thread's counts for this output, NULL when SetStats is off.
+   /// a thread_local table indexed by this output's slot, made on the thread's first call.
+   inline ThreadStats* threadStats()
+   {
+      if (!mStatsOn.load( std::memory_order_relaxed ) || ThreadStatsSlots::gone())
+         return NULL;
+      std::vector<ThreadStats*>& slots = threadStatsSlots();
+      if (mSlot < slots.size() && NULL != slots[mSlot])
+         return slots[mSlot];
+      return newThreadStats();
+   }
+   ThreadStats* newThreadStats()
+   {
+      ThreadStats* stats = new ThreadStats; // the thread frees it, see ThreadStatsSlots
+      stats->mHome = mStatsHome;
+      std::vector<ThreadStats*>& slots = threadStatsSlots();
+      if (slots.size() <= mSlot)
+         slots.resize( mSlot + 1, NULL );
+      slots[mSlot] = stats;
+      std::lock_guard<std::mutex> lock( mStatsHome->mMutex );
+      mStatsHome->mLive.push_back( stats );
+      return stats;
+   }
+   /// times a log call into this thread's histogram (when SetStats is on)
+   struct CallTimer
+   {
+      CallTimer( ThreadStats* stats ) : mStats( stats ), mStart( NULL != stats ? Clock::instance().ticks() : 0 ) {}
+      ~CallTimer()
+      {
+         if (NULL != mStats)
+            mStats->mCall.record( Clock::instance().nanos( Clock::instance().ticks() - mStart ) );
+      }
+      ThreadStats* mStats;
+      uint64_t mStart;
+   };
+   /// (under mWriteMutex) a stream's or sink's write started: its start time, 0 when SetStats is off
+   inline uint64_t sinkStart() const
+   {
+      return mStatsOn.load( std::memory_order_relaxed ) ? Clock::instance().ticks() : 0;
+   }
+   /// (under mWriteMutex) and ended
+   template <typename Out>
+   inline void sinkDone( Out* out, size_t length, uint64_t start )
+   {
+      if (0 == start)
+         return;
+      uint64_t nanos = Clock::instance().nanos( Clock::instance().ticks() - start );
+      SinkStats* stats = findSinkStats( out );
+      if (NULL == stats)
+      {
+         mSinkStats.push_back( SinkStats() );
+         stats = &mSinkStats.back();
+         setSinkStats( stats, out );
+      }
+      stats->mBytes += length;
+      ++stats->mWrites;
+      stats->mWrite.record( nanos );
+   }
+   inline SinkStats* findSinkStats( std::ostream* stream )
+   {
+      for (size_t x = 0; x < mSinkStats.size(); ++x)
+         if (mSinkStats[x].mStream == stream)
+            return &mSinkStats[x];
+      return NULL;
+   }
+   inline SinkStats* findSinkStats( Sink* sink )
+   {
+      for (size_t x = 0; x < mSinkStats.size(); ++x)
+         if (mSinkStats[x].mSink == sink)
+            return &mSinkStats[x];
+      return NULL;
+   }
+   static inline void setSinkStats( SinkStats* stats, std::ostream* stream ) { stats->mStream = stream; }
+   static inline void setSinkStats( SinkStats* stats, Sink* sink ) { stats->mSink = sink; }
+
+   /// write stage, always under mWriteMutex (the async writer holds it for a batch).
+   /// repeats are held back here (SetRepeatCoalescing), the rest goes to writeOut.
+   /// the header (SetHeader) isn't part of what's compared, the time in it always differs.
+   inline void write( const char* data, size_t length, unsigned int filter, unsigned int level, bool batched )
+   {
+      if (0 != mRepeatMilliseconds && 0 != length)
+      {
+         size_t header = (level & HEADER_LENGTH_BITS) >> HEADER_LENGTH_SHIFT;
+         uint64_t hash = messageHash( data + header, length - header );
+         // (the text is compared too, only when the hash says it's the same)
+         if (hash == mLastHash && length - header == mLastLength && length - header == mLastMessage.size() &&
+             0 == memcmp( data + header, mLastMessage.c_str(), length - header ))
+         {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            ++mCoalesced;
+            if (0 == mRepeats++)
+               mRepeatStart = now;
+            else if (now - mRepeatStart >= std::chrono::milliseconds( mRepeatMilliseconds ))
+               endRepeats( batched );
+            return;
+         }
+         endRepeats( batched );
+         mLastHash = hash;
+         mLastLength = length - header;
+         mLastMessage.clear();
+         mLastMessage.append( data + header, length - header );
+         mLastFilter = filter;
+         mLastLevel = level & ~(STRUCTURED_RECORD | HEADER_LENGTH_BITS);
+      }
+      writeOut( data, length, filter, level, batched );
+   }
+   /// the held back repeats (if any) as one line
+   void endRepeats( bool batched )
+   {
+      if (0 == mRepeats)
+         return;
+      char text[64];
+      int length = snprintf( text, sizeof( text ), "last message repeated %u times\n", mRepeats );
+      mRepeats = 0;
+      if (!mBinary.load( std::memory_order_relaxed ))
+      {
+         // a header of its own, with the time the run ended
+         size_t header = 0;
+         mRepeatBuffer.clear();
+         unsigned int fields = mHeader.load( std::memory_order_relaxed );
+         if (HEADER_NONE != fields)
+            header = appendHeader( mRepeatBuffer, fields, 0 != (fields & HEADER_CLOCK) ? Clock::instance().now() : 0, mLastLevel, filterName( mLastFilter ) );
+         mRepeatBuffer.append( text, length );
+         return writeOut( mRepeatBuffer.c_str(), mRepeatBuffer.size(), mLastFilter, mLastLevel | (unsigned int)(header << HEADER_LENGTH_SHIFT), batched );
+      }
+      textBinary( mRepeatBuffer, mLastFilter, mLastLevel, text, length );
+      writeOut( mRepeatBuffer.c_str(), mRepeatBuffer.size(), mLastFilter, mLastLevel, batched );
+   }
+   /// cheap 64 bit hash, 8 bytes a step (only ever compared to the previous message's)
+   static inline uint64_t messageHash( const char* data, size_t length )
+   {
+      const uint64_t k = 0x9e3779b97f4a7c15ull;
+      uint64_t h = length * k;
+      size_t x = 0;
+      for (; x + 8 <= length; x += 8)
+      {
+         uint64_t word;
+         memcpy( &word, data + x, 8 );
+         h = (h ^ word) * k;
+         h ^= h >> 29;
+      }
+      if (x < length)
+      {
+         uint64_t word = 0;
+         memcpy( &word, data + x, length - x );
+         h = (h ^ word) * k;
+         h ^= h >> 29;
+      }
+      return h;
+   }
+   /// write to every stream and sink.  they are flushed as their FlushPolicy says,
+   /// when 'batched' the every-message ones wait for the end of the batch (endBatch).
+   inline void writeOut( const char* data, size_t length, unsigned int filter, unsigned int level, bool batched )
+   {
+      mWritingFormat = NO_FORMAT;
+      if (NULL != mRecorder)
+      {
+         if (!mBinary.load( std::memory_order_relaxed )) // (text only, binary records would need their definitions)
+            record( data, length, level );
+         unsigned int out = mOutLevel.load( std::memory_order_relaxed ) | mHeldLevel.load( std::memory_order_relaxed );
+         if (FILTERALL != filter && 0 == (level & ~(STRUCTURED_RECORD | HEADER_LENGTH_BITS) & out))
+            return; // at a level only the recorder wants
+      }
+      if (0 != (level & STRUCTURED_RECORD) || (!mEncodings.empty() && !mBinary.load( std::memory_order_relaxed )))
+         return writeEncoded( data, length, filter, level & ~(STRUCTURED_RECORD | HEADER_LENGTH_BITS), 0 != (level & STRUCTURED_RECORD),
+                              (level & HEADER_LENGTH_BITS) >> HEADER_LENGTH_SHIFT, batched );
+      level &= ~HEADER_LENGTH_BITS;
+      // binary mode: a format's definition goes out just before its first use
+      Span spans[2];
+      size_t count = 0;
+      if (mBinary.load( std::memory_order_relaxed ) && 'M' == data[0])
+      {
+         uint32_t id = binaryRecordId( data, length );
+         mWritingFormat = id;
+         if (mDefined.size() <= id || !mDefined[id])
+         {
+            if (mDefined.size() <= id)
+               mDefined.resize( id + 1, false );
+            mDefined[id] = true;
+            defineBinary( mDefineBuffer, *FormatTable::instance().find( id ) );
+            for (size_t x = 0; x < mOutStreams.size(); ++x)
+               mOutStreams[x]->write( mDefineBuffer.c_str(), mDefineBuffer.size() );
+            spans[count].mData = mDefineBuffer.c_str();
+            spans[count++].mLength = mDefineBuffer.size();
+         }
+      }
+      spans[count].mData = data;
+      spans[count++].mLength = length;
+      for (size_t x = 0; x < mOutStreams.size(); ++x)
+      {
+         uint64_t start = sinkStart();
+         mOutStreams[x]->write( data, length );
+         wrote( mOutStreams[x], length, filter, level, batched );
+         sinkDone( mOutStreams[x], length, start );
+      }
+      // the same bytes to every sink, no copies
+      for (size_t x = 0; x < mSinks.size(); ++x)
+      {
+         uint64_t start = sinkStart();
+         mSinks[x]->writev( spans, count );
+         wrote( mSinks[x], length, filter, level, batched );
+         sinkDone( mSinks[x], length, start );
+      }
+   }
+   /// (under mWriteMutex) a mapped file stream moved on to a new segment, in the middle of
+   /// a write (see BinarySegmentStart)
+   void startSegment( std::streambuf& segment )
+   {
+      segment.sputn( gBinaryHeader, sizeof( gBinaryHeader ) - 1 );
+      mDefined.assign( mDefined.size(), false );
+      if (NO_FORMAT == mWritingFormat)
+         return;
+      mDefined[mWritingFormat] = true;
+      defineBinary( mSegmentBuffer, *FormatTable::instance().find( mWritingFormat ) );
+      segment.sputn( mSegmentBuffer.c_str(), mSegmentBuffer.size() );
+   }
+   /// (under mWriteMutex) the recorder (SetRecorder) gets the text of everything
+   inline void record( const char* data, size_t length, unsigned int level )
+   {
+      if (0 == (level & STRUCTURED_RECORD))
+         return mRecorder->write( data, length );
+      bool missing;
+      Span part = structuredPart( data, ENCODE_TEXT, missing );
+      mRecorder->write( part.mData, part.mLength );
+   }
+   /// (RecorderNotes) a note of the caller's own, written to the recorder under mWriteMutex
+   void note( const char* data, size_t length )
+   {
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      if (NULL != mRecorder)
+         mRecorder->write( data, length );
+   }
+   void setRecorder( Sink* recorder )
+   {
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      mRecorder = recorder;
+      updateEncodingMask();
+   }
+   /// returns once no thread is writing to the tap it replaced (see tap)
+   void setTap( Sink* tap )
+   {
+      std::lock_guard<std::mutex> replacing( mTapReplaceMutex );
+      Sink* old;
+      {
+         std::lock_guard<std::mutex> lock( mWriteMutex );
+         old = mTap.exchange( tap );
+         updateEncodingMask();
+      }
+      if (NULL == old || old == tap)
+         return; // nothing, or the same sink with a new subscription: nothing to wait for
+      // writers from here on count in the other half, so only the ones that may have the
+      // old tap are waited for (however busy the new one is)
+      unsigned int epoch = mTapEpoch.fetch_xor( 1 );
+      while (0 != mTapWriters[epoch].load())
+         std::this_thread::yield();
+   }
+   /// writeOut for a structured record, or when streams have encodings (SetEncoding):
+   /// every stream and sink gets its own encoding of the message
+   void writeEncoded( const char* data, size_t length, unsigned int filter, unsigned int level, bool structured, size_t header, bool batched )
+   {
+      Span parts[ENCODINGS] = {};
+      bool missing = false;
+      for (size_t x = 0; x < mOutStreams.size(); ++x)
+      {
+         const Span& part = encoded( parts, encodingOf( mOutStreams[x], NULL ), data, length, filter, level, structured, header, missing );
+         uint64_t start = sinkStart();
+         mOutStreams[x]->write( part.mData, part.mLength );
+         wrote( mOutStreams[x], part.mLength, filter, level, batched );
+         sinkDone( mOutStreams[x], part.mLength, start );
+      }
+      for (size_t x = 0; x < mSinks.size(); ++x)
+      {
+         const Span& part = encoded( parts, encodingOf( NULL, mSinks[x] ), data, length, filter, level, structured, header, missing );
+         uint64_t start = sinkStart();
+         mSinks[x]->write( part.mData, part.mLength );
+         wrote( mSinks[x], part.mLength, filter, level, batched );
+         sinkDone( mSinks[x], part.mLength, start );
+      }
+      if (missing)
+         updateEncodingMask(); // streams changed since SetEncoding
+   }
+   /// one encoding of the message, worked out the first time a stream wants it
+   inline const Span& encoded( Span* parts, Encoding encoding, const char* data, size_t length, unsigned int filter, unsigned int level, bool structured, size_t header, bool& missing )
+   {
+      Span& part = parts[encoding];
+      if (NULL != part.mData)
+         return part;
+      bool notThere = false;
+      if (structured)
+      {
+         part = structuredPart( data, encoding, notThere );
+         missing = missing || notThere;
+      }
+      else if (ENCODE_TEXT == encoding)
+      {
+         part.mData = data;
+         part.mLength = length;
+      }
+      else
+      {
+         // a plain message, as a record with no fields (and without its header)
+         StructuredRecord record = { filter, filterName( filter ), level, NULL, data + header, length - header, NULL, 0 };
+         FormatBuffer& buf = mEncodeBuffer[encoding];
+         buf.clear();
+         appendEncoded( buf, encoding, record );
+         part.mData = buf.c_str();
+         part.mLength = buf.size();
+      }
+      return part;
+   }
+   inline Encoding encodingOf( std::ostream* stream, Sink* sink ) const
+   {
+      for (size_t x = 0; x < mEncodings.size(); ++x)
+         if (mEncodings[x].mStream == stream && mEncodings[x].mSink == sink)
+            return mEncodings[x].mEncoding;
+      return ENCODE_TEXT;
+   }
+   void setEncoding( std::ostream* stream, Sink* sink, Encoding encoding )
+   {
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      for (size_t x = 0; x < mEncodings.size(); ++x)
+         if (mEncodings[x].mStream == stream && mEncodings[x].mSink == sink)
+         {
+            mEncodings[x].mEncoding = encoding;
+            return updateEncodingMask();
+         }
+      StreamEncoding add = { stream, sink, encoding };
+      mEncodings.push_back( add );
+      updateEncodingMask();
+   }
+   /// (under mWriteMutex) the encodings the streams and sinks want, for structured messages
+   void updateEncodingMask()
+   {
+      unsigned int mask = 0;
+      for (size_t x = 0; x < mOutStreams.size(); ++x)
+         mask |= 1u << encodingOf( mOutStreams[x], NULL );
+      for (size_t x = 0; x < mSinks.size(); ++x)
+         mask |= 1u << encodingOf( NULL, mSinks[x] );
+      if (NULL != mRecorder || NULL != mTap.load( std::memory_order_relaxed ))
+         mask |= 1u << ENCODE_TEXT;
+      mEncodingMask.store( 0 == mask ? 1u << ENCODE_TEXT : mask, std::memory_order_relaxed );
+   }
+
+   /// flush after a write, as the stream's (or sink's) FlushPolicy says
+   template <typename Out>
+   inline void wrote( Out* out, size_t length, unsigned int filter, unsigned int level, bool batched )
+   {
+      StreamFlush* flush = mFlush.empty() ? NULL : findFlush( out );
+      if (NULL == flush || flush->mPolicy.everyMessage())
+      {
+         if (!batched)
+            out->flush();
+      }
+      else if (flush->wrote( length, filter, level ))
+         flush->flush();
+   }
+   /// end of an async batch: flush the every-message streams and sinks
+   inline void endBatch()
+   {
+      for (size_t x = 0; x < mOutStreams.size(); ++x)
+         endBatch( mOutStreams[x] );
+      for (size_t x = 0; x < mSinks.size(); ++x)
+         endBatch( mSinks[x] );
+   }
+   template <typename Out>
+   inline void endBatch( Out* out )
+   {
+      StreamFlush* flush = mFlush.empty() ? NULL : findFlush( out );
+      if (NULL == flush || flush->mPolicy.everyMessage())
+         out->flush();
+   }
+   inline StreamFlush* findFlush( std::ostream* stream )
+   {
+      for (size_t x = 0; x < mFlush.size(); ++x)
+         if (mFlush[x].mStream == stream)
+            return &mFlush[x];
+      return NULL;
+   }
+   inline StreamFlush* findFlush( Sink* sink )
+   {
+      for (size_t x = 0; x < mFlush.size(); ++x)
+         if (mFlush[x].mSink == sink)
+            return &mFlush[x];
+      return NULL;
+   }
+   void setFlushPolicy( std::ostream* stream, Sink* sink, const FlushPolicy& policy )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mWriteMutex );
+         StreamFlush* flush = NULL != sink ? findFlush( sink ) : findFlush( stream );
+         if (NULL == flush)
+         {
+            StreamFlush add;
+            add.mStream = stream;
+            add.mSink = sink;
+            add.mPending = 0;
+            mFlush.push_back( add );
+            flush = &mFlush.back();
+         }
+         flush->mPolicy = policy;
       }
-      return mStreamOut; 
+      if (0 != policy.mMilliseconds)
+         StartFlushTimer();
    }
 
-   /// get output object as an o-stream
-   inline operator std::ostream&() { return mStreamOut; }
+   /// flushes streams whose text has waited long enough (FlushPolicy::Every),
+   /// ends runs of repeats that have waited long enough (SetRepeatCoalescing),
+   /// and writes the summaries of floods that have stopped (reportSuppressed)
+   void StartFlushTimer()
+   {
+      std::lock_guard<std::mutex> lock( mWriteMutex );
+      if (mFlushTimer.joinable())
+         return;
+      mFlushTimerStop = false;
+      mFlushTimer = std::thread( [this]()
+      {
+         std::unique_lock<std::mutex> lock( mWriteMutex );
+         while (!mFlushTimerStop)
+         {
+            // wake for the soonest deadline any stream could have
+            unsigned int ms = 0 != mRepeatMilliseconds && mRepeatMilliseconds < 1000 ? mRepeatMilliseconds : 1000;
+            for (size_t x = 0; x < mFlush.size(); ++x)
+               if (0 != mFlush[x].mPolicy.mMilliseconds && mFlush[x].mPolicy.mMilliseconds < ms)
+                  ms = mFlush[x].mPolicy.mMilliseconds;
+            bool limits = 0 != mLimitedFilters.load( std::memory_order_relaxed ) || NULL != mLimitSites.load( std::memory_order_relaxed );
+            if (limits && ms > 200)
+               ms = 200;
+            mFlushTimerWake.wait_for( lock, std::chrono::milliseconds( ms < 2 ? 1 : ms / 2 ) );
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            // a run of repeats that stopped: report it without waiting for the next message
+            if (0 != mRepeats && now - mRepeatStart >= std::chrono::milliseconds( mRepeatMilliseconds ))
+               endRepeats( false );
+            // and floods that stopped (written like any message, so not under the lock)
+            if (limits)
+            {
+               lock.unlock();
+               reportSuppressed( false );
+               lock.lock();
+               if (mFlushTimerStop)
+                  break;
+            }
+            for (size_t x = 0; x < mFlush.size(); ++x)
+               if (mFlush[x].due( now ))
+                  mFlush[x].flush();
+         }
+      } );
+   }
+   void StopFlushTimer()
+   {
+      if (!mFlushTimer.joinable())
+         return;
+      {
+         std::lock_guard<std::mutex> lock( mWriteMutex );
+         mFlushTimerStop = true;
+         mFlushTimerWake.notify_one();
+      }
+      mFlushTimer.join();
+   }
 
-   /// holds the singleton object for each output type.
-	static OutputBase& instance() { static OutputBase blah; return blah; } 
+   /// output functor for the AsyncWriter, runs on the writer thread...
+   /// holds mWriteMutex from the first write of a batch until its flush.
+   struct AsyncAdaptor
+   {
+      inline void write( const char* data, size_t length, unsigned int filter, unsigned int level )
+      {
+         if (!mLocked)
+         {
+            mParent->mWriteMutex.lock();
+            mLocked = true;
+         }
+         mParent->write( data, length, filter, level, true );
+      }
+      inline void printf( const char* text )
+      {
+         if (!mParent->mBinary.load( std::memory_order_relaxed ))
+            return write( text, strlen( text ), FILTERALL, LEVEL1 );
+         FormatBuffer& buf = threadBinaryBuffer();
+         textBinary( buf, FILTERALL, LEVEL1, text, strlen( text ) );
+         write( buf.c_str(), buf.size(), FILTERALL, LEVEL1 );
+      }
+      inline void flush()
+      {
+         if (!mLocked)
+            return;
+         mParent->endBatch();
+         mLocked = false;
+         mParent->mWriteMutex.unlock();
+      }
+      OutputBase* mParent;
+      bool mLocked;
+   };
 
-   /// list of output streams available.
-   std::vector<std::ostream*> mOutStreams;
-   //unsigned int mOutputFilter, mOutputLevel; 
-   unsigned int mGlobalFilter, mGlobalLevel; //< global filter setting
-   OUTPUTBASE_INIT mOutputBaseInit; //< used to initialize this outputter.
+   /// binary mode, on MappedFileOstreams: a new segment starts with the header and the
+   /// definition of the record being written.  mDefined starts over, so the formats used
+   /// after it are defined again in the segment too.
+   struct BinarySegmentStart : public SegmentStart
+   {
+      void started( std::streambuf& segment ) { mParent->startSegment( segment ); }
+      OutputBase* mParent;
+   };
+   /// RecorderNotes' sink
+   struct RecorderNoteSink : public Sink
+   {
+      void write( const char* data, size_t length ) { mParent->note( data, length ); }
+      OutputBase* mParent;
+   };
 
-private:
-   /// output functor for the OstreamTemplate (mStreamOut)...
+   /// output functor for the per thread OstreamTemplate (see threadStream)...
 	struct OutputAdaptor
 	{
-      OutputAdaptor() : mParent( NULL ), mFilter( FILTERDEFAULT ), mLevel( _LEVELDEFAULT ) {}
+      OutputAdaptor() : mParent( NULL ), mFilter( FILTERDEFAULT ), mLevel( _LEVELDEFAULT ), mCategory( NULL ) {}
 		inline void printf( const char* const str )
 		{
-         if (INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE)
+         // filter was tested when the stream was handed out, and str is 
+         // finished text (not a format string), so just send it along.
+         if ((INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE) && NULL != mParent && '\0' != str[0])
+         {
+	   		mParent->emit( mFilter, mLevel, str, strlen( str ), mCategory );
+         }
+		}
+      OutputBase* mParent;
+      Filter mFilter;
+      Level mLevel;
+      const char* mCategory; //< a runtime category's name, for the header
+	};
+   /// this thread's stream for this output type...
+   struct ThreadStream : public OstreamTemplate<char, OutputAdaptor>
+   {
+      ThreadStream() { alive() = true; }
+      ~ThreadStream() { alive() = false; }
+      static bool& alive() { static thread_local bool a = false; return a; }
+   };
+   static OstreamTemplate<char, OutputAdaptor>& threadStream()
+   {
+      static thread_local ThreadStream stream;
+      return stream;
+   }
+   /// handed out when filtered, badbit is set so operator<< formats nothing.
+   static std::ostream& threadNullStream()
+   {
+      static thread_local std::ostream stream( NULL );
+      return stream;
+   }
+   /// the same for wide text (Wide)...
+	struct WideOutputAdaptor
+	{
+      WideOutputAdaptor() : mParent( NULL ), mFilter( FILTERDEFAULT ), mLevel( _LEVELDEFAULT ), mCategory( NULL ) {}
+		inline void printf( const wchar_t* const str )
+		{
+         if ((INCLUDE_IN_RELEASE_MODE || IN_DEBUG_MODE) && NULL != mParent && L'\0' != str[0])
          {
-	   		mParent->operator()( mFilter, mLevel, str );
+            CallTimer timer( mParent->threadStats() );
+	   		mParent->emitWide( mFilter, mLevel, mCategory, str, wcslen( str ) );
          }
 		}
       OutputBase* mParent;
       Filter mFilter;
       Level mLevel;
+      const char* mCategory;
 	};
-   /// a stream for this output class...
-	OstreamTemplate<char, OutputAdaptor> mStreamOut;
+   struct WideThreadStream : public OstreamTemplate<wchar_t, WideOutputAdaptor>
+   {
+      WideThreadStream() { alive() = true; }
+      ~WideThreadStream() { alive() = false; }
+      static bool& alive() { static thread_local bool a = false; return a; }
+   };
+   static OstreamTemplate<wchar_t, WideOutputAdaptor>& threadWideStream()
+   {
+      static thread_local WideThreadStream stream;
+      return stream;
+   }
+   static std::wostream& threadNullWideStream()
+   {
+      static thread_local std::wostream stream( NULL );
+      return stream;
+   }
+   /// the published settings: filter (low 32 bits) and level (high 32 bits) in one word,
+   /// the rest under mCategoryMutex.  mSettingsMutex serializes the writers.
+   std::atomic<uint64_t> mFilterLevel;
+   /// the level mOutStreams and mSinks get (SetLevel), and the recorder's (SetRecorder),
+   /// mFilterLevel has both.  the recorder is guarded by mWriteMutex, its level by mSettingsMutex.
+   std::atomic<unsigned int> mOutLevel;
+   unsigned int mRecordLevel;
+   Sink* mRecorder;
+   /// the tap (SetTap): the filter and level words without it and of it alone (the routing
+   /// test), the tap (set under mWriteMutex), and its subscription (under mSettingsMutex)
+   std::atomic<uint64_t> mOwnFilterLevel, mTapFilterLevel;
+   std::atomic<Sink*> mTap;
+   std::atomic<unsigned int> mTapWriters[2]; //< threads in tap()'s write right now, by the mTapEpoch they came in
+   std::atomic<unsigned int> mTapEpoch; //< which half of mTapWriters counts newcomers (setTap flips it)
+   std::mutex mTapReplaceMutex; //< one setTap at a time
+   bool mTapOn;
+   OutputSettings mTapSettings;
+   /// backtrace buffering (SetBacktrace): the levels asked for (under mSettingsMutex), the
+   /// ones of them held back (not in the output's level), the trigger filter, the ring size,
+   /// and a generation that tells the threads' rings the settings changed
+   unsigned int mBacktraceLevel;
+   std::atomic<unsigned int> mHeldLevel, mBacktraceTrigger, mBacktraceSize, mBacktraceGeneration;
+   std::mutex mSettingsMutex;
+   OutputSettings mDefaults; //< what init() set up
+   /// category state: a byte per category id (on, on for the tap, or not worked out yet),
+   /// and the EnableCategory rules and default that work it out (the output's and the tap's)
+   enum { CATEGORY_ON = 1, CATEGORY_TAP = 2, CATEGORY_UNRESOLVED = 0xff };
+   mutable std::atomic<unsigned char> mCategoryOn[SPEW_MAX_CATEGORIES];
+   std::vector<CategoryRule> mCategoryRules, mTapCategoryRules;
+   bool mCategoryDefault, mTapCategoryDefault;
+   mutable std::mutex mCategoryMutex;
+   /// rate limits by filter bit (SetRateLimit)
+   std::atomic<unsigned int> mLimitedFilters; //< published after the interval and tolerance
+   RateLimit mLimits[32];
+   std::atomic<int64_t> mLimitInterval[32], mLimitTolerance[32];
+   /// call sites with a flood to summarize (Flooded), linked through LimitedSite::mNext
+   std::atomic<LimitedSite*> mLimitSites;
+   std::mutex mLimitSitesMutex;
+   /// serializes writes to mOutStreams and mSinks
+   std::mutex mWriteMutex;
+   /// flush policies (guarded by mWriteMutex), and the timer thread for timed ones
+   std::vector<StreamFlush> mFlush;
+   std::thread mFlushTimer;
+   std::condition_variable mFlushTimerWake;
+   bool mFlushTimerStop;
+   /// repeat coalescing (guarded by mWriteMutex): the last message's hash, length and text,
+   /// and how many times it came again since it was written
+   unsigned int mRepeatMilliseconds;
+   unsigned int mRepeats;
+   size_t mLastLength;
+   uint64_t mLastHash;
+   FormatBuffer mLastMessage;
+   unsigned int mLastFilter, mLastLevel;
+   std::chrono::steady_clock::time_point mRepeatStart;
+   FormatBuffer mRepeatBuffer;
+   /// stream and sink encodings (guarded by mWriteMutex), and which ones structured messages are encoded in
+   struct StreamEncoding
+   {
+      std::ostream* mStream;
+      Sink* mSink;
+      Encoding mEncoding;
+   };
+   std::vector<StreamEncoding> mEncodings;
+   std::atomic<unsigned int> mEncodingMask;
+   FormatBuffer mEncodeBuffer[ENCODINGS]; //< plain messages, wrapped for json and tlv streams
+   /// which header fields go in front of messages (SetHeader)
+   std::atomic<unsigned int> mHeader;
+   /// binary mode, and which format ids have been written out already
+   std::atomic<bool> mBinary; //< read by every call, the writer thread and the flush timer
+   std::vector<bool> mDefined;
+   FormatBuffer mDefineBuffer;
+   enum { NO_FORMAT = 0xffffffff };
+   uint32_t mWritingFormat; //< format id of the 'M' record being written, NO_FORMAT if none
+   BinarySegmentStart mSegmentStart;
+   RecorderNoteSink mRecorderNotes;
+   FormatBuffer mSegmentBuffer;
+   /// background writer, NULL when writing synchronously
+   std::atomic<AsyncWriter<AsyncAdaptor>*> mAsync;
+   std::unique_ptr<AsyncWriter<AsyncAdaptor> > mAsyncWriter;
+   std::atomic<unsigned int> mAsyncCallers; //< threads in emitNow using mAsync right now
+   size_t mAsyncDropped; //< the last writer's dropped(), after StopAsync
+   /// this output's index in the per thread tables (see nextOutputSlot)
+   unsigned int mSlot;
+   /// counts (SetStats): each thread's block (made and freed by the thread, found through
+   /// mStatsHome along with the exited threads' totals), and the write stage's own
+   /// (guarded by mWriteMutex)
+   std::atomic<bool> mStatsOn;
+   std::shared_ptr<StatsHome> mStatsHome;
+   uint64_t mCoalesced;
+   std::vector<SinkStats> mSinkStats;
+   StatsFile mStatsFile;
+};
+
+
+/// per call site cache of "is this filter/level on?", used by SPEW_IF and SPEW_PRINTF.
+/// zero initialized, so a function-local static of this needs no init guard.
+struct CallSite
+{
+   std::atomic<unsigned int> mState; //< (generation << 1) | enabled bit, 0 == never checked
+
+   /// the generation, shifted into place.  read it before the filter, so a bit cached
+   /// under it was worked out from settings at least that new (settings can change live).
+   static inline unsigned int current() { return (gFilterGeneration.load( std::memory_order_acquire ) & 0x7fffffff) << 1; }
+
+   /// true/false when the cached bit is current, refresh() otherwise
+   inline bool isOff( unsigned int now ) const { return mState.load( std::memory_order_relaxed ) == now; }
+   inline bool isOn( unsigned int now ) const { return mState.load( std::memory_order_relaxed ) == (now | 1); }
+   inline bool refresh( unsigned int now, bool enabled )
+   {
+      mState.store( now | (enabled ? 1 : 0), std::memory_order_relaxed );
+      return enabled;
+   }
 };
 
+/// filter-first front end.
+/// the filter and level are tested before any argument is evaluated or formatted,
+/// the result is cached at each call site, so a disabled call is one compare and branch.
+/// SetFilter/AddFilter/RemoveFilter/SetLevel (on any output) invalidate the caches.
+/// a call stripped at build time (SPEW_COMPILE_MIN_LEVEL) is a constant false, its statement is dead code.
+/// NOTE: Trace is not an object in release builds, so use plain Trace( ... ) syntax with it.
+/// usage:
+/// @code
+///   SPEW_IF( spew::Log, spew::GFX, 4 ) << "scene: " << dumpScene() << std::endl;
+///   SPEW_PRINTF( spew::Log, spew::GFX, 4, "scene: %s\n", dumpScene().c_str() );
+///   if (SPEW_ENABLED( spew::Log, spew::GFX, 4 )) { ...build a big report... }
+/// @endcode
+#define SPEW_ENABLED( output, filter, level ) \
+   (SPEWNAMESPACE::compiledIn( filter, level ) && [&]() -> bool \
+   { \
+      static SPEWNAMESPACE::CallSite site_; \
+      const unsigned int now_ = SPEWNAMESPACE::CallSite::current(); \
+      if (site_.isOff( now_ )) return false; \
+      if (site_.isOn( now_ )) return true; \
+      return site_.refresh( now_, (output).IsEnabled( filter, level ) ); \
+   }())
+#define SPEW_IF( output, filter, level ) \
+   if (!SPEW_ENABLED( output, filter, level )) {} else (output)( filter, level )
+#define SPEW_PRINTF( output, filter, level, ... ) \
+   do { if (SPEW_ENABLED( output, filter, level )) (output)( filter, level, __VA_ARGS__ ); } while (0)
+
+/// SPEW_IF and SPEW_PRINTF with flood suppression at the call site (see RateLimit).
+/// 'perSecond' messages a second get through, in bursts of up to 'burst'.  the rest
+/// are counted, and the next one through is preceded by "suppressed N messages from file:line"
+/// (or when the flood stops, the output's flush timer writes it, see LimitedSite).
+/// usage:
+/// @code
+///   SPEW_PRINTF_LIMITED( spew::Log, spew::ERROR, 1, 10, 5, "backend %s down: %s\n", name, why );
+/// @endcode
+#define SPEW_LIMIT_OK( output, filter, level, perSecond, burst ) \
+   ([&]() -> bool \
+   { \
+      static SPEWNAMESPACE::LimitedSite site_( __FILE__, __LINE__ ); \
+      if (!site_.mLimit.allow( perSecond, burst )) \
+      { \
+         if (!site_.mListed.load( std::memory_order_relaxed )) (output).Flooded( site_, filter, level ); \
+         return false; \
+      } \
+      unsigned int suppressed_ = site_.mLimit.takeSuppressed(); \
+      if (0 != suppressed_) (output).Suppressed( filter, level, suppressed_, __FILE__, __LINE__ ); \
+      return true; \
+   }())
+#define SPEW_IF_LIMITED( output, filter, level, perSecond, burst ) \
+   if (!SPEW_ENABLED( output, filter, level ) || !SPEW_LIMIT_OK( output, filter, level, perSecond, burst )) {} else (output)( filter, level )
+#define SPEW_PRINTF_LIMITED( output, filter, level, perSecond, burst, ... ) \
+   do { if (SPEW_ENABLED( output, filter, level ) && SPEW_LIMIT_OK( output, filter, level, perSecond, burst )) (output)( filter, level, __VA_ARGS__ ); } while (0)
+
 
 /////////////////////////////////////////////////////////////////////////
 // --- Define some common output types ---
@@ -386,12 +2261,61 @@ private:
 /// Log  (see OutputBase for docs)
 /// use this silent logger for debug and trace output, logs messages to a file.
 /// output is on by default, call Log::SetFilter to change the filter level...
+/// where Log writes, and how much of it is kept (see MappedFile.h).
+/// #define these before including spew to change them.
+#ifndef SPEW_LOG_FILE
+#  define SPEW_LOG_FILE "log.txt"
+#endif
+#ifndef SPEW_LOG_SEGMENT_SIZE
+#  define SPEW_LOG_SEGMENT_SIZE (16 * 1024 * 1024) //< bytes per file
+#endif
+#ifndef SPEW_LOG_SEGMENTS
+#  define SPEW_LOG_SEGMENTS 4 //< log.txt plus log.txt.1 .. log.txt.3
+#endif
+/// many processes on a host: #define SPEW_LOG_COLLECTOR to a directory ("/dev/shm") and Log
+/// writes to a shared memory ring there instead of to SPEW_LOG_FILE, for spew-collector to
+/// merge into one log (see SharedRing.h).
+#ifndef SPEW_LOG_COLLECTOR_PREFIX
+#  define SPEW_LOG_COLLECTOR_PREFIX "spew"
+#endif
+#ifndef SPEW_LOG_COLLECTOR_SIZE
+#  define SPEW_LOG_COLLECTOR_SIZE (1024 * 1024) //< bytes of ring per process
+#endif
+#if defined(SPEW_LOG_COLLECTOR) && !defined(WIN32)
+struct InitLog
+{
+   void init( OutputBase<InitLog>& l )
+   {
+      reset( l );
+      ring.openLater( SPEW_LOG_COLLECTOR, SPEW_LOG_COLLECTOR_PREFIX, SPEW_LOG_COLLECTOR_SIZE );
+      l.mOutStreams.clear();
+      l.mSinks.push_back( &ring );
+   }
+   /// (see OutputBase::Open, Shutdown)
+   inline void open( OutputBase<InitLog>& l )
+   {
+      if (!ring.openNow())
+         ring.open( SPEW_LOG_COLLECTOR, SPEW_LOG_COLLECTOR_PREFIX, SPEW_LOG_COLLECTOR_SIZE );
+   }
+   inline void close( OutputBase<InitLog>& l )
+   {
+      ring.close();
+   }
+   inline void reset( OutputBase<InitLog>& l )
+   {
+      l.SetFilter( spew::FILTERALL );
+      l.SetLevel( spew::LEVEL1ANDLOWER );
+   }
+   SharedRingSink ring;
+};
+#else
 struct InitLog
 {
    void init( OutputBase<InitLog>& l )
    {
       reset( l );
-      outstr.open( "log.txt" );
+      // the file is made by the first message (or spew::init), including spew doesn't touch it
+      outstr.openLater( SPEW_LOG_FILE, SPEW_LOG_SEGMENT_SIZE, SPEW_LOG_SEGMENTS );
       l.mOutStreams.clear();
       //l.mOutStreams.push_back( &std::cout );
       //l.mOutStreams.push_back( &the<DebuggerTraceWindowOstream>() );
@@ -401,13 +2325,24 @@ struct InitLog
    {
       outstr.close();
    }
+   /// (see OutputBase::Open, Shutdown)
+   inline void open( OutputBase<InitLog>& l )
+   {
+      if (!outstr.openNow())
+         outstr.open( SPEW_LOG_FILE, SPEW_LOG_SEGMENT_SIZE, SPEW_LOG_SEGMENTS ); // again, after a shutdown
+   }
+   inline void close( OutputBase<InitLog>& l )
+   {
+      outstr.close();
+   }
    inline void reset( OutputBase<InitLog>& l )
    {
       l.SetFilter( spew::FILTERALL );
       l.SetLevel( spew::LEVEL1ANDLOWER );
    }
-   std::ofstream outstr;
+   MappedFileOstream outstr;
 };
+#endif
 //extern OutputBase<InitLog> Log;
 #define Log OutputBase<SPEWNAMESPACE::InitLog>::instance()
 
@@ -415,6 +2350,12 @@ struct InitLog
 /// Trace  (see OutputBase for docs)
 /// use Trace for debug output.
 /// output is off by default, call Trace::SetFilter to set your filter level...
+/// on linux Trace also writes to ftrace's trace_marker (see TraceMarkerSink), so messages
+/// show up in a kernel trace when one is recording.  #define SPEW_TRACE_MARKER to write
+/// somewhere else instead.
+#ifndef SPEW_TRACE_MARKER
+#  define SPEW_TRACE_MARKER NULL //< tracefs
+#endif
 struct InitTrace
 {
    void init( OutputBase<InitTrace>& l )
@@ -422,12 +2363,32 @@ struct InitTrace
       reset( l );
       l.mOutStreams.push_back( &std::cout );
       l.mOutStreams.push_back( &the<DebuggerTraceWindowOstream>() );
+#ifndef WIN32
+      // opened by the first message (or spew::init)
+      marker.openLater( SPEW_TRACE_MARKER );
+      l.mSinks.push_back( &marker );
+#endif
+   }
+#ifndef WIN32
+   /// (see OutputBase::Open, Shutdown)
+   inline void open( OutputBase<InitTrace>& l )
+   {
+      if (!marker.openNow())
+         marker.open( SPEW_TRACE_MARKER ); // again, after a shutdown
+   }
+   inline void close( OutputBase<InitTrace>& l )
+   {
+      marker.close();
    }
+#endif
    inline void reset( OutputBase<InitTrace>& l )
    {
       l.SetFilter( spew::FILTERNONE );
       l.SetLevel( spew::LEVEL1ANDLOWER );
    }
+#ifndef WIN32
+   TraceMarkerSink marker;
+#endif
 };
 #if defined(_DEBUG)
    // Trace exists only in debug mode
@@ -497,19 +2458,101 @@ struct InitEmpty
 };
 
 
+/// explicit start up.  the built in outputs already exist (see Lifetime), this opens
+/// Log's file and calibrates the clock now, instead of in the first message.
+/// after a shutdown() it opens Log's file again (the previous one rotates to log.txt.1).
+inline void init()
+{
+   Clock::instance();
+   OutputBase<InitStdOut, true>::instance().Open();
+   OutputBase<InitStdErr, true>::instance().Open();
+   OutputBase<InitLog>::instance().Open();
+#ifdef _DEBUG
+   OutputBase<InitTrace>::instance().Open();
+#endif
+}
+
+/// explicit shut down: each built in output stops its background work (async writer,
+/// flush timer, stats file), writes what's pending, flushes, and Log closes its file.
+/// the outputs stay usable, synchronously; Log drops messages until the next init().
+/// runs at exit by itself (see Lifetime), call it sooner to choose when (before _exit, say).
+inline void shutdown()
+{
+#ifdef _DEBUG
+   OutputBase<InitTrace>::instance().Shutdown();
+#endif
+   OutputBase<InitLog>::instance().Shutdown();
+   OutputBase<InitStdErr, true>::instance().Shutdown();
+   OutputBase<InitStdOut, true>::instance().Shutdown();
+}
+
+/// the library's lifetime, the "nifty counter" iostreams use for std::cout:
+/// every file that includes spew gets a Lifetime (gLifetime) ahead of its own statics.
+/// the first one constructed builds the built in outputs in their StaticStorage, and the
+/// last one destroyed calls shutdown().  so logging works from any static constructor or
+/// destructor.  like std::cout the outputs are never destroyed, a message after that is safe.
+class Lifetime
+{
+public:
+   Lifetime()
+   {
+      if (0 != mCount.fetch_add( 1, std::memory_order_acq_rel ))
+         return;
+      // what the outputs use, made first so it's destroyed after them
+      categoryRegistry();
+      FormatTable::instance();
+      new (&StaticStorage<OutputBase<InitStdOut, true> >::mBytes) OutputBase<InitStdOut, true>;
+      new (&StaticStorage<OutputBase<InitStdErr, true> >::mBytes) OutputBase<InitStdErr, true>;
+      new (&StaticStorage<OutputBase<InitLog> >::mBytes) OutputBase<InitLog>;
+#ifdef _DEBUG
+      new (&StaticStorage<OutputBase<InitTrace> >::mBytes) OutputBase<InitTrace>;
+#endif
+   }
+   ~Lifetime()
+   {
+      if (1 == mCount.fetch_sub( 1, std::memory_order_acq_rel ))
+         shutdown();
+   }
+
+private:
+   static inline std::atomic<int> mCount{ 0 };
+};
+static Lifetime gLifetime;
+
+
+/// case insensitive compare of the first n chars (strnicmp isn't available everywhere)
+inline static int compareNoCase( const char* a, const char* b, size_t n )
+{
+#ifdef WIN32
+   return strnicmp( a, b, n );
+#else
+   return strncasecmp( a, b, n );
+#endif
+}
+
 /// helper to set up the outputs via commandline
 /// commad line syntax:
 ///   -[trace|log|stderr|stdout][on|off|level][filter|level]
+///   -[trace|log|stderr|stdout][on|off]:category   (the category and everything under it)
 /// examples:
-///   myapp.exe -TraceOnGFX -LogLevel3 -StdErrNone
+///   myapp.exe -TraceOnGFX -LogLevel3 -StdErrNone -LogOn:net.http
+/// each output's changes are published at once (see OutputBase::SetSettings).
+/// 'fromDefaults' starts every output over from its defaults first (a config reload).
 /// note: in release mode Trace will be compiled out, so cmd line args will have no effect.
-inline static void parseCommandLine( int argc, char* argv[] )
+inline static void parseCommandLine( int argc, char* argv[], bool fromDefaults = false )
 {
-   // add new output types here... (and below in the switch)
+   // add new output types here... (and below, where settings are read and published)
    const int num_types = 4;
-   char* types[num_types] = { "Trace", "Log", "StdErr", "StdOut" };
+   const char* types[num_types] = { "Trace", "Log", "StdErr", "StdOut" };
    const int num_functions = 3;
-   char* function[num_functions] = { "Off", "On", "Level" };
+   const char* function[num_functions] = { "Off", "On", "Level" };
+
+   OutputSettings settings[num_types];
+   bool touched[num_types] = { fromDefaults, fromDefaults, fromDefaults, fromDefaults };
+   Trace.GetSettings( settings[0], fromDefaults );
+   Log.GetSettings( settings[1], fromDefaults );
+   StdErr.GetSettings( settings[2], fromDefaults );
+   StdOut.GetSettings( settings[3], fromDefaults );
 
    // for each command line arg
    for (int x = 0; x < argc; ++x)
@@ -519,7 +2562,7 @@ inline static void parseCommandLine( int argc, char* argv[] )
       int type = notfound;
       for (int typesIt = 0; typesIt < num_types; ++typesIt)
       {
-         if (strnicmp( types[typesIt], &argv[x][pos], strlen( types[typesIt] ) ) == 0)
+         if (compareNoCase( types[typesIt], &argv[x][pos], strlen( types[typesIt] ) ) == 0)
          {
             type = typesIt;
             pos += (int)strlen( types[typesIt] );
@@ -528,13 +2571,20 @@ inline static void parseCommandLine( int argc, char* argv[] )
       int func = notfound;
       for (int functionIt = 0; functionIt < num_functions; ++functionIt)
       {
-         if (strnicmp( function[functionIt], &argv[x][pos], strlen( function[functionIt] ) ) == 0)
+         if (compareNoCase( function[functionIt], &argv[x][pos], strlen( function[functionIt] ) ) == 0)
          {
             func = functionIt;
             pos += (int)strlen( function[functionIt] );
          }
       }
-      int tag = notfound;
+      // runtime categories, by prefix: -LogOn:net.http
+      if (notfound != type && func < 2 && ':' == argv[x][pos])
+      {
+         settings[type].EnableCategory( &argv[x][pos + 1], 1 == func );
+         touched[type] = true;
+         continue;
+      }
+      unsigned int tag = notfound;
       if (argv[x][pos] == '\0')
       {
          // support simple on/off case i.e. -TraceOff, -LogOn ("" for 3rd param)
@@ -545,7 +2595,7 @@ inline static void parseCommandLine( int argc, char* argv[] )
          int filterStringPairsIt = 0;
          while ('\0' != gTagDescriptions[filterStringPairsIt].mName[0])
          {
-            if (strnicmp( gTagDescriptions[filterStringPairsIt].mName, &argv[x][pos], strlen( gTagDescriptions[filterStringPairsIt].mName ) ) == 0)
+            if (compareNoCase( gTagDescriptions[filterStringPairsIt].mName, &argv[x][pos], strlen( gTagDescriptions[filterStringPairsIt].mName ) ) == 0)
             {
                tag = gTagDescriptions[filterStringPairsIt].mTag;
                pos += (int)strlen( gTagDescriptions[filterStringPairsIt].mName );
@@ -557,49 +2607,35 @@ inline static void parseCommandLine( int argc, char* argv[] )
       // found one, set the flag...
       if (notfound != type && notfound != func && notfound != tag)
       {
-         switch (type)
+         switch (func)
          {
-         // add new output types here...
-         case 0: 
-            switch (func)
-            {
-            case 0: Trace.RemoveFilter( tag ); break;
-            case 1: Trace.AddFilter( tag ); break;
-            case 2: Trace.SetLevel( (Level)tag ); break;
-            }
-            break;
-         case 1: 
-            switch (func)
-            {
-            case 0: Log.RemoveFilter( tag ); break;
-            case 1: Log.AddFilter( tag ); break;
-            case 2: Log.SetLevel( (Level)tag ); break;
-            }
-            break;
-         case 2:
-            switch (func)
-            {
-            case 0: StdErr.RemoveFilter( tag ); break;
-            case 1: StdErr.AddFilter( tag ); break;
-            case 2: StdErr.SetLevel( (Level)tag ); break;
-            }
-            break;
-         case 3:
-            switch (func)
-            {
-            case 0: StdOut.RemoveFilter( tag ); break;
-            case 1: StdOut.AddFilter( tag ); break;
-            case 2: StdOut.SetLevel( (Level)tag ); break;
-            }
-            break;
-         } // switch
+         case 0: settings[type].RemoveFilter( tag ); break;
+         case 1: settings[type].AddFilter( tag ); break;
+         case 2: settings[type].SetLevel( tag ); break;
+         }
+         touched[type] = true;
       }
    } // for argv...
+
+   if (touched[0]) Trace.SetSettings( settings[0] );
+   if (touched[1]) Log.SetSettings( settings[1] );
+   if (touched[2]) StdErr.SetSettings( settings[2] );
+   if (touched[3]) StdOut.SetSettings( settings[3] );
 }
 
 /// Unit test for Outputs.
 struct OutputUnitTest
 {
+   /// a printf style wrapper, into the va_list overload
+   template <typename Output>
+   static void vsprintfTest( Output& out, Filter filter, const char* fmtstr, ... )
+   {
+      va_list arg_ptr;
+      va_start( arg_ptr, fmtstr );
+      out( filter, fmtstr, arg_ptr );
+      va_end( arg_ptr );
+   }
+
    static void test()
    {
       /// some common examples
@@ -644,7 +2680,7 @@ struct OutputUnitTest
       mycustomoutput << "bok" << std::flush;
       if (str.str() == "bok")
       {
-         StdOut( "'bok' written successfully", str.str().c_str() );
+         StdOut( "'%s' written successfully", str.str().c_str() );
       }
       StdOut( "]\n" );
 
@@ -694,6 +2730,771 @@ struct OutputUnitTest
       mycustomoutput( PHYSICS, LEVEL4, "F" );
       mycustomoutput( PHYSICS, LEVEL5, "F" );
       StdOut( "]\n" );
+
+      // test filter-first call sites, and that filter changes invalidate them.
+      StdOut( "running call site cache tests on custom output... [" );
+      mycustomoutput.SetFilter( GFX );
+      mycustomoutput.SetLevel( LEVEL2ANDLOWER );
+      for (int x = 0; x < 2; ++x)
+      {
+         int evaluated = 0;
+         SPEW_IF( mycustomoutput, IO, 1 ) << "F" << ++evaluated;
+         SPEW_PRINTF( mycustomoutput, GFX, 3, "F%d", ++evaluated );
+         SPEW_PRINTF( mycustomoutput, GFX, 2, "%s", 0 == evaluated ? "." : "F" );
+         SPEW_IF( mycustomoutput, GFX, 1 ) << "." << std::flush;
+         mycustomoutput( IO, 1 ) << "F" << std::flush;
+         mycustomoutput.SetFilter( GFX ); // same setting, new generation
+      }
+      for (int x = 0; x < 2; ++x)
+      {
+         // same call site goes from off to on
+         SPEW_IF( mycustomoutput, IO, 1 ) << (0 == x ? "F" : ".") << std::flush;
+         mycustomoutput.AddFilter( IO );
+      }
+      StdOut( "]\n" );
+
+      // test the async writer: everything arrives, in order, nothing lost at stop.
+      StdOut( "running async tests on custom output... [" );
+      std::stringstream asyncstr, expected;
+      OutputBase<InitEmpty, true> asyncoutput;
+      asyncoutput.mOutStreams.push_back( &asyncstr );
+      asyncoutput.StartAsync( 16, OVERFLOW_BLOCK ); // small ring, producer has to block
+      for (int x = 0; x < 1000; ++x)
+      {
+         asyncoutput( "%d,", x );
+         expected << x << ",";
+      }
+      StdOut( "%s", asyncoutput.StopAsync() ? "." : "F" );
+      StdOut( "%s", asyncstr.str() == expected.str() ? "." : "F" );
+      asyncoutput.StartAsync( 2, OVERFLOW_DROP_COUNT );
+      for (int x = 0; x < 1000; ++x)
+         asyncoutput( "x" );
+      asyncoutput.StopAsync();
+      StdOut( "%s", 0 < asyncoutput.GetDropped() && std::string::npos != asyncstr.str().find( "dropped" ) ? "." : "F" );
+      // a producer late to a stopped writer drops instead of blocking on a ring nobody drains
+      struct NullAsyncOut
+      {
+         void write( const char*, size_t, unsigned int, unsigned int ) {}
+         void printf( const char* ) {}
+         void flush() {}
+      };
+      AsyncWriter<NullAsyncOut> stopped( NullAsyncOut(), 2, OVERFLOW_BLOCK );
+      stopped.stop( 0 );
+      bool late = false;
+      for (int x = 0; x < 4; ++x)
+         late = stopped.push( "x", 1, FILTERALL, 1 ) || late;
+      StdOut( "%s", !late && 4 == stopped.dropped() ? "." : "F" );
+      // producers racing stop: every push that said true is written, the rest are counted
+      struct CountAsyncOut
+      {
+         std::atomic<size_t>* mWritten;
+         void write( const char*, size_t, unsigned int, unsigned int ) { ++*mWritten; }
+         void printf( const char* ) {}
+         void flush() {}
+      };
+      bool accounted = true;
+      for (int round = 0; round < 20; ++round)
+      {
+         std::atomic<size_t> written( 0 ), accepted( 0 );
+         CountAsyncOut counter = { &written };
+         AsyncWriter<CountAsyncOut> racing( counter, 64, OVERFLOW_DROP_COUNT );
+         std::vector<std::thread> producers;
+         for (int t = 0; t < 4; ++t)
+            producers.push_back( std::thread( [&racing, &accepted]() {
+               for (int x = 0; x < 500; ++x)
+                  if (racing.push( "x", 1, FILTERALL, 1 ))
+                     ++accepted;
+            } ) );
+         racing.stop( 1000 );
+         for (size_t t = 0; t < producers.size(); ++t)
+            producers[t].join();
+         accounted = accounted && written == accepted && 2000 == accepted + racing.dropped();
+      }
+      StdOut( "%s", accounted ? "." : "F" );
+      // start and stop while other threads log: nothing lost, each writer freed at its stop
+      std::stringstream cyclestr;
+      OutputBase<InitEmpty, true> cycleoutput;
+      cycleoutput.mOutStreams.push_back( &cyclestr );
+      std::atomic<bool> cycling( true );
+      std::atomic<size_t> cycleLogged( 0 );
+      std::vector<std::thread> cyclers;
+      for (int t = 0; t < 3; ++t)
+         cyclers.push_back( std::thread( [&cycleoutput, &cycling, &cycleLogged]() {
+            int x = 0;
+            for (; x < 3000 || cycling; ++x)
+               cycleoutput( "x\n" );
+            cycleLogged += x;
+         } ) );
+      size_t cycleDropped = 0;
+      for (int x = 0; x < 50; ++x)
+      {
+         cycleoutput.StartAsync( 64, OVERFLOW_BLOCK );
+         std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+         cycleoutput.StopAsync();
+         cycleDropped += cycleoutput.GetDropped();
+      }
+      cycling = false;
+      for (size_t t = 0; t < cyclers.size(); ++t)
+         cyclers[t].join();
+      std::string cycled = cyclestr.str();
+      StdOut( "%s", 0 == cycleDropped && cycled.size() == 2 * cycleLogged && cycled.size() == 2 * (size_t)std::count( cycled.begin(), cycled.end(), 'x' ) ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test threads: no truncation, no text or filters mixed between threads.
+      StdOut( "running thread tests on custom output... [" );
+      std::stringstream threadstr;
+      OutputBase<InitEmpty, true> threadoutput;
+      threadoutput.mOutStreams.push_back( &threadstr );
+      threadoutput.SetFilter( GFX );
+      std::string big( 1000, 'x' );
+      threadoutput( GFX, "%s", big.c_str() );
+      StdOut( "%s", threadstr.str() == big ? "." : "F" );
+      threadstr.str( "" );
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 4; ++t)
+      {
+         threads.push_back( std::thread( [&threadoutput, t]()
+         {
+            for (int x = 0; x < 1000; ++x)
+            {
+               threadoutput( 0 == t % 2 ? GFX : IO ) << "<" << t << ">" << std::flush;
+               threadoutput( GFX, "<%d>", t );
+            }
+         } ) );
+      }
+      for (size_t t = 0; t < threads.size(); ++t)
+         threads[t].join();
+      int counts[4] = { 0, 0, 0, 0 };
+      for (size_t x = 0; x + 2 < threadstr.str().size(); x += 3)
+         if ('<' == threadstr.str()[x] && '>' == threadstr.str()[x+2])
+            ++counts[threadstr.str()[x+1] - '0'];
+      StdOut( "%s", 2000 == counts[0] && 1000 == counts[1] && 2000 == counts[2] && 1000 == counts[3] ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test binary mode: decodes to what text mode would have written.
+      StdOut( "running binary mode tests on custom output... [" );
+      std::stringstream binarystr;
+      OutputBase<InitEmpty, true> binaryoutput;
+      binaryoutput.mOutStreams.push_back( &binarystr );
+      binaryoutput.SetBinary( true );
+      for (int x = 0; x < 3; ++x)
+      {
+         binaryoutput( GFX, "frame %d took %.2f ms (%s)\n", x, 16.5 + x, "ok" );
+         binaryoutput( GFX ) << "stream " << x << std::endl;
+      }
+      binaryoutput( IO, 1, "%s", "done\n" );
+      std::string bytes = binarystr.str();
+      FormatBuffer decoded;
+      BinaryDecoder decoder;
+      for (const char* p = bytes.data(), *end = p + bytes.size(); p < end;)
+      {
+         long used = decoder.decode( p, end, decoded );
+         if (used <= 0)
+            break;
+         p += used;
+      }
+      StdOut( "%s", std::string( decoded.c_str(), decoded.size() ) ==
+              "frame 0 took 16.50 ms (ok)\nstream 0\nframe 1 took 17.50 ms (ok)\nstream 1\n"
+              "frame 2 took 18.50 ms (ok)\nstream 2\ndone\n" ? "." : "F" );
+#ifndef WIN32
+      // through tiny rotating segments: each one decodes on its own, even the ones whose
+      // first use of a format was in a segment that's gone
+      {
+         const char* name = "spew-binary-rotate.txt";
+         OutputBase<InitEmpty, true> rotating;
+         MappedFileOstream segments;
+         segments.open( name, 4096, 3 );
+         rotating.mOutStreams.push_back( &segments );
+         rotating.SetBinary( true );
+         for (int x = 0; x < 2000; ++x)
+         {
+            rotating( GFX, "frame %d took %.2f ms\n", x, 16.5 );
+            if (0 == x % 7)
+               rotating( IO, "tick %u\n", (unsigned int)x );
+         }
+         segments.close();
+         bool alone = true;
+         for (int n = 0; n < 3; ++n)
+         {
+            std::ifstream file( 0 == n ? std::string( name ) : std::string( name ) + "." + std::to_string( n ) );
+            std::string segment( (std::istreambuf_iterator<char>( file )), std::istreambuf_iterator<char>() );
+            FormatBuffer text;
+            BinaryDecoder fresh;
+            const char* p = segment.data(), *end = p + segment.size();
+            long used = 1;
+            while (p < end && 0 < (used = fresh.decode( p, end, text )))
+               p += used;
+            alone = alone && !segment.empty() && p == end && 0 == strncmp( segment.data(), gBinaryHeader, 8 ) &&
+                    (0 == strncmp( text.c_str(), "frame ", 6 ) || 0 == strncmp( text.c_str(), "tick ", 5 ));
+            ::remove( (0 == n ? std::string( name ) : std::string( name ) + "." + std::to_string( n )).c_str() );
+         }
+         StdOut( "%s", alone ? "." : "F" );
+      }
+#endif
+      StdOut( "]\n" );
+
+      // test flush policies: count the flushes each stream gets.
+      StdOut( "running flush policy tests on custom output... [" );
+      struct CountingBuf : public std::stringbuf
+      {
+         CountingBuf() : mSyncs( 0 ) {}
+         int sync() { ++mSyncs; return 0; }
+         std::atomic<int> mSyncs; //< the flush timer thread bumps this too
+      };
+      CountingBuf everyBuf, bytesBuf, timedBuf;
+      std::ostream everyStream( &everyBuf ), bytesStream( &bytesBuf ), timedStream( &timedBuf );
+      OutputBase<InitEmpty, true> flushoutput;
+      flushoutput.SetFilter( FILTERALL );
+      flushoutput.mOutStreams.push_back( &everyStream );
+      flushoutput.mOutStreams.push_back( &bytesStream );
+      flushoutput.mOutStreams.push_back( &timedStream );
+      flushoutput.SetFlushPolicy( &bytesStream, FlushPolicy::EveryBytes( 100 ).Urgent( ERROR ) );
+      flushoutput.SetFlushPolicy( &timedStream, FlushPolicy::EveryMilliseconds( 20 ) );
+      for (int x = 0; x < 10; ++x)
+         flushoutput( GFX, "message %04d of 30 bytes.....\n", x );
+      StdOut( "%s", 10 == everyBuf.mSyncs && 2 == bytesBuf.mSyncs ? "." : "F" );
+      flushoutput( ERROR, "urgent\n" );
+      StdOut( "%s", 3 == bytesBuf.mSyncs ? "." : "F" );
+      std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+      StdOut( "%s", 1 == timedBuf.mSyncs && 3 == bytesBuf.mSyncs ? "." : "F" );
+      flushoutput.StartAsync( 64, OVERFLOW_BLOCK );
+      for (int x = 0; x < 10; ++x)
+         flushoutput( GFX, "message %04d of 30 bytes.....\n", x );
+      flushoutput.StopAsync();
+      StdOut( "%s", 5 == bytesBuf.mSyncs && everyBuf.str() == bytesBuf.str() ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test rate limits: a flood is cut to the burst, then summarized.
+      StdOut( "running rate limit tests on custom output... [" );
+      std::stringstream limitstr;
+      OutputBase<InitEmpty, true> limitoutput;
+      limitoutput.mOutStreams.push_back( &limitstr );
+      limitoutput.SetFilter( FILTERALL );
+      limitoutput.SetRateLimit( IO, 20, 5 );
+      for (int x = 0; x < 100; ++x)
+      {
+         limitoutput( IO, "io %d\n", x );
+         limitoutput( IO ) << "io stream " << x << std::endl;
+         limitoutput( GFX, "gfx %d\n", x ); // not limited
+      }
+      std::string limited = limitstr.str();
+      StdOut( "%s", std::string::npos != limited.find( "io 2\n" ) && std::string::npos != limited.find( "io stream 1\n" ) &&
+                    std::string::npos == limited.find( "io 3\n" ) && std::string::npos == limited.find( "io stream 2\n" ) &&
+                    std::string::npos != limited.find( "gfx 99\n" ) ? "." : "F" );
+      // (the summary comes from the next message through, or the flush timer if the bucket filled first)
+      size_t floodEnd = limited.size();
+      std::this_thread::sleep_for( std::chrono::milliseconds( 120 ) );
+      limitoutput( IO, "io again\n" );
+      StdOut( "%s", limitstr.str().substr( floodEnd ) == "suppressed 195 IO messages\nio again\n" ? "." : "F" );
+      std::string flood;
+      for (int pass = 0; pass < 2; ++pass)
+      {
+         if (0 == pass)
+            limitstr.str( "" );
+         for (int x = 0; x < (0 == pass ? 100 : 2); ++x)
+            SPEW_PRINTF_LIMITED( limitoutput, GFX, 1, 20, 3, "site %d\n", x );
+         if (0 == pass)
+         {
+            flood = limitstr.str();
+            std::this_thread::sleep_for( std::chrono::milliseconds( 120 ) );
+         }
+      }
+      StdOut( "%s", flood == "site 0\nsite 1\nsite 2\n" ? "." : "F" );
+      StdOut( "%s", flood.size() == limitstr.str().find( "suppressed 97 messages from " ) &&
+                    limitstr.str().size() - strlen( "site 0\nsite 1\n" ) == limitstr.str().find( "site 0\nsite 1\n", flood.size() ) ? "." : "F" );
+      // a flood that just stops is summarized anyway (by the flush timer), once its bucket is full again
+      struct LockedSink : public Sink
+      {
+         std::mutex mMutex;
+         std::string mText;
+         void write( const char* data, size_t length ) { std::lock_guard<std::mutex> lock( mMutex ); mText.append( data, length ); }
+         std::string text() { std::lock_guard<std::mutex> lock( mMutex ); return mText; }
+      } floodsink;
+      OutputBase<InitEmpty, true> floodoutput;
+      floodoutput.mSinks.push_back( &floodsink );
+      floodoutput.SetRateLimit( IO, 20, 3 );
+      for (int x = 0; x < 50; ++x)
+      {
+         floodoutput( IO, "io flood %d\n", x );
+         SPEW_PRINTF_LIMITED( floodoutput, GFX, 1, 20, 3, "site flood %d\n", x );
+      }
+      std::string floodsOver = floodsink.text();
+      for (int x = 0; x < 200 && (std::string::npos == floodsOver.find( "suppressed 47 IO messages\n" ) ||
+                                  std::string::npos == floodsOver.find( "suppressed 47 messages from " )); ++x)
+      {
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+         floodsOver = floodsink.text();
+      }
+      StdOut( "%s", std::string::npos != floodsOver.find( "suppressed 47 IO messages\n" ) && std::string::npos != floodsOver.find( "suppressed 47 messages from " ) ? "." : "F" );
+      // and Shutdown writes what's still pending
+      std::stringstream shutstr;
+      OutputBase<InitEmpty, true> shutoutput;
+      shutoutput.mOutStreams.push_back( &shutstr );
+      shutoutput.SetRateLimit( IO, 1, 1 );
+      for (int x = 0; x < 3; ++x)
+         shutoutput( IO, "io %d\n", x );
+      shutoutput.Shutdown();
+      StdOut( "%s", shutstr.str() == "io 0\nsuppressed 2 IO messages\n" ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test runtime categories: prefixes cover subtrees, the Filter constants are categories too.
+      StdOut( "running category tests on custom output... [" );
+      std::stringstream categorystr;
+      OutputBase<InitEmpty, true> categoryoutput;
+      categoryoutput.mOutStreams.push_back( &categorystr );
+      Category client( "test.net.http.client" ), https( "test.net.https" ), http( "test.net.http" );
+      StdOut( "%s", 0 == Category( "GFX" ).mId && 7 == Category( "ERROR" ).mId && 32 <= client.mId &&
+                    client.mId == Category( "test.net.http.client" ).mId && "test.net.https" == https.name() ? "." : "F" );
+      StdOut( "%s", categoryoutput.IsEnabled( client, 1 ) && categoryoutput.IsEnabled( GFX, 1 ) ? "." : "F" ); // FILTERALL
+      categoryoutput.SetFilter( FILTERNONE );
+      categoryoutput.EnableCategory( "TEST.net.http", true );
+      Category server( "test.net.http.server" ); // registered after the rule, still covered
+      StdOut( "%s", categoryoutput.IsEnabled( client, 1 ) && categoryoutput.IsEnabled( http, 1 ) &&
+                    categoryoutput.IsEnabled( server, 1 ) && !categoryoutput.IsEnabled( https, 1 ) &&
+                    !categoryoutput.IsEnabled( client, 2 ) ? "." : "F" );
+      categoryoutput.EnableCategory( "test.net.http.server", false );
+      categoryoutput.EnableCategory( "gfx", true );
+      StdOut( "%s", !categoryoutput.IsEnabled( server, 1 ) && categoryoutput.IsEnabled( client, 1 ) &&
+                    categoryoutput.IsEnabled( GFX, 1 ) && categoryoutput.IsEnabled( Category( "GFX" ), 1 ) &&
+                    !categoryoutput.IsEnabled( IO, 1 ) ? "." : "F" );
+      categoryoutput( client, "client %d\n", 1 );
+      categoryoutput( server, 1, "server %d\n", 1 );
+      categoryoutput( client ) << "client stream" << std::endl;
+      categoryoutput( https ) << "https stream" << std::endl;
+      StdOut( "%s", categorystr.str() == "client 1\nclient stream\n" ? "." : "F" );
+      const char* args[] = { "app", "-StdErrOn:test.cli", "-StdErrOff:test.cli.quiet" };
+      parseCommandLine( 3, (char**)args );
+      StdOut( "%s", StdErr.IsEnabled( Category( "test.cli.loud" ), 1 ) && !StdErr.IsEnabled( Category( "test.cli.quiet.x" ), 1 ) &&
+                    !StdErr.IsEnabled( Category( "test.clix" ), 1 ) ? "." : "F" );
+      StdErr.SetDefaults();
+      StdOut( "]\n" );
+
+      // test settings: published all at once, a reader never sees one output's filter with the other's level.
+      StdOut( "running settings tests on custom output... [" );
+      OutputBase<InitEmpty, true> settingsoutput;
+      OutputSettings gfxSettings, ioSettings;
+      gfxSettings.SetFilter( GFX );
+      gfxSettings.SetLevel( LEVEL1ANDLOWER );
+      ioSettings.SetFilter( IO );
+      ioSettings.SetLevel( LEVEL5ANDLOWER );
+      ioSettings.EnableCategory( "net", true );
+      settingsoutput.SetSettings( ioSettings );
+      OutputSettings got;
+      settingsoutput.GetSettings( got );
+      StdOut( "%s", IO == got.mFilter && LEVEL5ANDLOWER == got.mLevel && 1 == got.mCategoryRules.size() ? "." : "F" );
+      settingsoutput.GetSettings( got, true );
+      StdOut( "%s", FILTERALL == got.mFilter && LEVEL1ANDLOWER == got.mLevel && got.mCategoryDefault && got.mCategoryRules.empty() ? "." : "F" );
+      std::atomic<bool> settingsDone( false );
+      std::thread settingsWriter( [&]()
+      {
+         for (int x = 0; x < 20000; ++x)
+            settingsoutput.SetSettings( 0 == (x & 1) ? gfxSettings : ioSettings );
+         settingsDone = true;
+      } );
+      bool torn = false;
+      while (!settingsDone)
+         torn = torn || settingsoutput.IsEnabled( GFX, LEVEL5 );
+      settingsWriter.join();
+      StdOut( "%s", !torn ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test structured messages: one call, each stream and sink in its own encoding.
+      StdOut( "running structured tests on custom output... [" );
+      std::stringstream structuredtext;
+      MemorySink jsonSink, tlvSink;
+      OutputBase<InitEmpty, true> structuredoutput;
+      structuredoutput.mOutStreams.push_back( &structuredtext );
+      structuredoutput.mSinks.push_back( &jsonSink );
+      structuredoutput.mSinks.push_back( &tlvSink );
+      structuredoutput.SetEncoding( &jsonSink, ENCODE_JSON );
+      structuredoutput.SetEncoding( &tlvSink, ENCODE_TLV );
+      structuredoutput.SetLevel( LEVEL2ANDLOWER );
+      std::string path( "/index.html" );
+      structuredoutput( IO, 2, "request done", { { "path", path }, { "status", 200 }, { "ms", 3.5 } } );
+      structuredoutput( IO, "plain %d\n", 1 );
+      static const Category STRUCTURED_HTTP( "net.http.structured" );
+      structuredoutput( STRUCTURED_HTTP, 1, "get", { { "ok", true } } );
+      StdOut( "%s", structuredtext.str() == "request done path=\"/index.html\" status=200 ms=3.5\nplain 1\nget ok=true\n" ? "." : "F" );
+      StdOut( "%s", jsonSink.str() == "{\"level\":2,\"filter\":\"IO\",\"msg\":\"request done\",\"path\":\"/index.html\",\"status\":200,\"ms\":3.5}\n"
+                                      "{\"level\":1,\"filter\":\"IO\",\"msg\":\"plain 1\"}\n"
+                                      "{\"level\":1,\"category\":\"net.http.structured\",\"msg\":\"get\",\"ok\":true}\n" ? "." : "F" );
+      BinaryDecoder tlvDecoder;
+      FormatBuffer tlvText;
+      for (const char* p = tlvSink.str().data(), *end = p + tlvSink.str().size(); p < end; )
+      {
+         long used = tlvDecoder.decode( p, end, tlvText );
+         if (used <= 0)
+            break;
+         p += used;
+      }
+      StdOut( "%s", std::string( tlvText.c_str(), tlvText.size() ) == structuredtext.str() ? "." : "F" );
+      // binary mode: a 'K' record, like the tlv sink's
+      std::stringstream structuredbinary;
+      OutputBase<InitEmpty, true> structuredbinaryoutput;
+      structuredbinaryoutput.mOutStreams.push_back( &structuredbinary );
+      structuredbinaryoutput.SetLevel( LEVEL2ANDLOWER );
+      structuredbinaryoutput.SetBinary( true );
+      structuredbinaryoutput( IO, 2, "request done", { { "path", path }, { "status", 200 }, { "ms", 3.5 } } );
+      std::string binaryRecord = structuredbinary.str().substr( sizeof( gBinaryHeader ) - 1 );
+      StdOut( "%s", binaryRecord == tlvSink.str().substr( 0, binaryRecord.size() ) ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test repeat coalescing: runs are held back and counted.
+      StdOut( "running repeat coalescing tests on custom output... [" );
+      std::stringstream repeatstr;
+      OutputBase<InitEmpty, true> repeatoutput;
+      repeatoutput.mOutStreams.push_back( &repeatstr );
+      repeatoutput.SetRepeatCoalescing( 50 );
+      for (int x = 0; x < 100; ++x)
+         repeatoutput( IO, "poll\n" );
+      for (int x = 0; x < 3; ++x)
+         repeatoutput( IO ) << "stream poll" << std::endl;
+      repeatoutput( IO, "done %d\n", 1 );
+      repeatoutput( IO, "done %d\n", 2 );
+      StdOut( "%s", repeatstr.str() == "poll\nlast message repeated 99 times\nstream poll\n"
+                                       "last message repeated 2 times\ndone 1\ndone 2\n" ? "." : "F" );
+      struct LockedBuf : public std::stringbuf //< the flush timer thread writes this one
+      {
+         std::streamsize xsputn( const char* data, std::streamsize length )
+         {
+            std::lock_guard<std::mutex> lock( mMutex );
+            return std::stringbuf::xsputn( data, length );
+         }
+         std::string text() { std::lock_guard<std::mutex> lock( mMutex ); return str(); }
+         std::mutex mMutex;
+      };
+      LockedBuf timedRepeatBuf;
+      std::ostream timedRepeatStream( &timedRepeatBuf );
+      repeatoutput.mOutStreams[0] = &timedRepeatStream;
+      for (int x = 0; x < 10; ++x)
+         repeatoutput( IO, "poll\n" );
+      std::this_thread::sleep_for( std::chrono::milliseconds( 150 ) ); // the timer ends the run
+      StdOut( "%s", timedRepeatBuf.text() == "poll\nlast message repeated 9 times\n" ? "." : "F" );
+      repeatoutput.SetRepeatCoalescing( 0 );
+      repeatoutput.mOutStreams.clear(); // timedRepeatStream goes first
+      StdOut( "]\n" );
+
+      // test headers: written in front of every kind of message, left out where they don't belong.
+      StdOut( "running header tests on custom output... [" );
+      std::stringstream headerstr;
+      MemorySink headerJson;
+      OutputBase<InitEmpty, true> headeroutput;
+      headeroutput.mOutStreams.push_back( &headerstr );
+      headeroutput.SetLevel( LEVEL2ANDLOWER );
+      headeroutput.SetHeader( HEADER_LEVEL | HEADER_CATEGORY );
+      Category headerCategory( "test.header.client" );
+      headeroutput( IO, 2, "printf %d\n", 1 );
+      headeroutput( headerCategory, "category %d\n", 2 );
+      headeroutput( IO ) << "stream" << std::endl;
+      headeroutput( headerCategory ) << "category stream" << std::endl;
+      vsprintfTest( headeroutput, GFX, "va_list %d\n", 3 );
+      headeroutput( "default\n" );
+      StdOut( "%s", headerstr.str() == "L2 IO: printf 1\nL1 test.header.client: category 2\nL1 IO: stream\n"
+                                       "L1 test.header.client: category stream\nL1 GFX: va_list 3\nL1: default\n" ? "." : "F" );
+      headerstr.str( "" );
+      headeroutput.SetHeader( HEADER_DEFAULT );
+      headeroutput( GFX, "x\n" );
+      std::string line = headerstr.str();
+      char threadTag[32];
+      snprintf( threadTag, sizeof( threadTag ), " [%u] L1 GFX: x\n", threadId() );
+      StdOut( "%s", 26 < line.size() && '-' == line[4] && ' ' == line[10] && ':' == line[13] && '.' == line[19] &&
+                    line.substr( 26 ) == threadTag ? "." : "F" );
+      // repeats are still repeats, the time in front of them differs
+      headerstr.str( "" );
+      headeroutput.SetRepeatCoalescing( 1000 );
+      for (int x = 0; x < 5; ++x)
+         headeroutput( IO, "poll\n" );
+      headeroutput( IO, "done\n" );
+      line = headerstr.str();
+      StdOut( "%s", 3 == std::count( line.begin(), line.end(), '\n' ) &&
+                    std::string::npos != line.find( "L1 IO: poll\n" ) &&
+                    std::string::npos != line.find( "L1 IO: last message repeated 4 times\n" ) &&
+                    line.size() - 12 == line.find( "L1 IO: done\n" ) ? "." : "F" );
+      headeroutput.SetRepeatCoalescing( 0 );
+      // json gets the message, not the header
+      headerstr.str( "" );
+      headeroutput.SetHeader( HEADER_LEVEL | HEADER_CATEGORY );
+      headeroutput.mSinks.push_back( &headerJson );
+      headeroutput.SetEncoding( &headerJson, ENCODE_JSON );
+      headeroutput( IO, 2, "hi\n" );
+      StdOut( "%s", headerstr.str() == "L2 IO: hi\n" && std::string::npos == headerJson.str().find( "L2 IO" ) &&
+                    std::string::npos != headerJson.str().find( "\"msg\":\"hi" ) ? "." : "F" );
+      headeroutput.mSinks.clear();
+      StdOut( "]\n" );
+
+      // test stats: each thread's counts add up, filtered/suppressed/coalesced are told apart,
+      // bytes per stream and sink match what they got.
+      StdOut( "running stats tests on custom output... [" );
+      std::stringstream statsstr;
+      MemorySink statsSink;
+      OutputBase<InitEmpty, true> statsoutput;
+      statsoutput.mOutStreams.push_back( &statsstr );
+      statsoutput.mSinks.push_back( &statsSink );
+      statsoutput.SetLevel( LEVEL2ANDLOWER );
+      statsoutput( GFX, "not counted %d\n", 0 );
+      statsoutput.SetStats( true );
+      statsoutput( GFX, "one %d\n", 1 );
+      statsoutput( GFX, 4, "filtered %d\n", 2 );
+      statsoutput( GFX, 4 ) << "filtered" << std::endl;
+      statsoutput( GFX ) << "two" << std::endl;
+      std::thread statsThread( [&statsoutput]()
+      {
+         for (int x = 0; x < 3; ++x)
+            statsoutput( IO, "thread %d\n", x );
+      } );
+      statsThread.join();
+      OutputStats stats;
+      statsoutput.GetStats( stats );
+      StdOut( "%s", 5 == stats.mEmitted && 2 == stats.mFiltered && 5 == stats.mCall.count() && 0 != stats.mCall.max() ? "." : "F" );
+      StdOut( "%s", 2 == stats.mSinks.size() && &statsstr == stats.mSinks[0].mStream && &statsSink == stats.mSinks[1].mSink &&
+                    statsstr.str().size() - strlen( "not counted 0\n" ) == stats.mSinks[0].mBytes &&
+                    5 == stats.mSinks[0].mWrites && 5 == stats.mSinks[1].mWrites && 5 == stats.mSinks[1].mWrite.count() ? "." : "F" );
+      statsoutput.SetRateLimit( SOUND, 1, 2 );
+      for (int x = 0; x < 5; ++x)
+         statsoutput( SOUND, "flood\n" );
+      statsoutput.Suppressed( SOUND, 1, 7, "file.cpp", 10 );
+      statsoutput.SetRepeatCoalescing( 1000 );
+      for (int x = 0; x < 4; ++x)
+         statsoutput( IO, "same\n" );
+      statsoutput.SetRepeatCoalescing( 0 );
+      statsoutput.GetStats( stats );
+      StdOut( "%s", 3 + 7 == stats.mSuppressed && 3 == stats.mCoalesced && 5 + 2 + 1 + 4 == stats.mEmitted ? "." : "F" );
+      // dumped to a file, as text
+      std::string statsPath = "spew-stats-test.txt";
+      statsoutput.DumpStats( statsPath.c_str(), 60000 );
+      statsoutput.DumpStats( NULL, 0 ); // the last word is written when it stops
+      std::ifstream statsFile( statsPath.c_str() );
+      std::string statsText( (std::istreambuf_iterator<char>( statsFile )), std::istreambuf_iterator<char>() );
+      statsFile.close();
+      remove( statsPath.c_str() );
+      StdOut( "%s", 0 == statsText.find( "emitted 12\nfiltered 2\nsuppressed 10\n" ) &&
+                    std::string::npos != statsText.find( "\nstream 0: bytes " ) && std::string::npos != statsText.find( "\nsink 0: bytes " ) ? "." : "F" );
+      // threads that come and go: their blocks are freed, their counts stay in the totals
+      uint64_t before = stats.mEmitted;
+      for (int x = 0; x < 20; ++x)
+         std::thread( [&statsoutput]() { statsoutput( IO, "short lived\n" ); } ).join();
+      statsoutput.GetStats( stats );
+      StdOut( "%s", before + 20 == stats.mEmitted ? "." : "F" );
+      statsoutput.SetStats( false );
+      StdOut( "]\n" );
+
+      // test the recorder: it gets every level it asked for, the streams only their own
+      StdOut( "running recorder tests on custom output... [" );
+      std::stringstream recordstr;
+      MemorySink recorder;
+      OutputBase<InitEmpty, true> recordoutput;
+      recordoutput.mOutStreams.push_back( &recordstr );
+      recordoutput.SetLevel( LEVEL2ANDLOWER );
+      recordoutput.SetRecorder( &recorder, LEVEL5ANDLOWER );
+      StdOut( "%s", recordoutput.IsEnabled( IO, 5 ) && LEVEL2ANDLOWER == recordoutput.GetLevel() ? "." : "F" );
+      for (int x = 1; x <= 5; ++x)
+         recordoutput( IO, x, "level %d\n", x );
+      recordoutput( IO, 4 ) << "stream 4" << std::endl;
+      recordoutput( IO, 3, "fields", { { "n", 3 } } );
+      recordoutput( IO, 2, "fields", { { "n", 2 } } );
+      StdOut( "%s", recordstr.str() == "level 1\nlevel 2\nfields n=2\n" &&
+                    recorder.str() == "level 1\nlevel 2\nlevel 3\nlevel 4\nlevel 5\nstream 4\nfields n=3\nfields n=2\n" ? "." : "F" );
+      recorder.clear();
+      recordoutput.RecorderNotes().write( "note\n", 5 );
+      StdOut( "%s", recorder.str() == "note\n" && recordstr.str() == "level 1\nlevel 2\nfields n=2\n" ? "." : "F" );
+      recordoutput.SetRecorder( NULL );
+      recorder.clear();
+      recordoutput.RecorderNotes().write( "note\n", 5 );
+      recordoutput( IO, 5, "level %d\n", 5 );
+      StdOut( "%s", !recordoutput.IsEnabled( IO, 5 ) && recorder.str().empty() && LEVEL2ANDLOWER == recordoutput.GetLevel() ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test backtraces: detail is held per thread, and written just before an error on that thread
+      StdOut( "running backtrace tests on custom output... [" );
+      std::stringstream backtracestr;
+      OutputBase<InitEmpty, true> backtraceoutput;
+      backtraceoutput.mOutStreams.push_back( &backtracestr );
+      backtraceoutput.SetLevel( LEVEL2ANDLOWER );
+      backtraceoutput.SetBacktrace( LEVEL5ANDLOWER, 3 );
+      const char* steps[] = { "a", "b", "c", "d" };
+      for (int x = 0; x < 4; ++x)
+         backtraceoutput( IO, 4, "step %s\n", steps[x] );
+      backtraceoutput( IO, 1, "fine\n" );
+      StdOut( "%s", backtraceoutput.IsEnabled( IO, 5 ) && backtracestr.str() == "fine\n" ? "." : "F" );
+      backtraceoutput( ERROR, 1, "failed\n" );
+      backtraceoutput( ERROR, 1, "failed again\n" );
+      StdOut( "%s", backtracestr.str() == "fine\nstep b\nstep c\nstep d\nfailed\nfailed again\n" ? "." : "F" );
+      // another thread's detail stays with that thread's errors
+      backtracestr.str( "" );
+      backtraceoutput( IO, 5 ) << "main detail" << std::endl;
+      std::thread backtraceThread( [&backtraceoutput]()
+      {
+         backtraceoutput( IO, 3, "thread detail\n" );
+         backtraceoutput( ERROR, 1, "thread failed\n" );
+      } );
+      backtraceThread.join();
+      StdOut( "%s", backtracestr.str() == "thread detail\nthread failed\n" ? "." : "F" );
+      // off: what's held is dropped, and the detail levels are filtered again
+      backtraceoutput.SetBacktrace( 0, 0 );
+      backtraceoutput( ERROR, 1, "last\n" );
+      StdOut( "%s", !backtraceoutput.IsEnabled( IO, 5 ) && backtracestr.str() == "thread detail\nthread failed\nlast\n" ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test the lifecycle: built ins sit at a fixed address, Shutdown drains and stays usable
+      StdOut( "running lifetime tests on custom output... [" );
+      StdOut( "%s", &StdOut == &StaticStorage<OutputBase<InitStdOut, true> >::get() &&
+                    &StdErr == &StaticStorage<OutputBase<InitStdErr, true> >::get() ? "." : "F" );
+      std::stringstream lifestr;
+      OutputBase<InitEmpty, true> lifeoutput;
+      lifeoutput.mOutStreams.push_back( &lifestr );
+      lifeoutput.StartAsync( 64, OVERFLOW_BLOCK );
+      for (int x = 0; x < 100; ++x)
+         lifeoutput( GFX, "queued %d\n", x );
+      lifeoutput << "partial";
+      lifeoutput.Shutdown();
+      std::string drained = lifestr.str();
+      StdOut( "%s", 0 == drained.find( "queued 0\n" ) && std::string::npos != drained.find( "queued 99\npartial" ) ? "." : "F" );
+      lifeoutput( GFX, "after\n" );
+      StdOut( "%s", lifestr.str() == drained + "after\n" ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test wide text: printf and stream, as UTF-8, filtered like the rest
+      StdOut( "running wide tests on custom output... [" );
+      std::stringstream widestr;
+      OutputBase<InitEmpty, true> wideoutput;
+      wideoutput.mOutStreams.push_back( &widestr );
+      wideoutput( IO, 1, L"caf\u00e9 %d %ls\n", 5, L"\u20ac" );
+      wideoutput( IO, 5, L"filtered %d\n", 5 );
+      StdOut( "%s", widestr.str() == "caf\xc3\xa9 5 \xe2\x82\xac\n" ? "." : "F" );
+      widestr.str( "" );
+      wideoutput.Wide( IO, 1 ) << L"na\u00efve " << 3 << std::endl;
+      wideoutput.Wide( IO, 5 ) << L"filtered" << std::endl;
+      wideoutput.SetHeader( HEADER_CATEGORY );
+      wideoutput( Category( "test.wide" ), 1, L"\U0001F600\n" );
+      StdOut( "%s", widestr.str() == "na\xc3\xafve 3\ntest.wide: \xf0\x9f\x98\x80\n" ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test the tap: what it subscribes to comes through too, to it alone, until it's removed
+      StdOut( "running tap tests on custom output... [" );
+      std::stringstream tapstr;
+      MemorySink tapsink;
+      OutputBase<InitEmpty, true> tapoutput;
+      tapoutput.mOutStreams.push_back( &tapstr );
+      tapoutput.SetFilter( IO );
+      bool quiet = !tapoutput.IsEnabled( GFX, 5 ) && !tapoutput.IsEnabled( Category( "test.tap.x" ), 3 );
+      OutputSettings subscription;
+      subscription.SetFilter( GFX | IO );
+      subscription.EnableCategory( "test.tap", true );
+      subscription.SetLevel( LEVEL5ANDLOWER );
+      tapoutput.SetTap( &tapsink, subscription );
+      StdOut( "%s", quiet && tapoutput.IsEnabled( GFX, 5 ) && tapoutput.IsEnabled( Category( "test.tap.x" ), 3 ) && IO == tapoutput.GetFilter() ? "." : "F" );
+      tapoutput( GFX, 5, "verbose %d\n", 5 );
+      tapoutput( IO, 1, "normal\n" );
+      tapoutput( IO, 5, "io detail\n" );
+      tapoutput( Category( "test.tap.x" ), 3, "category\n" );
+      tapoutput( Category( "test.other" ), 3, "neither\n" );
+      tapoutput( GFX, 2 ) << "streamed" << std::endl;
+      tapoutput( GFX, 4, "fields", { { "n", 1 } } );
+      StdOut( "%s", "normal\n" == tapstr.str() && "verbose 5\nnormal\nio detail\ncategory\nstreamed\nfields n=1\n" == tapsink.str() ? "." : "F" );
+      tapoutput.SetLevel( LEVEL2ANDLOWER ); // the output's own settings change as usual meanwhile
+      tapoutput.SetTap( NULL );
+      tapsink.clear();
+      tapoutput( GFX, 5, "gone\n" );
+      tapoutput( IO, 2, "level two\n" );
+      StdOut( "%s", !tapoutput.IsEnabled( GFX, 5 ) && IO == tapoutput.GetFilter() && tapsink.str().empty() && "normal\nlevel two\n" == tapstr.str() ? "." : "F" );
+      // removing it waits for a write that's under way, the sink can go as soon as it returns
+      struct SlowTap : public Sink
+      {
+         std::atomic<bool> mIn{ false }, mDone{ false };
+         void write( const char*, size_t )
+         {
+            mIn = true;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            mDone = true;
+         }
+      } slowtap;
+      tapoutput.SetTap( &slowtap, subscription );
+      std::thread slowwriter( [&tapoutput]() { tapoutput( GFX, 5, "slow\n" ); } );
+      while (!slowtap.mIn)
+         std::this_thread::yield();
+      tapoutput.SetTap( NULL );
+      StdOut( "%s", slowtap.mDone ? "." : "F" );
+      slowwriter.join();
+      // under steady traffic a new subscription (same sink) or a new sink doesn't wait for a lull
+      struct BusyTap : public Sink
+      {
+         std::atomic<size_t> mWrites{ 0 };
+         void write( const char*, size_t )
+         {
+            ++mWrites;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+         }
+      } busytap, othertap;
+      tapoutput.SetTap( &busytap, subscription );
+      std::atomic<bool> busy( true );
+      std::vector<std::thread> busywriters;
+      for (int t = 0; t < 4; ++t)
+         busywriters.push_back( std::thread( [&tapoutput, &busy]() { while (busy) tapoutput( GFX, 5, "busy\n" ); } ) );
+      while (busytap.mWrites < 8)
+         std::this_thread::yield();
+      std::atomic<int> replaced( 0 );
+      std::thread replacer( [&]() {
+         tapoutput.SetTap( &busytap, subscription );
+         ++replaced;
+         tapoutput.SetTap( &othertap, subscription );
+         ++replaced;
+      } );
+      for (int x = 0; x < 2000 && 2 != replaced; ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+      bool prompt = 2 == replaced;
+      for (int x = 0; x < 2000 && 0 == othertap.mWrites; ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+      busy = false;
+      for (size_t t = 0; t < busywriters.size(); ++t)
+         busywriters[t].join();
+      replacer.join();
+      tapoutput.SetTap( NULL );
+      StdOut( "%s", prompt && 0 < othertap.mWrites ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test build time stripping: holds for any SPEW_COMPILE_MIN_LEVEL/SPEW_COMPILE_FILTER,
+      // a stripped call is never on and never evaluates its arguments
+      StdOut( "running compile time stripping tests on custom output... [" );
+      std::stringstream stripstr;
+      OutputBase<InitEmpty, true> stripoutput;
+      stripoutput.mOutStreams.push_back( &stripstr );
+      stripoutput.SetLevel( LEVELALL );
+      constexpr int kept = (compiledIn( GFX, 5 ) ? 1 : 0) + (compiledIn( GFX, 1 ) ? 1 : 0);
+      int evaluated = 0;
+      SPEW_PRINTF( stripoutput, GFX, 5, "%d\n", ++evaluated );
+      SPEW_IF( stripoutput, GFX, 1 ) << ++evaluated << std::endl;
+      StdOut( "%s", kept == evaluated && stripoutput.IsEnabled( GFX, 5 ) == compiledIn( GFX, 5 ) ? "." : "F" );
+      stripoutput( Category( "test.strip" ), 5, "category\n" );
+      StdOut( "%s", (std::string::npos != stripstr.str().find( "category" )) == compiledIn( Category( "test.strip" ), 5 ) ? "." : "F" );
+      StdOut( "]\n" );
+
+      // test sinks: the same bytes as the streams, in text and binary mode, flushed by policy.
+      StdOut( "running sink tests on custom output... [" );
+      struct CountingSink : public MemorySink
+      {
+         CountingSink() : mFlushes( 0 ) {}
+         void flush() { ++mFlushes; }
+         int mFlushes;
+      };
+      std::stringstream sinkstr;
+      CountingSink everySink, bytesSink;
+      OutputBase<InitEmpty, true> sinkoutput;
+      sinkoutput.mOutStreams.push_back( &sinkstr );
+      sinkoutput.mSinks.push_back( &everySink );
+      sinkoutput.mSinks.push_back( &bytesSink );
+      sinkoutput.SetFlushPolicy( &bytesSink, FlushPolicy::EveryBytes( 100 ) );
+      for (int x = 0; x < 10; ++x)
+         sinkoutput( GFX, "message %04d of 30 bytes.....\n", x );
+      sinkoutput( GFX ) << "stream" << std::endl;
+      StdOut( "%s", sinkstr.str() == everySink.str() && sinkstr.str() == bytesSink.str() ? "." : "F" );
+      StdOut( "%s", 11 == everySink.mFlushes && 2 == bytesSink.mFlushes ? "." : "F" );
+      sinkstr.str( "" );
+      everySink.clear();
+      sinkoutput.SetBinary( true );
+      sinkoutput( GFX, "frame %d\n", 1 );
+      sinkoutput( GFX, "frame %d\n", 2 );
+      StdOut( "%s", sinkstr.str() == everySink.str() ? "." : "F" );
+      StdOut( "]\n" );
    }
 }; // Unit Test
 
@@ -0,0 +1,109 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_RATE_LIMIT
+#define SPEW_RATE_LIMIT
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "Once.h" //< coarseNanoseconds
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// token bucket flood suppression, in two atomics.
+/// 'perSecond' messages a second get through, with bursts of up to 'burst'.
+/// the bucket is kept as GCRA (generic cell rate algorithm): instead of a token
+/// count that needs refilling, one timestamp says when the bucket will be full
+/// again, so a check is a clock read and a compare, and taking a token is one CAS.
+/// suppressed messages are counted, so whoever gets the next token can report them.
+/// constexpr constructible, so a function local static of this has no init guard.
+/// @see OutputBase::SetRateLimit, SPEW_IF_LIMITED, SPEW_PRINTF_LIMITED
+struct RateLimit
+{
+   constexpr RateLimit() : mFull( 0 ), mSuppressed( 0 ) {}
+
+   /// take a token, false (and counted as suppressed) if there's none
+   inline bool allow( unsigned int perSecond, unsigned int burst )
+   {
+      return take( interval( perSecond ), tolerance( perSecond, burst ) );
+   }
+   /// same, with interval() and tolerance() worked out already
+   inline bool take( int64_t interval, int64_t tolerance )
+   {
+      const int64_t now = coarseNanoseconds();
+      int64_t full = mFull.load( std::memory_order_relaxed );
+      for (;;)
+      {
+         if (full - now > tolerance)
+         {
+            mSuppressed.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+         }
+         if (mFull.compare_exchange_weak( full, (full > now ? full : now) + interval, std::memory_order_relaxed ))
+            return true;
+      }
+   }
+   /// nanoseconds a token takes to come back
+   static constexpr int64_t interval( unsigned int perSecond ) { return 1000000000 / (0 == perSecond ? 1 : perSecond); }
+   /// how far ahead of now the bucket may be, and still have a token
+   static constexpr int64_t tolerance( unsigned int perSecond, unsigned int burst ) { return interval( perSecond ) * ((0 == burst ? 1 : burst) - 1); }
+
+   /// the bucket is full again: a flood (if there was one) is over
+   inline bool refilled() const { return mFull.load( std::memory_order_relaxed ) <= coarseNanoseconds(); }
+
+   /// how many were suppressed since the last call (a plain load while there are none)
+   inline unsigned int takeSuppressed()
+   {
+      return 0 == mSuppressed.load( std::memory_order_relaxed ) ? 0 : mSuppressed.exchange( 0, std::memory_order_relaxed );
+   }
+
+   std::atomic<int64_t> mFull;            //< when the bucket is full again (coarseNanoseconds)
+   std::atomic<unsigned int> mSuppressed;
+};
+
+/// a call site's RateLimit (SPEW_IF_LIMITED, SPEW_PRINTF_LIMITED).  its first suppression
+/// lists it with the output (OutputBase::Flooded), so its summary is written when the
+/// flood is over, not only when the call site's next message gets through.
+/// constexpr constructible, like RateLimit.
+struct LimitedSite
+{
+   constexpr LimitedSite( const char* file, int line ) : mListed( false ), mFile( file ), mLine( line ), mFilter( 0 ), mLevel( 0 ), mNext( NULL ) {}
+
+   RateLimit mLimit;
+   std::atomic<bool> mListed;    //< on an output's list
+   const char* mFile;
+   int mLine;
+   unsigned int mFilter, mLevel; //< the summary's, set when it's listed
+   LimitedSite* mNext;           //< the next one on the output's list
+};
+
+
+} // spew namespace
+
+#endif
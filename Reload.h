@@ -0,0 +1,284 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_RELOAD
+#define SPEW_RELOAD
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Output.h" //< parseCommandLine
+#ifndef WIN32
+#  include <poll.h>
+#  include <signal.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  ifdef __linux__
+#     include <sys/inotify.h>
+#  endif
+#endif
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// apply a config file: command line args (see parseCommandLine), any number
+/// per line, '#' starts a comment.  every output starts over from its defaults,
+/// so taking a line out of the file undoes it.  each output gets its new
+/// settings in one go, loggers never see a half applied file.
+/// example file:
+/// @code
+///   -LogOff -LogOnIO -LogOnERROR   # just these two
+///   -LogLevel3
+///   -LogOn:net.http
+/// @endcode
+/// false if the file can't be read (nothing changes then)
+inline bool reloadConfig( const char* path )
+{
+   std::ifstream file( path );
+   if (!file)
+      return false;
+   std::vector<std::string> words;
+   std::string line, word;
+   while (std::getline( file, line ))
+   {
+      std::istringstream split( line.substr( 0, line.find( '#' ) ) );
+      while (split >> word)
+         words.push_back( word );
+   }
+   std::vector<char*> args;
+   for (size_t x = 0; x < words.size(); ++x)
+      args.push_back( &words[x][0] );
+   parseCommandLine( (int)args.size(), args.data(), true );
+   return true;
+}
+
+
+#ifndef WIN32
+
+/// reloads a config file (reloadConfig) when it changes, or on SIGHUP.
+/// a background thread notices the change (inotify on linux, the file's
+/// modification time elsewhere), or the flag the signal handler set, and does the
+/// reload: the parsing and the locks all happen there, away from the loggers.
+/// usage:
+/// @code
+///   spew::ConfigWatcher watcher;
+///   watcher.Start( "/etc/myapp/spew.conf" ); // applies it now, and whenever it changes
+///   ...
+///   $ echo "-LogLevel5" > /etc/myapp/spew.conf   (or: kill -HUP <pid>)
+/// @endcode
+class ConfigWatcher
+{
+public:
+   ConfigWatcher() : mStop( false ), mReloads( 0 ) {}
+   ~ConfigWatcher() { Stop(); }
+
+   /// watch 'path' (it may not exist yet), and apply it now if it does.
+   /// 'onSighup' installs a SIGHUP handler too (one watcher per process should).
+   void Start( const char* path, bool onSighup = true )
+   {
+      Stop();
+      mPath = path;
+      size_t slash = mPath.rfind( '/' );
+      mDirectory = std::string::npos == slash ? "." : mPath.substr( 0, slash + 1 );
+      mName = std::string::npos == slash ? mPath : mPath.substr( slash + 1 );
+      if (onSighup)
+      {
+         hangup() = 0;
+         signal( SIGHUP, onHangup );
+      }
+      mModified = modified();
+      if (reloadConfig( mPath.c_str() ))
+         ++mReloads;
+      mStop = false;
+      mThread = std::thread( [this]() { watch(); } );
+   }
+
+   void Stop()
+   {
+      if (!mThread.joinable())
+         return;
+      mStop = true;
+      mThread.join();
+   }
+
+   /// number of times the file has been applied
+   inline unsigned int reloads() const { return mReloads; }
+
+private:
+   ConfigWatcher( const ConfigWatcher& );
+   ConfigWatcher& operator=( const ConfigWatcher& );
+
+   /// the signal handler only sets this (nothing else is safe in there).
+   /// a lock-free atomic rather than volatile sig_atomic_t: the handler may run on
+   /// any thread, and the watcher thread reads it.
+   static std::atomic<int>& hangup()
+   {
+      static std::atomic<int> flag( 0 );
+      static_assert( ATOMIC_INT_LOCK_FREE == 2, "SIGHUP flag has to be lock-free" );
+      return flag;
+   }
+   static void onHangup( int ) { hangup() = 1; }
+
+   /// the file's modification time, 0 if it isn't there
+   int64_t modified() const
+   {
+      struct stat info;
+      if (0 != stat( mPath.c_str(), &info ))
+         return 0;
+      return (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+   }
+
+   /// true if an inotify event names our file.  the directory is watched, not the
+   /// file, so editors that write a new file and rename it over the old one work too.
+   bool changed( int notify )
+   {
+#ifdef __linux__
+      if (notify >= 0)
+      {
+         bool ours = false;
+         alignas( struct inotify_event ) char events[4096];
+         ssize_t length;
+         while (0 < (length = read( notify, events, sizeof( events ) )))
+         {
+            for (char* at = events; at < events + length; )
+            {
+               const struct inotify_event* event = (const struct inotify_event*)at;
+               if (0 != event->len && mName == event->name)
+                  ours = true;
+               at += sizeof( struct inotify_event ) + event->len;
+            }
+         }
+         return ours;
+      }
+#endif
+      (void)notify;
+      int64_t now = modified();
+      if (now == mModified)
+         return false;
+      mModified = now;
+      return true;
+   }
+
+   void watch()
+   {
+      int notify = -1;
+#ifdef __linux__
+      notify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+      if (notify >= 0 && inotify_add_watch( notify, mDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0)
+      {
+         close( notify );
+         notify = -1;
+      }
+#endif
+      while (!mStop)
+      {
+         // wake on a change, or every 100ms to look at the stop and SIGHUP flags
+         if (notify >= 0)
+         {
+            struct pollfd wait = { notify, POLLIN, 0 };
+            poll( &wait, 1, 100 );
+         }
+         else
+            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+         bool reload = changed( notify );
+         if (0 != hangup().exchange( 0 ))
+            reload = true;
+         if (reload && !mStop && reloadConfig( mPath.c_str() ))
+            ++mReloads;
+      }
+      if (notify >= 0)
+         close( notify );
+   }
+
+   std::string mPath, mDirectory, mName;
+   int64_t mModified; //< (only when there's no inotify)
+   std::atomic<bool> mStop;
+   std::atomic<unsigned int> mReloads;
+   std::thread mThread;
+};
+
+#endif
+
+
+/// a config file, applied by hand and by the watcher
+struct ReloadUnitTest
+{
+   static void test()
+   {
+      printf( "running reload tests... [" );
+      const char* path = "spew-reload-test.txt";
+      {
+         std::ofstream file( path );
+         file << "# stderr for the reload test\n-StdErrOff -StdErrOnIO   # just IO\n-StdErrLevel3\n";
+      }
+      StdErr.SetFilter( GFX );
+      bool applied = reloadConfig( path );
+      printf( "%s", applied && IO == StdErr.GetFilter() && LEVEL3ANDLOWER == StdErr.GetLevel() ? "." : "F" );
+
+      // a line taken out of the file goes back to the default
+      {
+         std::ofstream file( path );
+         file << "-StdErrOnGFX\n";
+      }
+      applied = reloadConfig( path );
+      printf( "%s", applied && GFX == StdErr.GetFilter() && LEVEL1ANDLOWER == StdErr.GetLevel() ? "." : "F" );
+      printf( "%s", !reloadConfig( "spew-reload-test-missing.txt" ) && GFX == StdErr.GetFilter() ? "." : "F" );
+
+#ifndef WIN32
+      ConfigWatcher watcher;
+      watcher.Start( path );
+      bool started = 1 == watcher.reloads();
+      {
+         std::ofstream file( path );
+         file << "-StdErrOnSOUND -StdErrLevel2\n";
+      }
+      for (int x = 0; x < 200 && watcher.reloads() < 2; ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      printf( "%s", started && 2 <= watcher.reloads() && SOUND == StdErr.GetFilter() && LEVEL2ANDLOWER == StdErr.GetLevel() ? "." : "F" );
+
+      unsigned int before = watcher.reloads();
+      raise( SIGHUP );
+      for (int x = 0; x < 200 && watcher.reloads() == before; ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      printf( "%s", before < watcher.reloads() ? "." : "F" );
+      watcher.Stop();
+      signal( SIGHUP, SIG_DFL );
+#endif
+      remove( path );
+      StdErr.SetDefaults();
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
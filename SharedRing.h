@@ -0,0 +1,562 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_SHARED_RING
+#define SPEW_SHARED_RING
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#  include <dirent.h>
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <signal.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+#include "Sink.h"
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+#ifndef WIN32
+
+/// the start of a shared ring file, the records follow it.
+/// the producer's and the collector's counters sit on cache lines of their own.
+struct SharedRingHeader
+{
+   enum { SIZE = 256 };
+   char mMagic[8];                          //< "SPEWSR1\n"
+   uint64_t mCapacity;                      //< bytes of records, a power of two
+   uint64_t mPid;                           //< the process writing it
+   std::atomic<uint32_t> mClosed;           //< the producer is done with it
+   alignas( 64 ) std::atomic<uint64_t> mHead;    //< producer: bytes ever written
+   std::atomic<uint64_t> mDropped;               //< producer: messages that didn't fit
+   alignas( 64 ) std::atomic<uint64_t> mTail;    //< collector: bytes ever taken
+};
+static_assert( sizeof( SharedRingHeader ) <= SharedRingHeader::SIZE, "header outgrew its space" );
+const char gSharedRingMagic[8] = { 'S', 'P', 'E', 'W', 'S', 'R', '1', '\n' };
+
+/// each message in the ring: this, then its bytes, padded to 8.
+/// a length of PAD means the rest of the ring up to its end is unused, the next record is at 0.
+struct SharedRingRecord
+{
+   enum { PAD = 0xffffffff };
+   uint32_t mLength;
+   uint32_t mUnused;
+   int64_t mTime; //< CLOCK_REALTIME ns, the collector merges the processes by it
+};
+
+/// bumped in the child of every fork, so a sink notices it has to make a ring of its own
+inline std::atomic<unsigned int>& sharedRingForks()
+{
+   static std::atomic<unsigned int> forks( 0 );
+   return forks;
+}
+inline void sharedRingForked() { sharedRingForks().fetch_add( 1, std::memory_order_relaxed ); }
+
+/// a sink for one of many processes on a host: finished messages go into a ring in shared
+/// memory (a file in /dev/shm), and spew-collector drains every process's ring into one
+/// merged, rotated log.  each process (each sink) has its own ring, so producers share
+/// nothing; a message is a memcpy and a release store.  the producer never waits on the
+/// collector: a message that doesn't fit is dropped and counted, the collector logs the count.
+/// a forked child makes its own ring on its first message.
+/// rings are named <dir>/<prefix>.<pid>.<n>.  text (or json lines), not binary mode records.
+/// usage:
+/// @code
+///    SharedRingSink ring;
+///    ring.open( "/dev/shm", "myservice", 1024 * 1024 );
+///    Log.mOutStreams.clear();
+///    Log.mSinks.push_back( &ring );
+///
+///    > spew-collector /dev/shm myservice /var/log/myservice.log
+/// @endcode
+/// (or build with -DSPEW_LOG_COLLECTOR=\"/dev/shm\" and Log does this itself, see InitLog)
+class SharedRingSink : public Sink
+{
+public:
+   SharedRingSink() : mHeader( NULL ), mRing( NULL ), mMask( 0 ), mForks( 0 ), mLater( false ) {}
+   ~SharedRingSink() { close(); }
+
+   /// make a ring of 'capacity' bytes (rounded up to a power of two) in 'dir'
+   bool open( const char* dir, const char* prefix, size_t capacity )
+   {
+      openLater( dir, prefix, capacity );
+      return openNow();
+   }
+   /// open( ... ) on the first message (or openNow), until then nothing is made
+   void openLater( const char* dir, const char* prefix, size_t capacity )
+   {
+      close();
+      mDir = dir;
+      mPrefix = prefix;
+      mCapacity = capacity;
+      mLater = true;
+   }
+   /// make the ring openLater named, if there isn't one.  false if it can't be made.
+   bool openNow()
+   {
+      if (NULL != mHeader)
+         return true;
+      if (!mLater)
+         return false;
+      mLater = false;
+      // (once per process: forked children start their own rings)
+      static int watching = ::pthread_atfork( NULL, NULL, sharedRingForked );
+      (void)watching;
+      mForks = sharedRingForks().load( std::memory_order_relaxed );
+      size_t size = 4096;
+      while (size < mCapacity)
+         size <<= 1;
+      static std::atomic<unsigned int> sequence( 0 );
+      char name[64];
+      snprintf( name, sizeof( name ), "/%s.%d.%u", mPrefix.c_str(), (int)::getpid(), sequence.fetch_add( 1 ) );
+      std::string path = mDir + name, building = path + ".tmp";
+      int fd = ::open( building.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0660 );
+      if (fd < 0)
+         return false;
+      size_t total = SharedRingHeader::SIZE + size;
+      void* base = MAP_FAILED;
+#ifdef __linux__
+      bool allocated = 0 == ::posix_fallocate( fd, 0, total );
+#else
+      bool allocated = false;
+#endif
+      if (allocated || 0 == ::ftruncate( fd, total ))
+         base = ::mmap( NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      ::close( fd );
+      if (MAP_FAILED == base)
+      {
+         ::unlink( building.c_str() );
+         return false;
+      }
+      mHeader = new (base) SharedRingHeader;
+      mHeader->mCapacity = size;
+      mHeader->mPid = (uint64_t)::getpid();
+      mHeader->mClosed.store( 0, std::memory_order_relaxed );
+      mHeader->mHead.store( 0, std::memory_order_relaxed );
+      mHeader->mDropped.store( 0, std::memory_order_relaxed );
+      mHeader->mTail.store( 0, std::memory_order_relaxed );
+      memcpy( mHeader->mMagic, gSharedRingMagic, sizeof( mHeader->mMagic ) );
+      mRing = (char*)base + SharedRingHeader::SIZE;
+      mMask = size - 1;
+      // the collector only sees finished rings
+      if (0 != ::rename( building.c_str(), path.c_str() ))
+      {
+         ::munmap( base, total );
+         ::unlink( building.c_str() );
+         mHeader = NULL;
+         mRing = NULL;
+         return false;
+      }
+      mPath = path;
+      return true;
+   }
+
+   /// done: the collector drains what's left, then removes the ring
+   void close()
+   {
+      mLater = false;
+      if (NULL == mHeader)
+         return;
+      mHeader->mClosed.store( 1, std::memory_order_release );
+      unmap();
+   }
+   inline bool is_open() const { return NULL != mHeader; }
+   inline const std::string& path() const { return mPath; }
+   /// messages dropped because the ring was full
+   inline uint64_t dropped() const { return NULL == mHeader ? 0 : mHeader->mDropped.load( std::memory_order_relaxed ); }
+
+   /// (one writer at a time, the output serializes them)
+   void write( const char* data, size_t length )
+   {
+      if (mForks != sharedRingForks().load( std::memory_order_relaxed ))
+         forked();
+      if (NULL == mHeader && !openNow())
+         return;
+      size_t need = recordSize( length );
+      uint64_t head = mHeader->mHead.load( std::memory_order_relaxed );
+      uint64_t tail = mHeader->mTail.load( std::memory_order_acquire );
+      size_t at = (size_t)(head & mMask);
+      size_t toEnd = mMask + 1 - at;
+      size_t total = need <= toEnd ? need : toEnd + need; // a record doesn't wrap, it starts over at 0
+      if (head + total - tail > mMask + 1)
+      {
+         mHeader->mDropped.fetch_add( 1, std::memory_order_relaxed );
+         return;
+      }
+      if (need > toEnd)
+      {
+         uint32_t pad = SharedRingRecord::PAD;
+         memcpy( mRing + at, &pad, sizeof( pad ) );
+         at = 0;
+      }
+      SharedRingRecord record;
+      record.mLength = (uint32_t)length;
+      record.mUnused = 0;
+      struct timespec now;
+      ::clock_gettime( CLOCK_REALTIME, &now );
+      record.mTime = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+      memcpy( mRing + at, &record, sizeof( record ) );
+      memcpy( mRing + at + sizeof( record ), data, length );
+      mHeader->mHead.store( head + total, std::memory_order_release );
+   }
+
+   /// a record's bytes in the ring, header and padding included
+   static inline size_t recordSize( size_t length ) { return (sizeof( SharedRingRecord ) + length + 7) & ~(size_t)7; }
+
+private:
+   SharedRingSink( const SharedRingSink& );
+   SharedRingSink& operator=( const SharedRingSink& );
+
+   void unmap()
+   {
+      ::munmap( mHeader, SharedRingHeader::SIZE + mMask + 1 );
+      mHeader = NULL;
+      mRing = NULL;
+   }
+   /// this is a forked child: the ring is the parent's, leave it be and make our own
+   void forked()
+   {
+      mForks = sharedRingForks().load( std::memory_order_relaxed );
+      if (NULL == mHeader)
+         return;
+      unmap();
+      mLater = true;
+   }
+
+   SharedRingHeader* mHeader;
+   char* mRing;
+   size_t mMask;
+   unsigned int mForks;
+   bool mLater;
+   std::string mDir, mPrefix, mPath;
+   size_t mCapacity;
+};
+
+
+/// the collector's side of one process's ring
+class SharedRingReader
+{
+public:
+   SharedRingReader() : mHeader( NULL ), mRing( NULL ), mMask( 0 ), mDropped( 0 ) {}
+   ~SharedRingReader() { close(); }
+
+   /// map the ring at 'path', false if it isn't one
+   bool open( const char* path )
+   {
+      close();
+      int fd = ::open( path, O_RDWR | O_CLOEXEC );
+      if (fd < 0)
+         return false;
+      struct stat info;
+      void* base = MAP_FAILED;
+      if (0 == ::fstat( fd, &info ) && (size_t)info.st_size > SharedRingHeader::SIZE)
+         base = ::mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      ::close( fd );
+      if (MAP_FAILED == base)
+         return false;
+      SharedRingHeader* header = (SharedRingHeader*)base;
+      uint64_t capacity = header->mCapacity;
+      if (0 != memcmp( header->mMagic, gSharedRingMagic, sizeof( gSharedRingMagic ) ) ||
+          0 == capacity || 0 != (capacity & (capacity - 1)) || SharedRingHeader::SIZE + capacity > (uint64_t)info.st_size)
+      {
+         ::munmap( base, info.st_size );
+         return false;
+      }
+      mHeader = header;
+      mRing = (char*)base + SharedRingHeader::SIZE;
+      mMask = capacity - 1;
+      mPath = path;
+      return true;
+   }
+   void close()
+   {
+      if (NULL == mHeader)
+         return;
+      ::munmap( mHeader, SharedRingHeader::SIZE + mMask + 1 );
+      mHeader = NULL;
+      mRing = NULL;
+   }
+
+   inline int pid() const { return (int)mHeader->mPid; }
+   inline const std::string& path() const { return mPath; }
+
+   /// hand every waiting message to 'out( time, data, length )', oldest first, then give
+   /// the room back to the producer.  returns how many more were dropped since the last call.
+   template <typename Out>
+   uint64_t drain( Out out )
+   {
+      uint64_t head = mHeader->mHead.load( std::memory_order_acquire );
+      uint64_t tail = mHeader->mTail.load( std::memory_order_relaxed );
+      while (tail < head)
+      {
+         size_t at = (size_t)(tail & mMask);
+         uint32_t length;
+         memcpy( &length, mRing + at, sizeof( length ) );
+         if (SharedRingRecord::PAD == length)
+         {
+            tail += mMask + 1 - at;
+            continue;
+         }
+         SharedRingRecord record;
+         memcpy( &record, mRing + at, sizeof( record ) );
+         if (SharedRingSink::recordSize( record.mLength ) > mMask + 1 - at)
+         {
+            tail = head; // not a record, the producer is broken: skip what's there
+            break;
+         }
+         out( record.mTime, mRing + at + sizeof( record ), (size_t)record.mLength );
+         tail += SharedRingSink::recordSize( record.mLength );
+      }
+      mHeader->mTail.store( tail, std::memory_order_release );
+      uint64_t dropped = mHeader->mDropped.load( std::memory_order_relaxed );
+      uint64_t more = dropped - mDropped;
+      mDropped = dropped;
+      return more;
+   }
+
+   /// nothing more will come: the producer closed it, or exited (drain once more first)
+   bool finished() const
+   {
+      if (0 != mHeader->mClosed.load( std::memory_order_acquire ))
+         return true;
+      return 0 != ::kill( (pid_t)mHeader->mPid, 0 ) && ESRCH == errno;
+   }
+
+private:
+   SharedRingReader( const SharedRingReader& );
+   SharedRingReader& operator=( const SharedRingReader& );
+
+   SharedRingHeader* mHeader;
+   char* mRing;
+   size_t mMask;
+   uint64_t mDropped;
+   std::string mPath;
+};
+
+
+/// spew-collector's work, one pass at a time: find the rings named <dir>/<prefix>.*,
+/// drain them all, and merge what they held by time into one text, each message behind
+/// its process id ("[1234] ...").  rings whose producer is done are removed once drained.
+/// usage:
+/// @code
+///    SharedRingCollector collector( "/dev/shm", "spew" );
+///    std::string merged;
+///    for (;;) { collector.collect( merged ); out.write( merged.data(), merged.size() ); sleep... }
+/// @endcode
+class SharedRingCollector
+{
+public:
+   SharedRingCollector( const char* dir, const char* prefix ) : mDir( dir ), mPrefix( std::string( prefix ) + "." ) {}
+
+   /// one pass: the merged messages replace what's in 'out'.  returns the number of messages.
+   size_t collect( std::string& out )
+   {
+      out.clear();
+      scan();
+      mEntries.clear();
+      mBytes.clear();
+      for (size_t x = 0; x < mReaders.size(); ++x)
+      {
+         SharedRingReader& reader = *mReaders[x];
+         // (read before draining: a producer that finishes after this drains again next pass)
+         bool finished = reader.finished();
+         int pid = reader.pid();
+         uint64_t dropped = reader.drain( [this, pid]( int64_t time, const char* data, size_t length )
+         {
+            add( time, pid, data, length );
+         } );
+         if (0 != dropped)
+         {
+            char note[96];
+            int length = snprintf( note, sizeof( note ), "spew-collector: %llu messages dropped, the ring was full\n", (unsigned long long)dropped );
+            add( nowNanos(), pid, note, length );
+         }
+         if (finished)
+         {
+            ::unlink( reader.path().c_str() );
+            mReaders.erase( mReaders.begin() + x-- );
+         }
+      }
+      std::stable_sort( mEntries.begin(), mEntries.end(), []( const Entry& a, const Entry& b ) { return a.mTime < b.mTime; } );
+      for (size_t x = 0; x < mEntries.size(); ++x)
+      {
+         char pid[24];
+         int length = snprintf( pid, sizeof( pid ), "[%d] ", mEntries[x].mPid );
+         out.append( pid, length );
+         out.append( mBytes, mEntries[x].mAt, mEntries[x].mLength );
+      }
+      return mEntries.size();
+   }
+
+   /// rings being read
+   inline size_t rings() const { return mReaders.size(); }
+
+private:
+   struct Entry
+   {
+      int64_t mTime;
+      int mPid;
+      size_t mAt, mLength; //< in mBytes
+   };
+
+   inline void add( int64_t time, int pid, const char* data, size_t length )
+   {
+      Entry entry = { time, pid, mBytes.size(), length };
+      mEntries.push_back( entry );
+      mBytes.append( data, length );
+   }
+   static int64_t nowNanos()
+   {
+      struct timespec now;
+      ::clock_gettime( CLOCK_REALTIME, &now );
+      return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+   }
+
+   /// start reading rings that showed up since the last pass
+   void scan()
+   {
+      DIR* dir = ::opendir( mDir.c_str() );
+      if (NULL == dir)
+         return;
+      for (struct dirent* entry = ::readdir( dir ); NULL != entry; entry = ::readdir( dir ))
+      {
+         std::string name = entry->d_name;
+         if (0 != name.compare( 0, mPrefix.size(), mPrefix ) || (4 < name.size() && 0 == name.compare( name.size() - 4, 4, ".tmp" )))
+            continue;
+         std::string path = mDir + "/" + name;
+         bool known = false;
+         for (size_t x = 0; x < mReaders.size() && !known; ++x)
+            known = mReaders[x]->path() == path;
+         if (known)
+            continue;
+         std::unique_ptr<SharedRingReader> reader( new SharedRingReader );
+         if (reader->open( path.c_str() ))
+            mReaders.push_back( std::move( reader ) );
+      }
+      ::closedir( dir );
+   }
+
+   std::string mDir, mPrefix;
+   std::vector<std::unique_ptr<SharedRingReader> > mReaders;
+   std::vector<Entry> mEntries;
+   std::string mBytes;
+};
+
+#endif
+
+
+/// two producers merged in order, a full ring drops instead of waiting, done rings go away
+struct SharedRingUnitTest
+{
+   static void test()
+   {
+#ifndef WIN32
+      printf( "running shared ring tests... [" );
+      char dir[] = "/tmp/spew-ring-XXXXXX";
+      if (NULL == ::mkdtemp( dir ))
+      {
+         printf( "F]\n" );
+         return;
+      }
+      SharedRingCollector collector( dir, "test" );
+      std::string merged;
+      {
+         SharedRingSink a, b;
+         bool opened = a.open( dir, "test", 4096 ) && b.open( dir, "test", 4096 );
+         a.write( "a1\n", 3 );
+         b.write( "b1\n", 3 );
+         a.write( "a2\n", 3 );
+         char expect[64];
+         snprintf( expect, sizeof( expect ), "[%d] a1\n[%d] b1\n[%d] a2\n", (int)::getpid(), (int)::getpid(), (int)::getpid() );
+         printf( "%s", opened && 3 == collector.collect( merged ) && merged == expect && 2 == collector.rings() ? "." : "F" );
+
+         // 4096 bytes hold 50 of these (16 + 64 each), the rest drop without waiting,
+         // then the collector makes room and it wraps around
+         std::string line( 63, 'x' );
+         line += '\n';
+         for (int x = 0; x < 60; ++x)
+            a.write( line.data(), line.size() );
+         size_t got = collector.collect( merged );
+         printf( "%s", 10 == a.dropped() && 51 == got && std::string::npos != merged.find( "10 messages dropped" ) ? "." : "F" );
+         for (int x = 0; x < 30; ++x)
+            a.write( line.data(), line.size() );
+         printf( "%s", 30 == collector.collect( merged ) && 10 == a.dropped() ? "." : "F" );
+         b.write( "last\n", 5 );
+      }
+      // closed: drained once more, then removed
+      collector.collect( merged );
+      std::string last = merged;
+      collector.collect( merged );
+      printf( "%s", std::string::npos != last.find( "] last\n" ) && 0 == collector.rings() && merged.empty() && 0 == ::rmdir( dir ) ? "." : "F" );
+
+      // a forked child gets a ring of its own
+      char forkdir[] = "/tmp/spew-ring-XXXXXX";
+      if (NULL != ::mkdtemp( forkdir ))
+      {
+         SharedRingSink parent;
+         parent.open( forkdir, "test", 4096 );
+         parent.write( "parent\n", 7 );
+         pid_t child = ::fork();
+         if (0 == child)
+         {
+            parent.write( "child\n", 6 );
+            ::_exit( 0 );
+         }
+         int status = 0;
+         ::waitpid( child, &status, 0 );
+         SharedRingCollector forkcollector( forkdir, "test" );
+         forkcollector.collect( merged );
+         char expect[64];
+         snprintf( expect, sizeof( expect ), "[%d] parent\n[%d] child\n", (int)::getpid(), (int)child );
+         printf( "%s", merged == expect ? "." : "F" );
+         parent.close();
+         forkcollector.collect( merged );
+         ::rmdir( forkdir );
+      }
+      printf( "]\n" );
+#endif
+   }
+};
+
+
+} // spew namespace
+
+#endif
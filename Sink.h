@@ -0,0 +1,477 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_SINK
+#define SPEW_SINK
+
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#ifndef WIN32
+#  include "FdOstream.h" //< writeAllFd
+#endif
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// one piece of a message (see Sink::writev)
+struct Span
+{
+   const char* mData;
+   size_t mLength;
+};
+
+/// where finished messages go, the lightweight alternative to an ostream in mOutStreams.
+/// an output formats a message once, then hands the very same bytes to every sink:
+/// no sentry, locale or streambuf in between, and nothing copied unless the sink
+/// itself buffers.  the output serializes the calls (one writer at a time).
+/// usage:
+/// @code
+///    FdSink file;
+///    file.open( "server.log" );
+///    Log.mSinks.push_back( &file );
+///    Log.SetFlushPolicy( &file, FlushPolicy::EveryBytes( 65536 ).Every( 100 ) );
+/// @endcode
+class Sink
+{
+public:
+   virtual ~Sink() {}
+
+   /// write one message
+   virtual void write( const char* data, size_t length ) = 0;
+
+   /// write several pieces as if they were one message
+   /// (e.g. a binary format definition and its first record)
+   virtual void writev( const Span* spans, size_t count )
+   {
+      for (size_t x = 0; x < count; ++x)
+         write( spans[x].mData, spans[x].mLength );
+   }
+
+   /// push out anything the sink is holding on to (see FlushPolicy)
+   virtual void flush() {}
+};
+
+
+/// keeps everything in memory, handy for tests and for grabbing output to show in a UI.
+/// read it when nobody is writing (or from the output's thread).
+class MemorySink : public Sink
+{
+public:
+   void write( const char* data, size_t length ) { mText.append( data, length ); }
+
+   inline const std::string& str() const { return mText; }
+   inline void clear() { mText.clear(); }
+
+private:
+   std::string mText;
+};
+
+
+/// a stdio FILE* (stdout, stderr, or a file of your own).
+/// stdio does the buffering, flush() is fflush.
+class FileSink : public Sink
+{
+public:
+   FileSink( FILE* file = NULL ) : mFile( file ), mOwned( false ) {}
+   ~FileSink() { close(); }
+
+   /// append to 'path' (created if needed)
+   bool open( const char* path )
+   {
+      close();
+      mFile = fopen( path, "ab" );
+      mOwned = true;
+      return NULL != mFile;
+   }
+   void close()
+   {
+      if (NULL != mFile)
+         fflush( mFile );
+      if (mOwned && NULL != mFile)
+         fclose( mFile );
+      mFile = NULL;
+      mOwned = false;
+   }
+
+   void write( const char* data, size_t length )
+   {
+      if (NULL != mFile)
+         fwrite( data, 1, length, mFile );
+   }
+   void flush()
+   {
+      if (NULL != mFile)
+         fflush( mFile );
+   }
+
+private:
+   FileSink( const FileSink& );
+   FileSink& operator=( const FileSink& );
+
+   FILE* mFile;
+   bool mOwned;
+};
+
+
+/// straight into a streambuf, skipping the ostream layer.
+/// e.g. the mapped log segments: StreambufSink( mappedFileOstream.rdbuf() )
+class StreambufSink : public Sink
+{
+public:
+   StreambufSink( std::streambuf* buf = NULL ) : mBuf( buf ) {}
+
+   void write( const char* data, size_t length )
+   {
+      if (NULL != mBuf)
+         mBuf->sputn( data, (std::streamsize)length );
+   }
+   void flush()
+   {
+      if (NULL != mBuf)
+         mBuf->pubsync();
+   }
+
+   std::streambuf* mBuf;
+};
+
+
+/// adapter for an ostream, for code that wants everything in mSinks.
+/// (ostreams in mOutStreams keep working as they are)
+class OstreamSink : public Sink
+{
+public:
+   OstreamSink( std::ostream* stream = NULL ) : mStream( stream ) {}
+
+   void write( const char* data, size_t length )
+   {
+      if (NULL != mStream)
+         mStream->write( data, (std::streamsize)length );
+   }
+   void flush()
+   {
+      if (NULL != mStream)
+         mStream->flush();
+   }
+
+   std::ostream* mStream;
+};
+
+
+#ifndef WIN32
+
+/// a raw file descriptor.
+/// with no buffer every message is one write(2) (one writev(2) for several spans),
+/// straight from the output's buffer.  with a buffer, text is coalesced until
+/// flush() (see FlushPolicy) and a message that doesn't fit goes out together with
+/// what's pending in one writev(2), like FdStreambuf.
+class FdSink : public Sink
+{
+public:
+   FdSink( int fd = -1, size_t bufferSize = 0 ) : mFd( fd ), mOwned( false ), mWrites( 0 ), mUsed( 0 ), mBuffer( bufferSize ) {}
+   ~FdSink() { close(); }
+
+   /// append to 'path' (created if needed)
+   bool open( const char* path )
+   {
+      close();
+      mFd = ::open( path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+      mOwned = true;
+      return mFd >= 0;
+   }
+   void close()
+   {
+      flush();
+      if (mOwned && mFd >= 0)
+         ::close( mFd );
+      mFd = -1;
+      mOwned = false;
+   }
+
+   /// number of write/writev syscalls so far
+   inline size_t writes() const { return mWrites; }
+
+   void write( const char* data, size_t length )
+   {
+      Span span = { data, length };
+      writev( &span, 1 );
+   }
+
+   void writev( const Span* spans, size_t count )
+   {
+      size_t length = 0;
+      for (size_t x = 0; x < count; ++x)
+         length += spans[x].mLength;
+      if (length <= mBuffer.size() - mUsed)
+      {
+         for (size_t x = 0; x < count; ++x)
+         {
+            memcpy( mBuffer.data() + mUsed, spans[x].mData, spans[x].mLength );
+            mUsed += spans[x].mLength;
+         }
+         return;
+      }
+      // doesn't fit (or no buffer): pending text and the spans in one go
+      mIov.clear();
+      if (0 != mUsed)
+         mIov.push_back( toIovec( mBuffer.data(), mUsed ) );
+      for (size_t x = 0; x < count; ++x)
+         mIov.push_back( toIovec( spans[x].mData, spans[x].mLength ) );
+      mUsed = 0;
+      writeAllFd( mFd, mIov.data(), (int)mIov.size(), mWrites );
+   }
+
+   void flush()
+   {
+      if (0 == mUsed)
+         return;
+      struct iovec pending = toIovec( mBuffer.data(), mUsed );
+      mUsed = 0;
+      writeAllFd( mFd, &pending, 1, mWrites );
+   }
+
+private:
+   FdSink( const FdSink& );
+   FdSink& operator=( const FdSink& );
+
+   static inline struct iovec toIovec( const char* data, size_t length )
+   {
+      struct iovec v;
+      v.iov_base = (void*)data;
+      v.iov_len = length;
+      return v;
+   }
+
+   int mFd;
+   bool mOwned;
+   size_t mWrites;
+   size_t mUsed;
+   std::vector<char> mBuffer;
+   std::vector<struct iovec> mIov; //< reused, so a write doesn't allocate
+};
+
+/// ftrace's trace_marker (tracefs): each message becomes a print event in the kernel's
+/// trace, between the scheduler, irq and block i/o events around it (perf, trace-cmd,
+/// the trace file).  the linux counterpart of the debugger trace window.
+/// every message is exactly one write(2), unbuffered, so the event's time is when it was
+/// logged.  spans are gathered first, a writev would make an event per span.  the kernel
+/// cuts messages over ~4KB short.  writing takes permission (root, or the tracing group).
+/// usage:
+/// @code
+///    TraceMarkerSink marker;
+///    marker.open(); // tracefs, wherever it's mounted
+///    Trace.mSinks.push_back( &marker );
+///    > trace-cmd record -e sched ./myapp; trace-cmd report
+/// @endcode
+class TraceMarkerSink : public Sink
+{
+public:
+   TraceMarkerSink() : mFd( -1 ), mWrites( 0 ), mLater( false ) {}
+   ~TraceMarkerSink() { close(); }
+
+   /// 'path' (a plain file works too, tests use one), NULL for tracefs's trace_marker
+   bool open( const char* path = NULL )
+   {
+      openLater( path );
+      return openNow();
+   }
+   /// open( path ) on the first message (or openNow), until then nothing is touched
+   void openLater( const char* path = NULL )
+   {
+      close();
+      mPath = NULL == path ? "" : path;
+      mLater = true;
+   }
+   /// open what openLater named, if it isn't already.  false if it can't be, and it
+   /// isn't tried again (no syscall a message when tracing isn't allowed)
+   bool openNow()
+   {
+      if (mFd >= 0)
+         return true;
+      if (!mLater)
+         return false;
+      mLater = false;
+      const char* tracefs[] = { "/sys/kernel/tracing/trace_marker", "/sys/kernel/debug/tracing/trace_marker" };
+      if (!mPath.empty())
+         mFd = ::open( mPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+      for (size_t x = 0; x < sizeof( tracefs ) / sizeof( tracefs[0] ) && mPath.empty() && mFd < 0; ++x)
+         mFd = ::open( tracefs[x], O_WRONLY | O_CLOEXEC );
+      return mFd >= 0;
+   }
+   void close()
+   {
+      mLater = false;
+      if (mFd >= 0)
+         ::close( mFd );
+      mFd = -1;
+   }
+   inline bool is_open() const { return mFd >= 0; }
+
+   /// number of write syscalls so far (one a message)
+   inline size_t writes() const { return mWrites; }
+
+   void write( const char* data, size_t length )
+   {
+      if (mFd < 0 && !openNow())
+         return;
+      // (a short write isn't continued, the rest would be an event of its own)
+      while (::write( mFd, data, length ) < 0 && EINTR == errno) {}
+      ++mWrites;
+   }
+   void writev( const Span* spans, size_t count )
+   {
+      if (1 == count)
+         return write( spans[0].mData, spans[0].mLength );
+      mBuffer.clear();
+      for (size_t x = 0; x < count; ++x)
+         mBuffer.insert( mBuffer.end(), spans[x].mData, spans[x].mData + spans[x].mLength );
+      write( mBuffer.data(), mBuffer.size() );
+   }
+
+private:
+   TraceMarkerSink( const TraceMarkerSink& );
+   TraceMarkerSink& operator=( const TraceMarkerSink& );
+
+   int mFd;
+   size_t mWrites;
+   bool mLater;        //< openLater named a file that isn't open yet
+   std::string mPath;  //< "" for tracefs
+   std::vector<char> mBuffer; //< gathered spans, reused
+};
+
+#endif
+
+
+/// every sink gets the bytes it was given, in order
+struct SinkUnitTest
+{
+   static void test()
+   {
+      printf( "running sink tests... [" );
+      Span spans[2] = { { "head,", 5 }, { "tail\n", 5 } };
+
+      MemorySink memory;
+      memory.write( "one\n", 4 );
+      memory.writev( spans, 2 );
+      printf( "%s", memory.str() == "one\nhead,tail\n" ? "." : "F" );
+
+      FILE* file = tmpfile();
+      if (NULL != file)
+      {
+         {
+            FileSink sink( file );
+            sink.write( "one\n", 4 );
+            sink.writev( spans, 2 );
+            sink.flush();
+         }
+         char got[64] = { 0 };
+         rewind( file );
+         size_t n = fread( got, 1, sizeof( got ) - 1, file );
+         fclose( file );
+         printf( "%s", std::string( got, n ) == "one\nhead,tail\n" ? "." : "F" );
+      }
+      else
+         printf( "F" );
+
+      std::stringbuf strbuf;
+      std::ostream stream( &strbuf );
+      StreambufSink bufsink( &strbuf );
+      OstreamSink streamsink( &stream );
+      bufsink.write( "one\n", 4 );
+      streamsink.writev( spans, 2 );
+      printf( "%s", strbuf.str() == "one\nhead,tail\n" ? "." : "F" );
+
+#ifndef WIN32
+      int fds[2];
+      if (0 == ::pipe( fds ))
+      {
+         std::string expected;
+         {
+            FdSink raw( fds[1] ), buffered( fds[1], 64 );
+            raw.writev( spans, 2 ); // unbuffered: one writev for both spans
+            expected += "head,tail\n";
+            bool counts = 1 == raw.writes();
+            for (int x = 0; x < 5; ++x)
+            {
+               buffered.write( "0123456789\n", 11 );
+               expected += "0123456789\n";
+            }
+            counts = counts && 0 == buffered.writes();
+            std::string big( 100, 'b' );
+            buffered.write( big.data(), big.size() ); // doesn't fit: one writev with the pending text
+            expected += big;
+            buffered.write( "last\n", 5 );
+            expected += "last\n";
+            buffered.flush();
+            printf( "%s", counts && 2 == buffered.writes() ? "." : "F" );
+         }
+         ::close( fds[1] );
+         std::string got;
+         char buf[256];
+         ssize_t n;
+         while (0 < (n = ::read( fds[0], buf, sizeof( buf ) )))
+            got.append( buf, n );
+         ::close( fds[0] );
+         printf( "%s", got == expected ? "." : "F" );
+      }
+      else
+         printf( "F" );
+
+      // trace_marker, on a plain file: untouched until the first message, then a write each
+      const char* marker = "spew-marker-test.txt";
+      ::remove( marker );
+      {
+         TraceMarkerSink sink;
+         sink.openLater( marker );
+         bool untouched = 0 != ::access( marker, F_OK );
+         sink.write( "one\n", 4 );
+         sink.writev( spans, 2 );
+         printf( "%s", untouched && sink.is_open() && 2 == sink.writes() ? "." : "F" );
+         TraceMarkerSink missing;
+         missing.open( "spew-no-such-dir/trace_marker" );
+         missing.write( "lost\n", 5 );
+         printf( "%s", !missing.is_open() && 0 == missing.writes() ? "." : "F" );
+      }
+      std::ifstream written( marker );
+      std::stringstream text;
+      text << written.rdbuf();
+      printf( "%s", "one\nhead,tail\n" == text.str() ? "." : "F" );
+      ::remove( marker );
+#endif
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
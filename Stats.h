@@ -0,0 +1,410 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_STATS
+#define SPEW_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include "Sink.h"
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// a count with one writer (a thread, or whoever holds a lock) and any number of readers.
+/// a relaxed load and store, no locked instruction: nobody else writes it.
+class Counter
+{
+public:
+   Counter() : mValue( 0 ) {}
+   inline void add( uint64_t n = 1 ) { mValue.store( mValue.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed ); }
+   inline uint64_t get() const { return mValue.load( std::memory_order_relaxed ); }
+
+private:
+   std::atomic<uint64_t> mValue;
+};
+
+
+/// latency histogram, HDR style: 8 linear buckets per power of two, so a value is
+/// known to within 12.5%, from 1ns to about 18 minutes (longer ones land in the last bucket).
+/// one writer, any number of readers (like Counter).  copying one reads it.
+class Histogram
+{
+public:
+   enum
+   {
+      SUB_BITS = 3,
+      SUBS = 1 << SUB_BITS,
+      MAX_EXPONENT = 40, //< 2^40ns, ~18 minutes
+      BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUBS,
+   };
+
+   Histogram() { clear(); }
+   Histogram( const Histogram& other ) { clear(); add( other ); }
+   Histogram& operator=( const Histogram& other )
+   {
+      if (this != &other)
+      {
+         clear();
+         add( other );
+      }
+      return *this;
+   }
+
+   inline void record( uint64_t nanos )
+   {
+      bump( mCounts[bucket( nanos )], 1 );
+      bump( mCount, 1 );
+      bump( mSum, nanos );
+      if (nanos > mMax.load( std::memory_order_relaxed ))
+         mMax.store( nanos, std::memory_order_relaxed );
+   }
+
+   /// add another histogram's counts to this one (this one's writer only)
+   void add( const Histogram& other )
+   {
+      for (int x = 0; x < BUCKETS; ++x)
+         bump( mCounts[x], other.mCounts[x].load( std::memory_order_relaxed ) );
+      bump( mCount, other.count() );
+      bump( mSum, other.mSum.load( std::memory_order_relaxed ) );
+      if (other.max() > max())
+         mMax.store( other.max(), std::memory_order_relaxed );
+   }
+   void clear()
+   {
+      for (int x = 0; x < BUCKETS; ++x)
+         mCounts[x].store( 0, std::memory_order_relaxed );
+      mCount.store( 0, std::memory_order_relaxed );
+      mSum.store( 0, std::memory_order_relaxed );
+      mMax.store( 0, std::memory_order_relaxed );
+   }
+
+   inline uint64_t count() const { return mCount.load( std::memory_order_relaxed ); }
+   inline uint64_t max() const { return mMax.load( std::memory_order_relaxed ); }
+   inline double mean() const { uint64_t n = count(); return 0 == n ? 0 : mSum.load( std::memory_order_relaxed ) / (double)n; }
+
+   /// the value 'fraction' (0.99 for p99) of the recorded values are at or under,
+   /// as the top of its bucket (never more than the max)
+   uint64_t percentile( double fraction ) const
+   {
+      uint64_t n = count();
+      if (0 == n)
+         return 0;
+      uint64_t want = (uint64_t)(fraction * n + 0.5), seen = 0;
+      if (0 == want)
+         want = 1;
+      for (int x = 0; x < BUCKETS; ++x)
+      {
+         seen += mCounts[x].load( std::memory_order_relaxed );
+         if (seen >= want)
+         {
+            uint64_t top = lowest( x + 1 ) - 1;
+            return top < max() ? top : max();
+         }
+      }
+      return max();
+   }
+
+   /// "count 10 mean 312 p50 287 p90 415 p99 1023 p999 1023 max 1102"
+   void print( std::string& out ) const
+   {
+      char text[160];
+      snprintf( text, sizeof( text ), "count %llu mean %.0f p50 %llu p90 %llu p99 %llu p999 %llu max %llu",
+                (unsigned long long)count(), mean(), (unsigned long long)percentile( 0.5 ), (unsigned long long)percentile( 0.9 ),
+                (unsigned long long)percentile( 0.99 ), (unsigned long long)percentile( 0.999 ), (unsigned long long)max() );
+      out += text;
+   }
+
+   /// the bucket a value goes in: values under SUBS get their own, the rest by their
+   /// top bit (the power of two) and the SUB_BITS under it
+   static inline int bucket( uint64_t value )
+   {
+      if (value < SUBS)
+         return (int)value;
+      int exponent = 63 - __builtin_clzll( value );
+      if (exponent > MAX_EXPONENT)
+         return BUCKETS - 1;
+      return (exponent - SUB_BITS + 1) * SUBS + (int)((value >> (exponent - SUB_BITS)) & (SUBS - 1));
+   }
+   /// the smallest value in a bucket
+   static inline uint64_t lowest( int bucket )
+   {
+      if (bucket < SUBS)
+         return (uint64_t)bucket;
+      int exponent = bucket / SUBS + SUB_BITS - 1;
+      return (uint64_t)(SUBS + bucket % SUBS) << (exponent - SUB_BITS);
+   }
+
+private:
+   static inline void bump( std::atomic<uint64_t>& value, uint64_t n )
+   {
+      value.store( value.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+   }
+
+   std::atomic<uint64_t> mCounts[BUCKETS];
+   std::atomic<uint64_t> mCount, mSum, mMax;
+};
+
+
+struct StatsHome; //< (below)
+
+/// one thread's counts for one output (OutputBase::SetStats).  only that thread writes them.
+struct ThreadStats
+{
+   Counter mEmitted;    //< messages that were written (or queued for the async writer)
+   Counter mFiltered;   //< calls filtered out by the filter/level or category
+   Counter mSuppressed; //< messages dropped by a rate limit (SetRateLimit, SPEW_*_LIMITED)
+   Counter mDropped;    //< messages the async ring had no room for
+   Counter mTruncated;  //< summary lines cut to fit their fixed size buffer (messages never are)
+   Histogram mCall;     //< ns spent in the log call: filter, format, and write (or queue)
+   std::shared_ptr<StatsHome> mHome; //< where it goes when its thread exits
+
+   /// add another thread's counts to these (this one's writer only)
+   void add( const ThreadStats& other )
+   {
+      mEmitted.add( other.mEmitted.get() );
+      mFiltered.add( other.mFiltered.get() );
+      mSuppressed.add( other.mSuppressed.get() );
+      mDropped.add( other.mDropped.get() );
+      mTruncated.add( other.mTruncated.get() );
+      mCall.add( other.mCall );
+   }
+};
+
+/// an output's ThreadStats: the ones of threads still running, and the counts of the
+/// ones that exited, folded together.  shared by the output and its threads' ThreadStats,
+/// so an output can go before its threads or after them.
+struct StatsHome
+{
+   std::mutex mMutex;
+   std::vector<ThreadStats*> mLive; //< each freed by its own thread, when it exits
+   ThreadStats mRetired;            //< (under mMutex)
+};
+
+/// a stream's (or sink's) counts: bytes and write time
+struct SinkStats
+{
+   SinkStats() : mStream( NULL ), mSink( NULL ), mBytes( 0 ), mWrites( 0 ) {}
+   std::ostream* mStream;
+   Sink* mSink;
+   uint64_t mBytes, mWrites;
+   Histogram mWrite; //< ns in its write (and flush)
+};
+
+/// everything an output has counted, over all threads (OutputBase::GetStats)
+struct OutputStats
+{
+   OutputStats() : mEmitted( 0 ), mFiltered( 0 ), mSuppressed( 0 ), mDropped( 0 ), mTruncated( 0 ), mCoalesced( 0 ) {}
+
+   void add( const ThreadStats& thread )
+   {
+      mEmitted += thread.mEmitted.get();
+      mFiltered += thread.mFiltered.get();
+      mSuppressed += thread.mSuppressed.get();
+      mDropped += thread.mDropped.get();
+      mTruncated += thread.mTruncated.get();
+      mCall.add( thread.mCall );
+   }
+
+   /// as text, one line each
+   void print( std::string& out ) const
+   {
+      char text[160];
+      snprintf( text, sizeof( text ), "emitted %llu\nfiltered %llu\nsuppressed %llu\ndropped %llu\ntruncated %llu\ncoalesced %llu\ncall ns: ",
+                (unsigned long long)mEmitted, (unsigned long long)mFiltered, (unsigned long long)mSuppressed,
+                (unsigned long long)mDropped, (unsigned long long)mTruncated, (unsigned long long)mCoalesced );
+      out += text;
+      mCall.print( out );
+      out += '\n';
+      int streams = 0, sinks = 0;
+      for (size_t x = 0; x < mSinks.size(); ++x)
+      {
+         snprintf( text, sizeof( text ), "%s %d: bytes %llu writes %llu write ns: ", NULL != mSinks[x].mStream ? "stream" : "sink",
+                   NULL != mSinks[x].mStream ? streams++ : sinks++, (unsigned long long)mSinks[x].mBytes, (unsigned long long)mSinks[x].mWrites );
+         out += text;
+         mSinks[x].mWrite.print( out );
+         out += '\n';
+      }
+   }
+
+   uint64_t mEmitted, mFiltered, mSuppressed, mDropped, mTruncated;
+   uint64_t mCoalesced; //< repeats held back by SetRepeatCoalescing
+   Histogram mCall;
+   std::vector<SinkStats> mSinks; //< in the order they were first written to
+};
+
+
+/// each thread's ThreadStats, by output slot.  when the thread exits, each is folded
+/// into its output's retired counts and freed, so threads that come and go don't pile up.
+struct ThreadStatsSlots
+{
+   ~ThreadStatsSlots()
+   {
+      gone() = true;
+      for (size_t x = 0; x < mSlots.size(); ++x)
+      {
+         if (NULL == mSlots[x])
+            continue;
+         std::shared_ptr<StatsHome> home = std::move( mSlots[x]->mHome );
+         {
+            std::lock_guard<std::mutex> lock( home->mMutex );
+            home->mRetired.add( *mSlots[x] );
+            home->mLive.erase( std::find( home->mLive.begin(), home->mLive.end(), mSlots[x] ) );
+         }
+         delete mSlots[x];
+      }
+   }
+   /// true once this thread's slots are destroyed (a message logged later isn't counted)
+   static bool& gone() { static thread_local bool g = false; return g; }
+   std::vector<ThreadStats*> mSlots;
+};
+inline std::vector<ThreadStats*>& threadStatsSlots()
+{
+   static thread_local ThreadStatsSlots slots;
+   return slots.mSlots;
+}
+/// an OutputBase gets a slot number when it's made, its index in per thread tables
+/// (stats, backtraces).  numbers aren't reused, so a slot never points at another output's.
+inline unsigned int nextOutputSlot()
+{
+   static std::atomic<unsigned int> next( 0 );
+   return next.fetch_add( 1, std::memory_order_relaxed );
+}
+
+
+/// rewrites a file every so often with what 'render' makes (the stats dump).
+/// written next to it and renamed over it, so a reader never sees half a file.
+class StatsFile
+{
+public:
+   StatsFile() : mStop( false ) {}
+   ~StatsFile() { Stop(); }
+
+   void Start( const char* path, unsigned int milliseconds, std::function<void( std::string& )> render )
+   {
+      Stop();
+      mPath = path;
+      mStop = false;
+      mThread = std::thread( [this, milliseconds, render]()
+      {
+         std::unique_lock<std::mutex> lock( mMutex );
+         while (!mWake.wait_for( lock, std::chrono::milliseconds( milliseconds ), [this]() { return mStop; } ))
+            write( render );
+         write( render ); // the last word
+      } );
+   }
+   void Stop()
+   {
+      if (!mThread.joinable())
+         return;
+      {
+         std::lock_guard<std::mutex> lock( mMutex );
+         mStop = true;
+      }
+      mWake.notify_one();
+      mThread.join();
+   }
+
+private:
+   StatsFile( const StatsFile& );
+   StatsFile& operator=( const StatsFile& );
+
+   void write( const std::function<void( std::string& )>& render )
+   {
+      std::string text;
+      render( text );
+      std::string temp = mPath + ".tmp";
+      FILE* file = fopen( temp.c_str(), "wb" );
+      if (NULL == file)
+         return;
+      fwrite( text.data(), 1, text.size(), file );
+      fclose( file );
+      rename( temp.c_str(), mPath.c_str() );
+   }
+
+   std::string mPath;
+   std::thread mThread;
+   std::mutex mMutex;
+   std::condition_variable mWake;
+   bool mStop;
+};
+
+
+/// the histogram's buckets and percentiles
+struct StatsUnitTest
+{
+   static void test()
+   {
+      printf( "running stats tests... [" );
+      bool exact = true, ordered = true;
+      for (uint64_t v = 0; v < 100000; v = v < 64 ? v + 1 : v * 9 / 8)
+      {
+         int b = Histogram::bucket( v );
+         exact = exact && Histogram::lowest( b ) <= v && v < Histogram::lowest( b + 1 );
+         ordered = ordered && (0 == v || Histogram::bucket( v - 1 ) <= b);
+      }
+      printf( "%s", exact && ordered && Histogram::BUCKETS - 1 == Histogram::bucket( ~0ull ) ? "." : "F" );
+
+      Histogram h;
+      for (uint64_t v = 1; v <= 1000; ++v)
+         h.record( v );
+      uint64_t p50 = h.percentile( 0.5 ), p99 = h.percentile( 0.99 );
+      printf( "%s", 1000 == h.count() && 1000 == h.max() && 500.5 == h.mean() &&
+                    500 <= p50 && p50 < 500 * 9 / 8 && 990 <= p99 && p99 <= 1000 ? "." : "F" );
+
+      Histogram copy( h );
+      copy.add( h );
+      printf( "%s", 2000 == copy.count() && 1000 == copy.max() && copy.percentile( 0.5 ) == p50 ? "." : "F" );
+
+      OutputStats stats;
+      ThreadStats thread;
+      thread.mEmitted.add( 3 );
+      thread.mCall.record( 250 );
+      stats.add( thread );
+      stats.add( thread );
+      std::string text;
+      stats.print( text );
+      printf( "%s", 6 == stats.mEmitted && 2 == stats.mCall.count() && 0 == text.find( "emitted 6\nfiltered 0\n" ) ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
@@ -0,0 +1,645 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_STRUCTURED
+#define SPEW_STRUCTURED
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <immintrin.h>
+#endif
+#include "FormatBuffer.h"
+#include "BinaryLog.h" //< varints, record tags, BinaryDecoder
+#include "Sink.h" //< Span
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// one key/value pair of a structured message.
+/// holds the value (numbers) or points at it (strings), so it only lives as long as
+/// the call it's made for.
+/// usage:
+/// @code
+///    Log( IO, 2, "request done", { { "path", path }, { "status", 200 }, { "ms", ms } } );
+/// @endcode
+struct Field
+{
+   enum Type { INT = 'i', UINT = 'u', DOUBLE = 'd', BOOL = 'b', STRING = 's', NUL = 'n' };
+
+   /// integers, floats, bool, strings (char*, std::string, std::string_view, char), nullptr
+   template <typename T>
+   Field( std::string_view key, const T& value ) : mKey( key )
+   {
+      if constexpr (std::is_same<T, bool>::value)
+      {
+         mType = BOOL;
+         mUint = value ? 1 : 0;
+      }
+      else if constexpr (std::is_same<T, char>::value)
+         string( &value, 1 );
+      else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+      {
+         mType = INT;
+         mInt = value;
+      }
+      else if constexpr (std::is_integral<T>::value)
+      {
+         mType = UINT;
+         mUint = value;
+      }
+      else if constexpr (std::is_enum<T>::value)
+      {
+         mType = INT;
+         mInt = (int64_t)value;
+      }
+      else if constexpr (std::is_floating_point<T>::value)
+      {
+         mType = DOUBLE;
+         mDouble = (double)value;
+      }
+      else if constexpr (std::is_same<T, std::nullptr_t>::value)
+         mType = NUL;
+      else if constexpr (std::is_convertible<const T&, const char*>::value)
+      {
+         const char* text = value;
+         if (NULL == text)
+            mType = NUL;
+         else
+            string( text, strlen( text ) );
+      }
+      else if constexpr (std::is_convertible<const T&, std::string_view>::value)
+      {
+         std::string_view text( value );
+         string( text.data(), text.size() );
+      }
+      else
+         static_assert( !sizeof( T ), "spew::Field: numbers, bool and strings only" );
+   }
+
+   std::string_view mKey;
+   char mType;
+   union
+   {
+      int64_t mInt;
+      uint64_t mUint; //< also bool
+      double mDouble;
+   };
+   const char* mString;
+   size_t mLength;
+
+private:
+   inline void string( const char* text, size_t length )
+   {
+      mType = STRING;
+      mString = text;
+      mLength = length;
+   }
+};
+
+/// how a stream or sink gets its messages (OutputBase::SetEncoding)
+enum Encoding
+{
+   ENCODE_TEXT,  //< message key="value" key=value
+   ENCODE_JSON,  //< one json object per line
+   ENCODE_TLV,   //< 'K' binary records, spew-decode turns them into text
+   ENCODINGS
+};
+
+/// everything about one structured message the encoders need
+struct StructuredRecord
+{
+   unsigned int mFilter;    //< FILTERALL, the filter, or 0 (runtime category)
+   const char* mFilterName; //< NULL unless the filter is one named bit
+   unsigned int mLevel;     //< a Level bit
+   const char* mCategory;   //< runtime category name, NULL for none
+   const char* mMessage;
+   size_t mMessageLength;
+   const Field* mFields;
+   size_t mCount;
+};
+
+
+/// length of the run at the start of 'text' json can take as is
+/// (no '"', '\\' or control chars), a byte at a time
+inline size_t jsonPlainRunScalar( const char* text, size_t length )
+{
+   size_t x = 0;
+   while (x < length && '"' != text[x] && '\\' != text[x] && 0x20 <= (unsigned char)text[x])
+      ++x;
+   return x;
+}
+
+/// same, 16 (SSE2) or 32 (AVX2) bytes at a time
+inline size_t jsonPlainRun( const char* text, size_t length )
+{
+   size_t x = 0;
+#if defined(__AVX2__)
+   const __m256i quote32 = _mm256_set1_epi8( '"' ), slash32 = _mm256_set1_epi8( '\\' ), space32 = _mm256_set1_epi8( 0x1f );
+   for (; x + 32 <= length; x += 32)
+   {
+      __m256i bytes = _mm256_loadu_si256( (const __m256i*)(text + x) );
+      __m256i special = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( bytes, quote32 ), _mm256_cmpeq_epi8( bytes, slash32 ) ),
+                                         _mm256_cmpeq_epi8( _mm256_max_epu8( bytes, space32 ), space32 ) ); // bytes <= 0x1f
+      unsigned int mask = (unsigned int)_mm256_movemask_epi8( special );
+      if (0 != mask)
+         return x + std::countr_zero( mask );
+   }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+   const __m128i quote = _mm_set1_epi8( '"' ), slash = _mm_set1_epi8( '\\' ), space = _mm_set1_epi8( 0x1f );
+   for (; x + 16 <= length; x += 16)
+   {
+      __m128i bytes = _mm_loadu_si128( (const __m128i*)(text + x) );
+      __m128i special = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( bytes, quote ), _mm_cmpeq_epi8( bytes, slash ) ),
+                                      _mm_cmpeq_epi8( _mm_max_epu8( bytes, space ), space ) );
+      unsigned int mask = (unsigned int)_mm_movemask_epi8( special );
+      if (0 != mask)
+         return x + std::countr_zero( mask );
+   }
+#endif
+   return x + jsonPlainRunScalar( text + x, length - x );
+}
+
+/// appends to a FormatBuffer through a pointer.  room is made a piece at a time
+/// (ensure), so most writes are a compare and a copy, not a call to append.
+/// ensure is false when the heap is out, the encoders stop there (a truncated message).
+class BufferWriter
+{
+public:
+   BufferWriter( FormatBuffer& buf ) : mBuf( buf ), mStart( buf.prepare( 0 ) ), mAt( mStart ), mEnd( mStart + (buf.capacity() - buf.size() - 1) ) {}
+   ~BufferWriter() { mBuf.commit( mAt - mStart ); }
+
+   /// room for 'length' more chars, false if it can't be made
+   inline bool ensure( size_t length )
+   {
+      return (size_t)(mEnd - mAt) >= length || grow( length );
+   }
+   /// these need room made first
+   inline void put( char c ) { *mAt++ = c; }
+   inline void put( const char* text, size_t length )
+   {
+      memcpy( mAt, text, length );
+      mAt += length;
+   }
+   inline void putVarint( uint64_t value )
+   {
+      while (value >= 0x80)
+      {
+         *mAt++ = (char)(value | 0x80);
+         value >>= 7;
+      }
+      *mAt++ = (char)value;
+   }
+   template <typename T>
+   inline void putNumber( T value ) { mAt = std::to_chars( mAt, mAt + 32, value ).ptr; }
+   /// doubles: the fewest decimals (up to 6) that read back as the very same double,
+   /// std::to_chars for the rest.  the usual "3.5" or "0.25" is a few integer ops
+   /// this way, where the shortest round trip search takes ~100ns.
+   inline void putNumber( double value )
+   {
+      static const double scales[] = { 1, 10, 100, 1e3, 1e4, 1e5, 1e6 };
+      static const uint64_t divisors[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+      double magnitude = std::fabs( value );
+      for (int decimals = 0; magnitude < 1e15 && decimals < 7; ++decimals)
+      {
+         double scaled = magnitude * scales[decimals];
+         if (scaled >= 9007199254740992.0) // 2^53, past this the digits aren't exact
+            break;
+         uint64_t digits = (uint64_t)(scaled + 0.5);
+         if ((double)digits / scales[decimals] != magnitude) // both exact, so this rounds like strtod
+            continue;
+         if (std::signbit( value ))
+            *mAt++ = '-';
+         mAt = std::to_chars( mAt, mAt + 20, digits / divisors[decimals] ).ptr;
+         if (0 != decimals)
+         {
+            *mAt++ = '.';
+            uint64_t fraction = digits % divisors[decimals];
+            for (int x = decimals - 1; x >= 0; --x, fraction /= 10)
+               mAt[x] = (char)('0' + fraction % 10);
+            mAt += decimals;
+         }
+         return;
+      }
+      mAt = std::to_chars( mAt, mAt + 32, value ).ptr;
+   }
+
+   /// these make their own room
+   inline void append( const char* text, size_t length )
+   {
+      if (ensure( length ))
+         put( text, length );
+   }
+
+private:
+   BufferWriter( const BufferWriter& );
+   BufferWriter& operator=( const BufferWriter& );
+
+   bool grow( size_t length )
+   {
+      mBuf.commit( mAt - mStart );
+      mStart = mAt = mBuf.prepare( length < 256 ? 256 : length );
+      bool grown = NULL != mStart;
+      if (!grown)
+         mStart = mAt = mBuf.prepare( 0 ); // the room there was, never fails
+      mEnd = mStart + (mBuf.capacity() - mBuf.size() - 1);
+      return grown;
+   }
+
+   FormatBuffer& mBuf;
+   char* mStart; //< what's been written since the last commit starts here
+   char* mAt;
+   char* mEnd;
+};
+
+/// "text", escaped for json.  plain runs are copied in one go, utf-8 passes through.
+inline void writeJsonString( BufferWriter& out, const char* text, size_t length )
+{
+   if (!out.ensure( length + 2 ))
+      return;
+   out.put( '"' );
+   for (;;)
+   {
+      size_t run = jsonPlainRun( text, length );
+      out.put( text, run );
+      if (run == length)
+         break;
+      if (!out.ensure( 6 + length - run ))
+         return;
+      out.put( '\\' );
+      switch (text[run])
+      {
+      case '"': out.put( '"' ); break;
+      case '\\': out.put( '\\' ); break;
+      case '\n': out.put( 'n' ); break;
+      case '\r': out.put( 'r' ); break;
+      case '\t': out.put( 't' ); break;
+      case '\b': out.put( 'b' ); break;
+      case '\f': out.put( 'f' ); break;
+      default:
+         {
+            const char* hex = "0123456789abcdef";
+            unsigned char c = (unsigned char)text[run];
+            out.put( "u00", 3 );
+            out.put( hex[c >> 4] );
+            out.put( hex[c & 15] );
+         }
+         break;
+      }
+      text += run + 1;
+      length -= run + 1;
+   }
+   out.put( '"' );
+}
+inline void appendJsonString( FormatBuffer& buf, const char* text, size_t length )
+{
+   BufferWriter out( buf );
+   writeJsonString( out, text, length );
+}
+
+/// a field's value as text ('json': null for nan/inf)
+inline void writeFieldValue( BufferWriter& out, const Field& field, bool json )
+{
+   if (Field::STRING == field.mType)
+      return writeJsonString( out, field.mString, field.mLength );
+   if (!out.ensure( 32 ))
+      return;
+   switch (field.mType)
+   {
+   case Field::INT: out.putNumber( field.mInt ); break;
+   case Field::UINT: out.putNumber( field.mUint ); break;
+   case Field::BOOL: field.mUint ? out.put( "true", 4 ) : out.put( "false", 5 ); break;
+   case Field::NUL: out.put( "null", 4 ); break;
+   case Field::DOUBLE:
+      if (json && !std::isfinite( field.mDouble ))
+         out.put( "null", 4 );
+      else
+         out.putNumber( field.mDouble );
+      break;
+   }
+}
+inline void appendFieldValue( FormatBuffer& buf, const Field& field, bool json )
+{
+   BufferWriter out( buf );
+   writeFieldValue( out, field, json );
+}
+
+/// the message without its newline (structured messages get one of their own)
+inline size_t messageLength( const StructuredRecord& record )
+{
+   size_t length = record.mMessageLength;
+   return 0 != length && '\n' == record.mMessage[length - 1] ? length - 1 : length;
+}
+
+/// ENCODE_TEXT:  message key="value" key=value
+inline void appendText( FormatBuffer& buf, const StructuredRecord& record )
+{
+   BufferWriter out( buf );
+   out.append( record.mMessage, messageLength( record ) );
+   for (size_t x = 0; x < record.mCount; ++x)
+   {
+      const Field& field = record.mFields[x];
+      if (!out.ensure( field.mKey.size() + 2 ))
+         return;
+      out.put( ' ' );
+      out.put( field.mKey.data(), field.mKey.size() );
+      out.put( '=' );
+      writeFieldValue( out, field, false );
+   }
+   out.append( "\n", 1 );
+}
+
+/// ENCODE_JSON:  {"level":2,"filter":"IO","msg":"message","key":"value"}
+inline void appendJson( FormatBuffer& buf, const StructuredRecord& record )
+{
+   BufferWriter out( buf );
+   if (!out.ensure( 16 ))
+      return;
+   out.put( "{\"level\":", 9 );
+   out.putNumber( 1 + std::countr_zero( record.mLevel | 0x80000000u ) );
+   if (NULL != record.mFilterName)
+   {
+      out.append( ",\"filter\":", 10 );
+      writeJsonString( out, record.mFilterName, strlen( record.mFilterName ) );
+   }
+   if (NULL != record.mCategory)
+   {
+      out.append( ",\"category\":", 12 );
+      writeJsonString( out, record.mCategory, strlen( record.mCategory ) );
+   }
+   out.append( ",\"msg\":", 7 );
+   writeJsonString( out, record.mMessage, messageLength( record ) );
+   for (size_t x = 0; x < record.mCount; ++x)
+   {
+      const Field& field = record.mFields[x];
+      out.append( ",", 1 );
+      writeJsonString( out, field.mKey.data(), field.mKey.size() );
+      out.append( ":", 1 );
+      writeFieldValue( out, field, true );
+   }
+   out.append( "}\n", 2 );
+}
+
+/// ENCODE_TLV, a 'K' record in the binary log format (see BinaryLog.h):
+///    'K' u8:flags, [v:filter], [v:length, category], v:length, message, v:count, fields
+/// flags 0x40 says a category follows.  each field is
+///    u8:type, v:length, key, value
+/// with the value as in 'M' records: 'i' zigzag varint, 'u' varint, 'd' 8 bytes,
+/// 'b' one byte, 's' v:length then chars, 'n' nothing.
+inline void appendTlv( FormatBuffer& buf, const StructuredRecord& record )
+{
+   appendBinaryTag( buf, 'K', record.mFilter, record.mLevel, NULL != record.mCategory ? 0x40 : 0 );
+   BufferWriter out( buf );
+   if (NULL != record.mCategory)
+   {
+      size_t length = strlen( record.mCategory );
+      if (!out.ensure( 10 + length ))
+         return;
+      out.putVarint( length );
+      out.put( record.mCategory, length );
+   }
+   size_t length = messageLength( record );
+   if (!out.ensure( 20 + length ))
+      return;
+   out.putVarint( length );
+   out.put( record.mMessage, length );
+   out.putVarint( record.mCount );
+   for (size_t x = 0; x < record.mCount; ++x)
+   {
+      const Field& field = record.mFields[x];
+      if (!out.ensure( 21 + field.mKey.size() + (Field::STRING == field.mType ? field.mLength : 0) ))
+         return;
+      out.put( field.mType );
+      out.putVarint( field.mKey.size() );
+      out.put( field.mKey.data(), field.mKey.size() );
+      switch (field.mType)
+      {
+      case Field::INT: out.putVarint( ((uint64_t)field.mInt << 1) ^ (uint64_t)(field.mInt >> 63) ); break;
+      case Field::UINT: out.putVarint( field.mUint ); break;
+      case Field::DOUBLE: out.put( (const char*)&field.mDouble, sizeof( double ) ); break;
+      case Field::BOOL: out.put( field.mUint ? '\1' : '\0' ); break;
+      case Field::STRING:
+         out.putVarint( field.mLength );
+         out.put( field.mString, field.mLength );
+         break;
+      }
+   }
+}
+
+/// one encoding of a record, appended to 'buf'
+inline void appendEncoded( FormatBuffer& buf, Encoding encoding, const StructuredRecord& record )
+{
+   switch (encoding)
+   {
+   case ENCODE_JSON: appendJson( buf, record ); break;
+   case ENCODE_TLV: appendTlv( buf, record ); break;
+   default: appendText( buf, record ); break;
+   }
+}
+
+/// a record in several encodings at once, for outputs whose streams want different ones:
+/// a header with each encoding's length (0 for the ones not in 'mask'), then the
+/// encodings in order.  each is written straight into 'buf', once.
+typedef uint32_t StructuredLengths[ENCODINGS];
+inline void encodeStructured( FormatBuffer& buf, unsigned int mask, const StructuredRecord& record )
+{
+   StructuredLengths lengths = { 0 };
+   buf.clear();
+   buf.append( (const char*)lengths, sizeof( lengths ) );
+   for (unsigned int encoding = 0; encoding < ENCODINGS; ++encoding)
+   {
+      if (0 == (mask & (1u << encoding)))
+         continue;
+      size_t before = buf.size();
+      appendEncoded( buf, (Encoding)encoding, record );
+      lengths[encoding] = (uint32_t)(buf.size() - before);
+   }
+   memcpy( buf.data(), lengths, sizeof( lengths ) );
+}
+
+/// one encoding out of an encodeStructured record, or if it doesn't have that one,
+/// the first one it has (and 'missing' is set)
+inline Span structuredPart( const char* data, Encoding encoding, bool& missing )
+{
+   StructuredLengths lengths;
+   memcpy( lengths, data, sizeof( lengths ) );
+   missing = 0 == lengths[encoding];
+   for (unsigned int x = 0; missing && x < ENCODINGS; ++x)
+      if (0 != lengths[x])
+      {
+         encoding = (Encoding)x;
+         break;
+      }
+   size_t offset = sizeof( lengths );
+   for (unsigned int x = 0; x < (unsigned int)encoding; ++x)
+      offset += lengths[x];
+   Span part = { data + offset, lengths[encoding] };
+   return part;
+}
+
+/// the text of a 'K' record, same as ENCODE_TEXT (declared in BinaryLog.h)
+inline bool decodeStructured( unsigned char flags, const char*& p, const char* end, FormatBuffer& out )
+{
+   uint64_t length, count;
+   if (0 != (flags & 0x40))
+   {
+      if (!BinaryDecoder::varint( p, end, length ) || (uint64_t)(end - p) < length) return false;
+      p += length; // the category, text output doesn't show it
+   }
+   if (!BinaryDecoder::varint( p, end, length ) || (uint64_t)(end - p) < length) return false;
+   out.append( p, length );
+   p += length;
+   if (!BinaryDecoder::varint( p, end, count )) return false;
+   for (uint64_t x = 0; x < count; ++x)
+   {
+      if (p >= end) return false;
+      char type = *p++;
+      if (!BinaryDecoder::varint( p, end, length ) || (uint64_t)(end - p) < length) return false;
+      std::string_view key( p, length );
+      p += length;
+      int64_t i;
+      uint64_t u;
+      double d;
+      unsigned char b;
+      out.append( " ", 1 );
+      out.append( key.data(), key.size() );
+      out.append( "=", 1 );
+      switch (type)
+      {
+      case Field::INT: if (!BinaryDecoder::zigzag( p, end, i )) return false; appendFieldValue( out, Field( key, i ), false ); break;
+      case Field::UINT: if (!BinaryDecoder::varint( p, end, u )) return false; appendFieldValue( out, Field( key, u ), false ); break;
+      case Field::DOUBLE: if (!BinaryDecoder::read( p, end, d )) return false; appendFieldValue( out, Field( key, d ), false ); break;
+      case Field::BOOL: if (!BinaryDecoder::read( p, end, b )) return false; appendFieldValue( out, Field( key, 0 != b ), false ); break;
+      case Field::NUL: appendFieldValue( out, Field( key, nullptr ), false ); break;
+      case Field::STRING:
+         if (!BinaryDecoder::varint( p, end, length ) || (uint64_t)(end - p) < length) return false;
+         appendFieldValue( out, Field( key, std::string_view( p, length ) ), false );
+         p += length;
+         break;
+      default:
+         return false;
+      }
+   }
+   out.append( "\n", 1 );
+   return true;
+}
+
+
+/// escaping, and the three encodings of the same record
+struct StructuredUnitTest
+{
+   static bool equals( const FormatBuffer& buf, const std::string& expected )
+   {
+      return buf.size() == expected.size() && 0 == memcmp( buf.c_str(), expected.data(), buf.size() );
+   }
+   static void test()
+   {
+      printf( "running structured tests... [" );
+      // every kind of special char, at every offset of the 16/32 byte blocks
+      bool escapes = true;
+      for (size_t at = 0; at < 70; ++at)
+      {
+         const char specials[] = { '"', '\\', '\n', '\x01', '\x1f' };
+         const char* expect[] = { "\\\"", "\\\\", "\\n", "\\u0001", "\\u001f" };
+         for (size_t s = 0; s < sizeof( specials ); ++s)
+         {
+            std::string text( 70, 'a' );
+            text[at] = specials[s];
+            text += "\xc3\xa9"; // utf-8 passes through
+            FormatBuffer buf;
+            appendJsonString( buf, text.data(), text.size() );
+            std::string expected = "\"" + std::string( at, 'a' ) + expect[s] + std::string( 69 - at, 'a' ) + "\xc3\xa9\"";
+            escapes = escapes && equals( buf, expected ) && at == jsonPlainRun( text.data(), text.size() );
+         }
+      }
+      printf( "%s", escapes ? "." : "F" );
+
+      // doubles read back as themselves, the common ones as few decimals as can be
+      const double doubles[] = { 0, -0.0, 3.5, 0.1, -2.25, 1234567.125, 0.000001, 1e-7, 1e300, 123456789012345678.0, 0.1 + 0.2, 1.0 / 3 };
+      const char* short_[] = { "0", "-0", "3.5", "0.1", "-2.25", "1234567.125", "0.000001" };
+      bool doublesOk = true;
+      for (size_t x = 0; x < sizeof( doubles ) / sizeof( double ); ++x)
+      {
+         FormatBuffer buf;
+         appendFieldValue( buf, Field( "d", doubles[x] ), true );
+         double back = strtod( buf.c_str(), NULL );
+         doublesOk = doublesOk && back == doubles[x] && std::signbit( back ) == std::signbit( doubles[x] ) &&
+                     (x >= sizeof( short_ ) / sizeof( short_[0] ) || 0 == strcmp( buf.c_str(), short_[x] ));
+      }
+      printf( "%s", doublesOk ? "." : "F" );
+
+      std::string path( "/index.html" );
+      Field fields[] = { { "path", path }, { "status", 200 }, { "bytes", 1024u }, { "ms", 3.5 }, { "ok", true },
+                         { "note", "say \"hi\"" }, { "none", (const char*)NULL }, { "nan", NAN } };
+      StructuredRecord record = { 0x10, "IO", 2, "net.http", "request done\n", 13, fields, sizeof( fields ) / sizeof( fields[0] ) };
+      FormatBuffer text, json, tlv;
+      appendText( text, record );
+      appendJson( json, record );
+      appendTlv( tlv, record );
+      const char* expectedText = "request done path=\"/index.html\" status=200 bytes=1024 ms=3.5 ok=true note=\"say \\\"hi\\\"\" none=null nan=nan\n";
+      printf( "%s", equals( text, expectedText ) ? "." : "F" );
+      printf( "%s", equals( json, "{\"level\":2,\"filter\":\"IO\",\"category\":\"net.http\",\"msg\":\"request done\",\"path\":\"/index.html\","
+                                  "\"status\":200,\"bytes\":1024,\"ms\":3.5,\"ok\":true,\"note\":\"say \\\"hi\\\"\",\"none\":null,\"nan\":null}\n" ) ? "." : "F" );
+
+      // tlv decodes to the text encoding, and every cut short version is "incomplete"
+      BinaryDecoder decoder;
+      FormatBuffer decoded;
+      long used = decoder.decode( tlv.c_str(), tlv.c_str() + tlv.size(), decoded );
+      printf( "%s", used == (long)tlv.size() && equals( decoded, expectedText ) ? "." : "F" );
+      bool incomplete = true;
+      for (size_t cut = 0; cut < tlv.size(); ++cut)
+         incomplete = incomplete && 0 == decoder.decode( tlv.c_str(), tlv.c_str() + cut, decoded );
+      printf( "%s", incomplete ? "." : "F" );
+
+      // several encodings in one record
+      FormatBuffer both;
+      encodeStructured( both, (1u << ENCODE_TEXT) | (1u << ENCODE_JSON), record );
+      bool missing[3];
+      Span textPart = structuredPart( both.c_str(), ENCODE_TEXT, missing[0] );
+      Span jsonPart = structuredPart( both.c_str(), ENCODE_JSON, missing[1] );
+      Span tlvPart = structuredPart( both.c_str(), ENCODE_TLV, missing[2] ); // not there: the first one
+      printf( "%s", std::string( textPart.mData, textPart.mLength ) == expectedText &&
+                    std::string( jsonPart.mData, jsonPart.mLength ) == std::string( json.c_str(), json.size() ) &&
+                    tlvPart.mData == textPart.mData && !missing[0] && !missing[1] && missing[2] ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
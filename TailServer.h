@@ -0,0 +1,414 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_TAIL_SERVER
+#define SPEW_TAIL_SERVER
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <string.h>
+#include "Output.h" //< SetTap, OutputSettings
+#include "AsyncOutput.h" //< MpscRing
+#ifndef WIN32
+#  include <errno.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// a live tail client's subscription, one line of words (case insensitive):
+///   GFX IO ...           filters, or "all" for every filter and category
+///   1 .. 5, 3only, Max   a level, as on the command line (5 if none is given)
+///   net.http             a runtime category and everything under it
+///   -net.http.client     ... but not this one
+/// example: "IO 5 net -net.dns"
+inline void parseSubscription( const char* line, OutputSettings& settings )
+{
+   settings.SetFilter( FILTERNONE );
+   settings.SetLevel( LEVEL5ANDLOWER );
+   std::istringstream words( line );
+   std::string word;
+   while (words >> word)
+   {
+      if ('-' == word[0] && 1 < word.size())
+      {
+         settings.EnableCategory( word.c_str() + 1, false );
+         continue;
+      }
+      if (0 == compareNoCase( word.c_str(), "all", 4 ))
+      {
+         settings.AddFilter( FILTERALL );
+         continue;
+      }
+      // the filters come first in the table, the levels from "Off" on
+      bool found = false, level = false;
+      for (int x = 0; !found && '\0' != gTagDescriptions[x].mName[0]; ++x)
+      {
+         level = level || 0 == strcmp( "Off", gTagDescriptions[x].mName );
+         if (0 != compareNoCase( word.c_str(), gTagDescriptions[x].mName, strlen( gTagDescriptions[x].mName ) + 1 ))
+            continue;
+         found = true;
+         if (level)
+            settings.SetLevel( gTagDescriptions[x].mTag );
+         else
+            settings.AddFilter( gTagDescriptions[x].mTag );
+      }
+      if (!found)
+         settings.EnableCategory( word.c_str(), true );
+   }
+}
+
+
+#ifndef WIN32
+
+/// live tail: a unix domain socket that spew-tail (or anything that can connect to it)
+/// attaches to, sends a subscription (parseSubscription), and gets the matching messages
+/// as they happen.  the subscription goes on the output as its tap (SetTap) only while the
+/// client is attached: verbose categories nobody watches still fail the filter test, and
+/// log.txt (the output's streams and sinks) never sees them.
+/// the logging threads only push finished text into a lock-free queue.  this server's
+/// thread sends it in batches, non-blocking: a client that falls behind loses messages
+/// (and is told how many), it never holds up the program.  one client at a time.
+/// a line sent later changes the subscription.
+/// usage:
+/// @code
+///   static spew::TailServer tail;
+///   tail.Start( Log, "/tmp/myapp.spew" );
+///   ...
+///   $ spew-tail /tmp/myapp.spew IO 5 net.http
+/// @endcode
+class TailServer
+{
+public:
+   enum { BACKLOG = 1024 * 1024 }; //< bytes a client can fall behind by before messages drop
+
+   /// 'queue' messages can wait for the server thread
+   TailServer( size_t queue = 4096 ) : mListen( -1 ), mStop( false ), mAttached( false ), mLate( 0 ), mSent( 0 ), mQueue( queue ) {}
+   /// Stop takes the queue off the output (SetTap waits out threads still writing to it)
+   ~TailServer() { Stop(); }
+
+   /// listen at 'path' (a socket left there by an earlier run is replaced), for 'output'.
+   /// false if the socket can't be made.
+   template <typename Output>
+   bool Start( Output& output, const char* path )
+   {
+      Stop();
+      struct sockaddr_un address;
+      memset( &address, 0, sizeof( address ) );
+      address.sun_family = AF_UNIX;
+      if (strlen( path ) >= sizeof( address.sun_path ))
+         return false;
+      strcpy( address.sun_path, path );
+      int fd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+      if (fd < 0)
+         return false;
+      ::unlink( path );
+      if (0 != ::bind( fd, (struct sockaddr*)&address, sizeof( address ) ) || 0 != ::listen( fd, 4 ))
+      {
+         ::close( fd );
+         return false;
+      }
+      mListen = fd;
+      mPath = path;
+      mSetTap = [&output]( Sink* tap, const OutputSettings& subscription ) { output.SetTap( tap, subscription ); };
+      mStop = false;
+      mThread = std::thread( [this]() { serve(); } );
+      return true;
+   }
+
+   /// detach the client (its subscription goes), close and remove the socket
+   void Stop()
+   {
+      if (!mThread.joinable())
+         return;
+      mStop = true;
+      mThread.join();
+      ::close( mListen );
+      mListen = -1;
+      ::unlink( mPath.c_str() );
+   }
+
+   /// a client is attached, its subscription is on the output
+   inline bool attached() const { return mAttached.load(); }
+   /// messages a client didn't get: the queue was full, or it had fallen too far behind
+   inline size_t dropped() const { return mQueue.mDropped.load( std::memory_order_relaxed ) + mLate.load( std::memory_order_relaxed ); }
+
+   /// the client's side: a connected socket (blocking), or -1
+   static int connect( const char* path )
+   {
+      struct sockaddr_un address;
+      memset( &address, 0, sizeof( address ) );
+      address.sun_family = AF_UNIX;
+      if (strlen( path ) >= sizeof( address.sun_path ))
+         return -1;
+      strcpy( address.sun_path, path );
+      int fd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+      if (fd >= 0 && 0 != ::connect( fd, (struct sockaddr*)&address, sizeof( address ) ))
+      {
+         ::close( fd );
+         fd = -1;
+      }
+      return fd;
+   }
+
+private:
+   TailServer( const TailServer& );
+   TailServer& operator=( const TailServer& );
+
+   /// the output's tap: any thread pushes, the server thread pops
+   struct Queue : public Sink
+   {
+      Queue( size_t capacity ) : mRing( capacity ), mDropped( 0 ) {}
+      void write( const char* data, size_t length )
+      {
+         if (!mRing.push( data, length, 0, 0 ))
+            mDropped.fetch_add( 1, std::memory_order_relaxed );
+      }
+      MpscRing mRing;
+      std::atomic<size_t> mDropped;
+   };
+   /// (MpscRing::pop) a queued message, onto the client's backlog
+   struct Take
+   {
+      void write( const char* data, size_t length, unsigned int, unsigned int )
+      {
+         if (mServer->mBacklog.size() - mServer->mSent + length > BACKLOG)
+            mServer->mLate.fetch_add( 1, std::memory_order_relaxed );
+         else
+            mServer->mBacklog.append( data, length );
+      }
+      TailServer* mServer;
+   };
+
+   void serve()
+   {
+      int client = -1;
+      size_t reported = 0; //< drops the client was told about
+      bool busy = false;
+      while (!mStop)
+      {
+         // with a client, every 10ms (1ms while messages keep coming), else just for the stop flag
+         struct pollfd fds[2] = { { mListen, POLLIN, 0 }, { client, POLLIN, 0 } };
+         if (mSent < mBacklog.size())
+            fds[1].events |= POLLOUT;
+         ::poll( fds, 2, client < 0 ? 100 : busy ? 1 : 10 );
+         if (0 != (fds[0].revents & POLLIN))
+            client = accept( client, reported );
+         if (client >= 0 && 0 != (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !receive( client ))
+            client = detach( client );
+         if (client < 0)
+            continue;
+         busy = take();
+         size_t dropped = this->dropped();
+         if (dropped != reported)
+         {
+            char note[96];
+            int length = snprintf( note, sizeof( note ), "spew-tail: %lu messages dropped, the client fell behind\n", (unsigned long)(dropped - reported) );
+            mBacklog.append( note, length );
+            reported = dropped;
+         }
+         if (!send( client ))
+            client = detach( client );
+      }
+      if (client >= 0)
+         detach( client );
+   }
+
+   /// the new client, unless there already is one
+   int accept( int client, size_t& reported )
+   {
+      int fd = ::accept4( mListen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+      if (fd < 0)
+         return client;
+      if (client >= 0)
+      {
+         const char busy[] = "spew-tail: another client is attached\n";
+         if (::send( fd, busy, sizeof( busy ) - 1, MSG_DONTWAIT | MSG_NOSIGNAL ) < 0) {} // it's going away anyway
+         ::close( fd );
+         return client;
+      }
+      reported = dropped();
+      return fd;
+   }
+
+   /// read the client's subscription lines, each one replaces the last.  false when it's gone.
+   bool receive( int client )
+   {
+      char data[512];
+      ssize_t length = ::recv( client, data, sizeof( data ), MSG_DONTWAIT );
+      if (0 == length || (length < 0 && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno))
+         return false;
+      if (length < 0)
+         return true;
+      mLine.append( data, length );
+      for (size_t end = mLine.find( '\n' ); std::string::npos != end; end = mLine.find( '\n' ))
+      {
+         OutputSettings subscription;
+         parseSubscription( mLine.substr( 0, end ).c_str(), subscription );
+         mSetTap( &mQueue, subscription );
+         mAttached = true;
+         mLine.erase( 0, end + 1 );
+      }
+      return mLine.size() < 4096;
+   }
+
+   /// the client is gone: its subscription goes, what it didn't get is thrown away
+   int detach( int client )
+   {
+      if (mAttached)
+         mSetTap( NULL, OutputSettings() );
+      mAttached = false;
+      ::close( client );
+      take();
+      mBacklog.clear();
+      mSent = 0;
+      mLine.clear();
+      return -1;
+   }
+
+   /// the queue onto the backlog, true if there was anything
+   bool take()
+   {
+      Take take = { this };
+      bool any = false;
+      while (mQueue.mRing.pop( take ))
+         any = true;
+      return any;
+   }
+
+   /// as much of the backlog as the socket takes without blocking.  false if the client is gone.
+   bool send( int client )
+   {
+      while (mSent < mBacklog.size())
+      {
+         ssize_t sent = ::send( client, mBacklog.data() + mSent, mBacklog.size() - mSent, MSG_DONTWAIT | MSG_NOSIGNAL );
+         if (sent < 0)
+            return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+         mSent += sent;
+      }
+      // (kept for the next batch, it keeps its capacity)
+      mBacklog.clear();
+      mSent = 0;
+      return true;
+   }
+
+   int mListen;
+   std::string mPath;
+   std::function<void( Sink*, const OutputSettings& )> mSetTap;
+   std::atomic<bool> mStop, mAttached;
+   std::atomic<size_t> mLate;
+   std::string mBacklog, mLine; //< (server thread only) what the client hasn't got yet, and its partial line
+   size_t mSent;                //< of mBacklog
+   Queue mQueue;
+   std::thread mThread;
+};
+
+#endif
+
+
+/// a client attaches, gets what it subscribed to, isn't waited on, and takes its subscription along when it goes
+struct TailServerUnitTest
+{
+   static void test()
+   {
+#ifndef WIN32
+      printf( "running tail server tests... [" );
+      OutputSettings parsed;
+      parseSubscription( "io 3 net -net.dns", parsed );
+      printf( "%s", IO == parsed.mFilter && LEVEL3ANDLOWER == parsed.mLevel && 2 == parsed.mCategoryRules.size() && !parsed.mCategoryDefault ? "." : "F" );
+
+      std::stringstream outstr;
+      OutputBase<InitEmpty, true> output;
+      output.mOutStreams.push_back( &outstr );
+      output.SetFilter( IO );
+      char path[64];
+      snprintf( path, sizeof( path ), "/tmp/spew-tail-test.%d", (int)::getpid() );
+      TailServer server;
+      bool started = server.Start( output, path );
+      int client = TailServer::connect( path );
+      const char subscription[] = "GFX 5 test.tail\n";
+      bool sent = client >= 0 && (ssize_t)sizeof( subscription ) - 1 == ::send( client, subscription, sizeof( subscription ) - 1, MSG_NOSIGNAL );
+      for (int x = 0; x < 200 && !server.attached(); ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      printf( "%s", started && sent && server.attached() && output.IsEnabled( GFX, 5 ) ? "." : "F" );
+
+      output( GFX, 5, "verbose %d\n", 1 );
+      output( IO, 1, "normal\n" );
+      output( Category( "test.tail.x" ), 4, "category\n" );
+      const std::string expect = "verbose 1\ncategory\n";
+      std::string got;
+      for (int x = 0; x < 200 && got.size() < expect.size(); ++x)
+         got += readSome( client );
+      printf( "%s", expect == got && "normal\n" == outstr.str() ? "." : "F" );
+
+      // a client that doesn't read never holds the program up, it's told what it missed
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (int x = 0; x < 100000; ++x)
+         output( GFX, 5, "flood %06d ....................................................................\n", x );
+      bool quick = std::chrono::steady_clock::now() - start < std::chrono::seconds( 10 );
+      bool told = false;
+      for (int x = 0; x < 2000 && !told; ++x)
+         told = std::string::npos != readSome( client ).find( "messages dropped" );
+      printf( "%s", quick && told && 0 < server.dropped() ? "." : "F" );
+
+      // gone: its subscription goes with it
+      ::close( client );
+      for (int x = 0; x < 200 && server.attached(); ++x)
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      printf( "%s", !server.attached() && !output.IsEnabled( GFX, 5 ) && output.IsEnabled( IO, 1 ) ? "." : "F" );
+      server.Stop();
+      printf( "%s", 0 != ::access( path, F_OK ) ? "." : "F" );
+      printf( "]\n" );
+#endif
+   }
+
+#ifndef WIN32
+   /// what's there to read within 10ms
+   static std::string readSome( int fd )
+   {
+      struct pollfd wait = { fd, POLLIN, 0 };
+      if (::poll( &wait, 1, 10 ) <= 0)
+         return std::string();
+      char data[65536];
+      ssize_t length = ::recv( fd, data, sizeof( data ), 0 );
+      return length <= 0 ? std::string() : std::string( data, length );
+   }
+#endif
+};
+
+
+} // spew namespace
+
+#endif
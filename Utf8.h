@@ -0,0 +1,324 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+#ifndef SPEW_UTF8
+#define SPEW_UTF8
+
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <immintrin.h>
+#endif
+#include "FormatBuffer.h"
+
+/// If you'd like to change the namespace, #define SPEWNAMESPACE to your own name...
+#ifndef SPEWNAMESPACE
+   namespace spew          // default namespace to use is "spew".
+#  define SPEWNAMESPACE spew
+#else
+   namespace SPEWNAMESPACE // otherwise, use user-supplied namespace name if provided
+#endif
+{
+
+
+/// one code point as UTF-8, anything that isn't one (a surrogate, past U+10FFFF) as U+FFFD
+inline char* putUtf8( char* out, uint32_t c )
+{
+   if (c < 0x80)
+      *out++ = (char)c;
+   else if (c < 0x800)
+   {
+      *out++ = (char)(0xc0 | (c >> 6));
+      *out++ = (char)(0x80 | (c & 0x3f));
+   }
+   else if (c < 0x10000)
+   {
+      if (0xd800 <= c && c < 0xe000)
+         c = 0xfffd;
+      *out++ = (char)(0xe0 | (c >> 12));
+      *out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+      *out++ = (char)(0x80 | (c & 0x3f));
+   }
+   else if (c < 0x110000)
+   {
+      *out++ = (char)(0xf0 | (c >> 18));
+      *out++ = (char)(0x80 | ((c >> 12) & 0x3f));
+      *out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+      *out++ = (char)(0x80 | (c & 0x3f));
+   }
+   else
+      out = putUtf8( out, 0xfffd );
+   return out;
+}
+
+/// the scalar transcoder: UTF-16 (2 byte units, surrogate pairs) or UTF-32 (4 byte units)
+/// to UTF-8, at most 'units' units.  a lone surrogate becomes U+FFFD.  returns the end of
+/// the output, 'used' is how many units went (a pair isn't split, so it can be units + 1).
+template <typename CharT>
+inline char* utf8Scalar( char* out, const CharT* text, size_t length, size_t units, size_t& used )
+{
+   size_t x = 0;
+   for (; x < units && x < length; ++x)
+   {
+      uint32_t c = (uint32_t)text[x];
+      if (2 == sizeof( CharT ) && 0xd800 <= c && c < 0xdc00 && x + 1 < length)
+      {
+         uint32_t low = (uint32_t)text[x + 1];
+         if (0xdc00 <= low && low < 0xe000)
+         {
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            ++x;
+         }
+      }
+      out = putUtf8( out, c );
+   }
+   used = x;
+   return out;
+}
+
+/// copy the all-ASCII blocks at the start of 'text' (16 units at a time), narrowing each
+/// unit to a byte.  returns how many units went, stops at the first block with a non-ASCII unit.
+template <typename CharT>
+inline size_t utf8AsciiRun( char* out, const CharT* text, size_t length )
+{
+   size_t x = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+   const __m128i zero = _mm_setzero_si128();
+   if (4 == sizeof( CharT ))
+   {
+      const __m128i high = _mm_set1_epi32( (int)0xffffff80 );
+      for (; x + 16 <= length; x += 16)
+      {
+         const __m128i* in = (const __m128i*)(text + x);
+         __m128i a = _mm_loadu_si128( in ), b = _mm_loadu_si128( in + 1 ), c = _mm_loadu_si128( in + 2 ), d = _mm_loadu_si128( in + 3 );
+         __m128i any = _mm_and_si128( _mm_or_si128( _mm_or_si128( a, b ), _mm_or_si128( c, d ) ), high );
+         if (0xffff != _mm_movemask_epi8( _mm_cmpeq_epi32( any, zero ) ))
+            break;
+         // every unit < 0x80, so the saturating packs are plain narrowing
+         __m128i bytes = _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) );
+         _mm_storeu_si128( (__m128i*)(out + x), bytes );
+      }
+   }
+   else if (2 == sizeof( CharT ))
+   {
+      const __m128i high = _mm_set1_epi16( (short)0xff80 );
+      for (; x + 16 <= length; x += 16)
+      {
+         const __m128i* in = (const __m128i*)(text + x);
+         __m128i a = _mm_loadu_si128( in ), b = _mm_loadu_si128( in + 1 );
+         __m128i any = _mm_and_si128( _mm_or_si128( a, b ), high );
+         if (0xffff != _mm_movemask_epi8( _mm_cmpeq_epi16( any, zero ) ))
+            break;
+         _mm_storeu_si128( (__m128i*)(out + x), _mm_packus_epi16( a, b ) );
+      }
+   }
+#endif
+   return x;
+}
+
+/// append 'length' units of UTF-16 or UTF-32 text (wchar_t, char16_t, char32_t) to 'buf' as UTF-8.
+/// ASCII goes 16 units a step (SSE2), the rest a code point at a time.  room for the worst
+/// case is made once up front, so a buffer that's grown to the message size doesn't allocate.
+template <typename CharT>
+inline void appendUtf8( FormatBuffer& buf, const CharT* text, size_t length )
+{
+   static_assert( 2 == sizeof( CharT ) || 4 == sizeof( CharT ), "UTF-16 or UTF-32 units" );
+   char* start = buf.prepare( length * (2 == sizeof( CharT ) ? 3 : 4) );
+   if (NULL == start)
+      return;
+   char* out = start;
+   size_t x = 0;
+   while (x < length)
+   {
+      size_t ascii = utf8AsciiRun( out, text + x, length - x );
+      out += ascii;
+      x += ascii;
+      // the block that stopped the fast path (or the tail), then try it again
+      size_t used = 0;
+      out = utf8Scalar( out, text + x, length - x, 16, used );
+      x += used;
+   }
+   buf.commit( out - start );
+}
+template <typename CharT>
+inline void appendUtf8( FormatBuffer& buf, const CharT* text )
+{
+   appendUtf8( buf, text, std::char_traits<CharT>::length( text ) );
+}
+
+/// wide printf (vswprintf) into a buffer that keeps what it grew to,
+/// the wide counterpart of FormatBuffer::vappendf.  OutputBase keeps one per thread.
+class WideFormatBuffer
+{
+public:
+   enum { INLINE_SIZE = 256, MAX_SIZE = 16 * 1024 * 1024 };
+
+   WideFormatBuffer() : mText( INLINE_SIZE ), mLength( 0 ) {}
+
+   inline const wchar_t* c_str() const { return mText.data(); }
+   inline size_t size() const { return mLength; }
+
+   /// format, replacing what was there.  false (and empty) for a format or a %s argument
+   /// that can't be converted (vswprintf's EILSEQ), or text over MAX_SIZE.
+   bool vformat( const wchar_t* fmtstr, va_list arg_ptr )
+   {
+      for (;;)
+      {
+         va_list copy;
+         va_copy( copy, arg_ptr );
+         errno = 0;
+         int length = vswprintf( mText.data(), mText.size(), fmtstr, copy );
+         va_end( copy );
+         if (0 <= length)
+         {
+            mLength = length;
+            return true;
+         }
+         // vswprintf doesn't say how much room it needs, so double until it fits
+         if (EILSEQ == errno || MAX_SIZE <= mText.size())
+         {
+            mText[0] = L'\0';
+            mLength = 0;
+            return false;
+         }
+         mText.resize( mText.size() * 2 );
+      }
+   }
+   inline bool format( const wchar_t* fmtstr, ... )
+   {
+      va_list arg_ptr;
+      va_start( arg_ptr, fmtstr );
+      bool ok = vformat( fmtstr, arg_ptr );
+      va_end( arg_ptr );
+      return ok;
+   }
+
+private:
+   WideFormatBuffer( const WideFormatBuffer& );
+   WideFormatBuffer& operator=( const WideFormatBuffer& );
+
+   std::vector<wchar_t> mText;
+   size_t mLength;
+};
+
+/// the calling thread's wide format buffer
+inline WideFormatBuffer& threadWideFormatBuffer()
+{
+   static thread_local WideFormatBuffer buf;
+   return buf;
+}
+
+
+/// the fast path against the scalar one, and the corners of both encodings
+struct Utf8UnitTest
+{
+   static bool equals( const FormatBuffer& buf, const char* expected )
+   {
+      return buf.size() == strlen( expected ) && 0 == memcmp( buf.c_str(), expected, buf.size() );
+   }
+   /// every unit through the scalar transcoder, the reference
+   template <typename CharT>
+   static std::string scalar( const std::basic_string<CharT>& text )
+   {
+      std::string out( text.size() * 4, '\0' );
+      size_t used = 0;
+      char* end = utf8Scalar( &out[0], text.data(), text.size(), text.size(), used );
+      out.resize( end - out.data() );
+      return out;
+   }
+
+   static void test()
+   {
+      printf( "running utf8 tests... [" );
+      FormatBuffer buf;
+      appendUtf8( buf, L"plain ascii, long enough for a few blocks of sixteen." );
+      printf( "%s", equals( buf, "plain ascii, long enough for a few blocks of sixteen." ) ? "." : "F" );
+
+      buf.clear();
+      appendUtf8( buf, U"café € \U0001F600 日本" );
+      printf( "%s", equals( buf, "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xe6\x97\xa5\xe6\x9c\xac" ) ? "." : "F" );
+
+      // UTF-16: a pair is one code point, a lone surrogate is U+FFFD
+      buf.clear();
+      const char16_t pair[] = { u'a', 0xd83d, 0xde00, 0xdc00, u'b', 0xd800 };
+      appendUtf8( buf, pair, 6 );
+      printf( "%s", equals( buf, "a\xf0\x9f\x98\x80\xef\xbf\xbd" "b\xef\xbf\xbd" ) ? "." : "F" );
+
+      // UTF-32: surrogates and anything past U+10FFFF are U+FFFD
+      buf.clear();
+      const char32_t bad[] = { 0xd800, 0x110000, 0x10ffff };
+      appendUtf8( buf, bad, 3 );
+      printf( "%s", equals( buf, "\xef\xbf\xbd\xef\xbf\xbd\xf4\x8f\xbf\xbf" ) ? "." : "F" );
+
+      // fast path == scalar path, with non-ASCII at every offset in and around the blocks
+      // (a pair split across a block boundary included)
+      bool same = true;
+      const char32_t mix[] = { U'é', U'€', U'\U0001F600' };
+      for (size_t at = 0; at < 40 && same; ++at)
+         for (int m = 0; m < 3; ++m)
+         {
+            std::u32string wide( 48, U'x' );
+            wide[at] = mix[m];
+            std::u16string narrow16;
+            for (size_t x = 0; x < wide.size(); ++x)
+            {
+               if (wide[x] < 0x10000)
+                  narrow16 += (char16_t)wide[x];
+               else
+               {
+                  narrow16 += (char16_t)(0xd800 + ((wide[x] - 0x10000) >> 10));
+                  narrow16 += (char16_t)(0xdc00 + ((wide[x] - 0x10000) & 0x3ff));
+               }
+            }
+            buf.clear();
+            appendUtf8( buf, wide.data(), wide.size() );
+            same = same && std::string( buf.c_str(), buf.size() ) == scalar( wide );
+            buf.clear();
+            appendUtf8( buf, narrow16.data(), narrow16.size() );
+            same = same && std::string( buf.c_str(), buf.size() ) == scalar( wide );
+         }
+      printf( "%s", same ? "." : "F" );
+
+      // appending again after growing doesn't move the buffer
+      const char* data = buf.c_str();
+      buf.clear();
+      appendUtf8( buf, L"again" );
+      printf( "%s", data == buf.c_str() && equals( buf, "again" ) ? "." : "F" );
+
+      // wide printf grows past its inline size, and fails cleanly on a bad %s
+      WideFormatBuffer wide;
+      std::wstring big( 1000, L'w' );
+      bool grew = wide.format( L"%d %ls", 42, big.c_str() ) && 1003 == wide.size() && 0 == wcsncmp( wide.c_str(), L"42 ww", 5 );
+      bool failed = !wide.format( L"%s", "\xff\xfe" ) && 0 == wide.size();
+      printf( "%s", grew && failed ? "." : "F" );
+      printf( "]\n" );
+   }
+};
+
+
+} // spew namespace
+
+#endif
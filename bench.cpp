@@ -0,0 +1,821 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+// spew microbenchmarks, build and run with "make bench"
+//
+//   bench.exe [results.json [baseline.json]]   run everything, write the results as json,
+//                                              and compare them with an earlier run's
+//   bench.exe --compare old.json new.json      just compare two runs
+//
+// every row is ns/op (or the unit it says) and allocations/op (operator new calls,
+// counted below).  a compare lists what got more than 10% worse, and exits 1 if anything did.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Output.h"
+#include "Once.h"
+#include "FlightRecorder.h"
+#include "TailServer.h"
+
+/// every operator new in the process, for allocations/op
+static std::atomic<unsigned long long> gAllocations( 0 );
+
+/// each replacement calls malloc/free itself.  with the array forms forwarding to the
+/// plain ones, gcc sees free() on memory from the other form once they're inlined
+/// (-Wmismatched-new-delete)
+static void* counted( size_t size )
+{
+   gAllocations.fetch_add( 1, std::memory_order_relaxed );
+   void* p = malloc( 0 == size ? 1 : size );
+   if (NULL == p)
+      throw std::bad_alloc();
+   return p;
+}
+void* operator new( size_t size ) { return counted( size ); }
+void* operator new[]( size_t size ) { return counted( size ); }
+void operator delete( void* p ) noexcept { free( p ); }
+void operator delete[]( void* p ) noexcept { free( p ); }
+void operator delete( void* p, size_t ) noexcept { free( p ); }
+void operator delete[]( void* p, size_t ) noexcept { free( p ); }
+
+/// results of loops that would otherwise be optimized away
+static volatile int64_t gKeep;
+
+
+/// one row of the report
+struct Result
+{
+   std::string mSection, mName, mUnit;
+   double mValue, mAllocs;
+   int mThreads;
+};
+
+/// the rows so far, printed as they come and written out as json at the end
+struct Report
+{
+   std::vector<Result> mResults;
+   std::string mSection;
+
+   void section( const char* title )
+   {
+      mSection = title;
+      printf( "%s:\n", title );
+   }
+   void add( const char* name, double value, const char* unit = "ns/op", double allocs = 0 )
+   {
+      Result result = { mSection, name, unit, value, allocs, 1 };
+      mResults.push_back( result );
+      printf( "   %-36s %10.2f %-9s %6.2f allocs/op\n", name, value, unit, allocs );
+   }
+   /// a contention row: throughput and p99 latency of 'threads' threads at once
+   void add( const char* name, int threads, double nsPerOp, double p99, double allocs )
+   {
+      Result throughput = { mSection, name, "ns/op", nsPerOp, allocs, threads };
+      Result latency = { mSection, name, "ns p99", p99, allocs, threads };
+      mResults.push_back( throughput );
+      mResults.push_back( latency );
+      printf( "   %-36s %10.1f %10.1f %10.2f\n", name, nsPerOp, p99, allocs );
+   }
+
+   bool write( const char* path ) const
+   {
+      FILE* file = fopen( path, "w" );
+      if (NULL == file)
+         return false;
+      fprintf( file, "{\n  \"compiler\": \"%s\",\n  \"hardware_threads\": %u,\n  \"results\": [\n",
+               escaped( __VERSION__ ).c_str(), std::thread::hardware_concurrency() );
+      // one result a line, so read() can get them back without a json parser
+      for (size_t x = 0; x < mResults.size(); ++x)
+      {
+         const Result& r = mResults[x];
+         fprintf( file, "    {\"section\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f, \"allocs_per_op\": %.3f, \"threads\": %d}%s\n",
+                  escaped( r.mSection ).c_str(), escaped( r.mName ).c_str(), escaped( r.mUnit ).c_str(), r.mValue, r.mAllocs, r.mThreads,
+                  x + 1 < mResults.size() ? "," : "" );
+      }
+      fprintf( file, "  ]\n}\n" );
+      fclose( file );
+      return true;
+   }
+
+   /// the results in a file write() made, false if it can't be read
+   bool read( const char* path )
+   {
+      std::ifstream file( path );
+      if (!file)
+         return false;
+      std::string line;
+      while (std::getline( file, line ))
+      {
+         if (std::string::npos == line.find( "\"section\":" ))
+            continue;
+         Result r = { text( line, "section" ), text( line, "name" ), text( line, "unit" ),
+                      atof( number( line, "value" ).c_str() ), atof( number( line, "allocs_per_op" ).c_str() ),
+                      atoi( number( line, "threads" ).c_str() ) };
+         mResults.push_back( r );
+      }
+      return true;
+   }
+
+   /// rows of 'now' more than 10% worse than in 'before', or that allocate more.  returns how many
+   static int compare( const Report& before, const Report& now )
+   {
+      int worse = 0;
+      printf( "worse than the baseline (by more than 10%%, or more allocations):\n" );
+      for (size_t x = 0; x < now.mResults.size(); ++x)
+      {
+         const Result& r = now.mResults[x];
+         for (size_t y = 0; y < before.mResults.size(); ++y)
+         {
+            const Result& b = before.mResults[y];
+            if (b.mSection != r.mSection || b.mName != r.mName || b.mUnit != r.mUnit || b.mThreads != r.mThreads)
+               continue;
+            double ratio = 0 == b.mValue ? 1 : r.mValue / b.mValue;
+            bool slower = "GB/s" == r.mUnit ? ratio < 1 / 1.1 : ratio > 1.1;
+            if (slower || r.mAllocs > b.mAllocs + 0.01)
+            {
+               printf( "   %s, %s: %.2f -> %.2f %s, %.2f -> %.2f allocs/op\n", r.mSection.c_str(), r.mName.c_str(),
+                       b.mValue, r.mValue, r.mUnit.c_str(), b.mAllocs, r.mAllocs );
+               ++worse;
+            }
+            break;
+         }
+      }
+      if (0 == worse)
+         printf( "   nothing\n" );
+      return worse;
+   }
+
+private:
+   static std::string escaped( const std::string& s )
+   {
+      std::string out;
+      for (size_t x = 0; x < s.size(); ++x)
+      {
+         if ('"' == s[x] || '\\' == s[x])
+            out += '\\';
+         out += s[x];
+      }
+      return out;
+   }
+   static std::string text( const std::string& line, const char* key )
+   {
+      std::string out;
+      size_t at = line.find( std::string( "\"" ) + key + "\": \"" );
+      if (std::string::npos == at)
+         return out;
+      for (at += strlen( key ) + 5; at < line.size() && '"' != line[at]; ++at)
+      {
+         if ('\\' == line[at] && at + 1 < line.size())
+            ++at;
+         out += line[at];
+      }
+      return out;
+   }
+   static std::string number( const std::string& line, const char* key )
+   {
+      size_t at = line.find( std::string( "\"" ) + key + "\": " );
+      return std::string::npos == at ? "0" : line.substr( at + strlen( key ) + 4, 24 );
+   }
+};
+
+Report gReport;
+
+
+/// a measurement: time per call, and operator new calls per call
+struct Measured
+{
+   double mNs, mAllocs;
+};
+
+/// time n calls of f
+template <typename F>
+Measured measure( F f, int n = 5000000 )
+{
+   unsigned long long allocations = gAllocations.load();
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (int x = 0; x < n; ++x)
+      f( x );
+   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+   Measured m = { std::chrono::duration<double, std::nano>( end - start ).count() / n, (gAllocations.load() - allocations) / (double)n };
+   return m;
+}
+
+/// measure f, as a row of the report
+template <typename F>
+void row( const char* name, F f, int n = 5000000 )
+{
+   Measured m = measure( f, n );
+   gReport.add( name, m.mNs, "ns/op", m.mAllocs );
+}
+
+/// the old printf path: C varargs through vsnprintf
+template <typename Output>
+void vsprintfCall( Output& out, spew::Filter filter, int level, const char* fmtstr, ... )
+{
+   va_list arg_ptr;
+   va_start( arg_ptr, fmtstr );
+   out( filter, level, fmtstr, arg_ptr );
+   va_end( arg_ptr );
+}
+
+/// f n times on each of 'threads' threads, all at once, as a row of the report.
+/// throughput is all the calls over the wall time, p99 is of one call's latency
+/// (every 8th call is timed, so reading the clock doesn't dominate the throughput)
+template <typename F>
+void contend( const char* name, int threads, F f, int n = 20000 )
+{
+   std::vector<std::vector<double> > samples( threads );
+   std::vector<std::thread> pool;
+   std::atomic<int> ready( 0 );
+   std::atomic<bool> go( false );
+   for (int t = 0; t < threads; ++t)
+   {
+      pool.push_back( std::thread( [&samples, &f, &ready, &go, t, n]()
+      {
+         samples[t].reserve( n / 8 + 1 );
+         ++ready;
+         while (!go)
+            std::this_thread::yield();
+         for (int x = 0; x < n; ++x)
+         {
+            if (0 != (x & 7))
+            {
+               f( x );
+               continue;
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            f( x );
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            samples[t].push_back( std::chrono::duration<double, std::nano>( end - start ).count() );
+         }
+      } ) );
+   }
+   while (ready < threads)
+      std::this_thread::yield();
+   unsigned long long allocations = gAllocations.load();
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   go = true;
+   for (int t = 0; t < threads; ++t)
+      pool[t].join();
+   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+   std::vector<double> all;
+   for (int t = 0; t < threads; ++t)
+      all.insert( all.end(), samples[t].begin(), samples[t].end() );
+   std::sort( all.begin(), all.end() );
+   double calls = (double)threads * n;
+   gReport.add( name, threads, std::chrono::duration<double, std::nano>( end - start ).count() / calls,
+                all[all.size() * 99 / 100], (gAllocations.load() - allocations) / calls );
+}
+
+int main( int argc, char** argv )
+{
+   if (4 == argc && 0 == strcmp( argv[1], "--compare" ))
+   {
+      Report before, now;
+      if (!before.read( argv[2] ) || !now.read( argv[3] ))
+      {
+         fprintf( stderr, "can't read %s or %s\n", argv[2], argv[3] );
+         return 2;
+      }
+      return 0 == Report::compare( before, now ) ? 0 : 1;
+   }
+   const char* resultsPath = 2 <= argc ? argv[1] : "bench.json";
+   const char* baselinePath = 3 <= argc ? argv[2] : NULL;
+
+   // LEVEL4 messages below are filtered out
+   spew::Log.SetFilter( spew::FILTERALL );
+   spew::Log.SetLevel( spew::LEVEL1ANDLOWER );
+
+   gReport.section( "disabled calls" );
+   row( "printf style", []( int x )
+      { spew::Log( spew::GFX, 4, "disabled %d %s %f\n", x, "text", 1.5 ); } );
+   row( "stream style", []( int x )
+      { spew::Log( spew::GFX, 4 ) << "disabled " << x << " text " << 1.5 << std::endl; } );
+   row( "SPEW_PRINTF", []( int x )
+      { SPEW_PRINTF( spew::Log, spew::GFX, 4, "disabled %d %s %f\n", x, "text", 1.5 ); } );
+   row( "SPEW_IF", []( int x )
+      { SPEW_IF( spew::Log, spew::GFX, 4 ) << "disabled " << x << " text " << 1.5 << std::endl; } );
+   {
+      static const spew::Category HTTP( "net.http.client" );
+      spew::Log.EnableCategory( "net", false );
+      row( "category printf", []( int x )
+         { spew::Log( HTTP, 1, "disabled %d %s %f\n", x, "text", 1.5 ); } );
+      row( "category SPEW_IF", []( int x )
+         { SPEW_IF( spew::Log, HTTP, 1 ) << "disabled " << x << " text " << 1.5 << std::endl; } );
+      spew::Log.EnableCategory( "net", true );
+   }
+
+   // the same disabled call while another thread keeps publishing new settings
+   {
+      std::atomic<bool> done( false );
+      std::thread reloader( [&done]()
+      {
+         spew::OutputSettings settings;
+         spew::Log.GetSettings( settings );
+         while (!done)
+         {
+            spew::Log.SetSettings( settings );
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+         }
+      } );
+      row( "printf, reloading", []( int x )
+         { spew::Log( spew::GFX, 4, "disabled %d %s %f\n", x, "text", 1.5 ); } );
+      row( "SPEW_PRINTF, reloading", []( int x )
+         { SPEW_PRINTF( spew::Log, spew::GFX, 4, "disabled %d %s %f\n", x, "text", 1.5 ); } );
+      done = true;
+      reloader.join();
+   }
+
+   // a flood that is being suppressed, vs the disabled calls above
+   {
+      std::ofstream devnull( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mOutStreams.push_back( &devnull );
+      out.SetRateLimit( spew::ERROR, 10, 10 );
+      gReport.section( "suppressed calls" );
+      row( "SetRateLimit", [&out]( int x )
+         { out( spew::ERROR, 1, "backend %s down: %d\n", "db", x ); } );
+      row( "SPEW_PRINTF_LIMITED", [&out]( int x )
+         { SPEW_PRINTF_LIMITED( out, spew::IO, 1, 10, 10, "backend %s down: %d\n", "db", x ); } );
+   }
+
+   // once style call sites that have already fired (the common case in a hot loop)
+   {
+      std::atomic<int> sink( 0 );
+      gReport.section( "once/rate limited call sites, already fired" );
+      row( "std::map (old)", [&sink]( int x )
+         { static std::map<int, bool> once; if (0 == once.count( x & 63 )) { once[x & 63] = true; ++sink; } } );
+      row( "SPEW_ONCE const", [&sink]( int x ) { SPEW_ONCE( ++sink, __LINE__, int ); } );
+      row( "SPEW_ONCE runtime", [&sink]( int x ) { SPEW_ONCE( ++sink, x & 63, int ); } );
+      row( "SPEW_EVERY_N", [&sink]( int x ) { SPEW_EVERY_N( ++sink, 1000 ); } );
+      row( "SPEW_FIRST_N", [&sink]( int x ) { SPEW_FIRST_N( ++sink, 10 ); } );
+      row( "SPEW_EVERY_MS", [&sink]( int x ) { SPEW_EVERY_MS( ++sink, 1000 ); } );
+   }
+
+   // enabled calls through every front end, to an ofstream on /dev/null.
+   // binary is the printf style call with deferred formatting.
+   {
+      std::ofstream devnull( "/dev/null" );
+      std::stringstream textBytes, binaryBytes;
+      spew::OutputBase<spew::InitEmpty, true> text, binary;
+      text.mOutStreams.push_back( &devnull );
+      binary.mOutStreams.push_back( &devnull );
+      binary.SetBinary( true );
+      gReport.section( "enabled call" );
+      row( "printf style", [&text]( int x )
+         { text( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "stream style", [&text]( int x )
+         { text( spew::IO, 1 ) << "request " << x << " from " << "10.0.0.7" << ":" << 443 << " done in " << 1.25 << " ms, status " << 200 << std::endl; }, 1000000 );
+      row( "SPEW_PRINTF", [&text]( int x )
+         { SPEW_PRINTF( text, spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "va_list", [&text]( int x )
+         { vsprintfCall( text, spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "structured", [&text]( int x )
+         { text( spew::IO, 1, "request done", { { "id", x }, { "from", "10.0.0.7" }, { "port", 443 }, { "ms", 1.25 }, { "status", 200 } } ); }, 1000000 );
+      row( "binary", [&binary]( int x )
+         { binary( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+
+      text.mOutStreams[0] = &textBytes;
+      binary.mOutStreams[0] = &binaryBytes;
+      binary.SetBinary( true );
+      for (int x = 0; x < 10000; ++x)
+      {
+         text( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 );
+         binary( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 );
+      }
+      gReport.add( "printf style, text size", textBytes.str().size() / 10000.0, "bytes/op" );
+      gReport.add( "binary size", binaryBytes.str().size() / 10000.0, "bytes/op" );
+   }
+
+   // formatting engine: the old vsnprintf path vs the compile time checked one (Format.h)
+   {
+      std::ofstream devnull( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mOutStreams.push_back( &devnull );
+      std::string user( "kevin" ), path( "/usr/local/share/spew/config.txt" );
+      spew::FormatBuffer buf;
+      gReport.section( "formatting, vsnprintf vs typed" );
+      row( "int heavy, format only, vsnprintf", [&buf]( int x ) { buf.clear(); buf.appendf( "%d %d %d %u %x %ld\n", x, -x, x * 7, (unsigned)x, x, (long)x << 20 ); } );
+      row( "int heavy, format only, typed", [&buf]( int x ) { buf.clear(); spew::formatTo( buf, "%d %d %d %u %x %ld\n", x, -x, x * 7, (unsigned)x, x, (long)x << 20 ); } );
+      row( "float heavy, format only, vsnprintf", [&buf]( int x ) { buf.clear(); buf.appendf( "%f %.3f %g %e\n", x * 0.25, x / 3.0, x * 1.5e3, x * 1e-9 ); } );
+      row( "float heavy, format only, typed", [&buf]( int x ) { buf.clear(); spew::formatTo( buf, "%f %.3f %g %e\n", x * 0.25, x / 3.0, x * 1.5e3, x * 1e-9 ); } );
+      row( "string heavy, format only, vsnprintf", [&]( int x ) { buf.clear(); buf.appendf( "user %s opened %s (%s) via %s\n", user.c_str(), path.c_str(), "read only", "mmap" ); } );
+      row( "string heavy, format only, typed", [&]( int x ) { buf.clear(); spew::formatTo( buf, "user %s opened %s (%s) via %s\n", user, path, "read only", "mmap" ); } );
+      row( "int heavy, Log call, vsnprintf", [&out]( int x ) { vsprintfCall( out, spew::IO, 1, "%d %d %d %u %x %ld\n", x, -x, x * 7, (unsigned)x, x, (long)x << 20 ); }, 1000000 );
+      row( "int heavy, Log call, typed", [&out]( int x ) { out( spew::IO, 1, "%d %d %d %u %x %ld\n", x, -x, x * 7, (unsigned)x, x, (long)x << 20 ); }, 1000000 );
+      row( "float heavy, Log call, vsnprintf", [&out]( int x ) { vsprintfCall( out, spew::IO, 1, "%f %.3f %g %e\n", x * 0.25, x / 3.0, x * 1.5e3, x * 1e-9 ); }, 1000000 );
+      row( "float heavy, Log call, typed", [&out]( int x ) { out( spew::IO, 1, "%f %.3f %g %e\n", x * 0.25, x / 3.0, x * 1.5e3, x * 1e-9 ); }, 1000000 );
+      row( "string heavy, Log call, vsnprintf", [&]( int x ) { vsprintfCall( out, spew::IO, 1, "user %s opened %s (%s) via %s\n", user.c_str(), path.c_str(), "read only", "mmap" ); }, 1000000 );
+      row( "string heavy, Log call, typed", [&]( int x ) { out( spew::IO, 1, "user %s opened %s (%s) via %s\n", user, path, "read only", "mmap" ); }, 1000000 );
+   }
+
+   // every kind of output with the same enabled call.  /dev/null for the files,
+   // except the mapped segments, they need a real file.
+   {
+      gReport.section( "outputs, enabled printf style call" );
+      std::ofstream ofs( "/dev/null" );
+      spew::FdOstream fdStream, fdStreamBatched;
+      fdStream.open( "/dev/null" );
+      fdStreamBatched.open( "/dev/null" );
+      spew::MappedFileOstream mapped;
+      mapped.open( "bench-mapped.txt", 16 * 1024 * 1024, 2 );
+      spew::FdSink fdSink, fdSinkBatched( -1, 65536 );
+      fdSink.open( "/dev/null" );
+      fdSinkBatched.open( "/dev/null" );
+      spew::FileSink fileSink;
+      fileSink.open( "/dev/null" );
+      spew::StreambufSink streambufSink( ofs.rdbuf() );
+      spew::OstreamSink ostreamSink( &ofs );
+      spew::MemorySink memorySink;
+      spew::FlightRecorder flight;
+      flight.open( "bench-flight.bin", 1024 * 1024 );
+      // a collector drains the ring meanwhile, as spew-collector would
+      spew::SharedRingSink ring;
+      ring.open( "/dev/shm", "spew-bench", 1024 * 1024 );
+      std::atomic<bool> collecting( true );
+      std::thread collector( [&collecting]()
+      {
+         spew::SharedRingCollector rings( "/dev/shm", "spew-bench" );
+         std::string merged;
+         while (collecting.load( std::memory_order_relaxed ))
+            if (0 == rings.collect( merged ))
+               std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+         rings.collect( merged ); // (the ring is closed by now, this removes it)
+      } );
+      struct Case
+      {
+         const char* mName;
+         std::ostream* mStream;
+         spew::Sink* mSink;
+         bool mBatched;
+      };
+      const Case cases[] =
+      {
+         { "std::ofstream", &ofs, NULL, false },
+         { "FdOstream", &fdStream, NULL, false },
+         { "FdOstream, 64k batches", &fdStreamBatched, NULL, true },
+         { "MappedFileOstream", &mapped, NULL, false },
+         { "FdSink", NULL, &fdSink, false },
+         { "FdSink, 64k batches", NULL, &fdSinkBatched, true },
+         { "FileSink", NULL, &fileSink, false },
+         { "StreambufSink", NULL, &streambufSink, false },
+         { "OstreamSink", NULL, &ostreamSink, false },
+         { "MemorySink", NULL, &memorySink, false },
+         { "FlightRecorder", NULL, &flight, false },
+         { "SharedRingSink", NULL, &ring, false },
+      };
+      for (size_t c = 0; c < sizeof( cases ) / sizeof( cases[0] ); ++c)
+      {
+         spew::OutputBase<spew::InitEmpty, true> out;
+         if (NULL != cases[c].mStream)
+            out.mOutStreams.push_back( cases[c].mStream );
+         else
+            out.mSinks.push_back( cases[c].mSink );
+         if (cases[c].mBatched && NULL != cases[c].mStream)
+            out.SetFlushPolicy( cases[c].mStream, spew::FlushPolicy::EveryBytes( 65536 ) );
+         if (cases[c].mBatched && NULL != cases[c].mSink)
+            out.SetFlushPolicy( cases[c].mSink, spew::FlushPolicy::EveryBytes( 65536 ) );
+         bool memory = &memorySink == cases[c].mSink;
+         row( cases[c].mName, [&out, &memorySink, memory]( int x )
+         {
+            out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 );
+            if (memory)
+               memorySink.clear(); // (keeps its capacity)
+         }, 1000000 );
+      }
+      mapped.close();
+      remove( "bench-mapped.txt" );
+      remove( "bench-mapped.txt.1" );
+      flight.close();
+      remove( "bench-flight.bin" );
+      ring.close();
+      collecting.store( false );
+      collector.join();
+   }
+
+   // repeat coalescing: what the hash costs when nothing repeats, and what a repeat costs
+   {
+      gReport.section( "repeat coalescing, fd stream" );
+      spew::FdOstream file;
+      file.open( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> plain, dedup;
+      plain.mOutStreams.push_back( &file );
+      dedup.mOutStreams.push_back( &file );
+      dedup.SetRepeatCoalescing( 1000 );
+      row( "never repeats, off", [&plain]( int x ) { plain( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "never repeats, on", [&dedup]( int x ) { dedup( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "always repeats, off", [&plain]( int x ) { plain( spew::IO, 1, "polling %s: %s\n", "10.0.0.7", "no data yet" ); }, 1000000 );
+      row( "always repeats, on", [&dedup]( int x ) { dedup( spew::IO, 1, "polling %s: %s\n", "10.0.0.7", "no data yet" ); }, 1000000 );
+   }
+
+   // flush policies on a coalescing fd stream: a write(2) per message vs batched
+   {
+      gReport.section( "fd stream flush policy" );
+      for (int batched = 0; batched < 2; ++batched)
+      {
+         spew::FdOstream file;
+         file.open( "/dev/null" );
+         spew::OutputBase<spew::InitEmpty, true> out;
+         out.mOutStreams.push_back( &file );
+         if (batched)
+            out.SetFlushPolicy( &file, spew::FlushPolicy::EveryBytes( 65536 ).Every( 100 ).Urgent( spew::ERROR ) );
+         const int n = 1000000;
+         row( batched ? "64k/100ms/ERROR" : "every message", [&out]( int x )
+            { out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, n );
+         gReport.add( batched ? "64k/100ms/ERROR, writes" : "every message, writes", file.writes() / (double)n, "writes/op" );
+      }
+   }
+
+   // fan-out to 3 files, 64k batches: through ostreams vs sinks (same bytes, no ostream layer)
+   {
+      gReport.section( "fan-out to 3 fd outputs" );
+      spew::FdOstream streams[3];
+      spew::FdSink sinks[3] = { spew::FdSink( -1, 65536 ), spew::FdSink( -1, 65536 ), spew::FdSink( -1, 65536 ) };
+      spew::OutputBase<spew::InitEmpty, true> toStreams, toSinks;
+      for (int x = 0; x < 3; ++x)
+      {
+         streams[x].open( "/dev/null" );
+         sinks[x].open( "/dev/null" );
+         toStreams.mOutStreams.push_back( &streams[x] );
+         toSinks.mSinks.push_back( &sinks[x] );
+         toStreams.SetFlushPolicy( &streams[x], spew::FlushPolicy::EveryBytes( 65536 ) );
+         toSinks.SetFlushPolicy( &sinks[x], spew::FlushPolicy::EveryBytes( 65536 ) );
+      }
+      row( "ostreams", [&toStreams]( int x )
+         { toStreams( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "sinks", [&toSinks]( int x )
+         { toSinks( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+   }
+
+   // structured messages: the printf line vs the same fields, per encoding,
+   // and the json string escaper, vectorized vs a byte at a time
+   {
+      gReport.section( "structured call to a 64k buffered fd sink" );
+      const spew::Encoding encodings[] = { spew::ENCODE_TEXT, spew::ENCODE_JSON, spew::ENCODE_TLV };
+      const char* names[] = { "text", "json", "tlv" };
+      {
+         spew::FdSink sink( -1, 65536 );
+         sink.open( "/dev/null" );
+         spew::OutputBase<spew::InitEmpty, true> out;
+         out.mSinks.push_back( &sink );
+         out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+         row( "printf line", [&out]( int x )
+            { out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      }
+      for (int e = 0; e < 3; ++e)
+      {
+         spew::FdSink sink( -1, 65536 );
+         sink.open( "/dev/null" );
+         spew::OutputBase<spew::InitEmpty, true> out;
+         out.mSinks.push_back( &sink );
+         out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+         out.SetEncoding( &sink, encodings[e] );
+         row( names[e], [&out]( int x )
+            { out( spew::IO, 1, "request done", { { "id", x }, { "from", "10.0.0.7" }, { "port", 443 }, { "ms", 1.25 }, { "status", 200 } } ); }, 1000000 );
+      }
+      std::string payload;
+      for (int x = 0; x < 4096; ++x)
+         payload += (char)('a' + x % 26);
+      payload += "\"end\"\n";
+      size_t total = 0;
+      gReport.section( "json escape scan, 4k string" );
+      Measured scalar = measure( [&]( int x ) { total += spew::jsonPlainRunScalar( payload.data() + (x & 1), payload.size() - 1 ); }, 200000 );
+      Measured vector = measure( [&]( int x ) { total += spew::jsonPlainRun( payload.data() + (x & 1), payload.size() - 1 ); }, 200000 );
+      gKeep = total;
+      gReport.add( "byte at a time", payload.size() / scalar.mNs, "GB/s", scalar.mAllocs );
+      gReport.add( "vectorized", payload.size() / vector.mNs, "GB/s", vector.mAllocs );
+   }
+
+   // headers: what the clock costs, and a header written by SetHeader vs by hand at the call site
+   {
+      gReport.section( "clock read" );
+      spew::Clock& clock = spew::Clock::instance();
+      int64_t total = 0;
+      row( clock.tsc() ? "Clock::now (tsc)" : "Clock::now", [&]( int x ) { total += clock.now(); } );
+      row( "clock_gettime", [&]( int x ) { total += spew::Clock::systemNow(); } );
+      gKeep = total;
+      gReport.section( "message header, 64k buffered fd sink" );
+      for (int header = 0; header < 3; ++header)
+      {
+         spew::FdSink sink( -1, 65536 );
+         sink.open( "/dev/null" );
+         spew::OutputBase<spew::InitEmpty, true> out;
+         out.mSinks.push_back( &sink );
+         out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+         if (2 == header)
+            out.SetHeader( spew::HEADER_DEFAULT );
+         const char* names[] = { "none", "by hand", "SetHeader" };
+         row( names[header], [&out, header]( int x )
+         {
+            if (1 != header)
+               return out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 );
+            // the way call sites did it: strftime and a thread id into the message
+            struct timespec now;
+            clock_gettime( CLOCK_REALTIME, &now );
+            struct tm parts;
+            localtime_r( &now.tv_sec, &parts );
+            char date[32];
+            strftime( date, sizeof( date ), "%Y-%m-%d %H:%M:%S", &parts );
+            out( spew::IO, 1, "%s.%06ld [%u] L1 IO: request %d from %s:%d done in %.3f ms, status %d\n",
+                 date, now.tv_nsec / 1000, spew::threadId(), x, "10.0.0.7", 443, 1.25, 200 );
+         }, 1000000 );
+      }
+   }
+
+   // self-instrumentation: the same call with SetStats off and on, and a filtered one
+   {
+      gReport.section( "stats, 64k buffered fd sink" );
+      for (int on = 0; on < 2; ++on)
+      {
+         spew::FdSink sink( -1, 65536 );
+         sink.open( "/dev/null" );
+         spew::OutputBase<spew::InitEmpty, true> out;
+         out.mSinks.push_back( &sink );
+         out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+         out.SetLevel( spew::LEVEL1ANDLOWER );
+         out.SetStats( 1 == on );
+         row( on ? "enabled, stats on" : "enabled, stats off", [&out]( int x )
+            { out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+         row( on ? "disabled, stats on" : "disabled, stats off", [&out]( int x )
+            { out( spew::IO, 4, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); } );
+      }
+   }
+
+   // backtrace buffering: a LEVEL4 message held in the thread's ring vs written, and an error behind 16 held ones
+   {
+      gReport.section( "backtrace, 64k buffered fd sink" );
+      spew::FdSink sink( -1, 65536 );
+      sink.open( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mSinks.push_back( &sink );
+      out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+      out.SetLevel( spew::LEVEL4ANDLOWER );
+      row( "LEVEL4 written", [&out]( int x )
+         { out( spew::IO, 4, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      out.SetLevel( spew::LEVEL1ANDLOWER );
+      out.SetBacktrace( spew::LEVEL5ANDLOWER, 64 );
+      row( "LEVEL4 held", [&out]( int x )
+         { out( spew::IO, 4, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); }, 1000000 );
+      row( "ERROR after 16 held", [&out]( int x )
+      {
+         for (int y = 0; y < 16; ++y)
+            out( spew::IO, 4, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 );
+         out( spew::ERROR, 1, "request %d failed\n", x );
+      }, 20000 );
+   }
+
+   // wide text: the way wide subsystems logged (wcstombs, then the narrow call) vs the wide
+   // front end, and the UTF-8 transcoder, vectorized vs a unit at a time
+   {
+      gReport.section( "wide text, 64k buffered fd sink" );
+      spew::FdSink sink( -1, 65536 );
+      sink.open( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mSinks.push_back( &sink );
+      out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+      const wchar_t* path = L"/srv/assets/textures/terrain/grass_albedo.png";
+      row( "wcstombs + printf", [&out, path]( int x )
+      {
+         char narrow[256];
+         size_t length = wcstombs( narrow, path, sizeof( narrow ) );
+         out( spew::IO, 1, "loaded %s in %d ms\n", (size_t)-1 == length ? "?" : narrow, x & 63 );
+      }, 1000000 );
+      row( "wide printf", [&out, path]( int x )
+         { out( spew::IO, 1, L"loaded %ls in %d ms\n", path, x & 63 ); }, 1000000 );
+      row( "wide stream", [&out, path]( int x )
+         { out.Wide( spew::IO, 1 ) << L"loaded " << path << L" in " << (x & 63) << L" ms" << std::endl; }, 1000000 );
+
+      std::wstring payload;
+      for (int x = 0; x < 4096; ++x)
+         payload += (wchar_t)(0 == x % 512 ? 0xe9 : 'a' + x % 26); // mostly ASCII
+      spew::FormatBuffer buf;
+      size_t total = 0;
+      gReport.section( "utf-8 transcode, 4k wide string" );
+      Measured scalar = measure( [&]( int x )
+      {
+         size_t used = 0;
+         buf.clear();
+         buf.commit( spew::utf8Scalar( buf.prepare( payload.size() * 4 ), payload.data(), payload.size(), payload.size(), used ) - buf.c_str() );
+         total += buf.size();
+      }, 100000 );
+      Measured vector = measure( [&]( int x )
+      {
+         buf.clear();
+         spew::appendUtf8( buf, payload.data(), payload.size() );
+         total += buf.size();
+      }, 100000 );
+      gKeep = total;
+      gReport.add( "unit at a time", payload.size() / scalar.mNs, "Gunits/s", scalar.mAllocs );
+      gReport.add( "vectorized", payload.size() / vector.mNs, "Gunits/s", vector.mAllocs );
+   }
+
+   // live tail: a verbose call nobody watches vs one a spew-tail client subscribed to,
+   // and what an attached client costs the calls it didn't ask for
+   {
+      gReport.section( "live tail, 64k buffered fd sink" );
+      spew::FdSink sink( -1, 65536 );
+      sink.open( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mSinks.push_back( &sink );
+      out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+      out.SetFilter( spew::IO );
+      spew::TailServer tail;
+      tail.Start( out, "bench-tail.sock" );
+      row( "verbose call, no client", [&out]( int x ) { out( spew::GFX, 5, "frame %d: %d draws\n", x, x & 1023 ); } );
+      row( "normal call, no client", [&out]( int x ) { out( spew::IO, 1, "request %d done\n", x ); }, 1000000 );
+      int client = spew::TailServer::connect( "bench-tail.sock" );
+      if (client >= 0 && 4 == ::send( client, "GFX\n", 4, MSG_NOSIGNAL ))
+      {
+         std::thread reader( [client]()
+         {
+            char data[65536];
+            while (0 < ::recv( client, data, sizeof( data ), 0 )) {}
+         } );
+         while (!tail.attached())
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+         row( "normal call, client attached", [&out]( int x ) { out( spew::IO, 1, "request %d done\n", x ); }, 1000000 );
+         row( "verbose call, client attached", [&out]( int x ) { out( spew::GFX, 5, "frame %d: %d draws\n", x, x & 1023 ); }, 1000000 );
+         tail.Stop();
+         reader.join();
+      }
+      if (client >= 0)
+         ::close( client );
+   }
+
+   // contention: 1 to 64 threads logging at once to one output.
+   // Log to log.txt (the mapped segments) synchronous vs the async writer, and a 64k buffered fd sink.
+   {
+      const int threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+      char name[64];
+      gReport.section( "contention, Log to log.txt" );
+      printf( "   %-36s %10s %10s %10s\n", "", "ns/op", "p99 ns", "allocs/op" );
+      for (int async = 0; async < 2; ++async)
+      {
+         if (async)
+            spew::Log.StartAsync( 65536, spew::OVERFLOW_BLOCK );
+         for (size_t x = 0; x < sizeof( threadCounts ) / sizeof( int ); ++x)
+         {
+            snprintf( name, sizeof( name ), "%s, %d threads", async ? "async" : "sync", threadCounts[x] );
+            contend( name, threadCounts[x], []( int x )
+               { spew::Log( spew::GFX, 1, "an enabled log message %d of typical length, sent to the %s\n", x, "log file" ); } );
+         }
+         spew::Log.StopAsync();
+      }
+      gReport.section( "contention, 64k buffered fd sink" );
+      spew::FdSink sink( -1, 65536 );
+      sink.open( "/dev/null" );
+      spew::OutputBase<spew::InitEmpty, true> out;
+      out.mSinks.push_back( &sink );
+      out.SetFlushPolicy( &sink, spew::FlushPolicy::EveryBytes( 65536 ) );
+      for (size_t x = 0; x < sizeof( threadCounts ) / sizeof( int ); ++x)
+      {
+         snprintf( name, sizeof( name ), "%d threads", threadCounts[x] );
+         contend( name, threadCounts[x], [&out]( int x )
+            { out( spew::IO, 1, "request %d from %s:%d done in %.3f ms, status %d\n", x, "10.0.0.7", 443, 1.25, 200 ); } );
+      }
+   }
+
+   if (!gReport.write( resultsPath ))
+   {
+      fprintf( stderr, "can't write %s\n", resultsPath );
+      return 2;
+   }
+   printf( "results: %s\n", resultsPath );
+   if (NULL == baselinePath)
+      return 0;
+   Report baseline;
+   if (!baseline.read( baselinePath ))
+   {
+      fprintf( stderr, "can't read %s\n", baselinePath );
+      return 2;
+   }
+   return 0 == Report::compare( baseline, gReport ) ? 0 : 1;
+}
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include "Output.h"
 #include "Once.h"
+#include "Reload.h"
+#include "FlightRecorder.h"
+#include "TailServer.h"
 #include <assert.h>
 
 void hit_a_key()
@@ -12,6 +15,7 @@ void hit_a_key()
 
 int main( int argc, char *argv[] )
 {
+   spew::init();
    spew::parseCommandLine( argc, argv );
 
    spew::Trace( spew::GFX,1 ) << "Trace] filter:gfx level:1 is on" << std::endl;
@@ -37,7 +41,23 @@ int main( int argc, char *argv[] )
 
    // do unit tests...
    spew::OutputUnitTest::test();
+   spew::BinaryLogUnitTest::test();
+   spew::FormatUnitTest::test();
+   spew::MappedFileUnitTest::test();
+   spew::FdOstreamUnitTest::test();
+   spew::SinkUnitTest::test();
+   spew::OnceUnitTest::test();
+   spew::StructuredUnitTest::test();
+   spew::HeaderUnitTest::test();
+   spew::StatsUnitTest::test();
+   spew::FlightRecorderUnitTest::test();
+   spew::BacktraceUnitTest::test();
+   spew::Utf8UnitTest::test();
+   spew::SharedRingUnitTest::test();
+   spew::TailServerUnitTest::test();
+   spew::ReloadUnitTest::test();
 
    hit_a_key();
+   spew::shutdown();
 	return 0;
 }
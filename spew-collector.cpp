@@ -0,0 +1,80 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+// spew-collector: drain the shared memory rings of every process logging through a
+// SharedRingSink (see SharedRing.h) into one log, merged by time, each message behind its
+// process id.  the log rotates like MappedFileOstream does.  runs until SIGINT/SIGTERM,
+// then drains once more.
+// usage:
+//    spew-collector [dir=/dev/shm] [prefix=spew] [log=log.txt] [segment MB=16] [segments=4]
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include "MappedFile.h"
+#include "SharedRing.h"
+
+static volatile sig_atomic_t gStop = 0;
+static void stop( int ) { gStop = 1; }
+
+int main( int argc, char* argv[] )
+{
+   if (1 < argc && '-' == argv[1][0])
+   {
+      fprintf( stderr, "usage: spew-collector [dir=/dev/shm] [prefix=spew] [log=log.txt] [segment MB=16] [segments=4]\n" );
+      return 1;
+   }
+   const char* dir = 1 < argc ? argv[1] : "/dev/shm";
+   const char* prefix = 2 < argc ? argv[2] : "spew";
+   const char* log = 3 < argc ? argv[3] : "log.txt";
+   size_t segmentSize = (4 < argc ? strtoul( argv[4], NULL, 10 ) : 16) * 1024 * 1024;
+   unsigned int segments = 5 < argc ? (unsigned int)strtoul( argv[5], NULL, 10 ) : 4;
+
+   spew::MappedFileOstream out;
+   out.open( log, segmentSize, segments );
+   if (!out.good())
+   {
+      fprintf( stderr, "spew-collector: can't open %s\n", log );
+      return 1;
+   }
+   signal( SIGINT, stop );
+   signal( SIGTERM, stop );
+
+   spew::SharedRingCollector collector( dir, prefix );
+   std::string merged;
+   while (!gStop)
+   {
+      collector.collect( merged );
+      out.write( merged.data(), merged.size() );
+      // busy: go again right away, producers drop what doesn't fit in their rings.
+      // otherwise sleep a while.
+      if (merged.size() < 64 * 1024)
+      {
+         struct timespec wait = { 0, 20 * 1000 * 1000 };
+         nanosleep( &wait, NULL );
+      }
+   }
+   collector.collect( merged );
+   out.write( merged.data(), merged.size() );
+   out.close();
+   return 0;
+}
@@ -0,0 +1,85 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+// spew-decode: turn a binary mode log (see OutputBase::SetBinary), or a stream with
+// ENCODE_TLV structured records (see OutputBase::SetEncoding), back into text.
+// usage:
+//    spew-decode log.txt [more files, in order...]   (stdin if no files given)
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "BinaryLog.h"
+
+/// decode one file, the decoder carries format definitions on to the next file.
+static bool decodeFile( FILE* in, const char* name, spew::BinaryDecoder& decoder )
+{
+   std::vector<char> pending;
+   char chunk[65536];
+   spew::FormatBuffer text;
+   size_t got;
+   while (0 < (got = fread( chunk, 1, sizeof( chunk ), in )))
+   {
+      pending.insert( pending.end(), chunk, chunk + got );
+      const char* p = &pending[0];
+      const char* end = p + pending.size();
+      while (p < end)
+      {
+         long used = decoder.decode( p, end, text );
+         if (used < 0)
+         {
+            fprintf( stderr, "spew-decode: %s: corrupt record at byte offset %ld\n", name, (long)(p - &pending[0]) );
+            return false;
+         }
+         if (0 == used)
+            break; // record continues in the next chunk
+         p += used;
+      }
+      fwrite( text.c_str(), 1, text.size(), stdout );
+      text.clear();
+      pending.erase( pending.begin(), pending.begin() + (p - &pending[0]) );
+   }
+   if (!pending.empty())
+      fprintf( stderr, "spew-decode: %s: %lu trailing bytes (truncated record)\n", name, (unsigned long)pending.size() );
+   return true;
+}
+
+int main( int argc, char* argv[] )
+{
+   spew::BinaryDecoder decoder;
+   if (argc < 2)
+      return decodeFile( stdin, "stdin", decoder ) ? 0 : 1;
+
+   int result = 0;
+   for (int x = 1; x < argc; ++x)
+   {
+      FILE* in = fopen( argv[x], "rb" );
+      if (NULL == in)
+      {
+         fprintf( stderr, "spew-decode: can't open %s\n", argv[x] );
+         result = 1;
+         continue;
+      }
+      if (!decodeFile( in, argv[x], decoder ))
+         result = 1;
+      fclose( in );
+   }
+   return result;
+}
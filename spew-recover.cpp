@@ -0,0 +1,50 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+// spew-recover: print what a flight recorder (see FlightRecorder.h) held, oldest
+// message first.  works on the file of a process that was killed, or is still running.
+// usage:
+//    spew-recover myapp.flight [more files...]
+
+#include <stdio.h>
+#include <string>
+#include "FlightRecorder.h"
+
+int main( int argc, char* argv[] )
+{
+   if (argc < 2)
+   {
+      fprintf( stderr, "usage: spew-recover <flight recorder file> [more files...]\n" );
+      return 1;
+   }
+   int result = 0;
+   for (int x = 1; x < argc; ++x)
+   {
+      std::string text;
+      if (!spew::FlightRecorder::recoverFile( argv[x], text ))
+      {
+         fprintf( stderr, "spew-recover: %s isn't a flight recorder file (or can't be read)\n", argv[x] );
+         result = 1;
+         continue;
+      }
+      fwrite( text.data(), 1, text.size(), stdout );
+   }
+   return result;
+}
@@ -0,0 +1,63 @@
+/*
+   spew - semi-powerful trace logger, debug output, stderr/stdout
+   Copyright (c) 2006 kevin meinert all rights reserved
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301  USA
+*/
+
+// spew-tail: watch a running program's messages live, through its TailServer (see
+// TailServer.h).  the words say what to see (see parseSubscription), everything if there
+// are none.  the program formats those only while spew-tail is attached.
+// usage:
+//    spew-tail <socket> [filters] [level] [categories] [-categories]
+//    spew-tail /tmp/myapp.spew IO 5 net -net.dns
+
+#include <stdio.h>
+#include <string>
+#include "TailServer.h"
+
+int main( int argc, char* argv[] )
+{
+   if (argc < 2)
+   {
+      fprintf( stderr, "usage: spew-tail <socket> [filters] [level] [categories] [-categories]\n" );
+      return 1;
+   }
+   int fd = spew::TailServer::connect( argv[1] );
+   if (fd < 0)
+   {
+      fprintf( stderr, "spew-tail: can't connect to %s\n", argv[1] );
+      return 1;
+   }
+   std::string subscription = argc < 3 ? "all" : argv[2];
+   for (int x = 3; x < argc; ++x)
+      subscription += std::string( " " ) + argv[x];
+   subscription += '\n';
+   if (::send( fd, subscription.data(), subscription.size(), MSG_NOSIGNAL ) != (ssize_t)subscription.size())
+   {
+      fprintf( stderr, "spew-tail: %s went away\n", argv[1] );
+      return 1;
+   }
+   char data[65536];
+   ssize_t length;
+   while (0 < (length = ::recv( fd, data, sizeof( data ), 0 )))
+   {
+      fwrite( data, 1, length, stdout );
+      fflush( stdout );
+   }
+   ::close( fd );
+   return 0;
+}